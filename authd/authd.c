@@ -41,6 +41,7 @@ authd_cmd_handler authd_cmd_handlers[256] = {
 };
 
 authd_stat_handler authd_stat_handlers[256] = {
+	['C'] = enumerate_dns_cache,
 	['D'] = enumerate_nameservers,
 };
 
@@ -143,6 +144,9 @@ parse_request(rb_helper *helper)
 		if (handler != NULL)
 			handler(parc, parv);
 	}
+
+	/* answer any lookups that were satisfied from the DNS cache */
+	deliver_cached_answers();
 }
 
 static void
@@ -23,21 +23,267 @@
 #include "notice.h"
 #include "res.h"
 
+/*
+ * Answer cache.
+ *
+ * Every lookup goes through a cache entry keyed on the query type and the
+ * name or address being looked up.  While the resolver is working on an
+ * entry, further lookups for the same key just queue up behind it; once the
+ * answer arrives it is kept until its TTL runs out (positive answers) or for
+ * DNS_CACHE_NEG_TTL seconds (NXDOMAIN and empty answers).  Timeouts and
+ * server failures are never cached.  Resolved entries sit on an LRU list
+ * bounded by DNS_CACHE_MAX_ENTRIES.
+ *
+ * Answers served from the cache are never delivered from within lookup_*(),
+ * as callers expect the callback to run after they have stored the returned
+ * dns_query.  They are queued and handed out by deliver_cached_answers(),
+ * which runs once the current batch of requests from ircd (or resolver
+ * replies) has been processed, with an event as a backstop.
+ */
+#define DNS_CACHE_MAX_ENTRIES	4096
+#define DNS_CACHE_NEG_TTL	60
+#define DNS_CACHE_EXPIRE_FREQ	60
+
+struct dns_cache_entry
+{
+	struct DNSQuery query;		/* resolver request, while pending */
+	char key[RESOLVER_HOSTLEN + 2];	/* query type followed by the name */
+	query_type type;
+	struct rb_sockaddr_storage addr;	/* address being looked up, for PTR */
+
+	bool pending;
+	rb_dlink_list waiters;		/* dns_query objects awaiting the answer */
+
+	char *answer;			/* NULL for a negative answer */
+	time_t expires;
+	rb_dlink_node lru_node;
+};
+
+struct dns_cache_stats
+{
+	uint64_t hits;
+	uint64_t neg_hits;
+	uint64_t misses;
+	uint64_t coalesced;
+	uint64_t uncached;
+	uint64_t expired;
+	uint64_t evicted;
+};
+
 static void handle_lookup_ip_reply(void *data, struct DNSReply *reply);
 static void handle_lookup_hostname_reply(void *data, struct DNSReply *reply);
 
+static rb_dictionary *dns_cache;
+static rb_dlink_list dns_cache_lru;
+static struct dns_cache_stats dns_cache_stats;
+
+static rb_dlink_list ready_queries;
+static struct ev_entry *deliver_ev;
+static struct ev_entry *expire_ev;
+
 uint64_t query_count = 0;
 
+static void
+free_cache_entry(struct dns_cache_entry *entry)
+{
+	rb_dictionary_delete(dns_cache, entry->key);
+
+	if(!entry->pending)
+		rb_dlinkDelete(&entry->lru_node, &dns_cache_lru);
+
+	rb_free(entry->answer);
+	rb_free(entry);
+}
+
+static void
+deliver_query(struct dns_query *query, const char *answer)
+{
+	if(query->callback)
+		query->callback(answer, answer != NULL, query->type, query->data);
+
+	rb_free(query->answer);
+	rb_free(query);
+}
+
+void
+deliver_cached_answers(void)
+{
+	rb_dlink_node *ptr, *nptr;
+
+	if(deliver_ev != NULL)
+	{
+		rb_event_delete(deliver_ev);
+		deliver_ev = NULL;
+	}
+
+	RB_DLINK_FOREACH_SAFE(ptr, nptr, ready_queries.head)
+	{
+		struct dns_query *query = ptr->data;
+
+		rb_dlinkDelete(&query->node, &ready_queries);
+		deliver_query(query, query->answer);
+	}
+}
+
+static void
+deliver_cached_answers_ev(void *unused)
+{
+	deliver_ev = NULL;
+	deliver_cached_answers();
+}
+
+static void
+expire_cache_entries(void *unused)
+{
+	rb_dlink_node *ptr, *nptr;
+	time_t now = rb_current_time();
+
+	RB_DLINK_FOREACH_SAFE(ptr, nptr, dns_cache_lru.head)
+	{
+		struct dns_cache_entry *entry = ptr->data;
+
+		if(entry->expires <= now)
+		{
+			dns_cache_stats.expired++;
+			free_cache_entry(entry);
+		}
+	}
+}
+
+/* Store the answer for a pending entry and hand it to everyone waiting on it.
+ * A NULL reply is a failure and leaves nothing behind in the cache.
+ */
+static void
+complete_cache_entry(struct dns_cache_entry *entry, struct DNSReply *reply, const char *answer)
+{
+	rb_dlink_list waiters = entry->waiters;
+	rb_dlink_node *ptr, *nptr;
+	time_t ttl = 0;
+
+	/* Settle the entry first, callbacks may well look the same name up again */
+	entry->waiters.head = entry->waiters.tail = NULL;
+	entry->waiters.length = 0;
+
+	if(reply != NULL)
+	{
+		ttl = answer != NULL ? reply->ttl : DNS_CACHE_NEG_TTL;
+		if(ttl > AR_TTL)
+			ttl = AR_TTL;
+	}
+
+	if(ttl <= 0)
+	{
+		dns_cache_stats.uncached++;
+		free_cache_entry(entry);
+	}
+	else
+	{
+		if(rb_dlink_list_length(&dns_cache_lru) >= DNS_CACHE_MAX_ENTRIES)
+		{
+			dns_cache_stats.evicted++;
+			free_cache_entry(dns_cache_lru.tail->data);
+		}
+
+		entry->pending = false;
+		entry->answer = answer != NULL ? rb_strdup(answer) : NULL;
+		entry->expires = rb_current_time() + ttl;
+		rb_dlinkAdd(entry, &entry->lru_node, &dns_cache_lru);
+	}
+
+	RB_DLINK_FOREACH_SAFE(ptr, nptr, waiters.head)
+	{
+		struct dns_query *query = ptr->data;
+
+		rb_dlinkDelete(&query->node, &waiters);
+		deliver_query(query, answer);
+	}
+
+	deliver_cached_answers();
+}
+
+/* Find or create the cache entry for a query.
+ *
+ * Returns the entry if it was newly created and needs a resolver request
+ * issued; otherwise the query has been queued for delivery and NULL is
+ * returned.
+ */
+static struct dns_cache_entry *
+attach_cache_entry(struct dns_query *query, const char *name)
+{
+	struct dns_cache_entry *entry;
+	char key[RESOLVER_HOSTLEN + 2];
+
+	if(dns_cache == NULL)
+		dns_cache = rb_dictionary_create("dns cache", rb_strcasecmp);
+
+	if(expire_ev == NULL)
+		expire_ev = rb_event_addish("dns_cache_expire", expire_cache_entries, NULL, DNS_CACHE_EXPIRE_FREQ);
+
+	snprintf(key, sizeof(key), "%c%s", query->type, name);
+
+	entry = rb_dictionary_retrieve(dns_cache, key);
+	if(entry != NULL && !entry->pending && entry->expires <= rb_current_time())
+	{
+		dns_cache_stats.expired++;
+		free_cache_entry(entry);
+		entry = NULL;
+	}
+
+	if(entry != NULL && entry->pending)
+	{
+		dns_cache_stats.coalesced++;
+		rb_dlinkAddTail(query, &query->node, &entry->waiters);
+		return NULL;
+	}
+
+	if(entry != NULL)
+	{
+		if(entry->answer != NULL)
+			dns_cache_stats.hits++;
+		else
+			dns_cache_stats.neg_hits++;
+
+		rb_dlinkMoveNode(&entry->lru_node, &dns_cache_lru, &dns_cache_lru);
+		query->answer = entry->answer != NULL ? rb_strdup(entry->answer) : NULL;
+		rb_dlinkAddTail(query, &query->node, &ready_queries);
+
+		if(deliver_ev == NULL)
+			deliver_ev = rb_event_addonce("dns_cache_deliver", deliver_cached_answers_ev, NULL, 1);
+
+		return NULL;
+	}
+
+	dns_cache_stats.misses++;
+
+	entry = rb_malloc(sizeof(struct dns_cache_entry));
+	rb_strlcpy(entry->key, key, sizeof(entry->key));
+	entry->type = query->type;
+	entry->addr = query->addr;
+	entry->pending = true;
+	entry->query.ptr = entry;
+	rb_dlinkAddTail(query, &query->node, &entry->waiters);
+	rb_dictionary_add(dns_cache, entry->key, entry);
+
+	return entry;
+}
+
 /* A bit different from ircd... you just get a dns_query object.
  *
- * It gets freed whenever the res code gets back to us.
+ * It gets freed whenever the answer is delivered, which may come from the
+ * cache.
  */
 struct dns_query *
 lookup_ip(const char *host, int aftype, DNSCB callback, void *data)
 {
-	struct dns_query *query = rb_malloc(sizeof(struct dns_query));
+	struct dns_query *query;
+	struct dns_cache_entry *entry;
 	int g_type;
 
+	if(strlen(host) > RESOLVER_HOSTLEN)
+		return NULL;
+
+	query = rb_malloc(sizeof(struct dns_query));
+
 	if(aftype == AF_INET)
 	{
 		query->type = QUERY_A;
@@ -58,10 +304,11 @@ lookup_ip(const char *host, int aftype, DNSCB callback, void *data)
 	query->callback = callback;
 	query->data = data;
 
-	query->query.ptr = query;
-	query->query.callback = handle_lookup_ip_reply;
-
-	gethost_byname_type(host, &query->query, g_type);
+	if((entry = attach_cache_entry(query, host)) != NULL)
+	{
+		entry->query.callback = handle_lookup_ip_reply;
+		gethost_byname_type(host, &entry->query, g_type);
+	}
 
 	return query;
 }
@@ -71,6 +318,8 @@ struct dns_query *
 lookup_hostname(const char *ip, DNSCB callback, void *data)
 {
 	struct dns_query *query = rb_malloc(sizeof(struct dns_query));
+	struct dns_cache_entry *entry;
+	char addr[HOSTIPLEN];
 	int aftype;
 
 	if(!rb_inet_pton_sock(ip, &query->addr))
@@ -95,10 +344,14 @@ lookup_hostname(const char *ip, DNSCB callback, void *data)
 	query->callback = callback;
 	query->data = data;
 
-	query->query.ptr = query;
-	query->query.callback = handle_lookup_hostname_reply;
+	/* key on the canonical form, so differently-written addresses share */
+	rb_inet_ntop_sock((struct sockaddr *)&query->addr, addr, sizeof(addr));
 
-	gethost_byaddr(&query->addr, &query->query);
+	if((entry = attach_cache_entry(query, addr)) != NULL)
+	{
+		entry->query.callback = handle_lookup_hostname_reply;
+		gethost_byaddr(&entry->addr, &entry->query);
+	}
 
 	return query;
 }
@@ -114,20 +367,20 @@ cancel_query(struct dns_query *query)
 static void
 handle_lookup_ip_reply(void *data, struct DNSReply *reply)
 {
-	struct dns_query *query = data;
+	struct dns_cache_entry *entry = data;
 	char ip[HOSTIPLEN] = "*";
 
-	if(query == NULL)
+	if(entry == NULL)
 	{
 		/* Shouldn't happen */
-		warn_opers(L_CRIT, "DNS: handle_lookup_ip_reply: query == NULL!");
+		warn_opers(L_CRIT, "DNS: handle_lookup_ip_reply: entry == NULL!");
 		exit(EX_DNS_ERROR);
 	}
 
-	if(reply == NULL)
+	if(reply == NULL || reply->negative)
 		goto end;
 
-	switch(query->type)
+	switch(entry->type)
 	{
 	case QUERY_A:
 		if(GET_SS_FAMILY(&reply->addr) == AF_INET)
@@ -146,47 +399,44 @@ handle_lookup_ip_reply(void *data, struct DNSReply *reply)
 		break;
 	default:
 		warn_opers(L_CRIT, "DNS: handle_lookup_ip_reply: unknown query type %d",
-				query->type);
+				entry->type);
 		exit(EX_DNS_ERROR);
 	}
 
 end:
-	if(query->callback)
-		query->callback(ip, ip[0] != '*', query->type, query->data);
-
-	rb_free(query);
+	complete_cache_entry(entry, reply, ip[0] != '*' ? ip : NULL);
 }
 
 /* Callback from gethost_byaddr */
 static void
 handle_lookup_hostname_reply(void *data, struct DNSReply *reply)
 {
-	struct dns_query *query = data;
+	struct dns_cache_entry *entry = data;
 	char *hostname = NULL;
 
-	if(query == NULL)
+	if(entry == NULL)
 	{
 		/* Shouldn't happen */
-		warn_opers(L_CRIT, "DNS: handle_lookup_hostname_reply: query == NULL!");
+		warn_opers(L_CRIT, "DNS: handle_lookup_hostname_reply: entry == NULL!");
 		exit(EX_DNS_ERROR);
 	}
 
-	if(reply == NULL)
+	if(reply == NULL || reply->negative)
 		goto end;
 
-	if(query->type == QUERY_PTR_A)
+	if(entry->type == QUERY_PTR_A)
 	{
 		struct sockaddr_in *ip, *ip_fwd;
-		ip = (struct sockaddr_in *) &query->addr;
+		ip = (struct sockaddr_in *) &entry->addr;
 		ip_fwd = (struct sockaddr_in *) &reply->addr;
 
 		if(ip->sin_addr.s_addr == ip_fwd->sin_addr.s_addr)
 			hostname = reply->h_name;
 	}
-	else if(query->type == QUERY_PTR_AAAA)
+	else if(entry->type == QUERY_PTR_AAAA)
 	{
 		struct sockaddr_in6 *ip, *ip_fwd;
-		ip = (struct sockaddr_in6 *) &query->addr;
+		ip = (struct sockaddr_in6 *) &entry->addr;
 		ip_fwd = (struct sockaddr_in6 *) &reply->addr;
 
 		if(memcmp(&ip->sin6_addr, &ip_fwd->sin6_addr, sizeof(struct in6_addr)) == 0)
@@ -196,14 +446,11 @@ handle_lookup_hostname_reply(void *data, struct DNSReply *reply)
 	{
 		/* Shouldn't happen */
 		warn_opers(L_CRIT, "DNS: handle_lookup_hostname_reply: unknown query type %d",
-				query->type);
+				entry->type);
 		exit(EX_DNS_ERROR);
 	}
 end:
-	if(query->callback)
-		query->callback(hostname, hostname != NULL, query->type, query->data);
-
-	rb_free(query);
+	complete_cache_entry(entry, reply, hostname);
 }
 
 static void
@@ -219,12 +466,12 @@ submit_dns_answer(const char *reply, bool status, query_type type, void *data)
 
 	if(reply == NULL || status == false)
 	{
-		rb_helper_write(authd_helper, "E %s E %c *", id, type);
+		rb_helper_write_batch(authd_helper, "E %s E %c *", id, type);
 		rb_free(id);
 		return;
 	}
 
-	rb_helper_write(authd_helper, "E %s O %c %s", id, type, reply);
+	rb_helper_write_batch(authd_helper, "E %s O %c %s", id, type, reply);
 	rb_free(id);
 }
 
@@ -295,9 +542,27 @@ enumerate_nameservers(uint32_t rid, const char letter)
 	stats_result(rid, letter, "%s", buf);
 }
 
+void
+enumerate_dns_cache(uint32_t rid, const char letter)
+{
+	stats_result(rid, letter, "entries=%zu hits=%" PRIu64 " neg_hits=%" PRIu64
+		" misses=%" PRIu64 " coalesced=%" PRIu64 " uncached=%" PRIu64
+		" expired=%" PRIu64 " evicted=%" PRIu64,
+		(size_t)rb_dlink_list_length(&dns_cache_lru),
+		dns_cache_stats.hits, dns_cache_stats.neg_hits,
+		dns_cache_stats.misses, dns_cache_stats.coalesced,
+		dns_cache_stats.uncached, dns_cache_stats.expired,
+		dns_cache_stats.evicted);
+}
+
 void
 reload_nameservers(const char letter)
 {
-	/* Not a whole lot to it */
+	rb_dlink_node *ptr, *nptr;
+
+	/* Answers from the old servers are not worth keeping */
+	RB_DLINK_FOREACH_SAFE(ptr, nptr, dns_cache_lru.head)
+		free_cache_entry(ptr->data);
+
 	restart_resolver();
 }
@@ -41,10 +41,11 @@ typedef void (*DNSCB)(const char *res, bool status, query_type type, void *data)
 
 struct dns_query
 {
-	struct DNSQuery query;
+	rb_dlink_node node;
 	query_type type;
 	struct rb_sockaddr_storage addr;
 	uint64_t id;
+	char *answer;		/* cached answer awaiting delivery */
 
 	DNSCB callback;
 	void *data;
@@ -53,9 +54,11 @@ struct dns_query
 extern struct dns_query *lookup_hostname(const char *ip, DNSCB callback, void *data);
 extern struct dns_query *lookup_ip(const char *host, int aftype, DNSCB callback, void *data);
 extern void cancel_query(struct dns_query *query);
+extern void deliver_cached_answers(void);
 
 extern void handle_resolve_dns(int parc, char *parv[]);
 extern void enumerate_nameservers(uint32_t rid, const char letter);
+extern void enumerate_dns_cache(uint32_t rid, const char letter);
 extern void reload_nameservers(const char letter);
 
 #endif
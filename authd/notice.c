@@ -32,7 +32,7 @@ notice_client(uint32_t cid, const char *fmt, ...)
 	vsnprintf(buf, sizeof(buf), fmt, args);
 	va_end(args);
 
-	rb_helper_write(authd_helper, "N %x :%s", cid, buf);
+	rb_helper_write_batch(authd_helper, "N %x :%s", cid, buf);
 }
 
 /* Send a warning to the IRC daemon for logging, etc. */
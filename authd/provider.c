@@ -273,7 +273,7 @@ reject_client(struct auth_client *auth, uint32_t id, const char *data, const cha
 	 * In the future this may not be the case.
 	 * --Elizafox
 	 */
-	rb_helper_write(authd_helper, "R %x %c %s %s %s :%s",
+	rb_helper_write_batch(authd_helper, "R %x %c %s %s %s :%s",
 		auth->cid, id != UINT32_MAX ? auth->data[id].provider->letter : '*',
 		auth->username, auth->hostname,
 		data == NULL ? "*" : data, buf);
@@ -288,7 +288,7 @@ reject_client(struct auth_client *auth, uint32_t id, const char *data, const cha
 void
 accept_client(struct auth_client *auth)
 {
-	rb_helper_write(authd_helper, "A %x %s %s", auth->cid, auth->username, auth->hostname);
+	rb_helper_write_batch(authd_helper, "A %x %s %s", auth->cid, auth->username, auth->hostname);
 	cancel_providers(auth);
 }
 
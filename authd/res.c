@@ -44,7 +44,6 @@
 static PF res_readreply;
 
 #define MAXPACKET      1024	/* rfc sez 512 but we expand names so ... */
-#define AR_TTL         600	/* TTL in seconds for dns cache entries */
 
 /* RFC 1104/1105 wasn't very helpful about what these fields
  * should be named, so for now, we'll just name them this way.
@@ -800,12 +799,22 @@ static int res_read_single_reply(rb_fde_t *F, void *data)
 			 * Either a fatal error was returned or no answer. Cancel the
 			 * request.
 			 */
-			if (NXDOMAIN == header->rcode)
+			if (NXDOMAIN == header->rcode || NO_ERRORS == header->rcode)
 			{
-				/* If the rcode is NXDOMAIN, treat it as a good response. */
-				ns_failure_count[ns] /= 4;
+				/*
+				 * If the rcode is NXDOMAIN, treat it as a good response.
+				 * Either way the name has no answer, which the caller
+				 * may cache.
+				 */
+				struct DNSReply negative = { .negative = true };
+
+				if (NXDOMAIN == header->rcode)
+					ns_failure_count[ns] /= 4;
+
+				(*request->query->callback) (request->query->ptr, &negative);
 			}
-			(*request->query->callback) (request->query->ptr, NULL);
+			else
+				(*request->query->callback) (request->query->ptr, NULL);
 			rem_request(request);
 		}
 		return 1;
@@ -880,6 +889,7 @@ make_dnsreply(struct reslist *request)
 	cp = (struct DNSReply *)rb_malloc(sizeof(struct DNSReply));
 
 	cp->h_name = request->name;
+	cp->ttl = request->ttl;
 	memcpy(&cp->addr, &request->addr, sizeof(cp->addr));
 	return (cp);
 }
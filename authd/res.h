@@ -12,11 +12,14 @@
  */
 #define IRCD_MAXNS 10
 #define RESOLVER_HOSTLEN 255
+#define AR_TTL         600	/* TTL in seconds for dns cache entries */
 
 struct DNSReply
 {
   char *h_name;
   struct rb_sockaddr_storage addr;
+  time_t ttl;		/* TTL of the answer record, in seconds */
+  bool negative;	/* authoritative NXDOMAIN or empty answer */
 };
 
 struct DNSQuery
@@ -32,6 +32,7 @@
 #include <stdio.h>
 #include "rsdb.h"
 #include "ircd_defs.h"
+#include "bandb_snapshot.h"
 
 
 #define MAXPARA 10
@@ -59,7 +60,15 @@ static const char *bandb_table[LAST_BANDB_TYPE] = {
 static rb_helper *bandb_helper;
 static int in_transaction;
 
+/* statements are prepared once the schema is known to exist */
+static struct rsdb_stmt *insert_stmt[LAST_BANDB_TYPE];
+static struct rsdb_stmt *delete_stmt[LAST_BANDB_TYPE];
+static struct rsdb_stmt *list_stmt[LAST_BANDB_TYPE];
+
 static void check_schema(void);
+static void prepare_statements(void);
+static void free_statements(void);
+static void list_bans_text(void);
 
 static void
 bandb_commit(void *unused)
@@ -68,9 +77,23 @@ bandb_commit(void *unused)
 	in_transaction = 0;
 }
 
+static void
+start_transaction(void)
+{
+	/* writes arriving within COMMIT_INTERVAL are committed together */
+	if(!in_transaction)
+	{
+		rsdb_transaction(RSDB_TRANS_START);
+		in_transaction = 1;
+		rb_event_addonce("bandb_commit", bandb_commit, NULL,
+				COMMIT_INTERVAL);
+	}
+}
+
 static void
 parse_ban(bandb_type type, char *parv[], int parc)
 {
+	const char *args[6];
 	const char *mask1 = NULL;
 	const char *mask2 = NULL;
 	const char *oper = NULL;
@@ -97,22 +120,21 @@ parse_ban(bandb_type type, char *parv[], int parc)
 	perm = parv[para++];
 	reason = parv[para++];
 
-	if(!in_transaction)
-	{
-		rsdb_transaction(RSDB_TRANS_START);
-		in_transaction = 1;
-		rb_event_addonce("bandb_commit", bandb_commit, NULL,
-				COMMIT_INTERVAL);
-	}
+	args[0] = mask1;
+	args[1] = mask2 ? mask2 : "";
+	args[2] = oper;
+	args[3] = curtime;
+	args[4] = perm;
+	args[5] = reason;
 
-	rsdb_exec(NULL,
-		  "INSERT INTO %s (mask1, mask2, oper, time, perm, reason) VALUES('%Q', '%Q', '%Q', %s, %s, '%Q')",
-		  bandb_table[type], mask1, mask2 ? mask2 : "", oper, curtime, perm, reason);
+	start_transaction();
+	rsdb_stmt_exec(insert_stmt[type], 6, args);
 }
 
 static void
 parse_unban(bandb_type type, char *parv[], int parc)
 {
+	const char *args[2];
 	const char *mask1 = NULL;
 	const char *mask2 = NULL;
 
@@ -129,20 +151,102 @@ parse_unban(bandb_type type, char *parv[], int parc)
 	if(type == BANDB_KLINE)
 		mask2 = parv[2];
 
-	if(!in_transaction)
+	args[0] = mask1;
+	args[1] = mask2 ? mask2 : "";
+
+	start_transaction();
+	rsdb_stmt_exec(delete_stmt[type], 2, args);
+}
+
+/* write_snapshot()
+ *
+ * inputs	- path to write the snapshot to
+ * outputs	- 1 on success, 0 on failure
+ * side effects - dumps every ban into a snapshot file, see bandb_snapshot.h
+ */
+static int
+write_snapshot(const char *path)
+{
+	char tmppath[PATH_MAX];
+	struct bandb_snapshot_header header;
+	FILE *out;
+	int i, j;
+
+	if(snprintf(tmppath, sizeof(tmppath), "%s.tmp", path) >= (int)sizeof(tmppath))
+		return 0;
+
+	if((out = fopen(tmppath, "wb")) == NULL)
+		return 0;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, BANDB_SNAPSHOT_MAGIC, sizeof(header.magic));
+	fwrite(&header, sizeof(header), 1, out);
+
+	for(i = 0; i < LAST_BANDB_TYPE; i++)
 	{
-		rsdb_transaction(RSDB_TRANS_START);
-		in_transaction = 1;
-		rb_event_addonce("bandb_commit", bandb_commit, NULL,
-				COMMIT_INTERVAL);
+		while(rsdb_stmt_step(list_stmt[i]))
+		{
+			const char *field[BANDB_SNAPSHOT_FIELDS];
+			uint16_t len[BANDB_SNAPSHOT_FIELDS];
+			size_t flen;
+
+			for(j = 0; j < BANDB_SNAPSHOT_FIELDS; j++)
+			{
+				field[j] = rsdb_stmt_column(list_stmt[i], j, &flen);
+				if(flen > BUFSIZE)
+					break;
+				len[j] = flen;
+			}
+
+			/* nothing that long ever came from an ircd */
+			if(j < BANDB_SNAPSHOT_FIELDS)
+				continue;
+
+			fwrite(len, sizeof(len), 1, out);
+			for(j = 0; j < BANDB_SNAPSHOT_FIELDS; j++)
+				fwrite(field[j], len[j] + 1, 1, out);
+
+			header.count[i]++;
+		}
+
+		rsdb_stmt_reset(list_stmt[i]);
 	}
 
-	rsdb_exec(NULL, "DELETE FROM %s WHERE mask1='%Q' AND mask2='%Q'",
-		  bandb_table[type], mask1, mask2 ? mask2 : "");
+	rewind(out);
+	fwrite(&header, sizeof(header), 1, out);
+
+	if(ferror(out) | fclose(out) || rename(tmppath, path))
+	{
+		unlink(tmppath);
+		return 0;
+	}
+
+	return 1;
 }
 
 static void
 list_bans(void)
+{
+	const char *dbpath = getenv("BANDB_DBPATH");
+	char path[PATH_MAX];
+
+	if(dbpath != NULL)
+	{
+		snprintf(path, sizeof(path), "%s.snapshot", dbpath);
+
+		if(write_snapshot(path))
+		{
+			rb_helper_write(bandb_helper, "S :%s", path);
+			return;
+		}
+	}
+
+	/* no snapshot, stream the bans instead */
+	list_bans_text();
+}
+
+static void
+list_bans_text(void)
 {
 	static char buf[512];
 	struct rsdb_table table;
@@ -244,6 +348,9 @@ error_cb(rb_helper *helper)
 {
 	if(in_transaction)
 		rsdb_transaction(RSDB_TRANS_END);
+	/* sqlite won't close the database with statements outstanding */
+	free_statements();
+	rsdb_shutdown();
 	exit(1);
 }
 
@@ -313,6 +420,7 @@ main(int argc, char *argv[])
 	}
 	rsdb_init(db_error_cb);
 	check_schema();
+	prepare_statements();
 	rb_helper_loop(bandb_helper, 0);
 
 	return 0;
@@ -338,3 +446,33 @@ check_schema(void)
 				  bandb_table[i]);
 	}
 }
+
+static void
+prepare_statements(void)
+{
+	int i;
+
+	for(i = 0; i < LAST_BANDB_TYPE; i++)
+	{
+		insert_stmt[i] = rsdb_prepare("INSERT INTO %s (mask1, mask2, oper, time, perm, reason) VALUES(?, ?, ?, ?, ?, ?)",
+					      bandb_table[i]);
+		delete_stmt[i] = rsdb_prepare("DELETE FROM %s WHERE mask1=? AND mask2=?",
+					      bandb_table[i]);
+		list_stmt[i] = rsdb_prepare("SELECT mask1, mask2, oper, reason FROM %s "
+					    "ORDER BY ifnull(mask1, ''), ifnull(mask2, ''), ifnull(oper, ''), ifnull(reason, '')",
+					    bandb_table[i]);
+	}
+}
+
+static void
+free_statements(void)
+{
+	int i;
+
+	for(i = 0; i < LAST_BANDB_TYPE; i++)
+	{
+		rsdb_stmt_free(insert_stmt[i]);
+		rsdb_stmt_free(delete_stmt[i]);
+		rsdb_stmt_free(list_stmt[i]);
+	}
+}
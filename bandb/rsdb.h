@@ -32,6 +32,16 @@ void rsdb_exec_fetch(struct rsdb_table *data, const char *format, ...);
 void rsdb_exec_fetch_end(struct rsdb_table *data);
 
 void rsdb_transaction(rsdb_transtype type);
+
+/* prepared statements, parameters are always bound as text */
+struct rsdb_stmt;
+
+struct rsdb_stmt *rsdb_prepare(const char *format, ...);
+void rsdb_stmt_exec(struct rsdb_stmt *stmt, int argc, const char **argv);
+int rsdb_stmt_step(struct rsdb_stmt *stmt);
+const char *rsdb_stmt_column(struct rsdb_stmt *stmt, int col, size_t *len);
+void rsdb_stmt_reset(struct rsdb_stmt *stmt);
+void rsdb_stmt_free(struct rsdb_stmt *stmt);
 /* rsdb_snprintf.c */
 
 int rs_vsnprintf(char *dest, const size_t bytes, const char *format, va_list args);
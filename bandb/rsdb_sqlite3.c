@@ -261,3 +261,116 @@ rsdb_transaction(rsdb_transtype type)
 	else if(type == RSDB_TRANS_END)
 		rsdb_exec(NULL, "COMMIT TRANSACTION");
 }
+
+struct rsdb_stmt
+{
+	sqlite3_stmt *stmt;
+};
+
+struct rsdb_stmt *
+rsdb_prepare(const char *format, ...)
+{
+	static char buf[BUFSIZE * 4];
+	struct rsdb_stmt *stmt;
+	va_list args;
+	unsigned int i;
+
+	va_start(args, format);
+	i = rs_vsnprintf(buf, sizeof(buf), format, args);
+	va_end(args);
+
+	if(i >= sizeof(buf))
+	{
+		mlog("fatal error: length problem with compiling sql");
+	}
+
+	stmt = rb_malloc(sizeof(struct rsdb_stmt));
+
+	if(sqlite3_prepare_v2(rb_bandb, buf, -1, &stmt->stmt, NULL) != SQLITE_OK)
+	{
+		mlog("fatal error: problem preparing statement: %s", sqlite3_errmsg(rb_bandb));
+	}
+
+	return stmt;
+}
+
+/* rsdb_stmt_step()
+ *
+ * inputs	- statement
+ * outputs	- 1 if a row is available, 0 once the statement is done
+ * side effects - retries for a while if the database is busy, like
+ *		  rsdb_exec() does
+ */
+int
+rsdb_stmt_step(struct rsdb_stmt *stmt)
+{
+	int i, retval;
+
+	for(i = 0; i < 6; i++)
+	{
+		retval = sqlite3_step(stmt->stmt);
+
+		if(retval == SQLITE_ROW)
+			return 1;
+		if(retval == SQLITE_DONE)
+			return 0;
+		if(retval != SQLITE_BUSY)
+			break;
+
+		rb_sleep(0, 500000);
+	}
+
+	mlog("fatal error: problem with db file: %s", sqlite3_errmsg(rb_bandb));
+	return 0;
+}
+
+/* rsdb_stmt_exec()
+ *
+ * inputs	- statement, parameters to bind to it
+ * outputs	-
+ * side effects - runs a statement that returns no rows and resets it for
+ *		  the next use
+ */
+void
+rsdb_stmt_exec(struct rsdb_stmt *stmt, int argc, const char **argv)
+{
+	int i;
+
+	for(i = 0; i < argc; i++)
+		sqlite3_bind_text(stmt->stmt, i + 1, argv[i], -1, SQLITE_STATIC);
+
+	while(rsdb_stmt_step(stmt))
+		;
+
+	rsdb_stmt_reset(stmt);
+}
+
+/* returns "" for NULL columns */
+const char *
+rsdb_stmt_column(struct rsdb_stmt *stmt, int col, size_t *len)
+{
+	const char *text = (const char *)sqlite3_column_text(stmt->stmt, col);
+
+	if(text == NULL)
+	{
+		*len = 0;
+		return "";
+	}
+
+	*len = sqlite3_column_bytes(stmt->stmt, col);
+	return text;
+}
+
+void
+rsdb_stmt_reset(struct rsdb_stmt *stmt)
+{
+	sqlite3_reset(stmt->stmt);
+	sqlite3_clear_bindings(stmt->stmt);
+}
+
+void
+rsdb_stmt_free(struct rsdb_stmt *stmt)
+{
+	sqlite3_finalize(stmt->stmt);
+	rb_free(stmt);
+}
@@ -0,0 +1,527 @@
+/*
+ * bench/bench_librb.c
+ * Copyright (c) 2026 Ophion development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Microbenchmarks for the librb containers, line and raw buffers and the
+ * block allocator.
+ */
+
+#include "rb_lib.h"
+#include "rb_dictionary.h"
+#include "rb_radixtree.h"
+#include "microbench.h"
+
+#define MAX_ENTRIES	1000000
+#define CHURN_LIVE	65536
+#define LINE_BLOCK	65536
+#define READ_SIZE	4096
+
+static const size_t sizes[] = { 10000, 100000, 1000000 };
+
+static char **keys;
+static struct sockaddr_in *addrs;
+
+/* nick-like keys, unique thanks to the counter on the end */
+static void
+make_keys(void)
+{
+	char nick[32];
+
+	keys = rb_malloc(sizeof(char *) * MAX_ENTRIES);
+	addrs = rb_malloc(sizeof(struct sockaddr_in) * MAX_ENTRIES);
+
+	for(size_t i = 0; i < MAX_ENTRIES; i++)
+	{
+		char buf[48];
+
+		bench_nick(nick, 10);
+		snprintf(buf, sizeof buf, "%s%zx", nick, i);
+		keys[i] = rb_strdup(buf);
+
+		/* multiplying by an odd constant is a bijection, so no duplicates */
+		addrs[i].sin_family = AF_INET;
+		addrs[i].sin_addr.s_addr = htonl((uint32_t)(i * 2654435761u));
+	}
+}
+
+/* radixtree */
+
+static rb_radixtree *rtree;
+
+static void
+radixtree_create(size_t n)
+{
+	rtree = rb_radixtree_create("bench", NULL);
+}
+
+static void
+radixtree_fill(size_t n)
+{
+	radixtree_create(n);
+	for(size_t i = 0; i < n; i++)
+		rb_radixtree_add(rtree, keys[i], keys[i]);
+}
+
+static void
+radixtree_free(size_t n)
+{
+	rb_radixtree_destroy(rtree, NULL, NULL);
+	rtree = NULL;
+}
+
+static size_t
+radixtree_insert(size_t n)
+{
+	for(size_t i = 0; i < n; i++)
+		rb_radixtree_add(rtree, keys[i], keys[i]);
+	return n;
+}
+
+static size_t
+radixtree_lookup(size_t n)
+{
+	size_t found = 0;
+
+	/* stride through the keys so lookups don't follow insertion order */
+	for(size_t i = 0, j = 0; i < n; i++, j = (j + 7919) % n)
+		found += rb_radixtree_retrieve(rtree, keys[j]) != NULL;
+	return found;
+}
+
+static size_t
+radixtree_delete(size_t n)
+{
+	for(size_t i = 0, j = 0; i < n; i++, j = (j + 7919) % n)
+		rb_radixtree_delete(rtree, keys[j]);
+	return n;
+}
+
+static size_t
+radixtree_iterate(size_t n)
+{
+	rb_radixtree_iteration_state iter;
+	size_t count = 0;
+	void *data;
+
+	RB_RADIXTREE_FOREACH(data, &iter, rtree)
+		count++;
+	return count;
+}
+
+/* dictionary */
+
+static rb_dictionary *dict;
+
+static void
+dictionary_create(size_t n)
+{
+	dict = rb_dictionary_create("bench", (DCF)strcmp);
+}
+
+static void
+dictionary_fill(size_t n)
+{
+	dictionary_create(n);
+	for(size_t i = 0; i < n; i++)
+		rb_dictionary_add(dict, keys[i], keys[i]);
+}
+
+static void
+dictionary_free(size_t n)
+{
+	rb_dictionary_destroy(dict, NULL, NULL);
+	dict = NULL;
+}
+
+static size_t
+dictionary_insert(size_t n)
+{
+	for(size_t i = 0; i < n; i++)
+		rb_dictionary_add(dict, keys[i], keys[i]);
+	return n;
+}
+
+static size_t
+dictionary_lookup(size_t n)
+{
+	size_t found = 0;
+
+	for(size_t i = 0, j = 0; i < n; i++, j = (j + 7919) % n)
+		found += rb_dictionary_retrieve(dict, keys[j]) != NULL;
+	return found;
+}
+
+static size_t
+dictionary_delete(size_t n)
+{
+	for(size_t i = 0, j = 0; i < n; i++, j = (j + 7919) % n)
+		rb_dictionary_delete(dict, keys[j]);
+	return n;
+}
+
+static size_t
+dictionary_iterate(size_t n)
+{
+	rb_dictionary_iter iter;
+	size_t count = 0;
+	void *data;
+
+	RB_DICTIONARY_FOREACH(data, &iter, dict)
+		count++;
+	return count;
+}
+
+/* patricia */
+
+static rb_patricia_tree_t *ptree;
+
+static void
+patricia_create(size_t n)
+{
+	ptree = rb_new_patricia(128);
+}
+
+static void
+patricia_fill(size_t n)
+{
+	patricia_create(n);
+	for(size_t i = 0; i < n; i++)
+		make_and_lookup_ip(ptree, (struct sockaddr *)&addrs[i], 32);
+}
+
+static void
+patricia_free(size_t n)
+{
+	rb_destroy_patricia(ptree, NULL);
+	ptree = NULL;
+}
+
+static size_t
+patricia_insert(size_t n)
+{
+	for(size_t i = 0; i < n; i++)
+		make_and_lookup_ip(ptree, (struct sockaddr *)&addrs[i], 32);
+	return n;
+}
+
+static size_t
+patricia_lookup(size_t n)
+{
+	size_t found = 0;
+
+	for(size_t i = 0, j = 0; i < n; i++, j = (j + 7919) % n)
+		found += rb_match_ip(ptree, (struct sockaddr *)&addrs[j]) != NULL;
+	return found;
+}
+
+static size_t
+patricia_delete(size_t n)
+{
+	for(size_t i = 0, j = 0; i < n; i++, j = (j + 7919) % n)
+	{
+		rb_patricia_node_t *node = rb_match_ip_exact(ptree, (struct sockaddr *)&addrs[j], 32);
+
+		if(node != NULL)
+			rb_patricia_remove(ptree, node);
+	}
+	return n;
+}
+
+static size_t
+patricia_iterate(size_t n)
+{
+	rb_patricia_node_t *node;
+	size_t count = 0;
+
+	RB_PATRICIA_WALK(ptree->head, node)
+	{
+		count++;
+	}
+	RB_PATRICIA_WALK_END;
+	return count;
+}
+
+/* allocator churn: a live set of objects where a random one is freed and
+ * replaced on every step, the way clients and linebufs come and go
+ */
+
+static void **live;
+static rb_bh *churn_heap;
+
+static void
+malloc_setup(size_t n)
+{
+	live = rb_malloc(sizeof(void *) * CHURN_LIVE);
+	for(size_t i = 0; i < CHURN_LIVE; i++)
+		live[i] = malloc(96);
+}
+
+static void
+malloc_teardown(size_t n)
+{
+	for(size_t i = 0; i < CHURN_LIVE; i++)
+		free(live[i]);
+	rb_free(live);
+	live = NULL;
+}
+
+static void
+balloc_setup(size_t n)
+{
+	live = rb_malloc(sizeof(void *) * CHURN_LIVE);
+	churn_heap = rb_bh_create(96, 1024, "bench churn");
+	for(size_t i = 0; i < CHURN_LIVE; i++)
+		live[i] = rb_bh_alloc(churn_heap);
+}
+
+static void
+balloc_teardown(size_t n)
+{
+	for(size_t i = 0; i < CHURN_LIVE; i++)
+		rb_bh_free(churn_heap, live[i]);
+	rb_bh_destroy(churn_heap);
+	churn_heap = NULL;
+	rb_free(live);
+	live = NULL;
+}
+
+static size_t
+balloc_churn(size_t n)
+{
+	for(size_t i = 0; i < n; i++)
+	{
+		size_t j = bench_rand() % CHURN_LIVE;
+
+		rb_bh_free(churn_heap, live[j]);
+		live[j] = rb_bh_alloc(churn_heap);
+	}
+	return n;
+}
+
+static size_t
+malloc_churn(size_t n)
+{
+	for(size_t i = 0; i < n; i++)
+	{
+		size_t j = bench_rand() % CHURN_LIVE;
+
+		free(live[j]);
+		live[j] = malloc(96);
+	}
+	return n;
+}
+
+/* linebuf: parsing what a client sends, and sending lines to a socket */
+
+static char *line_block;
+static size_t line_block_len, line_block_lines;
+static rb_fde_t *sock_in, *sock_out;
+
+static void
+make_line_block(void)
+{
+	static const char *templates[] = {
+		"PRIVMSG #channel :%s",
+		"PING :%s",
+		"MODE #channel +b *!*@%s.example.net",
+		"JOIN #%s",
+		"PRIVMSG %s :hello there, how are things going today? this one is a bit longer than most",
+		"WHO #%s",
+	};
+	char nick[32];
+
+	line_block = rb_malloc(LINE_BLOCK);
+	while(line_block_len < LINE_BLOCK - 512)
+	{
+		const char *t = templates[bench_rand() % ARRAY_SIZE(templates)];
+		int len;
+
+		bench_nick(nick, 16);
+		len = snprintf(line_block + line_block_len, LINE_BLOCK - line_block_len, t, nick);
+		line_block_len += len;
+		memcpy(line_block + line_block_len, "\r\n", 2);
+		line_block_len += 2;
+		line_block_lines++;
+	}
+}
+
+static buf_head_t linebuf;
+
+static void
+linebuf_setup(size_t n)
+{
+	rb_linebuf_newbuf(&linebuf);
+}
+
+static void
+linebuf_teardown(size_t n)
+{
+	rb_linebuf_donebuf(&linebuf);
+}
+
+static size_t
+linebuf_parse(size_t n)
+{
+	char line[512];
+	size_t lines = 0;
+
+	/* feed the block in read()-sized pieces and take each line back out */
+	while(lines < n)
+	{
+		for(size_t off = 0; off < line_block_len; off += READ_SIZE)
+		{
+			size_t len = line_block_len - off < READ_SIZE ? line_block_len - off : READ_SIZE;
+
+			rb_linebuf_parse(&linebuf, line_block + off, len, 0);
+			bench_bytes += len;
+
+			while(rb_linebuf_get(&linebuf, line, sizeof line, 0, 0) > 0)
+				lines++;
+		}
+	}
+	return lines;
+}
+
+static void
+socket_setup(size_t n)
+{
+	if(rb_socketpair(AF_UNIX, SOCK_STREAM, 0, &sock_in, &sock_out, "bench") < 0)
+	{
+		perror("socketpair");
+		exit(1);
+	}
+}
+
+static void
+socket_teardown(size_t n)
+{
+	rb_close(sock_in);
+	rb_close(sock_out);
+}
+
+static void
+drain(void)
+{
+	char buf[65536];
+	ssize_t len;
+
+	while((len = rb_read(sock_out, buf, sizeof buf)) > 0)
+		bench_bytes += len;
+}
+
+static size_t
+linebuf_flush(size_t n)
+{
+	const char *p = line_block;
+
+	rb_linebuf_newbuf(&linebuf);
+
+	for(size_t i = 0; i < n; i++)
+	{
+		const char *eol = strchr(p, '\r');
+		char line[512];
+		rb_strf_t strings = { .format = line };
+
+		memcpy(line, p, eol - p);
+		line[eol - p] = '\0';
+		rb_linebuf_put(&linebuf, &strings);
+
+		p = eol + 2;
+		if(p >= line_block + line_block_len)
+			p = line_block;
+
+		/* a sendq gets flushed every so often, not after each line */
+		if(i % 64 == 63)
+		{
+			while(rb_linebuf_len(&linebuf) > 0 && rb_linebuf_flush(sock_in, &linebuf) > 0)
+				drain();
+		}
+	}
+
+	while(rb_linebuf_len(&linebuf) > 0 && rb_linebuf_flush(sock_in, &linebuf) > 0)
+		drain();
+	drain();
+
+	rb_linebuf_donebuf(&linebuf);
+	return n;
+}
+
+static rawbuf_head_t *rawbuf;
+
+static size_t
+rawbuf_flush(size_t n)
+{
+	rawbuf = rb_new_rawbuffer();
+
+	for(size_t i = 0; i < n; i++)
+	{
+		rb_rawbuf_append(rawbuf, line_block + (i * 512) % (LINE_BLOCK - 1024), 512);
+
+		if(i % 64 == 63)
+		{
+			while(rb_rawbuf_length(rawbuf) > 0 && rb_rawbuf_flush(rawbuf, sock_in) > 0)
+				drain();
+		}
+	}
+
+	while(rb_rawbuf_length(rawbuf) > 0 && rb_rawbuf_flush(rawbuf, sock_in) > 0)
+		drain();
+	drain();
+
+	rb_free_rawbuffer(rawbuf);
+	return n;
+}
+
+static const struct bench_case cases[] = {
+	{ "radixtree/insert", radixtree_create, radixtree_insert, radixtree_free },
+	{ "radixtree/lookup", radixtree_fill, radixtree_lookup, radixtree_free, true },
+	{ "radixtree/delete", radixtree_fill, radixtree_delete, radixtree_free },
+	{ "radixtree/iterate", radixtree_fill, radixtree_iterate, radixtree_free, true },
+	{ "dictionary/insert", dictionary_create, dictionary_insert, dictionary_free },
+	{ "dictionary/lookup", dictionary_fill, dictionary_lookup, dictionary_free, true },
+	{ "dictionary/delete", dictionary_fill, dictionary_delete, dictionary_free },
+	{ "dictionary/iterate", dictionary_fill, dictionary_iterate, dictionary_free, true },
+	{ "patricia/insert", patricia_create, patricia_insert, patricia_free },
+	{ "patricia/lookup", patricia_fill, patricia_lookup, patricia_free, true },
+	{ "patricia/delete", patricia_fill, patricia_delete, patricia_free },
+	{ "patricia/iterate", patricia_fill, patricia_iterate, patricia_free, true },
+	{ "balloc/churn", balloc_setup, balloc_churn, balloc_teardown },
+	{ "malloc/churn", malloc_setup, malloc_churn, malloc_teardown },
+	{ "linebuf/parse", linebuf_setup, linebuf_parse, linebuf_teardown },
+	{ "linebuf/flush", socket_setup, linebuf_flush, socket_teardown },
+	{ "rawbuf/flush", socket_setup, rawbuf_flush, socket_teardown },
+};
+
+int
+main(int argc, char *argv[])
+{
+	make_keys();
+	make_line_block();
+	return bench_main(argc, argv, cases, ARRAY_SIZE(cases), sizes, ARRAY_SIZE(sizes));
+}
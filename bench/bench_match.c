@@ -0,0 +1,316 @@
+/*
+ * bench/bench_match.c
+ * Copyright (c) 2026 Ophion development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Microbenchmarks for the glob matchers and case-insensitive comparison in
+ * ircd/match.c, and for GlobSet, over ban lists shaped like real ones.
+ */
+
+#include "stdinc.h"
+#include "match.h"
+#include "globset.h"
+#include "microbench.h"
+
+#define MAX_MASKS	10000
+#define CLIENTS		256
+
+static const size_t sizes[] = { 100, 1000, 10000 };
+
+static char *bans[MAX_MASKS];
+static char *gecos_masks[MAX_MASKS];
+static char *clients[CLIENTS];
+static char *gecos[CLIENTS];
+static char *nicks[MAX_MASKS][2];
+
+/* results go here so the compiler can't drop the work */
+static volatile size_t sink;
+
+static char *
+make_ban(void)
+{
+	char buf[128], nick[32], word[32];
+	unsigned int a = bench_rand() % 256, b = bench_rand() % 256;
+
+	bench_nick(nick, 10);
+	bench_nick(word, 8);
+
+	/* roughly the mix found on the ban lists of busy channels */
+	switch(bench_rand() % 10)
+	{
+	case 0:
+	case 1:
+		snprintf(buf, sizeof buf, "*!*@%u-%u-%u-%u.dsl.%s.net", a, b, a ^ b, (a + b) & 255, word);
+		break;
+	case 2:
+		snprintf(buf, sizeof buf, "*!*@198.51.%u.*", a);
+		break;
+	case 3:
+		snprintf(buf, sizeof buf, "*!*%s@*", nick);
+		break;
+	case 4:
+		snprintf(buf, sizeof buf, "%s*!*@*", nick);
+		break;
+	case 5:
+		snprintf(buf, sizeof buf, "*!*@*.%s.example.org", word);
+		break;
+	case 6:
+		snprintf(buf, sizeof buf, "*!*@gateway/web/irccloud.com/x-%06u", a * 256 + b);
+		break;
+	case 7:
+		snprintf(buf, sizeof buf, "*!~*@*.isp%u.%s.com", a, word);
+		break;
+	case 8:
+		snprintf(buf, sizeof buf, "%s!*%s@*", nick, word);
+		break;
+	default:
+		snprintf(buf, sizeof buf, "*!*@2001:db8:%x:%x:*", a, b);
+		break;
+	}
+
+	return rb_strdup(buf);
+}
+
+static char *
+make_client(void)
+{
+	char buf[128], nick[32], user[32], word[32];
+	unsigned int a = bench_rand() % 256, b = bench_rand() % 256;
+
+	bench_nick(nick, 16);
+	bench_nick(user, 10);
+	bench_nick(word, 8);
+
+	switch(bench_rand() % 4)
+	{
+	case 0:
+		snprintf(buf, sizeof buf, "%s!~%s@%u-%u-%u-%u.dsl.%s.net", nick, user, a, b, a ^ b, (a + b) & 255, word);
+		break;
+	case 1:
+		snprintf(buf, sizeof buf, "%s!%s@198.51.%u.%u", nick, user, a, b);
+		break;
+	case 2:
+		snprintf(buf, sizeof buf, "%s!uid%u@gateway/web/irccloud.com/x-%06u", nick, a, a * 256 + b);
+		break;
+	default:
+		snprintf(buf, sizeof buf, "%s!~%s@c-%u-%u.home.isp%u.%s.com", nick, user, a, b, a, word);
+		break;
+	}
+
+	return rb_strdup(buf);
+}
+
+static void
+make_corpus(void)
+{
+	static const char *spam[] = {
+		"free", "money", "bot", "click", "http", "win", "casino", "crypto", "join", "now",
+	};
+	char buf[128], nick[32];
+
+	for(size_t i = 0; i < MAX_MASKS; i++)
+	{
+		bans[i] = make_ban();
+
+		snprintf(buf, sizeof buf, "*%s*%s*%u*", spam[bench_rand() % ARRAY_SIZE(spam)],
+			 spam[bench_rand() % ARRAY_SIZE(spam)], (unsigned int)i);
+		gecos_masks[i] = rb_strdup(buf);
+
+		nicks[i][0] = rb_strdup(bench_nick(nick, 16));
+		nicks[i][1] = rb_strdup(nick);
+		/* half of the pairs differ only by case */
+		if(i % 2 == 0)
+		{
+			for(char *p = nicks[i][1]; *p != '\0'; p++)
+				*p = irctoupper(*p);
+		}
+		else
+			nicks[i][1][strlen(nick) - 1] ^= 1;
+	}
+
+	for(size_t i = 0; i < CLIENTS; i++)
+	{
+		clients[i] = make_client();
+
+		snprintf(buf, sizeof buf, "%s %s realname %zu", bench_nick(nick, 12),
+			 spam[bench_rand() % ARRAY_SIZE(spam)], i);
+		gecos[i] = rb_strdup(buf);
+	}
+}
+
+/* what checking every client against a ban list of n entries costs */
+static size_t
+match_banlist(size_t n)
+{
+	size_t hits = 0;
+
+	for(size_t c = 0; c < CLIENTS; c++)
+		for(size_t i = 0; i < n; i++)
+			hits += match(bans[i], clients[c]);
+	sink = hits;
+	return CLIENTS * n;
+}
+
+static struct match_prog *progs[MAX_MASKS];
+
+static void
+compiled_setup(size_t n)
+{
+	for(size_t i = 0; i < n; i++)
+		progs[i] = match_compile(bans[i]);
+}
+
+static void
+compiled_teardown(size_t n)
+{
+	for(size_t i = 0; i < n; i++)
+		match_free(progs[i]);
+}
+
+/* what a ban check does: each client folded once, then every ban */
+static size_t
+compiled_banlist(size_t n)
+{
+	char folded[BUFSIZE];
+	size_t hits = 0;
+
+	for(size_t c = 0; c < CLIENTS; c++)
+	{
+		size_t len;
+
+		for(len = 0; clients[c][len] != '\0'; len++)
+			folded[len] = irctolower(clients[c][len]);
+
+		for(size_t i = 0; i < n; i++)
+			hits += match_folded(progs[i], folded, len);
+	}
+	sink = hits;
+	return CLIENTS * n;
+}
+
+static size_t
+match_esc_banlist(size_t n)
+{
+	size_t hits = 0;
+
+	for(size_t c = 0; c < CLIENTS; c++)
+		for(size_t i = 0; i < n; i++)
+			hits += match_esc(bans[i], clients[c]);
+	sink = hits;
+	return CLIENTS * n;
+}
+
+/* redundancy checks when a new ban is set */
+static size_t
+mask_match_banlist(size_t n)
+{
+	size_t hits = 0;
+
+	for(size_t c = 0; c < 16; c++)
+		for(size_t i = 0; i < n; i++)
+			hits += mask_match(bans[c], bans[i]);
+	sink = hits;
+	return 16 * n;
+}
+
+static size_t
+irccmp_nicks(size_t n)
+{
+	size_t same = 0;
+
+	for(size_t i = 0; i < n; i++)
+		same += irccmp(nicks[i][0], nicks[i][1]) == 0;
+	sink = same;
+	return n;
+}
+
+static struct GlobSet *set;
+
+static void
+globset_fill(size_t n)
+{
+	set = globset_create("bench");
+	for(size_t i = 0; i < n; i++)
+		globset_add(set, gecos_masks[i], gecos_masks[i]);
+}
+
+static void
+globset_free(size_t n)
+{
+	for(size_t i = 0; i < n; i++)
+		globset_delete(set, gecos_masks[i], gecos_masks[i]);
+}
+
+static size_t
+globset_lookup(size_t n)
+{
+	size_t hits = 0;
+
+	for(size_t c = 0; c < CLIENTS; c++)
+		hits += globset_match(set, gecos[c]) != NULL;
+	sink = hits;
+	return CLIENTS;
+}
+
+/* the same lookups done by trying every mask, as a baseline */
+static size_t
+gecos_linear(size_t n)
+{
+	size_t hits = 0;
+
+	for(size_t c = 0; c < CLIENTS; c++)
+	{
+		for(size_t i = 0; i < n; i++)
+		{
+			if(match_esc(gecos_masks[i], gecos[c]))
+			{
+				hits++;
+				break;
+			}
+		}
+	}
+	sink = hits;
+	return CLIENTS;
+}
+
+static const struct bench_case cases[] = {
+	{ "match/banlist", NULL, match_banlist, NULL, true },
+	{ "match_compiled/banlist", compiled_setup, compiled_banlist, compiled_teardown, true },
+	{ "match_esc/banlist", NULL, match_esc_banlist, NULL, true },
+	{ "mask_match/banlist", NULL, mask_match_banlist, NULL, true },
+	{ "irccmp/nicks", NULL, irccmp_nicks, NULL, true },
+	{ "globset/gecos", globset_fill, globset_lookup, globset_free, true },
+	{ "linear/gecos", NULL, gecos_linear, NULL, true },
+};
+
+int
+main(int argc, char *argv[])
+{
+	make_corpus();
+	return bench_main(argc, argv, cases, ARRAY_SIZE(cases), sizes, ARRAY_SIZE(sizes));
+}
@@ -0,0 +1,202 @@
+/*
+ * bench/microbench.c
+ * Copyright (c) 2026 Ophion development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "rb_lib.h"
+#include "microbench.h"
+
+#define DEFAULT_RUNS	7
+#define QUICK_MAX_SIZE	100000
+#define MIN_RUN_NS	20000000
+
+size_t bench_bytes;
+
+static uint64_t rand_state = 0x9e3779b97f4a7c15ULL;
+
+/* xorshift64*; the same sequence every time, so every run sees the same data */
+uint64_t
+bench_rand(void)
+{
+	rand_state ^= rand_state >> 12;
+	rand_state ^= rand_state << 25;
+	rand_state ^= rand_state >> 27;
+	return rand_state * 2685821657736338717ULL;
+}
+
+void
+bench_shuffle(void *base, size_t count, size_t size)
+{
+	char *p = base;
+	char tmp[64];
+
+	if(size > sizeof tmp)
+		return;
+
+	for(size_t i = count; i > 1; i--)
+	{
+		size_t j = bench_rand() % i;
+
+		memcpy(tmp, p + (i - 1) * size, size);
+		memcpy(p + (i - 1) * size, p + j * size, size);
+		memcpy(p + j * size, tmp, size);
+	}
+}
+
+char *
+bench_nick(char *buf, size_t len)
+{
+	static const char first[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ[]\\`_^{|}";
+	static const char rest[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-[]\\`_^{|}";
+	size_t n = 4 + bench_rand() % (len - 5 < 12 ? len - 5 : 12);
+
+	buf[0] = first[bench_rand() % (sizeof(first) - 1)];
+	for(size_t i = 1; i < n; i++)
+		buf[i] = rest[bench_rand() % (sizeof(rest) - 1)];
+	buf[n] = '\0';
+
+	return buf;
+}
+
+static int
+cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void
+usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-q] [-r runs] [filter]\n"
+		"  -q        only sizes up to %d\n"
+		"  -r runs   timed runs per case (default %d)\n"
+		"  filter    only cases whose name contains this\n",
+		name, QUICK_MAX_SIZE, DEFAULT_RUNS);
+}
+
+int
+bench_main(int argc, char *argv[], const struct bench_case *cases, size_t ncases,
+	   const size_t *sizes, size_t nsizes)
+{
+	const char *filter = NULL;
+	unsigned int runs = DEFAULT_RUNS;
+	bool quick = false;
+	uint64_t *times;
+	int c;
+
+	while((c = getopt(argc, argv, "qr:h")) != -1)
+	{
+		switch(c)
+		{
+		case 'q':
+			quick = true;
+			break;
+		case 'r':
+			runs = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	if(optind < argc)
+		filter = argv[optind];
+	if(runs < 1)
+		runs = 1;
+
+	rb_lib_init(NULL, NULL, NULL, 0, 1024, 1024, 1024);
+	rb_linebuf_init(4096);
+	rb_init_rawbuffers(1024);
+	times = rb_malloc(sizeof(uint64_t) * runs);
+
+	printf("%-28s %9s %11s %11s %7s %10s\n", "case", "size", "median ns", "best ns", "spread", "MB/s");
+
+	for(size_t i = 0; i < ncases; i++)
+	{
+		const struct bench_case *bc = &cases[i];
+
+		if(filter != NULL && strstr(bc->name, filter) == NULL)
+			continue;
+
+		for(size_t s = 0; s < nsizes; s++)
+		{
+			size_t n = sizes[s], ops = 0;
+			uint64_t median, best, worst;
+			double mbs = 0;
+
+			if(quick && n > QUICK_MAX_SIZE)
+				continue;
+
+			for(unsigned int r = 0; r <= runs; r++)
+			{
+				uint64_t start;
+
+				if(bc->setup != NULL)
+					bc->setup(n);
+
+				bench_bytes = 0;
+				ops = 0;
+				start = rb_monotonic_ns();
+				do
+					ops += bc->run(n);
+				while(bc->repeat && rb_monotonic_ns() - start < MIN_RUN_NS);
+				start = rb_monotonic_ns() - start;
+
+				if(bc->teardown != NULL)
+					bc->teardown(n);
+
+				/* the first run only warms the caches and the allocator */
+				if(r > 0)
+					times[r - 1] = start;
+			}
+
+			qsort(times, runs, sizeof(uint64_t), cmp_u64);
+			median = times[runs / 2];
+			best = times[0];
+			worst = times[runs - 1];
+
+			if(ops == 0)
+				ops = 1;
+			if(bench_bytes > 0)
+				mbs = bench_bytes / (median / 1e9) / 1e6;
+
+			printf("%-28s %9zu %11.1f %11.1f %6.1f%%", bc->name, n,
+			       (double)median / ops, (double)best / ops,
+			       median > 0 ? 100.0 * (worst - best) / median : 0.0);
+			if(mbs > 0)
+				printf(" %10.1f", mbs);
+			putchar('\n');
+			fflush(stdout);
+		}
+	}
+
+	rb_free(times);
+	return 0;
+}
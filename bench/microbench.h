@@ -0,0 +1,66 @@
+/*
+ * bench/microbench.h
+ * Copyright (c) 2026 Ophion development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * A tiny harness for the microbenchmarks.  Each case gets a setup and a
+ * teardown that are not timed, and a run function that does the work and
+ * returns how many operations it did.  Every case is run once to warm up
+ * and then a fixed number of times; cases that can be run back to back
+ * are repeated until each timing is long enough to trust.  The median and
+ * best time per operation are reported along with the spread between
+ * runs, so a noisy result can be told apart from a real regression.
+ */
+
+#ifndef __OPHION_MICROBENCH_H_GUARD
+#define __OPHION_MICROBENCH_H_GUARD
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(x)	(sizeof(x) / sizeof((x)[0]))
+#endif
+
+struct bench_case
+{
+	const char *name;
+	void (*setup)(size_t n);
+	size_t (*run)(size_t n);
+	void (*teardown)(size_t n);
+	bool repeat;		/* run leaves the state as it found it */
+};
+
+/* bytes processed by the current run, for cases that measure throughput */
+extern size_t bench_bytes;
+
+extern uint64_t bench_rand(void);
+extern void bench_shuffle(void *base, size_t count, size_t size);
+extern char *bench_nick(char *buf, size_t len);
+
+extern int bench_main(int argc, char *argv[], const struct bench_case *cases, size_t ncases,
+		      const size_t *sizes, size_t nsizes);
+
+#endif
@@ -43,7 +43,7 @@ static unsigned int mode_nonotice;
 static void chm_nonotice_process(hook_data_privmsg_channel *);
 
 mapi_hfn_list_av1 chm_nonotice_hfnlist[] = {
-	{ "privmsg_channel", (hookfn) chm_nonotice_process },
+	{ "privmsg_channel", (hookfn) chm_nonotice_process, HOOK_NORMAL, { .chmodes = &mode_nonotice } },
 	{ NULL, NULL }
 };
 
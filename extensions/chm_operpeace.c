@@ -29,6 +29,7 @@ mapi_hfn_list_av1 chm_operpeace_hfnlist[] = {
 };
 
 static unsigned int mymode;
+static int privid_receive_immunity;
 
 static int
 _modinit(void)
@@ -37,6 +38,8 @@ _modinit(void)
 	if (mymode == 0)
 		return -1;
 
+	privid_receive_immunity = privilege_register("oper:receive_immunity");
+
 	return 0;
 }
 
@@ -58,7 +61,7 @@ hdl_can_kick(hook_data_channel_approval *data)
 	if(IsOper(source_p))
 		return;
 
-	if((chptr->mode.mode & mymode) && HasPrivilege(who, "oper:receive_immunity"))
+	if((chptr->mode.mode & mymode) && HasPrivilegeId(who, privid_receive_immunity))
 	{
 		sendto_realops_snomask(SNO_GENERAL, L_NETWIDE, "%s attempted to kick %s from %s (which is +M)",
 			source_p->name, who->name, chptr->chname);
@@ -45,7 +45,9 @@ static int eb_oper(const char *data, struct Client *client_p,
 		if (set != NULL && client_p->user->privset == set)
 			return EXTBAN_MATCH;
 
-		/* $o:admin or whatever */
+		/* $o:oper:spy or whatever; privilege names must match
+		 * exactly, so $o:admin only matches a privset called admin
+		 */
 		return HasPrivilege(client_p, data) ? EXTBAN_MATCH : EXTBAN_NOMATCH;
 	}
 
@@ -17,6 +17,7 @@
 static const char helpops_desc[] = "The helpops system as used by freenode";
 
 static rb_dlink_list helper_list = { NULL, NULL, 0 };
+static int privid_dehelper, privid_helpops;
 static void h_hdl_stats_request(hook_data_int *hdata);
 static void h_hdl_new_remote_user(struct Client *client_p);
 static void h_hdl_client_exit(hook_data_client_exit *hdata);
@@ -53,7 +54,7 @@ mo_dehelper(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *sou
 {
 	struct Client *target_p;
 
-	if (!HasPrivilege(source_p, "oper:dehelper"))
+	if (!HasPrivilegeId(source_p, privid_dehelper))
 	{
 		sendto_one(source_p, form_str(ERR_NOPRIVS), me.name, source_p->name, "dehelper");
 		return;
@@ -110,6 +111,9 @@ _modinit(void)
 {
 	rb_dlink_node *ptr;
 
+	privid_dehelper = privilege_register("oper:dehelper");
+	privid_helpops = privilege_register("usermode:helpops");
+
 	user_modes[UMODECHAR_HELPOPS] = find_umode_slot();
 	construct_umodebuf();
 
@@ -224,7 +228,7 @@ h_hdl_umode_changed(hook_data_umode_changed *hdata)
 
 	if (source_p->umodes & user_modes[UMODECHAR_HELPOPS])
 	{
-		if (MyClient(source_p) && !HasPrivilege(source_p, "usermode:helpops"))
+		if (MyClient(source_p) && !HasPrivilegeId(source_p, privid_helpops))
 		{
 			source_p->umodes &= ~user_modes[UMODECHAR_HELPOPS];
 			sendto_one(source_p, form_str(ERR_NOPRIVS), me.name, source_p->name, "usermode:helpops");
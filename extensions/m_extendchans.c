@@ -44,14 +44,23 @@ struct Message extendchans_msgtab = {
 
 mapi_clist_av1 extendchans_clist[] = { &extendchans_msgtab, NULL };
 
-DECLARE_MODULE_AV2(extendchans, NULL, NULL, extendchans_clist, NULL, NULL, NULL, NULL, extendchans_desc);
+static int privid_extendchans;
+
+static int
+_modinit(void)
+{
+	privid_extendchans = privilege_register("oper:extendchans");
+	return 0;
+}
+
+DECLARE_MODULE_AV2(extendchans, _modinit, NULL, extendchans_clist, NULL, NULL, NULL, NULL, extendchans_desc);
 
 static void
 mo_extendchans(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source_p, int parc, const char *parv[])
 {
 	struct Client *target_p;
 
-	if(!HasPrivilege(source_p, "oper:extendchans"))
+	if(!HasPrivilegeId(source_p, privid_extendchans))
 	{
 		sendto_one(source_p, form_str(ERR_NOPRIVS), me.name, source_p->name, "extendchans");
 		return;
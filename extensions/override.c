@@ -37,13 +37,15 @@ mapi_hfn_list_av1 override_hfnlist[] = {
 	{ "get_channel_access", (hookfn) hack_channel_access, HOOK_HIGHEST },
 	{ "can_join", (hookfn) hack_can_join, HOOK_HIGHEST },
 	{ "can_kick", (hookfn) hack_can_kick, HOOK_HIGHEST },
-	{ "can_send", (hookfn) hack_can_send, HOOK_HIGHEST },
+	{ "can_send", (hookfn) hack_can_send, HOOK_HIGHEST, { .umodes = &user_modes['p'] } },
 	{ "client_exit", (hookfn) handle_client_exit },
 	{ NULL, NULL }
 };
 
 #define CHFL_OVERRIDE		0x0004
-#define IsOperOverride(x)	(HasPrivilege((x), "oper:override"))
+#define IsOperOverride(x)	(HasPrivilegeId((x), privid_override))
+
+static int privid_override;
 
 struct OverrideSession {
 	rb_dlink_node node;
@@ -259,6 +261,8 @@ _modinit(void)
 {
 	rb_dlink_node *ptr;
 
+	privid_override = privilege_register("oper:override");
+
 	/* add the usermode to the available slot */
 	user_modes['p'] = find_umode_slot();
 	construct_umodebuf();
@@ -36,7 +36,7 @@ static const char umode_noctcp_desc[] =
 static void umode_noctcp_process(hook_data_privmsg_user *);
 
 mapi_hfn_list_av1 umode_noctcp_hfnlist[] = {
-	{ "privmsg_user", (hookfn) umode_noctcp_process },
+	{ "privmsg_user", (hookfn) umode_noctcp_process, HOOK_NORMAL, { .umodes = &user_modes['C'] } },
 	{ NULL, NULL }
 };
 
@@ -38,7 +38,7 @@
 struct Account {
 	char *name;
 	time_t creation_ts;
-	rb_dlink_list prop_list;
+	struct PropertySet prop_list;
 };
 
 extern rb_radixtree *account_dict;
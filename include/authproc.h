@@ -30,9 +30,14 @@
 #include "rb_dictionary.h"
 #include "client.h"
 
+/* Maximum number of authd processes, see serverinfo::authd_count */
+#define AUTHD_MAX_COUNT 32
+
 struct DNSBLEntryStats
 {
 	char *host;
+	char *reason;		/* kept for configuring a new or restarted authd */
+	char *filters;
 	uint8_t iptype;
 	unsigned int hits;
 };
@@ -58,7 +63,7 @@ enum
 	LISTEN_LAST,
 };
 
-extern rb_helper *authd_helper;
+extern rb_helper *authd_helper;	/* the first authd, also used for DNS */
 
 extern rb_dictionary *dnsbl_stats;
 extern rb_dlink_list opm_list;
@@ -69,6 +74,11 @@ void configure_authd(void);
 void restart_authd(void);
 void rehash_authd(void);
 void check_authd(void);
+int start_authd_instances(int count);
+int get_authd_count(void);
+unsigned int get_authd_restarts(void);
+void authd_foreach_info(void (*func)(void *data, int id, bool running, unsigned int pending), void *data);
+void authd_broadcast(const char *format, ...) AFP(1, 2);
 
 void authd_initiate_client(struct Client *, bool defer);
 void authd_deferred_client(struct Client *);
@@ -0,0 +1,33 @@
+/*
+ * bandb_snapshot.h: on-disk format of the ban snapshot written by bandb
+ *
+ * bandb answers a ban listing request by dumping every stored ban into a
+ * file next to the database and telling the ircd where it is.  The ircd
+ * maps the file and walks it alongside the previous snapshot, so only the
+ * bans that changed in between have to be touched.
+ *
+ * Layout, in host byte order since both ends run on the same machine:
+ *
+ *	struct bandb_snapshot_header
+ *	records for type 0, then type 1, ... in the order of bandb_type
+ *
+ * Each record is four uint16_t lengths (mask1, mask2, oper, reason)
+ * followed by the four strings, each NUL terminated.  Within a type the
+ * records are sorted by bytewise comparison of mask1, mask2, oper and
+ * reason, in that order.
+ */
+
+#ifndef INCLUDED_bandb_snapshot_h
+#define INCLUDED_bandb_snapshot_h
+
+#define BANDB_SNAPSHOT_MAGIC	"BANDBSN1"
+#define BANDB_SNAPSHOT_FIELDS	4
+#define BANDB_SNAPSHOT_TYPES	4	/* LAST_BANDB_TYPE */
+
+struct bandb_snapshot_header
+{
+	char magic[8];
+	uint32_t count[BANDB_SNAPSHOT_TYPES];
+};
+
+#endif
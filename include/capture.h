@@ -0,0 +1,71 @@
+/*
+ * include/capture.h
+ * Copyright (c) 2026 Ophion development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __OPHION_CAPTURE_H_GUARD
+#define __OPHION_CAPTURE_H_GUARD
+
+/*
+ * Traffic capture: while a capture is running, every chunk read from a
+ * local connection is appended to a file exactly as read_packet() got it,
+ * so tools/ircreplay can later feed the same bytes to a test server.
+ *
+ * The file starts with CAPTURE_MAGIC and the wall clock time the capture
+ * began as a 64 bit number of seconds.  Records follow, each one
+ *
+ *	uint8_t type, uint32_t connection, uint64_t microseconds, uint16_t length
+ *
+ * and then length bytes of data.  Connections are numbered from 1 in the
+ * order they were first seen and the time is counted from the start of the
+ * capture.  Connections that were open before the capture began are not
+ * recorded at all.  Every integer is big endian so captures can be moved between
+ * machines.
+ */
+
+#define CAPTURE_MAGIC		"OPHCAP01"
+#define CAPTURE_HEADER_LEN	16
+#define CAPTURE_RECORD_LEN	15
+
+enum capture_record
+{
+	CAPTURE_OPEN = 1,	/* connection seen for the first time, no data */
+	CAPTURE_DATA = 2,	/* bytes read from the connection */
+	CAPTURE_CLOSE = 3,	/* connection closed, no data */
+};
+
+struct Client;
+
+extern bool capture_active;
+
+extern int capture_start(const char *path, size_t limit);
+extern void capture_stop(void);
+extern void capture_status(size_t *written, size_t *limit, unsigned int *connections);
+extern void capture_data(struct Client *client_p, const char *buf, size_t len);
+extern void capture_close(struct Client *client_p);
+
+#endif
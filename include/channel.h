@@ -32,6 +32,7 @@
 #define MAXMODEPARAMSSERV 10
 
 #include <setup.h>
+#include "propertyset.h"
 
 struct Client;
 
@@ -59,6 +60,7 @@ struct Channel
 
 	rb_dlink_list members;	/* channel members */
 	rb_dlink_list locmembers;	/* local channel members */
+	uint64_t summary_bit;		/* bit in the members' channel summaries */
 
 	rb_dlink_list invites;
 	rb_dlink_list banlist;
@@ -81,8 +83,10 @@ struct Channel
 	unsigned int last_checked_type;
 	int last_checked_result;
 
-	rb_dlink_list prop_list;
+	struct PropertySet prop_list;
 	rb_dlink_list access_list;
+	struct AccessIndex *access_index;
+	unsigned int access_serial;	/* bumped on every access list change */
 };
 
 struct membership
@@ -96,6 +100,9 @@ struct membership
 	unsigned int flags;
 
 	time_t bants;
+
+	unsigned int access_serial;	/* chptr->access_serial when cached */
+	unsigned int access_flags;	/* cached access list level */
 };
 
 #define BANLEN 195
@@ -105,6 +112,7 @@ struct Ban
 	char *who;
 	time_t when;
 	char *forward;
+	struct match_prog *prog;	/* banstr compiled, NULL for extbans */
 	rb_dlink_node node;
 };
 
@@ -115,8 +123,10 @@ struct AccessEntry
 
 	time_t when;
 	unsigned int flags;
+	unsigned long seq;
 
 	rb_dlink_node node;
+	rb_dlink_node index_node;
 };
 
 struct mode_letter
@@ -238,6 +248,8 @@ extern int can_join(struct Client *source_p, struct Channel *chptr,
 		    const char *key, const char **forward);
 
 extern struct membership *find_channel_membership(struct Channel *, struct Client *);
+extern struct Channel *find_common_channel(struct Client *source_p, struct Client *target_p,
+					   unsigned int source_flags);
 extern const char *find_channel_status(struct membership *msptr, int combine);
 extern void add_user_to_channel(struct Channel *, struct Client *, int flags);
 extern void remove_user_from_channel(struct membership *);
@@ -40,5 +40,6 @@ extern struct AccessEntry *channel_access_find(struct Channel *chptr, const char
 extern void channel_access_delete(struct Channel *chptr, const char *mask);
 extern void channel_access_clear(struct Channel *chptr);
 extern struct AccessEntry *channel_access_match(struct Channel *chptr, struct Client *client_p);
+extern unsigned int channel_access_level(struct Channel *chptr, struct membership *msptr);
 
 #endif
@@ -73,6 +73,8 @@ typedef int SSL_OPEN_CB(struct Client *, int status);
 struct User
 {
 	rb_dlink_list channel;	/* chain of channel pointer blocks */
+	uint64_t channel_summary;	/* OR of summary_bit of the channels */
+	bool channel_summary_stale;	/* a channel was left since it was built */
 	rb_dlink_list invited;	/* chain of invite pointer blocks */
 	char *away;		/* pointer to away message */
 	int refcnt;		/* Number of times this block is referenced */
@@ -83,7 +85,7 @@ struct User
 	struct Account *account;
 	char suser[NICKLEN+1];
 
-	rb_dlink_list prop_list;	/* user property list */
+	struct PropertySet prop_list;	/* user property list */
 };
 
 struct Server
@@ -160,6 +162,18 @@ struct Client
 
 struct sasl_session;
 
+/* compression counters for a ziplinked server, refreshed from ssld */
+struct ZipStats
+{
+	unsigned long long in;
+	unsigned long long in_wire;
+	unsigned long long out;
+	unsigned long long out_wire;
+	unsigned long long ns;		/* time ssld spent in zlib */
+	double in_ratio;
+	double out_ratio;
+};
+
 struct LocalUser
 {
 	rb_dlink_node tnode;	/* This is the node for the local list type the client is on */
@@ -270,12 +284,17 @@ struct LocalUser
 
 	struct _ssl_ctl *ssl_ctl;		/* which ssl daemon we're associate with */
 	struct ws_ctl *ws_ctl;			/* ctl for wsockd */
+	struct _ssl_ctl *z_ctl;			/* ssld doing compression for this link */
+	uint32_t zconnid;			/* connid of the compressed stream */
+	struct ZipStats *zipstats;
 	SSL_OPEN_CB *ssl_callback;		/* ssl connection is now open */
 	uint32_t localflags;
 	uint16_t cork_count;			/* used for corking/uncorking connections */
 	struct ev_entry *event;			/* used for associated events */
 
 	struct sasl_session *sess;
+
+	uint32_t capture_id;			/* connection number in the running traffic capture */
 };
 
 #define AUTHC_F_DEFERRED 0x01
@@ -284,6 +303,7 @@ struct LocalUser
 struct AuthClient
 {
 	uint32_t cid;	/* authd id */
+	int instance;	/* authd process handling us */
 	time_t timeout;	/* When to terminate authd query */
 	bool accepted;	/* did authd accept us? */
 	char cause;	/* rejection cause */
@@ -30,6 +30,7 @@
 #include "authproc.h"
 
 extern rb_dlink_list nameservers;
+extern char dns_cache_stats[];
 
 typedef void (*DNSCB)(const char *res, int status, int aftype, void *data);
 typedef void (*DNSLISTCB)(int resc, const char *resv[], int status, void *data);
@@ -44,5 +45,6 @@ void dns_stats_results_callback(const char *callid, const char *status, int resc
 
 void init_dns(void);
 void reload_nameservers(void);
+void refresh_dns_cache_stats(void);
 
 #endif
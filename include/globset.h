@@ -0,0 +1,52 @@
+/*
+ * include/globset.h
+ * Copyright (c) 2026 Ophion development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __OPHION_GLOBSET_H_GUARD
+#define __OPHION_GLOBSET_H_GUARD
+
+/*
+ * A GlobSet holds a collection of match_esc() masks and finds the one
+ * matching a given string without trying every mask in turn.  Each mask is
+ * filed under one three-character run of literal text it contains; a lookup
+ * only verifies the masks filed under trigrams that occur in the string,
+ * plus the few masks with no such run at all.
+ *
+ * When several masks match, the one added most recently wins, which is the
+ * order callers walking an rb_dlink_list filled by rb_dlinkAddAlloc() see.
+ */
+struct GlobSet;
+
+extern struct GlobSet *globset_create(const char *name);
+extern void globset_add(struct GlobSet *set, const char *mask, void *data);
+extern void globset_delete(struct GlobSet *set, const char *mask, void *data);
+extern void *globset_match(struct GlobSet *set, const char *name);
+extern void *globset_find_mask(struct GlobSet *set, const char *mask);
+extern unsigned int globset_count(const struct GlobSet *set);
+
+#endif
@@ -5,11 +5,6 @@
 #ifndef INCLUDED_HOOK_H
 #define INCLUDED_HOOK_H
 
-typedef struct
-{
-	char *name;
-	rb_dlink_list hooks;
-} hook;
 
 enum hook_priority
 {
@@ -23,6 +18,40 @@ enum hook_priority
 
 typedef void (*hookfn) (void *data);
 
+/* Conditions a hook function can be registered with, so the dispatcher
+ * can skip it without calling it.  Each points at the variable holding
+ * the bits, as capabilities and modes are only allocated when the module
+ * providing them loads.  A NULL pointer or no bits means no condition.
+ */
+struct hook_filter
+{
+	const unsigned int *caps;	/* any of these client caps */
+	const int *umodes;		/* any of these umodes */
+	const unsigned int *chmodes;	/* any of these channel modes */
+};
+
+/* one entry of a hook's compiled call list */
+struct hook_call
+{
+	hookfn fn;
+	struct hook_filter filter;
+};
+
+typedef struct
+{
+	char *name;
+	rb_dlink_list hooks;
+	struct hook_call *calls;	/* hooks in priority order, see compile_hook() */
+	int ncalls;
+	bool filtered;			/* some entry has a condition */
+	struct rb_histogram *profile;
+} hook;
+
+#define HOOK_ANY	(~0U)	/* caller doesn't know, don't filter on it */
+
+extern hook *hooks;
+extern int num_hooks;
+
 extern int h_iosend_id;
 extern int h_iorecv_id;
 extern int h_iorecvctrl_id;
@@ -50,8 +79,32 @@ void init_hook(void);
 int register_hook(const char *name);
 void add_hook(const char *name, hookfn fn);
 void add_hook_prio(const char *name, hookfn fn, enum hook_priority priority);
+void add_hook_filter(const char *name, hookfn fn, enum hook_priority priority, const struct hook_filter *filter);
 void remove_hook(const char *name, hookfn fn);
-void call_hook(int id, void *arg);
+void run_hook(int id, void *arg, unsigned int caps, unsigned int umodes, unsigned int chmodes);
+
+/* call_hook()
+ *   Calls every function hooked to the event.  A hook nobody uses costs
+ *   only the check here.
+ */
+static inline void
+call_hook(int id, void *arg)
+{
+	if(hooks[id].ncalls != 0)
+		run_hook(id, arg, HOOK_ANY, HOOK_ANY, HOOK_ANY);
+}
+
+/* call_hook_filtered()
+ *   As call_hook(), but functions registered with a condition are only
+ *   called if it matches the client caps, umodes and channel modes the
+ *   event is about.
+ */
+static inline void
+call_hook_filtered(int id, void *arg, unsigned int caps, unsigned int umodes, unsigned int chmodes)
+{
+	if(hooks[id].ncalls != 0)
+		run_hook(id, arg, caps, umodes, chmodes);
+}
 
 typedef struct
 {
@@ -101,7 +154,7 @@ typedef struct
 {
 	const struct Client *client;
 	int alevel;			// for client props, 1 if client == source_p
-	const rb_dlink_list *prop_list;
+	const struct PropertySet *prop_list;
 	const char *target;
 	const char *key;
 	const char *value;
@@ -99,6 +99,10 @@ struct AddressRec
 	const char *auth_user;
 	struct ConfItem *aconf;
 
+	/* username and hostname compiled by match_compile(), or NULL */
+	struct match_prog *username_prog;
+	struct match_prog *hostname_prog;
+
 	/* The next record in this hash bucket. */
 	struct AddressRec *next;
 };
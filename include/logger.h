@@ -62,5 +62,7 @@ extern void ierror(const char *fmt, ...) AFP(1, 2);
 extern void report_operspy(struct Client *, const char *, const char *);
 extern const char *smalldate(time_t);
 extern void ilog_error(const char *);
+extern unsigned long ilog_dropped(void);
+extern int write_json_string(FILE *, const char *);
 
 #endif
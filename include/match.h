@@ -43,6 +43,18 @@ extern int match_esc(const char *mask, const char *name);
 extern int match_cidr(const char *mask, const char *name);
 extern int match_ips(const char *mask, const char *name);
 
+/*
+ * match_compile - compile a mask for match_compiled(), for masks checked
+ *                 against many names
+ * match_compiled - same result as match(), with a compiled mask
+ * match_folded - match_compiled() on a name already folded with irctolower()
+ */
+struct match_prog;
+extern struct match_prog *match_compile(const char *mask);
+extern void match_free(struct match_prog *prog);
+extern int match_compiled(const struct match_prog *prog, const char *name);
+extern int match_folded(const struct match_prog *prog, const char *name, size_t len);
+
 /*
  * comp_with_mask - compares to IP address
  */
@@ -62,6 +74,12 @@ extern char *collapse_esc(char *pattern);
 struct matchset {
 	char host[2][NAMELEN + USERLEN + HOSTLEN + 6];
 	char ip[2][NAMELEN + USERLEN + HOSTIPLEN + 6];
+
+	/* the same, folded for match_folded() */
+	char host_fold[2][NAMELEN + USERLEN + HOSTLEN + 6];
+	char ip_fold[2][NAMELEN + USERLEN + HOSTIPLEN + 6];
+	size_t host_len[2];
+	size_t ip_len[2];
 };
 
 struct Client;
@@ -69,6 +87,7 @@ struct Client;
 void matchset_for_client(struct Client *who, struct matchset *m);
 bool client_matches_mask(struct Client *who, const char *mask);
 bool matches_mask(const struct matchset *m, const char *mask);
+bool matches_mask_compiled(const struct matchset *m, const char *mask, const struct match_prog *prog);
 
 /*
  * irccmp - case insensitive comparison of s1 and s2
@@ -72,6 +72,7 @@ typedef struct
 	const char *hapi_name;
 	hookfn fn;
 	enum hook_priority priority;
+	struct hook_filter filter;	/* only called when this matches, see add_hook_filter() */
 } mapi_hfn_list_av1;
 
 #define MAPI_CAP_CLIENT		1
@@ -134,6 +135,9 @@ void mod_clear_paths(void);
 extern void mod_remember_clicaps(void);
 extern void mod_notify_clicaps(void);
 
+/* finish a MODRESTART after its rehash */
+extern void modules_restart_done(void);
+
 /* load a module */
 extern void load_module(char *path);
 
@@ -70,6 +70,8 @@ struct Message
 	 * UNREGISTERED, CLIENT, RCLIENT, SERVER, ENCAP, OPER
 	 */
 	struct MessageEntry handlers[LAST_HANDLER_TYPE];
+
+	struct rb_histogram *profile;	/* set by mod_add_cmd() */
 };
 
 /* generic handlers */
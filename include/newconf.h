@@ -58,6 +58,8 @@ typedef struct conf_parm_t_stru
 }
 conf_parm_t;
 
+struct conf_parse;
+
 extern struct TopConf *conf_cur_block;
 
 extern char *current_file;
@@ -68,6 +70,17 @@ int conf_end_block(struct TopConf *);
 int conf_call_set(struct TopConf *, char *, conf_parm_t *);
 void conf_report_error(const char *, ...);
 void conf_report_warning(const char *, ...);
+void conf_report_syntax_error(const char *msg, const char *context);
+
+struct conf_parse *conf_parse_file(FILE *, const char *filename);
+void conf_parse_apply(struct conf_parse *);
+void conf_parse_free(struct conf_parse *);
+void conf_parse_fail(struct conf_parse *, const char *what, int err);
+const char *conf_parse_failure(struct conf_parse *, int *err);
+void conf_parse_block_start(const char *block, const char *label);
+void conf_parse_block_end(void);
+void conf_parse_set(const char *item, conf_parm_t *value);
+void conf_parse_loadmodule(const char *path);
 void newconf_init(void);
 int add_conf_item(const char *topconf, const char *name, int type, void (*func) (void *));
 int remove_conf_item(const char *topconf, const char *name);
@@ -31,15 +31,66 @@ enum {
 };
 typedef unsigned int PrivilegeFlags;
 
+/*
+ * Privilege names are interned into a table and each gets a bit slot; a
+ * privset carries a bitmap of the slots it grants.  The core privileges
+ * below have fixed slots, anything else (module privileges, or names only
+ * mentioned in ircd.conf) is given the next free slot when first seen.
+ *
+ * A module should privilege_register() the privileges it checks when it
+ * loads, and test the slot with HasPrivilegeId(); HasPrivilege() looks the
+ * name up on every call.
+ */
+enum {
+	PRIVID_AUSPEX_CMODES,
+	PRIVID_AUSPEX_HOSTNAME,
+	PRIVID_AUSPEX_OPER,
+	PRIVID_AUSPEX_UMODES,
+	PRIVID_OPER_ADMIN,
+	PRIVID_OPER_CMODES,
+	PRIVID_OPER_DIE,
+	PRIVID_OPER_GENERAL,
+	PRIVID_OPER_GLOBAL_KILL,
+	PRIVID_OPER_GRANT,
+	PRIVID_OPER_HIDDEN,
+	PRIVID_OPER_HIDDEN_ADMIN,
+	PRIVID_OPER_KLINE,
+	PRIVID_OPER_LOCAL_KILL,
+	PRIVID_OPER_MASS_NOTICE,
+	PRIVID_OPER_OPERWALL,
+	PRIVID_OPER_PRIVS,
+	PRIVID_OPER_REHASH,
+	PRIVID_OPER_REMOTEBAN,
+	PRIVID_OPER_RESV,
+	PRIVID_OPER_ROUTING,
+	PRIVID_OPER_SPY,
+	PRIVID_OPER_TESTLINE,
+	PRIVID_OPER_UNKLINE,
+	PRIVID_OPER_XLINE,
+	PRIVID_SNOMASK_NICK_CHANGES,
+	PRIVID_USERMODE_SERVNOTICE,
+	PRIVID_CORE_COUNT
+};
+
+#define PRIVID_MAX		256
+#define PRIVID_WORDS		(PRIVID_MAX / 32)
+
 struct PrivilegeSet {
 	unsigned int status;	/* If CONF_ILLEGAL, delete when no refs */
 	int refs;
 	char *name;
 	char *privs;
+	uint32_t privbits[PRIVID_WORDS];
 	PrivilegeFlags flags;
 	rb_dlink_node node;
 };
 
+#define privilegeset_has(set, id)	(((set)->privbits[(id) / 32] & (1U << ((id) % 32))) != 0)
+
+void init_privileges(void);
+int privilege_register(const char *priv);
+int privilege_find(const char *priv);
+
 int privilegeset_in_set(struct PrivilegeSet *set, const char *priv);
 struct PrivilegeSet *privilegeset_set_new(const char *name, const char *privs, PrivilegeFlags flags);
 struct PrivilegeSet *privilegeset_extend(struct PrivilegeSet *parent, const char *name, const char *privs, PrivilegeFlags flags);
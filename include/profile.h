@@ -0,0 +1,57 @@
+/*
+ * include/profile.h
+ * Copyright (c) 2026 Ophion development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __OPHION_PROFILE_H_GUARD
+#define __OPHION_PROFILE_H_GUARD
+
+/*
+ * Optional latency accounting for command handlers, hook chains, librb
+ * events and the event loop itself.  It is off by default; while off, the
+ * hot paths only test profile_enabled.  Samples are taken with the
+ * monotonic clock and kept in rb_histogram buckets.  Command histograms
+ * are keyed by command name and outlive the module providing the command,
+ * so reloading a module keeps its numbers.
+ */
+
+struct Client;
+
+extern bool profile_enabled;
+
+extern void init_profile(void);
+extern void profile_set(bool enabled);
+extern void profile_clear(void);
+extern time_t profile_since(void);
+
+extern struct rb_histogram *profile_command(const char *cmd);
+
+typedef void (*profile_walk_cb)(const char *kind, const char *name, const struct rb_histogram *, void *);
+extern void profile_walk(profile_walk_cb, void *);
+extern int profile_dump(const char *path);
+
+#endif
@@ -31,18 +31,34 @@
 #define __OPHION_PROPERTYSET_H_GUARD
 
 #include "ircd_defs.h"
-#include "client.h"
 #include "setup.h"
 
+struct Client;
+
+/*
+ * A property and its strings live in a single allocation; name, value and
+ * setter point into the space following the struct.
+ */
 struct Property {
 	char *name;
 	char *value;
 	time_t set_at;
 	char *setter;
+};
 
-	rb_dlink_node prop_node;
+/*
+ * Properties of one entity, kept as a vector sorted case-insensitively by
+ * name.  A zeroed PropertySet is a valid empty set.
+ */
+struct PropertySet {
+	struct Property **props;
+	unsigned int count;
+	unsigned int alloc;
 };
 
+#define PROPERTYSET_FOREACH(prop, i, set) \
+	for ((i) = 0; (i) < (set)->count && (((prop) = (set)->props[(i)]), 1); (i)++)
+
 enum PropMatchRequest {
 	PROP_EXISTS,
 	PROP_READ,
@@ -53,7 +69,7 @@ struct PropMatch {
 	const char *target_name;
 	const char *key;
 	void *target;
-	rb_dlink_list *prop_list;
+	struct PropertySet *prop_list;
 	enum PropMatchRequest match_request;
 	enum PropMatchRequest match_grant;
 	bool redistribute;
@@ -63,9 +79,15 @@ struct PropMatch {
 	time_t update_ts;
 };
 
-struct Property *propertyset_add(rb_dlink_list *prop_list, const char *name, const char *value, struct Client *setter_p);
-void propertyset_delete(rb_dlink_list *prop_list, const char *name);
-struct Property *propertyset_find(const rb_dlink_list *prop_list, const char *name);
-void propertyset_clear(rb_dlink_list *prop_list);
+struct Property *propertyset_add(struct PropertySet *prop_list, const char *name, const char *value, struct Client *setter_p);
+void propertyset_delete(struct PropertySet *prop_list, const char *name);
+struct Property *propertyset_find(const struct PropertySet *prop_list, const char *name);
+void propertyset_clear(struct PropertySet *prop_list);
+
+static inline unsigned int
+propertyset_count(const struct PropertySet *prop_list)
+{
+	return prop_list->count;
+}
 
 #endif
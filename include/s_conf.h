@@ -165,6 +165,7 @@ struct config_file_entry
 	char *fname_klinelog;
 	char *fname_operspylog;
 	char *fname_ioerrorlog;
+	int log_json;
 
 	int disable_fake_channels;
 	int dots_in_ident;
@@ -241,6 +242,7 @@ struct config_file_entry
 
 	unsigned int nicklen;
 	int certfp_method;
+	int compression_level;
 
 	int hide_opers_in_whois;
 	int hide_opers;
@@ -302,7 +304,12 @@ struct server_info
 	char *ssl_cipher_list;
 	int ssld_count;
 	int wsockd_count;
+	int authd_count;
 	bool ssl_client_cert;
+	bool wsockd_deflate;
+	bool wsockd_deflate_context_takeover;
+	int wsockd_deflate_memory;
+	bool helper_ring;
 };
 
 struct admin_info
@@ -390,7 +397,7 @@ extern void add_temp_dline(struct ConfItem *);
 extern void report_temp_klines(struct Client *);
 extern void show_temp_klines(struct Client *, rb_dlink_list *);
 
-extern bool rehash(bool);
+extern bool rehash(bool, struct Client *);
 extern void rehash_bans(void);
 
 extern int conf_add_server(struct ConfItem *, int);
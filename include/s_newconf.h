@@ -148,27 +148,29 @@ extern void cluster_generic(struct Client *, const char *, int cltype,
 
 #define HasPrivilege(x, y)	((x)->user != NULL && (x)->user->privset != NULL && privilegeset_in_set((x)->user->privset, (y)))
 #define MayHavePrivilege(x, y)	(HasPrivilege((x), (y)) || (IsOper((x)) && (x)->user != NULL && (x)->user->privset == NULL))
-
-#define IsOperGlobalKill(x)     (HasPrivilege((x), "oper:global_kill"))
-#define IsOperLocalKill(x)      (HasPrivilege((x), "oper:local_kill"))
-#define IsOperRemote(x)         (HasPrivilege((x), "oper:routing"))
-#define IsOperUnkline(x)        (HasPrivilege((x), "oper:unkline"))
-#define IsOperN(x)              (HasPrivilege((x), "snomask:nick_changes"))
-#define IsOperK(x)              (HasPrivilege((x), "oper:kline"))
-#define IsOperXline(x)          (HasPrivilege((x), "oper:xline"))
-#define IsOperResv(x)           (HasPrivilege((x), "oper:resv"))
-#define IsOperDie(x)            (HasPrivilege((x), "oper:die"))
-#define IsOperRehash(x)         (HasPrivilege((x), "oper:rehash"))
-#define IsOperHiddenAdmin(x)    (HasPrivilege((x), "oper:hidden_admin"))
-#define IsOperAdmin(x)          (HasPrivilege((x), "oper:admin") || HasPrivilege((x), "oper:hidden_admin"))
-#define IsOperOperwall(x)       (HasPrivilege((x), "oper:operwall"))
-#define IsOperSpy(x)            (HasPrivilege((x), "oper:spy"))
-#define IsOperInvis(x)          (HasPrivilege((x), "oper:hidden"))
-#define IsOperRemoteBan(x)	(HasPrivilege((x), "oper:remoteban"))
-#define IsOperMassNotice(x)	(HasPrivilege((x), "oper:mass_notice"))
-#define IsOperGeneral(x)	(MayHavePrivilege((x), "oper:general"))
-
-#define SeesOper(target, source)	(IsOper((target)) && ((!ConfigFileEntry.hide_opers && !HasPrivilege((target), "oper:hidden")) || HasPrivilege((source), "auspex:oper")))
+#define HasPrivilegeId(x, y)	((y) >= 0 && (x)->user != NULL && (x)->user->privset != NULL && privilegeset_has((x)->user->privset, (y)))
+#define MayHavePrivilegeId(x, y)	(HasPrivilegeId((x), (y)) || (IsOper((x)) && (x)->user != NULL && (x)->user->privset == NULL))
+
+#define IsOperGlobalKill(x)     (HasPrivilegeId((x), PRIVID_OPER_GLOBAL_KILL))
+#define IsOperLocalKill(x)      (HasPrivilegeId((x), PRIVID_OPER_LOCAL_KILL))
+#define IsOperRemote(x)         (HasPrivilegeId((x), PRIVID_OPER_ROUTING))
+#define IsOperUnkline(x)        (HasPrivilegeId((x), PRIVID_OPER_UNKLINE))
+#define IsOperN(x)              (HasPrivilegeId((x), PRIVID_SNOMASK_NICK_CHANGES))
+#define IsOperK(x)              (HasPrivilegeId((x), PRIVID_OPER_KLINE))
+#define IsOperXline(x)          (HasPrivilegeId((x), PRIVID_OPER_XLINE))
+#define IsOperResv(x)           (HasPrivilegeId((x), PRIVID_OPER_RESV))
+#define IsOperDie(x)            (HasPrivilegeId((x), PRIVID_OPER_DIE))
+#define IsOperRehash(x)         (HasPrivilegeId((x), PRIVID_OPER_REHASH))
+#define IsOperHiddenAdmin(x)    (HasPrivilegeId((x), PRIVID_OPER_HIDDEN_ADMIN))
+#define IsOperAdmin(x)          (HasPrivilegeId((x), PRIVID_OPER_ADMIN) || HasPrivilegeId((x), PRIVID_OPER_HIDDEN_ADMIN))
+#define IsOperOperwall(x)       (HasPrivilegeId((x), PRIVID_OPER_OPERWALL))
+#define IsOperSpy(x)            (HasPrivilegeId((x), PRIVID_OPER_SPY))
+#define IsOperInvis(x)          (HasPrivilegeId((x), PRIVID_OPER_HIDDEN))
+#define IsOperRemoteBan(x)	(HasPrivilegeId((x), PRIVID_OPER_REMOTEBAN))
+#define IsOperMassNotice(x)	(HasPrivilegeId((x), PRIVID_OPER_MASS_NOTICE))
+#define IsOperGeneral(x)	(MayHavePrivilegeId((x), PRIVID_OPER_GENERAL))
+
+#define SeesOper(target, source)	(IsOper((target)) && ((!ConfigFileEntry.hide_opers && !HasPrivilegeId((target), PRIVID_OPER_HIDDEN)) || HasPrivilegeId((source), PRIVID_AUSPEX_OPER)))
 
 extern struct oper_conf *make_oper_conf(void);
 extern void free_oper_conf(struct oper_conf *);
@@ -239,6 +241,11 @@ extern void set_server_conf_autoconn(struct Client *source_p, const char *name,
 extern void disable_server_conf_autoconn(const char *name);
 
 
+extern void add_xline_conf(struct ConfItem *);
+extern void remove_xline_conf(rb_dlink_node *);
+extern void add_nick_resv_conf(struct ConfItem *);
+extern void remove_nick_resv_conf(rb_dlink_node *);
+
 extern struct ConfItem *find_xline(const char *, int);
 extern struct ConfItem *find_xline_mask(const char *);
 extern struct ConfItem *find_nick_resv(const char *name);
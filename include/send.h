@@ -69,6 +69,12 @@ extern void sendto_channel_local_with_capability_butone(struct Client *, int typ
 extern void sendto_common_channels_local(struct Client *, int cap, int negcap, const char *, ...) AFP(4, 5);
 extern void sendto_common_channels_local_butone(struct Client *, int cap, int negcap, const char *, ...) AFP(4, 5);
 
+extern bool send_batch_begin(const char *type, const char *params);
+extern void send_batch_end(void);
+extern void send_batch_close(void);
+extern const char *send_batch_type(void);
+extern void send_batch_remove(struct Client *);
+
 
 extern void sendto_match_butone(struct Client *, struct Client *,
 				const char *, int, const char *, ...) AFP(5, 6);
@@ -35,6 +35,7 @@ void init_ssld(void);
 void restart_ssld(void);
 int start_ssldaemon(int count);
 ssl_ctl_t *start_ssld_accept(rb_fde_t *sslF, rb_fde_t *plainF, uint32_t id);
+ssl_ctl_t *start_ssld_accept_ring(rb_fde_t *sslF, rb_fde_t **plainF, uint32_t id);
 ssl_ctl_t *start_ssld_connect(rb_fde_t *sslF, rb_fde_t *plainF, uint32_t id);
 void start_zlib_session(void *data);
 void ssld_update_config(void);
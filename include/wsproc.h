@@ -32,13 +32,26 @@ enum wsockd_status {
 	WSOCKD_DEAD,
 };
 
+/* permessage-deflate totals, as last reported by a wsockd */
+struct wsockd_deflate_stats {
+	uint64_t negotiated;		/* connections that got compression */
+	uint64_t refused;		/* offers turned down by the memory cap */
+	size_t memory;			/* zlib memory in use, estimated */
+	uint64_t deflate_in, deflate_out;
+	uint64_t inflate_in, inflate_out;
+	uint64_t ns;			/* time spent compressing and inflating */
+};
+
 void init_wsockd(void);
 void restart_wsockd(void);
 int start_wsockd(int count);
 ws_ctl_t *start_wsockd_accept(rb_fde_t *wsF, rb_fde_t *plainF, uint32_t id);
+ws_ctl_t *start_wsockd_accept_ring(rb_fde_t *wsF, rb_fde_t **plainF, uint32_t id);
 void wsockd_decrement_clicount(ws_ctl_t *ctl);
 int get_wsockd_count(void);
-void wsockd_foreach_info(void (*func)(void *data, pid_t pid, int cli_count, enum wsockd_status status), void *data);
+void wsockd_update_config(void);
+void wsockd_foreach_info(void (*func)(void *data, pid_t pid, int cli_count, enum wsockd_status status,
+			 const struct wsockd_deflate_stats *deflate), void *data);
 
 #endif
 
@@ -48,10 +48,38 @@ struct authd_cb
 	int min_parc;
 };
 
-static int start_authd(void);
+/* One running authd process.  Clients are spread across these by cid. */
+struct authd_instance
+{
+	rb_helper *helper;
+	int id;
+	unsigned int restarts;
+};
+
+/* Client ids handed to authd index a flat table of pending clients.  The low
+ * AUTHD_CID_SLOT_BITS bits select the slot; the rest is a generation count
+ * bumped each time the slot is reused, so a late reply for a recycled slot
+ * does not find its new occupant.
+ */
+#define AUTHD_CID_SLOT_BITS	20
+#define AUTHD_CID_SLOT_MASK	((1U << AUTHD_CID_SLOT_BITS) - 1)
+#define AUTHD_CID_GEN_MASK	((1U << (32 - AUTHD_CID_SLOT_BITS)) - 1)
+#define AUTHD_CID_MIN_SLOTS	256
+
+struct authd_slot
+{
+	struct Client *client;
+	uint32_t cid;		/* cid of the current occupant, 0 if free */
+	uint32_t generation;
+	uint32_t next_free;	/* index + 1 of the next free slot, 0 ends the list */
+};
+
+static int start_authd(struct authd_instance *);
 static void parse_authd_reply(rb_helper * helper);
 static void restart_authd_cb(rb_helper * helper);
+static void configure_authd_instance(struct authd_instance *);
 static EVH timeout_dead_authd_clients;
+static inline void authd_read_client(struct Client *client_p);
 
 static void cmd_accept_client(int parc, char **parv);
 static void cmd_reject_client(int parc, char **parv);
@@ -63,8 +91,15 @@ static void cmd_stats_results(int parc, char **parv);
 rb_helper *authd_helper;
 static char *authd_path;
 
-uint32_t cid;
-static rb_dictionary *cid_clients;
+static struct authd_instance authd_instances[AUTHD_MAX_COUNT];
+static int authd_count;
+static bool authd_configured;
+static unsigned int authd_restarts;
+
+static struct authd_slot *cid_slots;
+static uint32_t cid_slots_size;		/* allocated */
+static uint32_t cid_slots_used;		/* high-water mark */
+static uint32_t cid_free_head;		/* index + 1 of the first free slot */
 static struct ev_entry *timeout_ev;
 
 rb_dictionary *dnsbl_stats;
@@ -72,6 +107,23 @@ rb_dictionary *dnsbl_stats;
 rb_dlink_list opm_list;
 struct OPMListener opm_listeners[LISTEN_LAST];
 
+/* Everything sent to authd as options is also kept here, so that a new or
+ * restarted authd can be brought up to date.
+ */
+static struct
+{
+	const char *key;
+	int value;
+} authd_timeouts[] = {
+	{ "ident_timeout", 0 },
+	{ "rdns_timeout", 0 },
+	{ "rbl_timeout", 0 },
+	{ "opm_timeout", 0 },
+};
+
+static bool ident_enabled;
+static bool opm_enabled;
+
 static struct authd_cb authd_cmd_tab[256] =
 {
 	['A'] = { cmd_accept_client,	4 },
@@ -85,7 +137,7 @@ static struct authd_cb authd_cmd_tab[256] =
 };
 
 static int
-start_authd(void)
+start_authd(struct authd_instance *inst)
 {
 	char fullpath[PATH_MAX + 1];
 #ifdef _WIN32
@@ -116,27 +168,232 @@ start_authd(void)
 		authd_path = rb_strdup(fullpath);
 	}
 
-	if(cid_clients == NULL)
-		cid_clients = rb_dictionary_create("authd cid to uid mapping", rb_uint32cmp);
-
 	if(timeout_ev == NULL)
 		timeout_ev = rb_event_addish("timeout_dead_authd_clients", timeout_dead_authd_clients, NULL, 1);
 
-	authd_helper = rb_helper_start("authd", authd_path, parse_authd_reply, restart_authd_cb);
+	inst->helper = rb_helper_start("authd", authd_path, parse_authd_reply, restart_authd_cb);
+	if(inst->id == 0)
+		authd_helper = inst->helper;
 
-	if(authd_helper == NULL)
+	if(inst->helper == NULL)
 	{
 		ierror("Unable to start authd helper: %s", strerror(errno));
 		sendto_realops_snomask(SNO_GENERAL, L_ALL, "Unable to start authd helper: %s", strerror(errno));
 		return 1;
 	}
 
-	ilog(L_MAIN, "authd helper started");
-	sendto_realops_snomask(SNO_GENERAL, L_ALL, "authd helper started");
-	rb_helper_run(authd_helper);
+	ilog(L_MAIN, "authd helper %d started", inst->id);
+	sendto_realops_snomask(SNO_GENERAL, L_ALL, "authd helper %d started", inst->id);
+	rb_helper_run(inst->helper);
+
+	if(authd_configured)
+		configure_authd_instance(inst);
+
 	return 0;
 }
 
+/*
+ * start_authd_instances
+ *
+ * inputs	- number of additional authd processes to start
+ * output	- number actually started
+ * side effects	- new authd processes are spawned and configured
+ */
+int
+start_authd_instances(int count)
+{
+	int started = 0;
+
+	while(count-- > 0 && authd_count < AUTHD_MAX_COUNT)
+	{
+		struct authd_instance *inst = &authd_instances[authd_count];
+
+		inst->id = authd_count;
+		if(start_authd(inst))
+			break;
+
+		authd_count++;
+		started++;
+	}
+
+	return started;
+}
+
+int
+get_authd_count(void)
+{
+	return authd_count;
+}
+
+unsigned int
+get_authd_restarts(void)
+{
+	return authd_restarts;
+}
+
+void
+authd_foreach_info(void (*func)(void *data, int id, bool running, unsigned int pending), void *data)
+{
+	for(int i = 0; i < authd_count; i++)
+	{
+		struct authd_instance *inst = &authd_instances[i];
+		unsigned int pending = 0;
+
+		for(uint32_t j = 0; j < cid_slots_used; j++)
+		{
+			struct Client *client_p = cid_slots[j].client;
+
+			if(client_p != NULL && client_p->preClient->auth.instance == inst->id)
+				pending++;
+		}
+
+		func(data, inst->id, inst->helper != NULL, pending);
+	}
+}
+
+static struct authd_instance *
+find_authd_instance(rb_helper *helper)
+{
+	for(int i = 0; i < authd_count; i++)
+	{
+		if(authd_instances[i].helper == helper)
+			return &authd_instances[i];
+	}
+
+	return NULL;
+}
+
+/* Pick the authd process for a client.  OPM scans need their replies to come
+ * back to the process that owns the listener, so with OPM enabled everything
+ * goes to the first one.
+ */
+static struct authd_instance *
+authd_instance_for_cid(uint32_t ncid)
+{
+	struct authd_instance *inst = &authd_instances[0];
+
+	if(!opm_enabled && authd_count > 1)
+		inst = &authd_instances[(ncid & AUTHD_CID_SLOT_MASK) % authd_count];
+
+	if(inst->helper == NULL)
+		inst = &authd_instances[0];
+
+	return inst;
+}
+
+/* Write a line to every running authd */
+void
+authd_broadcast(const char *format, ...)
+{
+	char buf[BUFSIZE];
+	va_list args;
+
+	va_start(args, format);
+	vsnprintf(buf, sizeof(buf), format, args);
+	va_end(args);
+
+	for(int i = 0; i < authd_count; i++)
+	{
+		if(authd_instances[i].helper != NULL)
+			rb_helper_write(authd_instances[i].helper, "%s", buf);
+	}
+}
+
+/* Options sent before configure_authd() has run are only recorded; it
+ * replays the lot once the config has been read.
+ */
+static void
+authd_send_option(const char *format, ...)
+{
+	char buf[BUFSIZE];
+	va_list args;
+
+	if(!authd_configured)
+		return;
+
+	va_start(args, format);
+	vsnprintf(buf, sizeof(buf), format, args);
+	va_end(args);
+
+	authd_broadcast("%s", buf);
+}
+
+/* OPM options only go to the first authd, see authd_instance_for_cid() */
+static void
+authd_send_opm_option(const char *format, ...)
+{
+	char buf[BUFSIZE];
+	va_list args;
+
+	if(!authd_configured || authd_helper == NULL)
+		return;
+
+	va_start(args, format);
+	vsnprintf(buf, sizeof(buf), format, args);
+	va_end(args);
+
+	rb_helper_write(authd_helper, "%s", buf);
+}
+
+static uint32_t
+alloc_cid(struct Client *client_p)
+{
+	struct authd_slot *slot;
+	uint32_t idx;
+
+	if(cid_free_head != 0)
+	{
+		idx = cid_free_head - 1;
+		cid_free_head = cid_slots[idx].next_free;
+	}
+	else
+	{
+		if(cid_slots_used == cid_slots_size)
+		{
+			uint32_t newsize = cid_slots_size ? cid_slots_size * 2 : AUTHD_CID_MIN_SLOTS;
+
+			if(newsize > AUTHD_CID_SLOT_MASK + 1)
+				newsize = AUTHD_CID_SLOT_MASK + 1;
+
+			if(newsize == cid_slots_size)
+				return 0;
+
+			cid_slots = rb_realloc(cid_slots, newsize * sizeof(struct authd_slot));
+			memset(&cid_slots[cid_slots_size], 0, (newsize - cid_slots_size) * sizeof(struct authd_slot));
+			cid_slots_size = newsize;
+		}
+
+		idx = cid_slots_used++;
+	}
+
+	slot = &cid_slots[idx];
+
+	/* generation 0 is skipped so that no cid is ever 0 */
+	slot->generation = (slot->generation + 1) & AUTHD_CID_GEN_MASK;
+	if(slot->generation == 0)
+		slot->generation = 1;
+
+	slot->client = client_p;
+	slot->cid = (slot->generation << AUTHD_CID_SLOT_BITS) | idx;
+	slot->next_free = 0;
+
+	return slot->cid;
+}
+
+static void
+free_cid(uint32_t ncid)
+{
+	uint32_t idx = ncid & AUTHD_CID_SLOT_MASK;
+
+	if(idx >= cid_slots_used || cid_slots[idx].cid != ncid)
+		return;
+
+	cid_slots[idx].client = NULL;
+	cid_slots[idx].cid = 0;
+	cid_slots[idx].next_free = cid_free_head;
+	cid_free_head = idx + 1;
+}
+
 static inline uint32_t
 str_to_cid(const char *str)
 {
@@ -153,30 +410,27 @@ str_to_cid(const char *str)
 }
 
 static inline struct Client *
-cid_to_client(uint32_t ncid, bool del)
+cid_to_client(uint32_t ncid)
 {
-	struct Client *client_p;
-
-	if(del)
-		client_p = rb_dictionary_delete(cid_clients, RB_UINT_TO_POINTER(ncid));
-	else
-		client_p = rb_dictionary_retrieve(cid_clients, RB_UINT_TO_POINTER(ncid));
+	uint32_t idx = ncid & AUTHD_CID_SLOT_MASK;
 
 	/* If the client's not found, that's okay, it may have already gone away.
 	 * --Elizafox */
+	if(idx >= cid_slots_used || cid_slots[idx].cid != ncid)
+		return NULL;
 
-	return client_p;
+	return cid_slots[idx].client;
 }
 
 static inline struct Client *
-str_cid_to_client(const char *str, bool del)
+str_cid_to_client(const char *str)
 {
 	uint32_t ncid = str_to_cid(str);
 
 	if(ncid == 0)
 		return NULL;
 
-	return cid_to_client(ncid, del);
+	return cid_to_client(ncid);
 }
 
 static void
@@ -184,8 +438,7 @@ cmd_accept_client(int parc, char **parv)
 {
 	struct Client *client_p;
 
-	/* cid to uid (retrieve and delete) */
-	if((client_p = str_cid_to_client(parv[1], true)) == NULL)
+	if((client_p = str_cid_to_client(parv[1])) == NULL)
 		return;
 
 	authd_accept_client(client_p, parv[2], parv[3]);
@@ -202,7 +455,7 @@ cmd_notice_client(int parc, char **parv)
 {
 	struct Client *client_p;
 
-	if((client_p = str_cid_to_client(parv[1], false)) == NULL)
+	if((client_p = str_cid_to_client(parv[1])) == NULL)
 		return;
 
 	sendto_one_notice(client_p, ":%s", parv[2]);
@@ -213,8 +466,7 @@ cmd_reject_client(int parc, char **parv)
 {
 	struct Client *client_p;
 
-	/* cid to uid (retrieve and delete) */
-	if((client_p = str_cid_to_client(parv[1], true)) == NULL)
+	if((client_p = str_cid_to_client(parv[1])) == NULL)
 		return;
 
 	authd_reject_client(client_p, parv[3], parv[4], toupper(*parv[2]), parv[5], parv[6]);
@@ -254,6 +506,7 @@ cmd_stats_results(int parc, char **parv)
 	/* Select by type */
 	switch(*parv[2])
 	{
+	case 'C':
 	case 'D':
 		/* parv[0] conveys status */
 		if(parc < 4)
@@ -276,8 +529,16 @@ parse_authd_reply(rb_helper * helper)
 	int parc;
 	char buf[READBUF_SIZE];
 	char *parv[MAXPARA];
+	struct authd_instance *inst = find_authd_instance(helper);
+	unsigned int *restarts_p, restarts;
 
-	while((len = rb_helper_read(helper, buf, sizeof(buf))) > 0)
+	/* a restart of this instance closes its helper, so stop reading from
+	 * it if one happens; restarts of the others leave it alone.  A helper
+	 * still being started is not counted in yet, so it goes by any restart.
+	 */
+	restarts_p = inst != NULL ? &inst->restarts : &authd_restarts;
+	restarts = *restarts_p;
+	while(restarts == *restarts_p && (len = rb_helper_read(helper, buf, sizeof(buf))) > 0)
 	{
 		struct authd_cb *cmd;
 
@@ -307,111 +568,168 @@ parse_authd_reply(rb_helper * helper)
 void
 init_authd(void)
 {
-	if(start_authd())
+	if(start_authd_instances(1) != 1)
 	{
 		ierror("Unable to start authd helper: %s", strerror(errno));
 		exit(0);
 	}
 }
 
-void
-configure_authd(void)
+/* Bring one authd up to date with everything the others have been told */
+static void
+configure_authd_instance(struct authd_instance *inst)
 {
-	/* Timeouts */
-	set_authd_timeout("ident_timeout", GlobalSetOptions.ident_timeout);
-	set_authd_timeout("rdns_timeout", ConfigFileEntry.connect_timeout);
-	set_authd_timeout("rbl_timeout", ConfigFileEntry.connect_timeout);
+	rb_helper *helper = inst->helper;
+	rb_dictionary_iter iter;
+	struct DNSBLEntryStats *stats;
 
-	ident_check_enable(!ConfigFileEntry.disable_auth);
+	if(helper == NULL)
+		return;
 
-	/* Configure OPM */
-	if(rb_dlink_list_length(&opm_list) > 0 &&
-		(opm_listeners[LISTEN_IPV4].ipaddr[0] != '\0' ||
-		opm_listeners[LISTEN_IPV6].ipaddr[0] != '\0'))
+	for(size_t i = 0; i < ARRAY_SIZE(authd_timeouts); i++)
+	{
+		if(authd_timeouts[i].value > 0)
+			rb_helper_write_queue(helper, "O %s %d", authd_timeouts[i].key, authd_timeouts[i].value);
+	}
+
+	rb_helper_write_queue(helper, "O ident_enabled %d", ident_enabled ? 1 : 0);
+
+	if(dnsbl_stats != NULL)
+	{
+		RB_DICTIONARY_FOREACH(stats, &iter, dnsbl_stats)
+		{
+			rb_helper_write_queue(helper, "O rbl %s %hhu %s :%s",
+				stats->host, stats->iptype, stats->filters, stats->reason);
+		}
+	}
+
+	/* Configure OPM; only the first authd does scans */
+	if(inst->id == 0 && opm_enabled)
 	{
 		rb_dlink_node *ptr;
 
 		if(opm_listeners[LISTEN_IPV4].ipaddr[0] != '\0')
-			rb_helper_write(authd_helper, "O opm_listener %s %hu",
+			rb_helper_write_queue(helper, "O opm_listener %s %hu",
 				opm_listeners[LISTEN_IPV4].ipaddr, opm_listeners[LISTEN_IPV4].port);
 
 		if(opm_listeners[LISTEN_IPV6].ipaddr[0] != '\0')
-			rb_helper_write(authd_helper, "O opm_listener %s %hu",
+			rb_helper_write_queue(helper, "O opm_listener %s %hu",
 				opm_listeners[LISTEN_IPV6].ipaddr, opm_listeners[LISTEN_IPV6].port);
 
 		RB_DLINK_FOREACH(ptr, opm_list.head)
 		{
 			struct OPMScanner *scanner = ptr->data;
-			rb_helper_write(authd_helper, "O opm_scanner %s %hu",
+			rb_helper_write_queue(helper, "O opm_scanner %s %hu",
 				scanner->type, scanner->port);
 		}
-
-		opm_check_enable(true);
 	}
-	else
-		opm_check_enable(false);
+
+	rb_helper_write_queue(helper, "O opm_enabled %d", inst->id == 0 && opm_enabled ? 1 : 0);
+	rb_helper_write_flush(helper);
+}
+
+void
+configure_authd(void)
+{
+	/* Timeouts */
+	set_authd_timeout("ident_timeout", GlobalSetOptions.ident_timeout);
+	set_authd_timeout("rdns_timeout", ConfigFileEntry.connect_timeout);
+	set_authd_timeout("rbl_timeout", ConfigFileEntry.connect_timeout);
+
+	ident_enabled = !ConfigFileEntry.disable_auth;
+	opm_enabled = rb_dlink_list_length(&opm_list) > 0 &&
+		(opm_listeners[LISTEN_IPV4].ipaddr[0] != '\0' ||
+		opm_listeners[LISTEN_IPV6].ipaddr[0] != '\0');
+
+	authd_configured = true;
+
+	for(int i = 0; i < authd_count; i++)
+		configure_authd_instance(&authd_instances[i]);
 }
 
 static void
 authd_free_client(struct Client *client_p)
 {
+	struct authd_instance *inst;
+
 	if(client_p == NULL || client_p->preClient == NULL)
 		return;
 
 	if(client_p->preClient->auth.cid == 0)
 		return;
 
-	if(authd_helper != NULL)
-		rb_helper_write(authd_helper, "E %x", client_p->preClient->auth.cid);
+	inst = &authd_instances[client_p->preClient->auth.instance];
+	if(inst->helper != NULL)
+		rb_helper_write_batch(inst->helper, "E %x", client_p->preClient->auth.cid);
+
+	free_cid(client_p->preClient->auth.cid);
 
 	client_p->preClient->auth.accepted = true;
 	client_p->preClient->auth.cid = 0;
 }
 
-static void
-authd_free_client_cb(rb_dictionary_element *delem, void *unused)
+void
+authd_abort_client(struct Client *client_p)
 {
-	struct Client *client_p = delem->data;
 	authd_free_client(client_p);
 }
 
-void
-authd_abort_client(struct Client *client_p)
+static void
+restart_authd_instance(struct authd_instance *inst)
 {
-	rb_dictionary_delete(cid_clients, RB_UINT_TO_POINTER(client_p->preClient->auth.cid));
-	authd_free_client(client_p);
+	authd_restarts++;
+	inst->restarts++;
+
+	if(inst->helper != NULL)
+	{
+		rb_helper_close(inst->helper);
+		inst->helper = NULL;
+		if(inst->id == 0)
+			authd_helper = NULL;
+	}
+
+	/* Clients this authd was working on will get no answer */
+	for(uint32_t i = 0; i < cid_slots_used; i++)
+	{
+		struct Client *client_p = cid_slots[i].client;
+
+		if(client_p != NULL && client_p->preClient->auth.instance == inst->id)
+			authd_free_client(client_p);
+	}
+
+	start_authd(inst);
 }
 
 static void
 restart_authd_cb(rb_helper * helper)
 {
+	struct authd_instance *inst = find_authd_instance(helper);
+
 	iwarn("authd: restart_authd_cb called, authd died?");
 	sendto_realops_snomask(SNO_GENERAL, L_ALL, "authd: restart_authd_cb called, authd died?");
 
-	if(helper != NULL)
+	if(inst == NULL)
 	{
 		rb_helper_close(helper);
-		authd_helper = NULL;
+		return;
 	}
 
-	rb_dictionary_destroy(cid_clients, authd_free_client_cb, NULL);
-	cid_clients = NULL;
-
-	start_authd();
-	configure_authd();
+	restart_authd_instance(inst);
 }
 
 void
 restart_authd(void)
 {
 	ierror("authd restarting...");
-	restart_authd_cb(authd_helper);
+
+	for(int i = 0; i < authd_count; i++)
+		restart_authd_instance(&authd_instances[i]);
 }
 
 void
 rehash_authd(void)
 {
-	rb_helper_write(authd_helper, "R");
+	authd_broadcast("R");
 }
 
 void
@@ -421,15 +739,6 @@ check_authd(void)
 		restart_authd();
 }
 
-static inline uint32_t
-generate_cid(void)
-{
-	if(++cid == 0)
-		cid = 1;
-
-	return cid;
-}
-
 /* Basically when this is called we begin handing off the client to authd for
  * processing. authd "owns" the client until processing is finished, or we
  * timeout from authd. authd will make a decision whether or not to accept the
@@ -451,14 +760,30 @@ authd_initiate_client(struct Client *client_p, bool defer)
 	char listen_ipaddr[HOSTIPLEN+1];
 	uint16_t client_port, listen_port;
 	uint32_t authd_cid;
+	struct authd_instance *inst;
 
 	if(client_p->preClient == NULL || client_p->preClient->auth.cid != 0)
 		return;
 
-	authd_cid = client_p->preClient->auth.cid = generate_cid();
+	if(defer)
+		client_p->preClient->auth.flags |= AUTHC_F_DEFERRED;
 
-	/* Collisions are extremely unlikely, so disregard the possibility */
-	rb_dictionary_add(cid_clients, RB_UINT_TO_POINTER(authd_cid), client_p);
+	authd_cid = alloc_cid(client_p);
+	inst = authd_instance_for_cid(authd_cid);
+
+	if(authd_cid == 0 || inst->helper == NULL)
+	{
+		/* Nobody to ask, let them in unchecked */
+		free_cid(authd_cid);
+		client_p->preClient->auth.accepted = true;
+		client_p->preClient->auth.flags |= AUTHC_F_COMPLETE;
+		if(!defer)
+			authd_read_client(client_p);
+		return;
+	}
+
+	client_p->preClient->auth.cid = authd_cid;
+	client_p->preClient->auth.instance = inst->id;
 
 	/* Retrieve listener and client IP's */
 	rb_inet_ntop_sock((struct sockaddr *)&client_p->preClient->lip, listen_ipaddr, sizeof(listen_ipaddr));
@@ -468,13 +793,11 @@ authd_initiate_client(struct Client *client_p, bool defer)
 	listen_port = ntohs(GET_SS_PORT(&client_p->preClient->lip));
 	client_port = ntohs(GET_SS_PORT(&client_p->localClient->ip));
 
-	if(defer)
-		client_p->preClient->auth.flags |= AUTHC_F_DEFERRED;
-
 	/* Add a bit of a fudge factor... */
 	client_p->preClient->auth.timeout = rb_current_time() + ConfigFileEntry.connect_timeout + 10;
 
-	rb_helper_write(authd_helper, "C %x %s %hu %s %hu %x", authd_cid, listen_ipaddr, listen_port, client_ipaddr, client_port,
+	/* Requests made during one pass of the event loop go out in one write */
+	rb_helper_write_batch(inst->helper, "C %x %s %hu %s %hu %x", authd_cid, listen_ipaddr, listen_port, client_ipaddr, client_port,
 #ifdef HAVE_LIBSCTP
 		IsSCTP(client_p) ? IPPROTO_SCTP : IPPROTO_TCP);
 #else
@@ -521,7 +844,7 @@ authd_decide_client(struct Client *client_p, const char *ident, const char *host
 	if(*host != '*')
 		rb_strlcpy(client_p->host, host, sizeof(client_p->host));
 
-	rb_dictionary_delete(cid_clients, RB_UINT_TO_POINTER(client_p->preClient->auth.cid));
+	free_cid(client_p->preClient->auth.cid);
 
 	client_p->preClient->auth.accepted = accept;
 	client_p->preClient->auth.cause = cause;
@@ -559,25 +882,12 @@ authd_reject_client(struct Client *client_p, const char *ident, const char *host
 static void
 timeout_dead_authd_clients(void *notused __unused)
 {
-	rb_dictionary_iter iter;
-	struct Client *client_p;
-	rb_dlink_list freelist = { NULL, NULL, 0 };
-	rb_dlink_node *ptr, *nptr;
-
-	RB_DICTIONARY_FOREACH(client_p, &iter, cid_clients)
+	for(uint32_t i = 0; i < cid_slots_used; i++)
 	{
-		if(client_p->preClient->auth.timeout < rb_current_time())
-		{
-			authd_free_client(client_p);
-			rb_dlinkAddAlloc(client_p, &freelist);
-		}
-	}
+		struct Client *client_p = cid_slots[i].client;
 
-	/* RB_DICTIONARY_FOREACH is not safe for deletion, so we do this crap */
-	RB_DLINK_FOREACH_SAFE(ptr, nptr, freelist.head)
-	{
-		client_p = ptr->data;
-		rb_dictionary_delete(cid_clients, RB_UINT_TO_POINTER(client_p->preClient->auth.cid));
+		if(client_p != NULL && client_p->preClient->auth.timeout < rb_current_time())
+			authd_free_client(client_p);
 	}
 }
 
@@ -613,11 +923,13 @@ add_dnsbl_entry(const char *host, const char *reason, uint8_t iptype, rb_dlink_l
 		filterbuf[s - 1] = '\0';
 
 	stats->host = rb_strdup(host);
+	stats->reason = rb_strdup(reason);
+	stats->filters = rb_strdup(filterbuf);
 	stats->iptype = iptype;
 	stats->hits = 0;
 	rb_dictionary_add(dnsbl_stats, stats->host, stats);
 
-	rb_helper_write(authd_helper, "O rbl %s %hhu %s :%s", host, iptype, filterbuf, reason);
+	authd_send_option("O rbl %s %hhu %s :%s", host, iptype, filterbuf, reason);
 }
 
 /* Delete a DNSBL entry. */
@@ -629,10 +941,12 @@ del_dnsbl_entry(const char *host)
 	{
 		rb_dictionary_delete(dnsbl_stats, host);
 		rb_free(stats->host);
+		rb_free(stats->reason);
+		rb_free(stats->filters);
 		rb_free(stats);
 	}
 
-	rb_helper_write(authd_helper, "O rbl_del %s", host);
+	authd_send_option("O rbl_del %s", host);
 }
 
 static void
@@ -641,6 +955,8 @@ dnsbl_delete_elem(rb_dictionary_element *delem, void *unused)
 	struct DNSBLEntryStats *stats = delem->data;
 
 	rb_free(stats->host);
+	rb_free(stats->reason);
+	rb_free(stats->filters);
 	rb_free(stats);
 }
 
@@ -652,7 +968,7 @@ del_dnsbl_entry_all(void)
 		rb_dictionary_destroy(dnsbl_stats, dnsbl_delete_elem, NULL);
 	dnsbl_stats = NULL;
 
-	rb_helper_write(authd_helper, "O rbl_del_all");
+	authd_send_option("O rbl_del_all");
 }
 
 /* Adjust an authd timeout value */
@@ -662,7 +978,13 @@ set_authd_timeout(const char *key, int timeout)
 	if(timeout <= 0)
 		return false;
 
-	rb_helper_write(authd_helper, "O %s %d", key, timeout);
+	for(size_t i = 0; i < ARRAY_SIZE(authd_timeouts); i++)
+	{
+		if(!strcmp(authd_timeouts[i].key, key))
+			authd_timeouts[i].value = timeout;
+	}
+
+	authd_send_option("O %s %d", key, timeout);
 	return true;
 }
 
@@ -670,7 +992,8 @@ set_authd_timeout(const char *key, int timeout)
 void
 ident_check_enable(bool enabled)
 {
-	rb_helper_write(authd_helper, "O ident_enabled %d", enabled ? 1 : 0);
+	ident_enabled = enabled;
+	authd_send_option("O ident_enabled %d", enabled ? 1 : 0);
 }
 
 /* Create an OPM listener
@@ -710,21 +1033,22 @@ create_opm_listener(const char *ip, uint16_t port)
 	}
 
 	conf_create_opm_listener(ip, port);
-	rb_helper_write(authd_helper, "O opm_listener %s %hu", ipbuf, port);
+	authd_send_opm_option("O opm_listener %s %hu", ipbuf, port);
 }
 
 void
 delete_opm_listener_all(void)
 {
 	memset(&opm_listeners, 0, sizeof(opm_listeners));
-	rb_helper_write(authd_helper, "O opm_listener_del_all");
+	authd_send_opm_option("O opm_listener_del_all");
 }
 
 /* Disable all OPM scans */
 void
 opm_check_enable(bool enabled)
 {
-	rb_helper_write(authd_helper, "O opm_enabled %d", enabled ? 1 : 0);
+	opm_enabled = enabled;
+	authd_send_opm_option("O opm_enabled %d", enabled ? 1 : 0);
 }
 
 /* Create an OPM proxy scanner
@@ -745,7 +1069,7 @@ void
 create_opm_proxy_scanner(const char *type, uint16_t port)
 {
 	conf_create_opm_proxy_scanner(type, port);
-	rb_helper_write(authd_helper, "O opm_scanner %s %hu", type, port);
+	authd_send_opm_option("O opm_scanner %s %hu", type, port);
 }
 
 void
@@ -766,7 +1090,7 @@ delete_opm_proxy_scanner(const char *type, uint16_t port)
 		}
 	}
 
-	rb_helper_write(authd_helper, "O opm_scanner_del %s %hu", type, port);
+	authd_send_opm_option("O opm_scanner_del %s %hu", type, port);
 }
 
 void
@@ -782,5 +1106,5 @@ delete_opm_proxy_scanner_all(void)
 		rb_free(scanner);
 	}
 
-	rb_helper_write(authd_helper, "O opm_scanner_del_all");
+	authd_send_opm_option("O opm_scanner_del_all");
 }
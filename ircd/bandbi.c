@@ -45,6 +45,9 @@
 #include "ircd.h"
 #include "msg.h"	/* XXX: MAXPARA */
 #include "operhash.h"
+#include "bandb_snapshot.h"
+
+#include <sys/mman.h>
 
 static void
 bandb_handle_failure(rb_helper *helper, char **parv, int parc) __attribute__((noreturn));
@@ -62,6 +65,29 @@ static void bandb_parse(rb_helper *);
 static void bandb_restart_cb(rb_helper *);
 static char *bandb_path;
 
+struct bandb_snapshot
+{
+	void *base;
+	size_t len;
+	const char *start[LAST_BANDB_TYPE];
+	uint32_t count[LAST_BANDB_TYPE];
+	bool sorted;
+};
+
+struct bandb_record
+{
+	const char *field[BANDB_SNAPSHOT_FIELDS];	/* mask1, mask2, oper, reason */
+};
+
+struct snapshot_cursor
+{
+	const char *pos;
+	uint32_t left;
+};
+
+/* the snapshot the permanent bans in effect were loaded from, if any */
+static struct bandb_snapshot *bandb_snapshot;
+
 void
 init_bandb(void)
 {
@@ -139,7 +165,7 @@ bandb_add(bandb_type type, struct Client *source_p, const char *mask1,
 	if(!EmptyString(oper_reason))
 		rb_snprintf_append(buf, sizeof(buf), "|%s", oper_reason);
 
-	rb_helper_write(bandb_helper, "%s", buf);
+	rb_helper_write_batch(bandb_helper, "%s", buf);
 }
 
 static char bandb_del_letter[LAST_BANDB_TYPE] = {
@@ -161,40 +187,44 @@ bandb_del(bandb_type type, const char *mask1, const char *mask2)
 	if(!EmptyString(mask2))
 		rb_snprintf_append(buf, sizeof(buf), " %s", mask2);
 
-	rb_helper_write(bandb_helper, "%s", buf);
+	rb_helper_write_batch(bandb_helper, "%s", buf);
 }
 
-static void
-bandb_handle_ban(char *parv[], int parc)
+static struct ConfItem *
+bandb_make_conf(bandb_type type, const char *mask1, const char *mask2,
+		const char *oper, const char *reason)
 {
 	struct ConfItem *aconf;
-	char *p;
-	int para = 1;
+	const char *p;
 
 	aconf = make_conf();
 	aconf->port = 0;
 
-	if(parv[0][0] == 'K')
-		aconf->user = rb_strdup(parv[para++]);
+	if(type == BANDB_KLINE)
+	{
+		aconf->user = rb_strdup(mask1);
+		aconf->host = rb_strdup(mask2);
+	}
+	else
+		aconf->host = rb_strdup(mask1);
 
-	aconf->host = rb_strdup(parv[para++]);
-	aconf->info.oper = operhash_add(parv[para++]);
+	aconf->info.oper = operhash_add(oper);
 
-	switch (parv[0][0])
+	switch (type)
 	{
-	case 'K':
+	case BANDB_KLINE:
 		aconf->status = CONF_KILL;
 		break;
 
-	case 'D':
+	case BANDB_DLINE:
 		aconf->status = CONF_DLINE;
 		break;
 
-	case 'X':
+	case BANDB_XLINE:
 		aconf->status = CONF_XLINE;
 		break;
 
-	case 'R':
+	default:
 		if(IsChannelName(aconf->host))
 			aconf->status = CONF_RESV_CHANNEL;
 		else
@@ -203,13 +233,40 @@ bandb_handle_ban(char *parv[], int parc)
 		break;
 	}
 
-	if((p = strchr(parv[para], '|')))
+	if((p = strchr(reason, '|')))
 	{
-		*p++ = '\0';
-		aconf->spasswd = rb_strdup(p);
+		aconf->passwd = rb_strndup(reason, p - reason + 1);
+		aconf->spasswd = rb_strdup(p + 1);
 	}
+	else
+		aconf->passwd = rb_strdup(reason);
 
-	aconf->passwd = rb_strdup(parv[para]);
+	return aconf;
+}
+
+static void
+bandb_handle_ban(char *parv[], int parc)
+{
+	struct ConfItem *aconf;
+
+	switch (parv[0][0])
+	{
+	case 'K':
+		aconf = bandb_make_conf(BANDB_KLINE, parv[1], parv[2], parv[3], parv[4]);
+		break;
+
+	case 'D':
+		aconf = bandb_make_conf(BANDB_DLINE, parv[1], NULL, parv[2], parv[3]);
+		break;
+
+	case 'X':
+		aconf = bandb_make_conf(BANDB_XLINE, parv[1], NULL, parv[2], parv[3]);
+		break;
+
+	default:
+		aconf = bandb_make_conf(BANDB_RESV, parv[1], NULL, parv[2], parv[3]);
+		break;
+	}
 
 	rb_dlinkAddAlloc(aconf, &bandb_pending);
 }
@@ -259,11 +316,17 @@ static int
 bandb_check_dline(struct ConfItem *aconf)
 {
 	struct rb_sockaddr_storage daddr;
+	struct ConfItem *dconf;
 	int bits;
 
 	if(!parse_netmask(aconf->host, &daddr, &bits))
 		return 0;
 
+	/* a DLINE issued since the last snapshot is already in effect */
+	dconf = find_exact_conf_by_address(aconf->host, CONF_DLINE, NULL);
+	if(dconf != NULL && !(dconf->flags & CONF_FLAGS_TEMPORARY))
+		return 0;
+
 	return 1;
 }
 
@@ -321,14 +384,19 @@ bandb_handle_clear(void)
 	}
 }
 
-static void
-bandb_handle_finish(void)
+/* bandb_add_pending()
+ *
+ * inputs	-
+ * outputs	- number of bans put in effect
+ * side effects - adds the bans on bandb_pending that pass the sanity
+ *		  checks, frees the rest
+ */
+static unsigned int
+bandb_add_pending(void)
 {
 	struct ConfItem *aconf;
 	rb_dlink_node *ptr, *next_ptr;
-
-	clear_out_address_conf_bans();
-	clear_s_newconf_bans();
+	unsigned int added = 0;
 
 	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, bandb_pending.head)
 	{
@@ -340,7 +408,10 @@ bandb_handle_finish(void)
 		{
 		case CONF_KILL:
 			if(bandb_check_kline(aconf))
+			{
 				add_conf_by_address(aconf->host, CONF_KILL, aconf->user, NULL, aconf);
+				added++;
+			}
 			else
 				free_conf(aconf);
 
@@ -348,7 +419,10 @@ bandb_handle_finish(void)
 
 		case CONF_DLINE:
 			if(bandb_check_dline(aconf))
+			{
 				add_conf_by_address(aconf->host, CONF_DLINE, aconf->user, NULL, aconf);
+				added++;
+			}
 			else
 				free_conf(aconf);
 
@@ -356,7 +430,10 @@ bandb_handle_finish(void)
 
 		case CONF_XLINE:
 			if(bandb_check_xline(aconf))
-				rb_dlinkAddAlloc(aconf, &xline_conf_list);
+			{
+				add_xline_conf(aconf);
+				added++;
+			}
 			else
 				free_conf(aconf);
 
@@ -364,7 +441,10 @@ bandb_handle_finish(void)
 
 		case CONF_RESV_CHANNEL:
 			if(bandb_check_resv_channel(aconf))
+			{
 				add_to_resv_hash(aconf->host, aconf);
+				added++;
+			}
 			else
 				free_conf(aconf);
 
@@ -372,7 +452,10 @@ bandb_handle_finish(void)
 
 		case CONF_RESV_NICK:
 			if(bandb_check_resv_nick(aconf))
-				rb_dlinkAddAlloc(aconf, &resv_conf_list);
+			{
+				add_nick_resv_conf(aconf);
+				added++;
+			}
 			else
 				free_conf(aconf);
 
@@ -380,6 +463,332 @@ bandb_handle_finish(void)
 		}
 	}
 
+	return added;
+}
+
+static void
+free_snapshot(struct bandb_snapshot *snap)
+{
+	if(snap == NULL)
+		return;
+
+	munmap(snap->base, snap->len);
+	rb_free(snap);
+}
+
+static bool
+snapshot_next(struct snapshot_cursor *cur, struct bandb_record *rec)
+{
+	uint16_t len[BANDB_SNAPSHOT_FIELDS];
+
+	if(cur->left == 0)
+		return false;
+
+	memcpy(len, cur->pos, sizeof(len));
+	cur->pos += sizeof(len);
+
+	for(int i = 0; i < BANDB_SNAPSHOT_FIELDS; i++)
+	{
+		rec->field[i] = cur->pos;
+		cur->pos += len[i] + 1;
+	}
+
+	cur->left--;
+	return true;
+}
+
+static void
+snapshot_cursor(struct bandb_snapshot *snap, bandb_type type, struct snapshot_cursor *cur)
+{
+	if(snap == NULL)
+	{
+		cur->pos = NULL;
+		cur->left = 0;
+		return;
+	}
+
+	cur->pos = snap->start[type];
+	cur->left = snap->count[type];
+}
+
+static int
+compare_records(const struct bandb_record *a, const struct bandb_record *b)
+{
+	int ret;
+
+	for(int i = 0; i < BANDB_SNAPSHOT_FIELDS; i++)
+	{
+		if((ret = strcmp(a->field[i], b->field[i])) != 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+/* open_snapshot()
+ *
+ * inputs	- path to a snapshot written by bandb
+ * outputs	- the mapped snapshot, or NULL if it is unusable
+ * side effects - checks every record is within the file, so walking it
+ *		  later needs no bounds checks
+ */
+static struct bandb_snapshot *
+open_snapshot(const char *path)
+{
+	struct bandb_snapshot_header header;
+	struct bandb_snapshot *snap;
+	struct stat st;
+	const char *pos, *end;
+	void *base;
+	int fd;
+
+	if((fd = open(path, O_RDONLY)) < 0)
+		return NULL;
+
+	if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(header))
+	{
+		close(fd);
+		return NULL;
+	}
+
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if(base == MAP_FAILED)
+		return NULL;
+
+	memcpy(&header, base, sizeof(header));
+
+	snap = rb_malloc(sizeof(struct bandb_snapshot));
+	snap->base = base;
+	snap->len = st.st_size;
+	snap->sorted = true;
+
+	if(memcmp(header.magic, BANDB_SNAPSHOT_MAGIC, sizeof(header.magic)))
+	{
+		free_snapshot(snap);
+		return NULL;
+	}
+
+	pos = (const char *)base + sizeof(header);
+	end = (const char *)base + snap->len;
+
+	for(int type = 0; type < LAST_BANDB_TYPE; type++)
+	{
+		struct bandb_record rec, prev;
+
+		snap->start[type] = pos;
+		snap->count[type] = header.count[type];
+
+		for(uint32_t n = 0; n < header.count[type]; n++)
+		{
+			uint16_t len[BANDB_SNAPSHOT_FIELDS];
+
+			if((size_t)(end - pos) < sizeof(len))
+			{
+				free_snapshot(snap);
+				return NULL;
+			}
+
+			memcpy(len, pos, sizeof(len));
+			pos += sizeof(len);
+
+			for(int i = 0; i < BANDB_SNAPSHOT_FIELDS; i++)
+			{
+				if((size_t)(end - pos) <= len[i] || pos[len[i]] != '\0')
+				{
+					free_snapshot(snap);
+					return NULL;
+				}
+
+				rec.field[i] = pos;
+				pos += len[i] + 1;
+			}
+
+			if(n > 0 && compare_records(&prev, &rec) > 0)
+				snap->sorted = false;
+
+			prev = rec;
+		}
+	}
+
+	return snap;
+}
+
+/* bandb_remove_ban()
+ *
+ * inputs	- type and record of a ban that is no longer stored
+ * outputs	- true if a ban was taken out of effect
+ * side effects - removes the permanent ban with that exact mask, leaving
+ *		  temporary and propagated ones alone
+ */
+static bool
+bandb_remove_ban(bandb_type type, const struct bandb_record *rec)
+{
+	struct ConfItem *aconf;
+	rb_dlink_node *ptr;
+	const char *mask = rec->field[0];
+
+	switch (type)
+	{
+	case BANDB_KLINE:
+	case BANDB_DLINE:
+		if(type == BANDB_KLINE)
+		{
+			aconf = find_exact_conf_by_address(rec->field[1], CONF_KILL, rec->field[0]);
+			mask = rec->field[1];
+		}
+		else
+			aconf = find_exact_conf_by_address(mask, CONF_DLINE, NULL);
+
+		if(aconf == NULL || aconf->flags & CONF_FLAGS_TEMPORARY)
+			return false;
+
+		delete_one_address_conf(mask, aconf);
+		return true;
+
+	case BANDB_XLINE:
+		aconf = find_xline_mask(mask);
+		if(aconf == NULL || aconf->hold)
+			return false;
+
+		if((ptr = rb_dlinkFind(aconf, &xline_conf_list)) != NULL)
+			remove_xline_conf(ptr);
+		free_conf(aconf);
+		return true;
+
+	default:
+		if(IsChannelName(mask))
+		{
+			aconf = rb_radixtree_retrieve(resv_tree, mask);
+			if(aconf == NULL || aconf->hold)
+				return false;
+
+			del_from_resv_hash(mask, aconf);
+			free_conf(aconf);
+			return true;
+		}
+
+		aconf = find_nick_resv_mask(mask);
+		if(aconf == NULL || aconf->hold)
+			return false;
+
+		if((ptr = rb_dlinkFind(aconf, &resv_conf_list)) != NULL)
+			remove_nick_resv_conf(ptr);
+		free_conf(aconf);
+		return true;
+	}
+}
+
+static void
+queue_snapshot_record(bandb_type type, const struct bandb_record *rec)
+{
+	struct ConfItem *aconf;
+
+	aconf = bandb_make_conf(type, rec->field[0], rec->field[1], rec->field[2], rec->field[3]);
+	rb_dlinkAddAlloc(aconf, &bandb_pending);
+}
+
+/* bandb_handle_snapshot()
+ *
+ * inputs	- path of the snapshot bandb just wrote
+ * outputs	-
+ * side effects - brings the permanent bans in line with the snapshot.
+ *		  Both snapshots are sorted, so walking them side by side
+ *		  finds the bans that were added and removed since the last
+ *		  one, and only those are touched.  Without a usable previous
+ *		  snapshot every permanent ban is reloaded.
+ */
+static void
+bandb_handle_snapshot(const char *path)
+{
+	struct bandb_snapshot *snap;
+	struct snapshot_cursor oldcur, newcur;
+	struct bandb_record oldrec, newrec;
+	unsigned int added, removed = 0;
+	bool full;
+
+	bandb_handle_clear();
+
+	if((snap = open_snapshot(path)) == NULL)
+	{
+		ilog(L_MAIN, "bandb - unable to load ban snapshot %s", path);
+		return;
+	}
+
+	full = bandb_snapshot == NULL || !bandb_snapshot->sorted || !snap->sorted;
+
+	if(full)
+	{
+		clear_out_address_conf_bans();
+		clear_s_newconf_bans();
+	}
+
+	for(int type = 0; type < LAST_BANDB_TYPE; type++)
+	{
+		bool have_old, have_new;
+
+		snapshot_cursor(full ? NULL : bandb_snapshot, type, &oldcur);
+		snapshot_cursor(snap, type, &newcur);
+
+		have_old = snapshot_next(&oldcur, &oldrec);
+		have_new = snapshot_next(&newcur, &newrec);
+
+		while(have_old || have_new)
+		{
+			int cmp;
+
+			if(!have_old)
+				cmp = 1;
+			else if(!have_new)
+				cmp = -1;
+			else
+				cmp = compare_records(&oldrec, &newrec);
+
+			if(cmp < 0)
+			{
+				if(bandb_remove_ban(type, &oldrec))
+					removed++;
+				have_old = snapshot_next(&oldcur, &oldrec);
+			}
+			else if(cmp > 0)
+			{
+				queue_snapshot_record(type, &newrec);
+				have_new = snapshot_next(&newcur, &newrec);
+			}
+			else
+			{
+				have_old = snapshot_next(&oldcur, &oldrec);
+				have_new = snapshot_next(&newcur, &newrec);
+			}
+		}
+	}
+
+	/* removals first, so a ban whose reason changed can be added back */
+	added = bandb_add_pending();
+
+	free_snapshot(bandb_snapshot);
+	bandb_snapshot = snap;
+
+	if(!full)
+		ilog(L_MAIN, "bandb - applied ban snapshot: %u added, %u removed", added, removed);
+
+	if(added > 0)
+		check_banned_lines();
+}
+
+static void
+bandb_handle_finish(void)
+{
+	/* a streamed listing leaves nothing to compare the next snapshot to */
+	free_snapshot(bandb_snapshot);
+	bandb_snapshot = NULL;
+
+	clear_out_address_conf_bans();
+	clear_s_newconf_bans();
+
+	bandb_add_pending();
+
 	check_banned_lines();
 }
 
@@ -423,6 +832,10 @@ bandb_parse(rb_helper *helper)
 		case 'C':
 			bandb_handle_clear();
 			break;
+		case 'S':
+			if(parc > 1)
+				bandb_handle_snapshot(parv[1]);
+			break;
 		case 'F':
 			bandb_handle_finish();
 			break;
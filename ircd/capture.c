@@ -0,0 +1,231 @@
+/*
+ * ircd/capture.c
+ * Copyright (c) 2026 Ophion development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stdinc.h"
+#include "capture.h"
+#include "client.h"
+#include "ircd.h"
+#include "logger.h"
+#include "s_newconf.h"
+#include "send.h"
+
+#define CAPTURE_BUFSIZE		(1024 * 1024)
+
+bool capture_active = false;
+
+static FILE *capture_file;
+static char *capture_buf;
+static uint64_t capture_started;
+static size_t capture_written;
+static size_t capture_limit;
+
+/* Connection numbers keep increasing across captures, so a client belongs
+ * to the running capture only if its number is above the base.  Clients
+ * that were already connected when the capture began are given the base
+ * itself and left out: a replay has nothing to bring them up to the state
+ * they were in.
+ */
+static uint32_t capture_base;
+static uint32_t capture_next;
+
+static void
+put_be(unsigned char *p, uint64_t v, int bytes)
+{
+	while(bytes-- > 0)
+	{
+		p[bytes] = v & 0xff;
+		v >>= 8;
+	}
+}
+
+static void
+capture_fail(const char *what)
+{
+	int saved_errno = errno;
+
+	capture_stop();
+	ierror("traffic capture stopped: %s: %s", what, strerror(saved_errno));
+	sendto_realops_snomask(SNO_GENERAL, L_ALL, "Traffic capture stopped: %s: %s",
+			       what, strerror(saved_errno));
+}
+
+static void
+capture_record(enum capture_record type, uint32_t id, const char *buf, size_t len)
+{
+	unsigned char hdr[CAPTURE_RECORD_LEN];
+
+	if(capture_written + sizeof(hdr) + len > capture_limit)
+	{
+		capture_stop();
+		sendto_realops_snomask(SNO_GENERAL, L_ALL,
+				       "Traffic capture stopped after reaching its size limit");
+		return;
+	}
+
+	hdr[0] = type;
+	put_be(hdr + 1, id - capture_base, 4);
+	put_be(hdr + 5, (rb_monotonic_ns() - capture_started) / 1000, 8);
+	put_be(hdr + 13, len, 2);
+
+	if(fwrite(hdr, sizeof(hdr), 1, capture_file) != 1 ||
+	   (len > 0 && fwrite(buf, len, 1, capture_file) != 1))
+	{
+		capture_fail("write error");
+		return;
+	}
+
+	capture_written += sizeof(hdr) + len;
+}
+
+static void
+capture_skip(rb_dlink_list *list)
+{
+	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, list->head)
+	{
+		struct Client *client_p = ptr->data;
+
+		client_p->localClient->capture_id = capture_base;
+	}
+}
+
+/* capture_start()
+ *
+ * inputs	- path to write to, largest file size to write
+ * outputs	- 0 on success, -1 with errno set on failure
+ * side effects - everything read from local connections from now on is
+ *		  appended to path, until capture_stop() or the limit
+ */
+int
+capture_start(const char *path, size_t limit)
+{
+	unsigned char hdr[CAPTURE_HEADER_LEN];
+
+	if(capture_active)
+		capture_stop();
+
+	if((capture_file = fopen(path, "wb")) == NULL)
+		return -1;
+
+	/* a big buffer keeps the event loop from writing on every read */
+	capture_buf = rb_malloc(CAPTURE_BUFSIZE);
+	setvbuf(capture_file, capture_buf, _IOFBF, CAPTURE_BUFSIZE);
+
+	memcpy(hdr, CAPTURE_MAGIC, 8);
+	put_be(hdr + 8, (uint64_t)rb_current_time(), 8);
+	if(fwrite(hdr, sizeof(hdr), 1, capture_file) != 1)
+	{
+		int saved_errno = errno;
+
+		fclose(capture_file);
+		capture_file = NULL;
+		rb_free(capture_buf);
+		capture_buf = NULL;
+		errno = saved_errno;
+		return -1;
+	}
+
+	capture_started = rb_monotonic_ns();
+	capture_written = sizeof(hdr);
+	capture_limit = limit;
+	capture_base = ++capture_next;
+	capture_skip(&unknown_list);
+	capture_skip(&lclient_list);
+	capture_skip(&serv_list);
+	capture_active = true;
+	return 0;
+}
+
+/* capture_stop()
+ *
+ * inputs	- none
+ * outputs	- none
+ * side effects - the running capture, if any, is flushed and closed
+ */
+void
+capture_stop(void)
+{
+	if(!capture_active)
+		return;
+
+	capture_active = false;
+	if(fclose(capture_file) != 0)
+		ierror("traffic capture: error closing file: %s", strerror(errno));
+	capture_file = NULL;
+	rb_free(capture_buf);
+	capture_buf = NULL;
+}
+
+void
+capture_status(size_t *written, size_t *limit, unsigned int *connections)
+{
+	*written = capture_written;
+	*limit = capture_limit;
+	*connections = capture_next - capture_base;
+}
+
+/* capture_data()
+ *
+ * inputs	- local client, what was just read from it
+ * outputs	- none
+ * side effects - the data is appended to the capture, preceded by an open
+ *		  record the first time the client is seen, unless the
+ *		  client was connected before the capture began
+ */
+void
+capture_data(struct Client *client_p, const char *buf, size_t len)
+{
+	struct LocalUser *lclient_p = client_p->localClient;
+
+	if(lclient_p->capture_id == capture_base)
+		return;
+
+	if(lclient_p->capture_id < capture_base)
+	{
+		lclient_p->capture_id = ++capture_next;
+		capture_record(CAPTURE_OPEN, lclient_p->capture_id, NULL, 0);
+	}
+
+	if(capture_active)
+		capture_record(CAPTURE_DATA, lclient_p->capture_id, buf, len);
+}
+
+/* capture_close()
+ *
+ * inputs	- local client that is going away
+ * outputs	- none
+ * side effects - a close record is written if the client is in the capture
+ */
+void
+capture_close(struct Client *client_p)
+{
+	if(client_p->localClient->capture_id > capture_base)
+		capture_record(CAPTURE_CLOSE, client_p->localClient->capture_id, NULL, 0);
+}
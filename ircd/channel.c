@@ -80,9 +80,12 @@ init_channels(void)
 struct Channel *
 allocate_channel(const char *chname)
 {
+	static unsigned int summary_next;
 	struct Channel *chptr;
 	chptr = rb_bh_alloc(channel_heap);
 	chptr->chname = rb_strdup(chname);
+	chptr->access_serial = 1;
+	chptr->summary_bit = UINT64_C(1) << (summary_next++ % 64);
 	return (chptr);
 }
 
@@ -102,6 +105,7 @@ allocate_ban(const char *banstr, const char *who, const char *forward)
 	bptr->banstr = rb_strdup(banstr);
 	bptr->who = rb_strdup(who);
 	bptr->forward = forward ? rb_strdup(forward) : NULL;
+	bptr->prog = *banstr != '$' ? match_compile(banstr) : NULL;
 
 	return (bptr);
 }
@@ -112,6 +116,8 @@ free_ban(struct Ban *bptr)
 	rb_free(bptr->banstr);
 	rb_free(bptr->who);
 	rb_free(bptr->forward);
+	if(bptr->prog != NULL)
+		match_free(bptr->prog);
 	rb_bh_free(ban_heap, bptr);
 }
 
@@ -185,6 +191,89 @@ find_channel_membership(struct Channel *chptr, struct Client *client_p)
 	return NULL;
 }
 
+/* channel_summary()
+ *
+ * input	- user
+ * output	- bitset with the summary_bit of every channel they are on
+ * side effects - the summary is rebuilt if channels were left since
+ */
+static uint64_t
+channel_summary(struct User *user)
+{
+	rb_dlink_node *ptr;
+
+	if(user->channel_summary_stale)
+	{
+		user->channel_summary = 0;
+		RB_DLINK_FOREACH(ptr, user->channel.head)
+		{
+			struct membership *msptr = ptr->data;
+			user->channel_summary |= msptr->chptr->summary_bit;
+		}
+		user->channel_summary_stale = false;
+	}
+
+	return user->channel_summary;
+}
+
+/* find_common_channel()
+ *
+ * input	- source and target clients, membership flags the source
+ *		  must have one of on the channel, or 0
+ * output	- a channel both are on, or NULL
+ * side effects -
+ *
+ * Users who share no channel nearly always have disjoint channel
+ * summaries, which answers without looking at a single channel.
+ * Otherwise only the channels of the user on fewer of them whose bit is
+ * in the other's summary are checked.
+ */
+struct Channel *
+find_common_channel(struct Client *source_p, struct Client *target_p, unsigned int source_flags)
+{
+	struct Client *walk_p, *other_p;
+	uint64_t common;
+	rb_dlink_node *ptr;
+
+	if(source_p->user == NULL || target_p->user == NULL)
+		return NULL;
+
+	common = channel_summary(source_p->user) & channel_summary(target_p->user);
+	if(common == 0)
+		return NULL;
+
+	if(rb_dlink_list_length(&source_p->user->channel) <= rb_dlink_list_length(&target_p->user->channel))
+	{
+		walk_p = source_p;
+		other_p = target_p;
+	}
+	else
+	{
+		walk_p = target_p;
+		other_p = source_p;
+	}
+
+	RB_DLINK_FOREACH(ptr, walk_p->user->channel.head)
+	{
+		struct membership *msptr = ptr->data, *other_msptr;
+		struct membership *source_msptr;
+
+		if((msptr->chptr->summary_bit & common) == 0)
+			continue;
+
+		if((other_msptr = find_channel_membership(msptr->chptr, other_p)) == NULL)
+			continue;
+
+		source_msptr = walk_p == source_p ? msptr : other_msptr;
+		if(source_flags != 0 && (source_msptr->flags & source_flags) == 0)
+			continue;
+
+		return msptr->chptr;
+	}
+
+	return NULL;
+}
+
 /* find_channel_status()
  *
  * input	- membership to get status for, whether we can combine flags
@@ -243,6 +332,7 @@ add_user_to_channel(struct Channel *chptr, struct Client *client_p, int flags)
 
 	rb_dlinkAdd(msptr, &msptr->usernode, &client_p->user->channel);
 	rb_dlinkAdd(msptr, &msptr->channode, &chptr->members);
+	client_p->user->channel_summary |= chptr->summary_bit;
 
 	if(MyClient(client_p))
 		rb_dlinkAdd(msptr, &msptr->locchannode, &chptr->locmembers);
@@ -268,6 +358,7 @@ remove_user_from_channel(struct membership *msptr)
 
 	rb_dlinkDelete(&msptr->usernode, &client_p->user->channel);
 	rb_dlinkDelete(&msptr->channode, &chptr->members);
+	client_p->user->channel_summary_stale = true;
 
 	if(client_p->servptr == &me)
 		rb_dlinkDelete(&msptr->locchannode, &chptr->locmembers);
@@ -315,6 +406,8 @@ remove_user_from_channels(struct Client *client_p)
 
 	client_p->user->channel.head = client_p->user->channel.tail = NULL;
 	client_p->user->channel.length = 0;
+	client_p->user->channel_summary = 0;
+	client_p->user->channel_summary_stale = false;
 }
 
 /* invalidate_bancache_user()
@@ -338,6 +431,7 @@ invalidate_bancache_user(struct Client *client_p)
 		msptr = ptr->data;
 		msptr->bants = 0;
 		msptr->flags &= ~CHFL_BANNED;
+		msptr->access_serial = 0;
 	}
 }
 
@@ -570,7 +664,7 @@ is_banned_list(struct Channel *chptr, rb_dlink_list *list,
 	RB_DLINK_FOREACH(ptr, list->head)
 	{
 		actualBan = ptr->data;
-		if (matches_mask(ms, actualBan->banstr))
+		if (matches_mask_compiled(ms, actualBan->banstr, actualBan->prog))
 			break;
 		if (match_extban(actualBan->banstr, who, chptr, CHFL_BAN))
 			break;
@@ -584,7 +678,7 @@ is_banned_list(struct Channel *chptr, rb_dlink_list *list,
 			actualExcept = ptr->data;
 
 			/* theyre exempted.. */
-			if (matches_mask(ms, actualExcept->banstr) ||
+			if (matches_mask_compiled(ms, actualExcept->banstr, actualExcept->prog) ||
 					match_extban(actualExcept->banstr, who, chptr, CHFL_BAN))
 			{
 				/* cache the fact theyre not banned */
@@ -706,7 +800,7 @@ can_join(struct Client *source_p, struct Channel *chptr, const char *key, const
 			RB_DLINK_FOREACH(ptr, chptr->invexlist.head)
 			{
 				invex = ptr->data;
-				if (matches_mask(&ms, invex->banstr) ||
+				if (matches_mask_compiled(&ms, invex->banstr, invex->prog) ||
 						match_extban(invex->banstr, source_p, chptr, CHFL_INVEX))
 					break;
 			}
@@ -811,7 +905,7 @@ can_send(struct Channel *chptr, struct Client *source_p, struct membership *mspt
 	moduledata.target = NULL;
 	moduledata.dir = (moduledata.approved == CAN_SEND_NO) ? MODE_ADD : MODE_QUERY;
 
-	call_hook(h_can_send, &moduledata);
+	call_hook_filtered(h_can_send, &moduledata, HOOK_ANY, source_p->umodes, chptr->mode.mode);
 
 	return moduledata.approved;
 }
@@ -1105,7 +1199,7 @@ channel_modes(struct Channel *chptr, struct Client *client_p)
 
 	for (i = 0; i < 256; i++)
 	{
-		if(chmode_table[i].set_func == chm_hidden && (!HasPrivilege(client_p, "auspex:cmodes") || !IsClient(client_p)))
+		if(chmode_table[i].set_func == chm_hidden && (!HasPrivilegeId(client_p, PRIVID_AUSPEX_CMODES) || !IsClient(client_p)))
 			continue;
 		if(chptr->mode.mode & chmode_flags[i])
 			*mbuf++ = i;
@@ -29,7 +29,260 @@
 
 #include "stdinc.h"
 #include "channel_access.h"
+#include "match.h"
 #include "s_assert.h"
+#include "rb_dictionary.h"
+#include "rb_radixtree.h"
+#include "rb_patricia.h"
+
+/*
+ * Access lists are indexed so that matching a joining client does not
+ * have to run every mask against it:
+ *
+ *   - masks without wildcards are looked up by the client's
+ *     nick!user@host strings,
+ *   - $a:account entries are looked up by the client's account name,
+ *   - nick!user@ip/len entries live in a patricia tree per family, and
+ *     only the entries whose network covers the client are verified,
+ *   - anything else is kept on a list and matched as before.
+ *
+ * The list order (newest entry first) decides which entry wins when more
+ * than one matches, so every entry carries a sequence number.
+ */
+struct AccessIndex
+{
+	rb_dictionary *masks;
+	rb_radixtree *exact;
+	rb_radixtree *account;
+	rb_patricia_tree_t *cidr4;
+	rb_patricia_tree_t *cidr6;
+	rb_dlink_list glob;
+};
+
+enum access_kind
+{
+	ACCESS_GLOB,
+	ACCESS_EXACT,
+	ACCESS_ACCOUNT,
+	ACCESS_CIDR
+};
+
+static unsigned long access_seq = 0;
+
+static bool
+has_wildcards(const char *s)
+{
+	return strpbrk(s, "*?") != NULL;
+}
+
+/*
+ * access_parse_cidr
+ *
+ * inputs	- address part of a mask (after the last '@')
+ * output	- true if it is an ip/len network match_cidr() would accept
+ * side effects	- addr and bitlen are filled in
+ */
+static bool
+access_parse_cidr(const char *ipmask, struct rb_sockaddr_storage *addr, int *bitlen)
+{
+	char buf[BUFSIZE];
+	char *len;
+
+	rb_strlcpy(buf, ipmask, sizeof buf);
+	if ((len = strrchr(buf, '/')) == NULL)
+		return false;
+	*len++ = '\0';
+
+	*bitlen = atoi(len);
+	if (*bitlen <= 0)
+		return false;
+
+	memset(addr, 0, sizeof *addr);
+	if (strchr(buf, ':') != NULL)
+	{
+		if (*bitlen > 128)
+			return false;
+		SET_SS_FAMILY(addr, AF_INET6);
+		return rb_inet_pton(AF_INET6, buf, &((struct sockaddr_in6 *)addr)->sin6_addr) > 0;
+	}
+
+	if (*bitlen > 32)
+		return false;
+	SET_SS_FAMILY(addr, AF_INET);
+	return rb_inet_pton(AF_INET, buf, &((struct sockaddr_in *)addr)->sin_addr) > 0;
+}
+
+static enum access_kind
+access_classify(const char *mask, struct rb_sockaddr_storage *addr, int *bitlen)
+{
+	const char *ipmask;
+
+	if (*mask == '$')
+	{
+		if (irctolower(mask[1]) == 'a' && mask[2] == ':' && mask[3] != '\0' && !has_wildcards(mask + 3))
+			return ACCESS_ACCOUNT;
+		return ACCESS_GLOB;
+	}
+
+	if ((ipmask = strrchr(mask, '@')) != NULL && !has_wildcards(ipmask) &&
+			access_parse_cidr(ipmask + 1, addr, bitlen))
+		return ACCESS_CIDR;
+
+	if (!has_wildcards(mask))
+		return ACCESS_EXACT;
+
+	return ACCESS_GLOB;
+}
+
+static rb_patricia_tree_t *
+access_cidr_tree(struct AccessIndex *idx, struct rb_sockaddr_storage *addr)
+{
+	return GET_SS_FAMILY(addr) == AF_INET6 ? idx->cidr6 : idx->cidr4;
+}
+
+static void
+access_bucket_add(rb_radixtree *tree, const char *key, struct AccessEntry *ae)
+{
+	rb_dlink_list *bucket = rb_radixtree_retrieve(tree, key);
+
+	if (bucket == NULL)
+	{
+		bucket = rb_malloc(sizeof(rb_dlink_list));
+		rb_radixtree_add(tree, key, bucket);
+	}
+
+	rb_dlinkAdd(ae, &ae->index_node, bucket);
+}
+
+static void
+access_bucket_delete(rb_radixtree *tree, const char *key, struct AccessEntry *ae)
+{
+	rb_dlink_list *bucket = rb_radixtree_retrieve(tree, key);
+
+	s_assert(bucket != NULL);
+	if (bucket == NULL)
+		return;
+
+	rb_dlinkDelete(&ae->index_node, bucket);
+	if (rb_dlink_list_length(bucket) == 0)
+	{
+		rb_radixtree_delete(tree, key);
+		rb_free(bucket);
+	}
+}
+
+static void
+access_index_add(struct Channel *chptr, struct AccessEntry *ae)
+{
+	struct AccessIndex *idx = chptr->access_index;
+	struct rb_sockaddr_storage addr;
+	rb_patricia_node_t *pnode;
+	int bitlen;
+
+	if (idx == NULL)
+	{
+		idx = chptr->access_index = rb_malloc(sizeof(struct AccessIndex));
+		idx->masks = rb_dictionary_create("access masks", rb_strcasecmp);
+		idx->exact = rb_radixtree_create("access exact", irccasecanon);
+		idx->account = rb_radixtree_create("access account", irccasecanon);
+		idx->cidr4 = rb_new_patricia(32);
+		idx->cidr6 = rb_new_patricia(128);
+	}
+
+	rb_dictionary_add(idx->masks, ae->mask, ae);
+
+	switch (access_classify(ae->mask, &addr, &bitlen))
+	{
+	case ACCESS_EXACT:
+		access_bucket_add(idx->exact, ae->mask, ae);
+		break;
+	case ACCESS_ACCOUNT:
+		access_bucket_add(idx->account, ae->mask + 3, ae);
+		break;
+	case ACCESS_CIDR:
+		pnode = make_and_lookup_ip(access_cidr_tree(idx, &addr), (struct sockaddr *)&addr, bitlen);
+		if (pnode->data == NULL)
+			pnode->data = rb_malloc(sizeof(rb_dlink_list));
+		rb_dlinkAdd(ae, &ae->index_node, pnode->data);
+		break;
+	default:
+		rb_dlinkAdd(ae, &ae->index_node, &idx->glob);
+		break;
+	}
+}
+
+static void
+access_index_delete(struct Channel *chptr, struct AccessEntry *ae)
+{
+	struct AccessIndex *idx = chptr->access_index;
+	struct rb_sockaddr_storage addr;
+	rb_patricia_tree_t *tree;
+	rb_patricia_node_t *pnode;
+	rb_dlink_list *bucket;
+	int bitlen;
+
+	s_assert(idx != NULL);
+	if (idx == NULL)
+		return;
+
+	rb_dictionary_delete(idx->masks, ae->mask);
+
+	switch (access_classify(ae->mask, &addr, &bitlen))
+	{
+	case ACCESS_EXACT:
+		access_bucket_delete(idx->exact, ae->mask, ae);
+		break;
+	case ACCESS_ACCOUNT:
+		access_bucket_delete(idx->account, ae->mask + 3, ae);
+		break;
+	case ACCESS_CIDR:
+		tree = access_cidr_tree(idx, &addr);
+		pnode = make_and_lookup_ip(tree, (struct sockaddr *)&addr, bitlen);
+		bucket = pnode->data;
+		rb_dlinkDelete(&ae->index_node, bucket);
+		if (rb_dlink_list_length(bucket) == 0)
+		{
+			rb_free(bucket);
+			rb_patricia_remove(tree, pnode);
+		}
+		break;
+	default:
+		rb_dlinkDelete(&ae->index_node, &idx->glob);
+		break;
+	}
+}
+
+static void
+access_index_free_bucket(const char *key, void *data, void *privdata)
+{
+	rb_free(data);
+}
+
+static void
+access_index_destroy(struct Channel *chptr)
+{
+	struct AccessIndex *idx = chptr->access_index;
+
+	if (idx == NULL)
+		return;
+
+	rb_dictionary_destroy(idx->masks, NULL, NULL);
+	rb_radixtree_destroy(idx->exact, access_index_free_bucket, NULL);
+	rb_radixtree_destroy(idx->account, access_index_free_bucket, NULL);
+	rb_destroy_patricia(idx->cidr4, rb_free);
+	rb_destroy_patricia(idx->cidr6, rb_free);
+	rb_free(idx);
+
+	chptr->access_index = NULL;
+}
+
+static void
+access_channel_changed(struct Channel *chptr)
+{
+	/* 0 is reserved for "not cached" in struct membership */
+	if (++chptr->access_serial == 0)
+		chptr->access_serial = 1;
+}
 
 struct AccessEntry *
 channel_access_upsert(struct Channel *chptr, struct Client *source_p, const char *mask, unsigned int flags)
@@ -46,8 +299,11 @@ channel_access_upsert(struct Channel *chptr, struct Client *source_p, const char
 	ae->who = rb_strdup(source_p->name);
 	ae->flags = flags;
 	ae->when = rb_current_time();
+	ae->seq = ++access_seq;
 
 	rb_dlinkAdd(ae, &ae->node, &chptr->access_list);
+	access_index_add(chptr, ae);
+	access_channel_changed(chptr);
 
 	return ae;
 }
@@ -58,17 +314,10 @@ channel_access_find(struct Channel *chptr, const char *mask)
 	s_assert(chptr != NULL);
 	s_assert(mask != NULL);
 
-	rb_dlink_node *iter;
-
-	RB_DLINK_FOREACH(iter, chptr->access_list.head)
-	{
-		struct AccessEntry *ae = iter->data;
-
-		if (!rb_strcasecmp(ae->mask, mask))
-			return ae;
-	}
+	if (chptr->access_index == NULL)
+		return NULL;
 
-	return NULL;
+	return rb_dictionary_retrieve(chptr->access_index->masks, mask);
 }
 
 static void
@@ -77,7 +326,9 @@ channel_access_delete_one(struct Channel *chptr, struct AccessEntry *ae)
 	s_assert(chptr != NULL);
 	s_assert(ae != NULL);
 
+	access_index_delete(chptr, ae);
 	rb_dlinkDelete(&ae->node, &chptr->access_list);
+	access_channel_changed(chptr);
 
 	rb_free(ae->mask);
 	rb_free(ae->who);
@@ -106,33 +357,187 @@ channel_access_clear(struct Channel *chptr)
 
 	RB_DLINK_FOREACH_SAFE(iter, next, chptr->access_list.head)
 	{
-		channel_access_delete_one(chptr, iter->data);
+		struct AccessEntry *ae = iter->data;
+
+		rb_free(ae->mask);
+		rb_free(ae->who);
+		rb_free(ae);
 	}
+
+	chptr->access_list.head = chptr->access_list.tail = NULL;
+	chptr->access_list.length = 0;
+
+	access_index_destroy(chptr);
+	access_channel_changed(chptr);
 }
 
-struct AccessEntry *
-channel_access_match(struct Channel *chptr, struct Client *client_p)
+/* picks the newest entry of a bucket, if it beats the best so far */
+static struct AccessEntry *
+access_newest(rb_dlink_list *bucket, struct AccessEntry *best)
 {
-	s_assert(chptr != NULL);
-	s_assert(client_p != NULL);
+	rb_dlink_node *iter;
+
+	if (bucket == NULL)
+		return best;
+
+	RB_DLINK_FOREACH(iter, bucket->head)
+	{
+		struct AccessEntry *ae = iter->data;
+
+		if (best == NULL || ae->seq > best->seq)
+			best = ae;
+	}
+
+	return best;
+}
+
+static struct AccessEntry *
+access_match_cidr(struct AccessIndex *idx, const char *ipstr, struct AccessEntry *best)
+{
+	struct rb_sockaddr_storage addr;
+	rb_patricia_tree_t *tree;
+	rb_patricia_node_t *pnode;
+	const char *ip;
+	void *ipptr;
+
+	if ((ip = strrchr(ipstr, '@')) == NULL)
+		return best;
+	ip++;
+
+	memset(&addr, 0, sizeof addr);
+	if (strchr(ip, ':') != NULL)
+	{
+		SET_SS_FAMILY(&addr, AF_INET6);
+		ipptr = &((struct sockaddr_in6 *)&addr)->sin6_addr;
+	}
+	else
+	{
+		SET_SS_FAMILY(&addr, AF_INET);
+		ipptr = &((struct sockaddr_in *)&addr)->sin_addr;
+	}
+
+	if (rb_inet_pton(GET_SS_FAMILY(&addr), ip, ipptr) <= 0)
+		return best;
+
+	tree = access_cidr_tree(idx, &addr);
+
+	/* every network covering the address is on the path to the best match */
+	for (pnode = rb_match_ip(tree, (struct sockaddr *)&addr); pnode != NULL; pnode = pnode->parent)
+	{
+		rb_dlink_node *iter;
+
+		if (pnode->prefix == NULL || pnode->data == NULL)
+			continue;
+
+		if (!comp_with_mask(ipptr, &pnode->prefix->add, pnode->prefix->bitlen))
+			continue;
+
+		RB_DLINK_FOREACH(iter, ((rb_dlink_list *) pnode->data)->head)
+		{
+			struct AccessEntry *ae = iter->data;
+
+			if ((best == NULL || ae->seq > best->seq) && match_cidr(ae->mask, ipstr))
+				best = ae;
+		}
+	}
+
+	return best;
+}
+
+/*
+ * access_match
+ *
+ * As channel_access_match(), but also says whether an extban was looked
+ * at.  Those depend on oper status, TLS, realname, other channels and
+ * more, none of which invalidate a cached level.
+ */
+static struct AccessEntry *
+access_match(struct Channel *chptr, struct Client *client_p, bool *used_extban)
+{
+	*used_extban = false;
 
 	if (!MyClient(client_p))
 		return NULL;
 
+	struct AccessIndex *idx = chptr->access_index;
+	if (idx == NULL)
+		return NULL;
+
 	struct matchset ms;
 	matchset_for_client(client_p, &ms);
 
+	struct AccessEntry *best = NULL;
+
+	for (int i = 0; i < ARRAY_SIZE(ms.host) && ms.host[i][0] != '\0'; i++)
+		best = access_newest(rb_radixtree_retrieve(idx->exact, ms.host[i]), best);
+
+	for (int i = 0; i < ARRAY_SIZE(ms.ip) && ms.ip[i][0] != '\0'; i++)
+	{
+		best = access_newest(rb_radixtree_retrieve(idx->exact, ms.ip[i]), best);
+		best = access_match_cidr(idx, ms.ip[i], best);
+	}
+
+	/* the account index assumes $a has its stock meaning (extb_account) */
+	if (!EmptyString(client_p->user->suser) && extban_table['a'] != NULL)
+		best = access_newest(rb_radixtree_retrieve(idx->account, client_p->user->suser), best);
+
 	rb_dlink_node *iter;
-	RB_DLINK_FOREACH(iter, chptr->access_list.head)
+	RB_DLINK_FOREACH(iter, idx->glob.head)
 	{
 		struct AccessEntry *ae = iter->data;
 
+		/* newest first, nothing further down can beat what we have */
+		if (best != NULL && ae->seq < best->seq)
+			break;
+
 		if (matches_mask(&ms, ae->mask))
 			return ae;
 
-		if (match_extban(ae->mask, client_p, chptr, CHFL_ACL))
-			return ae;
+		if (*ae->mask == '$')
+		{
+			*used_extban = true;
+			if (match_extban(ae->mask, client_p, chptr, CHFL_ACL))
+				return ae;
+		}
+	}
+
+	return best;
+}
+
+struct AccessEntry *
+channel_access_match(struct Channel *chptr, struct Client *client_p)
+{
+	bool used_extban;
+
+	s_assert(chptr != NULL);
+	s_assert(client_p != NULL);
+
+	return access_match(chptr, client_p, &used_extban);
+}
+
+/*
+ * channel_access_level
+ *
+ * inputs	- channel, local member
+ * output	- flags of the access entry matching the member, or 0
+ * side effects	- the result is cached on the membership until the access
+ *		  list or the member's identity changes, unless an extban
+ *		  had to be evaluated for it
+ */
+unsigned int
+channel_access_level(struct Channel *chptr, struct membership *msptr)
+{
+	s_assert(chptr != NULL);
+	s_assert(msptr != NULL);
+
+	if (msptr->access_serial != chptr->access_serial)
+	{
+		bool used_extban;
+		struct AccessEntry *ae = access_match(chptr, msptr->client_p, &used_extban);
+
+		msptr->access_flags = ae != NULL ? ae->flags : 0;
+		msptr->access_serial = used_extban ? 0 : chptr->access_serial;
 	}
 
-	return NULL;
+	return msptr->access_flags;
 }
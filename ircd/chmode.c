@@ -721,7 +721,7 @@ chm_staff(struct Client *source_p, struct Channel *chptr,
 		*errors |= SM_ERR_NOPRIVS;
 		return;
 	}
-	if(MyClient(source_p) && !HasPrivilege(source_p, "oper:cmodes"))
+	if(MyClient(source_p) && !HasPrivilegeId(source_p, PRIVID_OPER_CMODES))
 	{
 		if(!(*errors & SM_ERR_NOPRIVS))
 			sendto_one(source_p, form_str(ERR_NOPRIVS), me.name,
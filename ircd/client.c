@@ -33,6 +33,7 @@
 #include "numeric.h"
 #include "packet.h"
 #include "authproc.h"
+#include "capture.h"
 #include "s_conf.h"
 #include "s_newconf.h"
 #include "logger.h"
@@ -306,6 +307,11 @@ free_local_client(struct Client *client_p)
 	if (IsSSL(client_p))
 		ssld_decrement_clicount(client_p->localClient->ssl_ctl);
 
+	if (client_p->localClient->z_ctl != NULL)
+		ssld_decrement_clicount(client_p->localClient->z_ctl);
+
+	rb_free(client_p->localClient->zipstats);
+
 	rb_free(client_p->localClient->cipher_string);
 
 	if (client_p->localClient->ws_ctl != NULL)
@@ -580,9 +586,15 @@ check_one_kline(struct ConfItem *kline)
 	int bits;
 	struct rb_sockaddr_storage sockaddr;
 	struct sockaddr_in ip4;
+	struct match_prog *user_prog, *host_prog = NULL;
 
 	masktype = parse_netmask(kline->host, (struct sockaddr_storage *)&sockaddr, &bits);
 
+	/* the same masks are checked against every local client */
+	user_prog = match_compile(kline->user);
+	if(masktype == HM_HOST)
+		host_prog = match_compile(kline->host);
+
 	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, lclient_list.head)
 	{
 		int matched = 0;
@@ -592,7 +604,7 @@ check_one_kline(struct ConfItem *kline)
 		if(IsMe(client_p) || !IsPerson(client_p))
 			continue;
 
-		if(!match(kline->user, client_p->username))
+		if(!match_compiled(user_prog, client_p->username))
 			continue;
 
 		/* match one kline */
@@ -612,12 +624,12 @@ check_one_kline(struct ConfItem *kline)
 				matched = 1;
 			break;
 		case HM_HOST:
-			if (match(kline->host, client_p->orighost))
+			if (match_compiled(host_prog, client_p->orighost))
 				matched = 1;
 			if (IsConfDoSpoofIp(client_p->localClient->att_conf) &&
 					IsConfKlineSpoof(client_p->localClient->att_conf))
 				continue;
-			if (match(kline->host, client_p->sockhost))
+			if (match_compiled(host_prog, client_p->sockhost))
 				matched = 1;
 			break;
 		}
@@ -640,6 +652,10 @@ check_one_kline(struct ConfItem *kline)
 
 		notify_banned_client(client_p, kline, K_LINED);
 	}
+
+	match_free(user_prog);
+	if(host_prog != NULL)
+		match_free(host_prog);
 }
 
 
@@ -1254,6 +1270,7 @@ remove_dependents(struct Client *client_p,
 {
 	struct Client *to;
 	rb_dlink_node *ptr, *next;
+	bool opened;
 
 	RB_DLINK_FOREACH_SAFE(ptr, next, serv_list.head)
 	{
@@ -1265,7 +1282,12 @@ remove_dependents(struct Client *client_p,
 		sendto_one(to, "SQUIT %s :%s", get_id(source_p, to), comment);
 	}
 
+	/* comment1 is "uplink server", just what a netsplit batch wants */
+	opened = send_batch_begin("netsplit", comment1);
 	recurse_remove_clients(source_p, comment1);
+	send_batch_end();
+	if(opened)
+		send_batch_close();
 }
 
 void
@@ -1829,11 +1851,11 @@ show_ip(struct Client *source_p, struct Client *target_p)
 		 * to local opers.
 		 */
 		if(!ConfigFileEntry.hide_spoof_ips &&
-		   (source_p == NULL || (MyConnect(source_p) && HasPrivilege(source_p, "auspex:hostname"))))
+		   (source_p == NULL || (MyConnect(source_p) && HasPrivilegeId(source_p, PRIVID_AUSPEX_HOSTNAME))))
 			return 1;
 		return 0;
 	}
-	else if(IsDynSpoof(target_p) && (source_p != NULL && !HasPrivilege(source_p, "auspex:hostname")))
+	else if(IsDynSpoof(target_p) && (source_p != NULL && !HasPrivilegeId(source_p, PRIVID_AUSPEX_HOSTNAME)))
 		return 0;
 	else
 		return 1;
@@ -2049,6 +2071,11 @@ close_connection(struct Client *client_p)
 	if(!MyConnect(client_p))
 		return;
 
+	if(capture_active)
+		capture_close(client_p);
+
+	send_batch_remove(client_p);
+
 	if(IsServer(client_p))
 	{
 		struct server_conf *server_p;
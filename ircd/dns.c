@@ -44,7 +44,7 @@
 #define DNS_REVERSE_IPV6	((char)'S')
 
 static void submit_dns(uint32_t uid, char type, const char *addr);
-static void submit_dns_stat(uint32_t uid);
+static void submit_dns_stat(uint32_t uid, char letter);
 
 struct dnsreq
 {
@@ -63,6 +63,7 @@ static rb_dictionary *query_dict;
 static rb_dictionary *stat_dict;
 
 rb_dlink_list nameservers;
+char dns_cache_stats[BUFSIZE];
 
 static uint32_t query_id = 0;
 static uint32_t stat_id = 0;
@@ -180,7 +181,7 @@ lookup_ip(const char *addr, int aftype, DNSCB callback, void *data)
 }
 
 static uint32_t
-get_nameservers(DNSLISTCB callback, void *data)
+get_dns_stats(char letter, DNSLISTCB callback, void *data)
 {
 	struct dnsstatreq *req = rb_malloc(sizeof(struct dnsstatreq));
 	uint32_t qid = assign_id(&stat_id);
@@ -192,7 +193,7 @@ get_nameservers(DNSLISTCB callback, void *data)
 	req->callback = callback;
 	req->data = data;
 
-	submit_dns_stat(qid);
+	submit_dns_stat(qid, letter);
 	return (qid);
 }
 
@@ -302,21 +303,56 @@ stats_results_callback(int resc, const char *resv[], int status, void *data)
 	}
 }
 
+static void
+cache_stats_results_callback(int resc, const char *resv[], int status, void *data)
+{
+	char *p = dns_cache_stats;
+	size_t left = sizeof(dns_cache_stats);
+
+	if(status != 0)
+		return;
+
+	dns_cache_stats[0] = '\0';
+	for(int i = 0; i < resc && left > 1; i++)
+	{
+		int len = snprintf(p, left, "%s%s", i ? " " : "", resv[i]);
+
+		if(len < 0 || (size_t)len >= left)
+			break;
+
+		p += len;
+		left -= len;
+	}
+}
+
+/*
+ * refresh_dns_cache_stats - ask authd for its DNS cache counters
+ *
+ * The answer arrives asynchronously and replaces dns_cache_stats.
+ */
+void
+refresh_dns_cache_stats(void)
+{
+	(void)get_dns_stats('C', cache_stats_results_callback, NULL);
+}
+
 
 void
 init_dns(void)
 {
 	query_dict = rb_dictionary_create("dns queries", rb_uint32cmp);
 	stat_dict = rb_dictionary_create("dns stat queries", rb_uint32cmp);
-	(void)get_nameservers(stats_results_callback, NULL);
+	(void)get_dns_stats('D', stats_results_callback, NULL);
+	refresh_dns_cache_stats();
 }
 
 void
 reload_nameservers(void)
 {
 	check_authd();
-	rb_helper_write(authd_helper, "R D");
-	(void)get_nameservers(stats_results_callback, NULL);
+	authd_broadcast("R D");
+	(void)get_dns_stats('D', stats_results_callback, NULL);
+	refresh_dns_cache_stats();
 }
 
 
@@ -328,16 +364,16 @@ submit_dns(uint32_t nid, char type, const char *addr)
 		handle_dns_failure(nid);
 		return;
 	}
-	rb_helper_write(authd_helper, "D %x %c %s", nid, type, addr);
+	rb_helper_write_batch(authd_helper, "D %x %c %s", nid, type, addr);
 }
 
 static void
-submit_dns_stat(uint32_t nid)
+submit_dns_stat(uint32_t nid, char letter)
 {
 	if(authd_helper == NULL)
 	{
 		handle_dns_stat_failure(nid);
 		return;
 	}
-	rb_helper_write(authd_helper, "S %x D", nid);
+	rb_helper_write(authd_helper, "S %x %c", nid, letter);
 }
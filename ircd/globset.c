@@ -0,0 +1,267 @@
+/*
+ * ircd/globset.c
+ * Copyright (c) 2026 Ophion development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stdinc.h"
+#include "match.h"
+#include "s_assert.h"
+#include "globset.h"
+
+#define GLOBSET_BUCKETS		4096	/* must be a power of two */
+#define GLOBSET_GRAM		3
+
+struct GlobSetEntry
+{
+	char *mask;
+	void *data;
+	unsigned long seq;	/* order of insertion, newest wins */
+	unsigned int stamp;	/* last lookup that looked at this entry */
+	rb_dlink_list *list;	/* trigram bucket or the unindexed list */
+	rb_dlink_node node;
+	rb_dlink_node mask_node;
+};
+
+struct GlobSet
+{
+	rb_radixtree *masks;	/* mask -> rb_dlink_list of entries */
+	rb_dlink_list buckets[GLOBSET_BUCKETS];
+	rb_dlink_list unindexed;	/* masks without a literal trigram */
+	unsigned long seq;
+	unsigned int stamp;
+	unsigned int count;
+};
+
+static inline unsigned int
+gram_bucket(const unsigned char *gram)
+{
+	uint32_t h = ((uint32_t)gram[0] << 16) | ((uint32_t)gram[1] << 8) | gram[2];
+
+	h *= 0x9E3779B1U;
+	return h >> (32 - 12) & (GLOBSET_BUCKETS - 1);
+}
+
+/* Pick the least populated bucket among the trigrams of literal text in mask,
+ * following the escaping rules of match_esc().  Returns -1 if the mask has no
+ * run of GLOBSET_GRAM literal characters.
+ */
+static int
+pick_bucket(struct GlobSet *set, const char *mask)
+{
+	const unsigned char *m = (const unsigned char *)mask;
+	unsigned char run[GLOBSET_GRAM];
+	size_t runlen = 0;
+	int best = -1;
+
+	while(*m)
+	{
+		unsigned char c;
+
+		if(*m == '\\')
+		{
+			m++;
+			if(!*m)
+				break;
+			c = *m == 's' ? ' ' : irctolower(*m);
+		}
+		else if(*m == '*' || *m == '?' || *m == '@' || *m == '#')
+		{
+			runlen = 0;
+			m++;
+			continue;
+		}
+		else
+			c = irctolower(*m);
+
+		m++;
+
+		if(runlen == GLOBSET_GRAM)
+			memmove(run, run + 1, GLOBSET_GRAM - 1), runlen--;
+		run[runlen++] = c;
+
+		if(runlen == GLOBSET_GRAM)
+		{
+			int b = gram_bucket(run);
+
+			if(best == -1 || rb_dlink_list_length(&set->buckets[b]) < rb_dlink_list_length(&set->buckets[best]))
+				best = b;
+		}
+	}
+
+	return best;
+}
+
+struct GlobSet *
+globset_create(const char *name)
+{
+	struct GlobSet *set = rb_malloc(sizeof(struct GlobSet));
+
+	set->masks = rb_radixtree_create(name, irccasecanon);
+	return set;
+}
+
+void
+globset_add(struct GlobSet *set, const char *mask, void *data)
+{
+	struct GlobSetEntry *entry = rb_malloc(sizeof(struct GlobSetEntry));
+	rb_dlink_list *masklist;
+	int bucket;
+
+	entry->mask = rb_strdup(mask);
+	entry->data = data;
+	entry->seq = ++set->seq;
+
+	bucket = pick_bucket(set, mask);
+	entry->list = bucket == -1 ? &set->unindexed : &set->buckets[bucket];
+	rb_dlinkAdd(entry, &entry->node, entry->list);
+
+	if((masklist = rb_radixtree_retrieve(set->masks, mask)) == NULL)
+	{
+		masklist = rb_malloc(sizeof(rb_dlink_list));
+		rb_radixtree_add(set->masks, mask, masklist);
+	}
+	rb_dlinkAdd(entry, &entry->mask_node, masklist);
+
+	set->count++;
+}
+
+void
+globset_delete(struct GlobSet *set, const char *mask, void *data)
+{
+	rb_dlink_list *masklist = rb_radixtree_retrieve(set->masks, mask);
+	rb_dlink_node *ptr;
+
+	if(masklist == NULL)
+		return;
+
+	RB_DLINK_FOREACH(ptr, masklist->head)
+	{
+		struct GlobSetEntry *entry = ptr->data;
+
+		if(entry->data != data)
+			continue;
+
+		rb_dlinkDelete(&entry->node, entry->list);
+		rb_dlinkDelete(&entry->mask_node, masklist);
+		rb_free(entry->mask);
+		rb_free(entry);
+		set->count--;
+		break;
+	}
+
+	if(rb_dlink_list_length(masklist) == 0)
+	{
+		rb_radixtree_delete(set->masks, mask);
+		rb_free(masklist);
+	}
+}
+
+static void
+reset_stamps(struct GlobSet *set)
+{
+	rb_radixtree_iteration_state iter;
+	rb_dlink_list *masklist;
+	rb_dlink_node *ptr;
+
+	RB_RADIXTREE_FOREACH(masklist, &iter, set->masks)
+	{
+		RB_DLINK_FOREACH(ptr, masklist->head)
+			((struct GlobSetEntry *)ptr->data)->stamp = 0;
+	}
+
+	set->stamp = 1;
+}
+
+/* Lists are kept newest first, so a list can be abandoned as soon as it gets
+ * to entries older than the best match found so far.
+ */
+static struct GlobSetEntry *
+match_list(struct GlobSet *set, rb_dlink_list *list, const char *name, struct GlobSetEntry *best)
+{
+	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, list->head)
+	{
+		struct GlobSetEntry *entry = ptr->data;
+
+		if(best != NULL && entry->seq < best->seq)
+			break;
+
+		if(entry->stamp == set->stamp)
+			continue;
+		entry->stamp = set->stamp;
+
+		if(match_esc(entry->mask, name))
+			return entry;
+	}
+
+	return best;
+}
+
+void *
+globset_match(struct GlobSet *set, const char *name)
+{
+	const unsigned char *n = (const unsigned char *)name;
+	struct GlobSetEntry *best = NULL;
+	unsigned char gram[GLOBSET_GRAM];
+	size_t len = strlen(name);
+
+	if(++set->stamp == 0)
+		reset_stamps(set);
+
+	for(size_t i = 0; i + GLOBSET_GRAM <= len; i++)
+	{
+		for(size_t j = 0; j < GLOBSET_GRAM; j++)
+			gram[j] = irctolower(n[i + j]);
+
+		best = match_list(set, &set->buckets[gram_bucket(gram)], name, best);
+	}
+
+	best = match_list(set, &set->unindexed, name, best);
+
+	return best != NULL ? best->data : NULL;
+}
+
+/* Returns the most recently added entry whose mask is the given one, compared
+ * with irccmp().
+ */
+void *
+globset_find_mask(struct GlobSet *set, const char *mask)
+{
+	rb_dlink_list *masklist = rb_radixtree_retrieve(set->masks, mask);
+
+	if(masklist == NULL || masklist->head == NULL)
+		return NULL;
+
+	return ((struct GlobSetEntry *)masklist->head->data)->data;
+}
+
+unsigned int
+globset_count(const struct GlobSet *set)
+{
+	return set->count;
+}
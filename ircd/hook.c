@@ -37,6 +37,7 @@
 #include "stdinc.h"
 #include "hook.h"
 #include "match.h"
+#include "profile.h"
 
 hook *hooks;
 
@@ -47,12 +48,21 @@ struct hook_entry
 	rb_dlink_node node;
 	hookfn fn;
 	enum hook_priority priority;
+	struct hook_filter filter;
 };
 
 int num_hooks = 0;
 int last_hook = 0;
 int max_hooks = HOOK_INCREMENT;
 
+/* A hook function may add or remove hooks, or register new ones, which
+ * replaces call lists and may move the hook table.  run_hook() works from
+ * the call list it started with, so lists replaced while any hook is
+ * running are kept here until none is.
+ */
+static int hooks_running;
+static rb_dlink_list retired_calls;
+
 int h_burst_client;
 int h_burst_channel;
 int h_burst_finished;
@@ -168,6 +178,7 @@ register_hook(const char *name)
 	{
 		i = find_freehookslot();
 		hooks[i].name = rb_strdup(name);
+		hooks[i].profile = rb_malloc(sizeof(struct rb_histogram));
 		num_hooks++;
 	}
 
@@ -184,11 +195,58 @@ add_hook(const char *name, hookfn fn)
 	add_hook_prio(name, fn, HOOK_NORMAL);
 }
 
+/* compile_hook()
+ *   Rebuilds the flat call list of a hook from its entries.
+ */
+static void
+compile_hook(hook *h)
+{
+	rb_dlink_node *ptr;
+	int n = 0;
+
+	if(hooks_running > 0 && h->calls != NULL)
+		rb_dlinkAddAlloc(h->calls, &retired_calls);
+	else
+		rb_free(h->calls);
+	h->calls = NULL;
+	h->ncalls = 0;
+	h->filtered = false;
+
+	if(rb_dlink_list_length(&h->hooks) == 0)
+		return;
+
+	h->calls = rb_malloc(sizeof(struct hook_call) * rb_dlink_list_length(&h->hooks));
+
+	RB_DLINK_FOREACH(ptr, h->hooks.head)
+	{
+		struct hook_entry *entry = ptr->data;
+
+		h->calls[n].fn = entry->fn;
+		h->calls[n].filter = entry->filter;
+		if(entry->filter.caps != NULL || entry->filter.umodes != NULL ||
+		   entry->filter.chmodes != NULL)
+			h->filtered = true;
+		n++;
+	}
+
+	h->ncalls = n;
+}
+
 /* add_hook_prio()
  *   Adds a hook with the specified priority
  */
 void
 add_hook_prio(const char *name, hookfn fn, enum hook_priority priority)
+{
+	add_hook_filter(name, fn, priority, NULL);
+}
+
+/* add_hook_filter()
+ *   Adds a hook with the specified priority, that call_hook_filtered()
+ *   only calls when the event matches the conditions in filter.
+ */
+void
+add_hook_filter(const char *name, hookfn fn, enum hook_priority priority, const struct hook_filter *filter)
 {
 	rb_dlink_node *ptr;
 	struct hook_entry *entry = rb_malloc(sizeof *entry);
@@ -197,6 +255,8 @@ add_hook_prio(const char *name, hookfn fn, enum hook_priority priority)
 	i = register_hook(name);
 	entry->fn = fn;
 	entry->priority = priority;
+	if(filter != NULL)
+		entry->filter = *filter;
 
 	RB_DLINK_FOREACH(ptr, hooks[i].hooks.head)
 	{
@@ -204,11 +264,13 @@ add_hook_prio(const char *name, hookfn fn, enum hook_priority priority)
 		if (entry->priority <= o->priority)
 		{
 			rb_dlinkAddBefore(ptr, entry, &entry->node, &hooks[i].hooks);
+			compile_hook(&hooks[i]);
 			return;
 		}
 	}
 
 	rb_dlinkAddTail(entry, &entry->node, &hooks[i].hooks);
+	compile_hook(&hooks[i]);
 }
 
 /* remove_hook()
@@ -229,26 +291,88 @@ remove_hook(const char *name, hookfn fn)
 		if (entry->fn == fn)
 		{
 			rb_dlinkDelete(ptr, &hooks[i].hooks);
+			rb_free(entry);
+			compile_hook(&hooks[i]);
 			return;
 		}
 	}
 }
 
-/* call_hook()
- *   Calls functions from a given event in the hook table.
+/* filter_match()
+ *   Whether one condition of a hook entry allows calling it.
  */
-void
-call_hook(int id, void *arg)
+static inline bool
+filter_match(const void *want, unsigned int have)
 {
-	rb_dlink_node *ptr;
+	unsigned int bits;
+
+	if(want == NULL)
+		return true;
 
+	bits = *(const unsigned int *)want;
+	return bits == 0 || (bits & have) != 0;
+}
+
+/* free_retired_calls()
+ *   Frees the call lists replaced while hooks were running.
+ */
+static void
+free_retired_calls(void)
+{
+	rb_dlink_node *ptr, *next;
+
+	RB_DLINK_FOREACH_SAFE(ptr, next, retired_calls.head)
+	{
+		rb_free(ptr->data);
+		rb_dlinkDestroy(ptr, &retired_calls);
+	}
+}
+
+/* run_hook()
+ *   Calls functions from a given event in the hook table, skipping those
+ *   whose conditions don't match.  Used by call_hook() and
+ *   call_hook_filtered().  Hooks added or removed by the functions it
+ *   calls take effect from the next call.
+ */
+void
+run_hook(int id, void *arg, unsigned int caps, unsigned int umodes, unsigned int chmodes)
+{
 	/* The ID we were passed is the position in the hook table of this
-	 * hook
+	 * hook.  The table itself may move, so take what is needed now.
 	 */
-	RB_DLINK_FOREACH(ptr, hooks[id].hooks.head)
+	const struct hook_call *calls = hooks[id].calls;
+	struct rb_histogram *profile = hooks[id].profile;
+	int ncalls = hooks[id].ncalls;
+	uint64_t start = 0;
+
+	if(rb_unlikely(profile_enabled))
+		start = rb_monotonic_ns();
+
+	hooks_running++;
+
+	if(!hooks[id].filtered)
 	{
-		struct hook_entry *entry = ptr->data;
-		entry->fn(arg);
+		for(int i = 0; i < ncalls; i++)
+			calls[i].fn(arg);
 	}
-}
+	else
+	{
+		for(int i = 0; i < ncalls; i++)
+		{
+			const struct hook_call *call = &calls[i];
 
+			if(!filter_match(call->filter.caps, caps) ||
+			   !filter_match(call->filter.umodes, umodes) ||
+			   !filter_match(call->filter.chmodes, chmodes))
+				continue;
+
+			call->fn(arg);
+		}
+	}
+
+	if(--hooks_running == 0 && retired_calls.head != NULL)
+		free_retired_calls();
+
+	if(start != 0)
+		rb_histogram_add(profile, rb_monotonic_ns() - start);
+}
@@ -220,6 +220,51 @@ get_mask_hash(const char *text)
 	return hash_text(text);
 }
 
+/* A name folded once for match_folded(), since find_conf_by_address()
+ * checks it against many masks.
+ */
+struct folded_name
+{
+	const char *name;
+	size_t len;
+	char fold[BUFSIZE];
+};
+
+static void
+fold_name(struct folded_name *f, const char *name)
+{
+	f->name = name;
+	f->len = 0;
+
+	if(name == NULL)
+		return;
+
+	for(; name[f->len] != '\0' && f->len < sizeof(f->fold) - 1; f->len++)
+		f->fold[f->len] = irctolower(name[f->len]);
+
+	/* too long to fold, match_arec() falls back to match() */
+	if(name[f->len] != '\0')
+		f->len = sizeof(f->fold);
+}
+
+static inline int
+match_arec(const char *mask, const struct match_prog *prog, const struct folded_name *f)
+{
+	if(prog == NULL || f->len >= sizeof(f->fold))
+		return match(mask, f->name);
+	return match_folded(prog, f->fold, f->len);
+}
+
+static void
+free_arec(struct AddressRec *arec)
+{
+	if(arec->username_prog != NULL)
+		match_free(arec->username_prog);
+	if(arec->hostname_prog != NULL)
+		match_free(arec->hostname_prog);
+	rb_free(arec);
+}
+
 /* struct ConfItem* find_conf_by_address(const char*, struct rb_sockaddr_storage*,
  *         int type, int fam, const char *username)
  *
@@ -244,9 +289,16 @@ find_conf_by_address(const char *name, const char *sockhost,
 	struct sockaddr *pip4 = NULL;
 	int b;
 
+	struct folded_name fuser, fname, fsockhost, forighost;
+
 	if(username == NULL)
 		username = "";
 
+	fold_name(&fuser, username);
+	fold_name(&fname, name);
+	fold_name(&fsockhost, sockhost);
+	fold_name(&forighost, orighost);
+
 	if(addr)
 	{
 		if (fam == AF_INET)
@@ -264,7 +316,7 @@ find_conf_by_address(const char *name, const char *sockhost,
 					   arec->masktype == HM_IPV6 &&
 					   comp_with_mask_sock(addr, (struct sockaddr *)&arec->Mask.ipa.addr,
 						arec->Mask.ipa.bits) &&
-						(type & 0x1 || match(arec-> username, username)) &&
+						(type & 0x1 || match_arec(arec->username, arec->username_prog, &fuser)) &&
 						(type != CONF_CLIENT || !arec->auth_user ||
 						(auth_user && match(arec->auth_user, auth_user))) &&
 						arec->precedence > hprecv)
@@ -284,7 +336,7 @@ find_conf_by_address(const char *name, const char *sockhost,
 					   arec->masktype == HM_IPV4 &&
 					   comp_with_mask_sock(pip4, (struct sockaddr *)&arec->Mask.ipa.addr,
 							       arec->Mask.ipa.bits) &&
-						(type & 0x1 || match(arec->username, username)) &&
+						(type & 0x1 || match_arec(arec->username, arec->username_prog, &fuser)) &&
 						(type != CONF_CLIENT || !arec->auth_user ||
 						(auth_user && match(arec->auth_user, auth_user))) &&
 						arec->precedence > hprecv)
@@ -307,10 +359,10 @@ find_conf_by_address(const char *name, const char *sockhost,
 				if((arec->type == (type & ~0x1)) &&
 				   (arec->masktype == HM_HOST) &&
 				   arec->precedence > hprecv &&
-				   match(arec->Mask.hostname, orighost) &&
+				   match_arec(arec->Mask.hostname, arec->hostname_prog, &forighost) &&
 				   (type != CONF_CLIENT || !arec->auth_user ||
 				   (auth_user && match(arec->auth_user, auth_user))) &&
-				   (type & 0x1 || match(arec->username, username)))
+				   (type & 0x1 || match_arec(arec->username, arec->username_prog, &fuser)))
 				{
 					hprecv = arec->precedence;
 					hprec = arec->aconf;
@@ -326,11 +378,11 @@ find_conf_by_address(const char *name, const char *sockhost,
 			if(arec->type == (type & ~0x1) &&
 			   arec->masktype == HM_HOST &&
 			   arec->precedence > hprecv &&
-			   (match(arec->Mask.hostname, orighost) ||
-			    (sockhost && match(arec->Mask.hostname, sockhost))) &&
+			   (match_arec(arec->Mask.hostname, arec->hostname_prog, &forighost) ||
+			    (sockhost && match_arec(arec->Mask.hostname, arec->hostname_prog, &fsockhost))) &&
 			    (type != CONF_CLIENT || !arec->auth_user ||
 			    (auth_user && match(arec->auth_user, auth_user))) &&
-			   (type & 0x1 || match(arec->username, username)))
+			   (type & 0x1 || match_arec(arec->username, arec->username_prog, &fuser)))
 			{
 				hprecv = arec->precedence;
 				hprec = arec->aconf;
@@ -349,10 +401,10 @@ find_conf_by_address(const char *name, const char *sockhost,
 				if((arec->type == (type & ~0x1)) &&
 				   (arec->masktype == HM_HOST) &&
 				   arec->precedence > hprecv &&
-				   match(arec->Mask.hostname, name) &&
+				   match_arec(arec->Mask.hostname, arec->hostname_prog, &fname) &&
 				   (type != CONF_CLIENT || !arec->auth_user ||
 				   (auth_user && match(arec->auth_user, auth_user))) &&
-				   (type & 0x1 || match(arec->username, username)))
+				   (type & 0x1 || match_arec(arec->username, arec->username_prog, &fuser)))
 				{
 					hprecv = arec->precedence;
 					hprec = arec->aconf;
@@ -368,11 +420,11 @@ find_conf_by_address(const char *name, const char *sockhost,
 			if(arec->type == (type & ~0x1) &&
 			   arec->masktype == HM_HOST &&
 			   arec->precedence > hprecv &&
-			   (match(arec->Mask.hostname, name) ||
-			    (sockhost && match(arec->Mask.hostname, sockhost))) &&
+			   (match_arec(arec->Mask.hostname, arec->hostname_prog, &fname) ||
+			    (sockhost && match_arec(arec->Mask.hostname, arec->hostname_prog, &fsockhost))) &&
 			    (type != CONF_CLIENT || !arec->auth_user ||
 			    (auth_user && match(arec->auth_user, auth_user))) &&
-			   (type & 0x1 || match(arec->username, username)))
+			   (type & 0x1 || match_arec(arec->username, arec->username_prog, &fuser)))
 			{
 				hprecv = arec->precedence;
 				hprec = arec->aconf;
@@ -567,10 +619,13 @@ add_conf_by_address(const char *address, int type, const char *username, const c
 	else
 	{
 		arec->Mask.hostname = address;
+		arec->hostname_prog = match_compile(address);
 		arec->next = atable[(hv = get_mask_hash(address))];
 		atable[hv] = arec;
 	}
 	arec->username = username;
+	if(username != NULL)
+		arec->username_prog = match_compile(username);
 	arec->auth_user = auth_user;
 	arec->aconf = aconf;
 	arec->precedence = prec_value--;
@@ -616,7 +671,7 @@ delete_one_address_conf(const char *address, struct ConfItem *aconf)
 			aconf->status |= CONF_ILLEGAL;
 			if(!aconf->clients)
 				free_conf(aconf);
-			rb_free(arec);
+			free_arec(arec);
 			return;
 		}
 		arecl = arec;
@@ -656,7 +711,7 @@ clear_out_address_conf(void)
 				arec->aconf->status |= CONF_ILLEGAL;
 				if(!arec->aconf->clients)
 					free_conf(arec->aconf);
-				rb_free(arec);
+				free_arec(arec);
 			}
 		}
 		*store_next = NULL;
@@ -689,7 +744,7 @@ clear_out_address_conf_bans(void)
 				arec->aconf->status |= CONF_ILLEGAL;
 				if(!arec->aconf->clients)
 					free_conf(arec->aconf);
-				rb_free(arec);
+				free_arec(arec);
 			}
 		}
 		*store_next = NULL;
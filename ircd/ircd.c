@@ -65,6 +65,7 @@
 #include "bandbi.h"
 #include "authproc.h"
 #include "operhash.h"
+#include "profile.h"
 
 static void
 ircd_die_cb(const char *str) __attribute__((noreturn));
@@ -286,7 +287,7 @@ check_rehash(void *unused)
 	 */
 	if(dorehash)
 	{
-		rehash(true);
+		rehash(true, NULL);
 		dorehash = false;
 	}
 
@@ -745,6 +746,7 @@ charybdis_main(int argc, char * const argv[])
 	clear_scache_hash_table();	/* server cache name table */
 	init_host_hash();
 	clear_hash_parse();
+	init_profile();
 	init_client();
 	init_hook();
 	init_channels();
@@ -753,6 +755,7 @@ charybdis_main(int argc, char * const argv[])
 	init_reject();
 	init_cache();
 	init_monitor();
+	init_privileges();
 
         construct_cflags_strings();
 
@@ -95,25 +95,6 @@ static int	conf_get_yesno_value(char *str)
 	return -1;
 }
 
-static void	free_cur_list(conf_parm_t* list)
-{
-	if (list->type == CF_STRING || list->type == CF_QSTRING) {
-	        rb_free(list->v.string);
-	} else if (list->type == CF_FLIST) {
-		/* Even though CF_FLIST is a flag, comparing with == is valid
-		 * because conf_parm_t.type must be either a type or one flag.
-		 */
-		free_cur_list(list->v.list);
-	}
-
-	if (list->next) {
-		free_cur_list(list->next);
-	}
-
-	rb_free(list);
-}
-
-
 conf_parm_t *	cur_list = NULL;
 
 static void	add_cur_list_cpt(conf_parm_t *new)
@@ -188,21 +169,19 @@ conf_item: block
 
 block: string
          {
-           conf_start_block($1, NULL);
+           conf_parse_block_start($1, NULL);
          }
        '{' block_items '}' ';'
          {
-	   if (conf_cur_block)
-	           conf_end_block(conf_cur_block);
+           conf_parse_block_end();
          }
      | string qstring
          {
-           conf_start_block($1, $2);
+           conf_parse_block_start($1, $2);
          }
        '{' block_items '}' ';'
          {
-	   if (conf_cur_block)
-	           conf_end_block(conf_cur_block);
+           conf_parse_block_end();
          }
      ;
 
@@ -212,8 +191,8 @@ block_items: block_items block_item
 
 block_item:	string '=' itemlist ';'
 		{
-			conf_call_set(conf_cur_block, $1, cur_list);
-			free_cur_list(cur_list);
+			/* the recorded item owns the list from here on */
+			conf_parse_set($1, cur_list);
 			cur_list = NULL;
 		}
 		;
@@ -291,15 +270,7 @@ oneitem: qstring
 loadmodule:
 	  LOADMODULE QSTRING
             {
-                char *m_bn;
-                m_bn = rb_basename((char *) $2);
-
-                if (findmodule_byname(m_bn) == NULL)
-	        {
-	            load_one_module($2, MAPI_ORIGIN_EXTENSION, 0);
-		}
-
-                rb_free(m_bn);
+                conf_parse_loadmodule($2);
 	    }
 	  ';'
           ;
@@ -43,6 +43,7 @@
 #include "hash.h"
 #include "s_assert.h"
 #include "logger.h"
+#include "metrics.h"
 
 static rb_dlink_list listener_list = {};
 static int accept_precallback(rb_fde_t *F, struct sockaddr *addr, rb_socklen_t addrlen, void *data);
@@ -117,7 +118,7 @@ show_ports(struct Client *source_p)
 			   IsOperAdmin(source_p) ? listener->name : me.name,
 			   listener->ref_count, (listener->active) ? "active" : "disabled",
 			   listener->sctp ? " sctp" : " tcp",
-			   listener->ssl ? " ssl" : "");
+			   listener->ssl ? " ssl" : listener->metrics ? " metrics" : "");
 	}
 }
 
@@ -285,7 +286,7 @@ next:
  * the format "255.255.255.255"
  */
 void
-add_tcp_listener(int port, const char *vhost_ip, int family, int ssl, int defer_accept, int wsock)
+add_tcp_listener(int port, const char *vhost_ip, int family, int ssl, int defer_accept, int wsock, int metrics)
 {
 	struct Listener *listener;
 	struct rb_sockaddr_storage vaddr[ARRAY_SIZE(listener->addr)];
@@ -348,6 +349,7 @@ add_tcp_listener(int port, const char *vhost_ip, int family, int ssl, int defer_
 	listener->defer_accept = defer_accept;
 	listener->sctp = 0;
 	listener->wsock = wsock;
+	listener->metrics = metrics;
 
 	if (inetport(listener)) {
 		listener->active = 1;
@@ -418,6 +420,7 @@ add_sctp_listener(int port, const char *vhost_ip1, const char *vhost_ip2, int ss
 	listener->defer_accept = 0;
 	listener->sctp = 1;
 	listener->wsock = wsock;
+	listener->metrics = 0;
 
 	if (inetport(listener)) {
 		listener->active = 1;
@@ -509,15 +512,23 @@ add_connection(struct Listener *listener, rb_fde_t *F, struct sockaddr *sai, str
 	if (listener->ssl)
 	{
 		rb_fde_t *xF[2];
-		if(rb_socketpair(AF_UNIX, SOCK_STREAM, 0, &xF[0], &xF[1], "Incoming ssld Connection") == -1)
-		{
-			SetIOError(new_client);
-			exit_client(new_client, new_client, new_client, "Fatal Error");
-			return;
-		}
+		uint32_t connid = connid_get(new_client);
+
 		new_client->localClient->ssl_callback = accept_sslcallback;
 		defer = true;
-		new_client->localClient->ssl_ctl = start_ssld_accept(F, xF[1], connid_get(new_client));        /* this will close F for us */
+		/* a ring channel can't be passed on to wsockd */
+		if(!listener->wsock)
+			new_client->localClient->ssl_ctl = start_ssld_accept_ring(F, &xF[0], connid);
+		if(new_client->localClient->ssl_ctl == NULL)
+		{
+			if(rb_socketpair(AF_UNIX, SOCK_STREAM, 0, &xF[0], &xF[1], "Incoming ssld Connection") == -1)
+			{
+				SetIOError(new_client);
+				exit_client(new_client, new_client, new_client, "Fatal Error");
+				return;
+			}
+			new_client->localClient->ssl_ctl = start_ssld_accept(F, xF[1], connid);        /* this will close F for us */
+		}
 		if(new_client->localClient->ssl_ctl == NULL)
 		{
 			SetIOError(new_client);
@@ -532,13 +543,19 @@ add_connection(struct Listener *listener, rb_fde_t *F, struct sockaddr *sai, str
 	if (listener->wsock)
 	{
 		rb_fde_t *xF[2];
-		if(rb_socketpair(AF_UNIX, SOCK_STREAM, 0, &xF[0], &xF[1], "Incoming wsockd Connection") == -1)
+		uint32_t connid = connid_get(new_client);
+
+		new_client->localClient->ws_ctl = start_wsockd_accept_ring(F, &xF[0], connid);
+		if(new_client->localClient->ws_ctl == NULL)
 		{
-			SetIOError(new_client);
-			exit_client(new_client, new_client, new_client, "Fatal Error");
-			return;
+			if(rb_socketpair(AF_UNIX, SOCK_STREAM, 0, &xF[0], &xF[1], "Incoming wsockd Connection") == -1)
+			{
+				SetIOError(new_client);
+				exit_client(new_client, new_client, new_client, "Fatal Error");
+				return;
+			}
+			new_client->localClient->ws_ctl = start_wsockd_accept(F, xF[1], connid);        /* this will close F for us */
 		}
-		new_client->localClient->ws_ctl = start_wsockd_accept(F, xF[1], connid_get(new_client));        /* this will close F for us */
 		if(new_client->localClient->ws_ctl == NULL)
 		{
 			SetIOError(new_client);
@@ -627,7 +644,8 @@ accept_precallback(rb_fde_t *F, struct sockaddr *addr, rb_socklen_t addrlen, voi
 		return 0;
 	}
 
-	if(check_reject(F, addr)) {
+	/* the reject cache is for clients that failed to register */
+	if(!listener->metrics && check_reject(F, addr)) {
 		/* Reject the connection without closing the socket
 		 * because it is now on the delay_exit list. */
 		return 0;
@@ -650,6 +668,12 @@ accept_callback(rb_fde_t *F, int status, struct sockaddr *addr, rb_socklen_t add
 	struct rb_sockaddr_storage lip;
 	unsigned int locallen = sizeof(struct rb_sockaddr_storage);
 
+	if(listener->metrics)
+	{
+		metrics_accept(F);
+		return;
+	}
+
 	ServerStats.is_ac++;
 
 	if(getsockname(rb_get_fd(F), (struct sockaddr *) &lip, &locallen) < 0)
@@ -40,6 +40,9 @@
 #include "client.h"
 #include "s_serv.h"
 
+#include <pthread.h>
+#include <stdatomic.h>
+
 static FILE *log_main;
 static FILE *log_user;
 static FILE *log_fuser;
@@ -55,22 +58,461 @@ struct log_struct
 {
 	char **name;
 	FILE **logfile;
+	const char *tag;
+	bool open;		/* main loop's view: an open is queued */
 };
 
 static struct log_struct log_table[LAST_LOGFILE] =
 {
-	{ NULL, 				&log_main	},
-	{ &ConfigFileEntry.fname_userlog,	&log_user	},
-	{ &ConfigFileEntry.fname_fuserlog,	&log_fuser	},
-	{ &ConfigFileEntry.fname_operlog,	&log_oper	},
-	{ &ConfigFileEntry.fname_foperlog,	&log_foper	},
-	{ &ConfigFileEntry.fname_serverlog,	&log_server	},
-	{ &ConfigFileEntry.fname_killlog,	&log_kill	},
-	{ &ConfigFileEntry.fname_klinelog,	&log_kline	},
-	{ &ConfigFileEntry.fname_operspylog,	&log_operspy	},
-	{ &ConfigFileEntry.fname_ioerrorlog,	&log_ioerror	}
+	{ NULL, 				&log_main,	"main"		},
+	{ &ConfigFileEntry.fname_userlog,	&log_user,	"user"		},
+	{ &ConfigFileEntry.fname_fuserlog,	&log_fuser,	"fuser"		},
+	{ &ConfigFileEntry.fname_operlog,	&log_oper,	"oper"		},
+	{ &ConfigFileEntry.fname_foperlog,	&log_foper,	"foper"		},
+	{ &ConfigFileEntry.fname_serverlog,	&log_server,	"server"	},
+	{ &ConfigFileEntry.fname_killlog,	&log_kill,	"kill"		},
+	{ &ConfigFileEntry.fname_klinelog,	&log_kline,	"kline"		},
+	{ &ConfigFileEntry.fname_operspylog,	&log_operspy,	"operspy"	},
+	{ &ConfigFileEntry.fname_ioerrorlog,	&log_ioerror,	"ioerror"	}
+};
+
+/*
+ * Log records are handed from the main loop to a writer thread through a
+ * single-producer, single-consumer ring, so a slow disk never holds up the
+ * event loop.  The log files themselves belong to the writer: opening,
+ * closing and reopening them after a rehash are queued as records too, which
+ * keeps them ordered with the lines around them.  When the ring is full,
+ * lines are dropped and counted; the count is written out with the next line
+ * that makes it.  If the writer could not be started, records are handled
+ * inline as they are queued.
+ */
+#define LOG_RING_SIZE		(1024 * 1024)
+#define LOG_RECORD_ALIGN	16
+#define LOG_WRITER_IDLE_MSEC	1000
+
+enum log_record_type
+{
+	LOG_REC_PAD,
+	LOG_REC_LINE,
+	LOG_REC_OPEN,
+	LOG_REC_CLOSE,
+};
+
+#define LOG_RECF_JSON		0x01
+
+struct log_record
+{
+	uint8_t type;
+	uint8_t dest;
+	uint8_t flags;
+	uint16_t len;		/* of the text, including its NUL */
+	uint32_t dropped;	/* lines lost to this file just before this one */
+	time_t when;
 };
 
+struct log_ring
+{
+	_Atomic uint64_t head;	/* written by the main loop */
+	_Atomic uint64_t tail;	/* written by the writer */
+	_Atomic bool writer_idle;
+	bool writer_running;
+	bool writer_stop;
+	pthread_t writer;
+	pthread_mutex_t lock;
+	pthread_cond_t wakeup;
+	pthread_cond_t drained;
+	uint32_t dropped[LAST_LOGFILE];
+	unsigned long dropped_total;
+	char buf[LOG_RING_SIZE];
+};
+
+static struct log_ring log_ring = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.wakeup = PTHREAD_COND_INITIALIZER,
+	.drained = PTHREAD_COND_INITIALIZER,
+};
+
+static size_t
+log_record_size(size_t len)
+{
+	return (sizeof(struct log_record) + len + LOG_RECORD_ALIGN - 1) & ~(size_t)(LOG_RECORD_ALIGN - 1);
+}
+
+static void
+format_smalldate(char *buf, size_t buflen, time_t ltime)
+{
+	struct tm lt;
+
+	localtime_r(&ltime, &lt);
+
+	snprintf(buf, buflen, "%d/%d/%d %02d.%02d",
+		    lt.tm_year + 1900, lt.tm_mon + 1,
+		    lt.tm_mday, lt.tm_hour, lt.tm_min);
+}
+
+/* write_json_string()
+ *
+ * inputs	- file, string
+ * outputs	- result of the last stdio call, < 0 on error
+ * side effects - string is written as a quoted, escaped JSON string
+ */
+int
+write_json_string(FILE *logfile, const char *str)
+{
+	const unsigned char *p;
+
+	if(putc('"', logfile) == EOF)
+		return -1;
+
+	for(p = (const unsigned char *)str; *p != '\0'; p++)
+	{
+		switch(*p)
+		{
+		case '"':
+			fputs("\\\"", logfile);
+			break;
+		case '\\':
+			fputs("\\\\", logfile);
+			break;
+		case '\n':
+			fputs("\\n", logfile);
+			break;
+		case '\r':
+			fputs("\\r", logfile);
+			break;
+		case '\t':
+			fputs("\\t", logfile);
+			break;
+		default:
+			if(*p < 0x20 || *p == 0x7f)
+				fprintf(logfile, "\\u%04x", *p);
+			else
+				putc(*p, logfile);
+			break;
+		}
+	}
+
+	return putc('"', logfile) == EOF ? -1 : 0;
+}
+
+static int
+write_log_line(FILE *logfile, int dest, time_t when, bool json, const char *text)
+{
+	char date[MAX_DATE_STRING];
+
+	if(!json)
+	{
+		format_smalldate(date, sizeof(date), when);
+		return fprintf(logfile, "%s %s\n", date, text);
+	}
+
+	struct tm tm;
+
+	gmtime_r(&when, &tm);
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", &tm);
+
+	fprintf(logfile, "{\"time\":\"%s\",\"ts\":%lld,\"log\":\"%s\",\"message\":",
+		date, (long long)when, log_table[dest].tag);
+	if(write_json_string(logfile, text) < 0)
+		return -1;
+	return fputs("}\n", logfile);
+}
+
+/* process_log_record()
+ *
+ * inputs	- record taken off the ring
+ * outputs	- none
+ * side effects - the record is written out, or the file it names is
+ *		  opened or closed.  Only the writer (or the main loop when
+ *		  there is no writer) calls this.
+ */
+static void
+process_log_record(const struct log_record *rec)
+{
+	FILE **logfile = log_table[rec->dest].logfile;
+	const char *text = (const char *)(rec + 1);
+	bool json = (rec->flags & LOG_RECF_JSON) != 0;
+	char buf[64];
+
+	switch(rec->type)
+	{
+	case LOG_REC_OPEN:
+		if(*logfile != NULL)
+			fclose(*logfile);
+		*logfile = fopen(text, "a");
+		break;
+
+	case LOG_REC_CLOSE:
+		if(*logfile != NULL)
+		{
+			fclose(*logfile);
+			*logfile = NULL;
+		}
+		break;
+
+	case LOG_REC_LINE:
+		if(*logfile == NULL)
+			break;
+
+		if(rec->dropped > 0)
+		{
+			snprintf(buf, sizeof(buf), "%u earlier log lines were dropped", (unsigned int)rec->dropped);
+			write_log_line(*logfile, rec->dest, rec->when, json, buf);
+		}
+
+		if(write_log_line(*logfile, rec->dest, rec->when, json, text) < 0)
+		{
+			fclose(*logfile);
+			*logfile = NULL;
+		}
+		break;
+	}
+}
+
+static void
+flush_log_files(void)
+{
+	for(int i = 0; i < LAST_LOGFILE; i++)
+	{
+		FILE *logfile = *log_table[i].logfile;
+
+		if(logfile != NULL && fflush(logfile) == EOF)
+		{
+			fclose(logfile);
+			*log_table[i].logfile = NULL;
+		}
+	}
+}
+
+static void *
+log_writer_thread(void *unused)
+{
+	struct log_ring *ring = &log_ring;
+
+	for(;;)
+	{
+		uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+		uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+		if(tail == head)
+		{
+			struct timespec ts;
+
+			/* everything queued so far is written, push it to disk in one go */
+			flush_log_files();
+
+			pthread_mutex_lock(&ring->lock);
+			pthread_cond_broadcast(&ring->drained);
+			atomic_store(&ring->writer_idle, true);
+			if(atomic_load(&ring->head) == head && !ring->writer_stop)
+			{
+				clock_gettime(CLOCK_REALTIME, &ts);
+				ts.tv_sec += LOG_WRITER_IDLE_MSEC / 1000;
+				pthread_cond_timedwait(&ring->wakeup, &ring->lock, &ts);
+			}
+			atomic_store(&ring->writer_idle, false);
+
+			if(ring->writer_stop && atomic_load(&ring->head) == head)
+			{
+				pthread_mutex_unlock(&ring->lock);
+				break;
+			}
+			pthread_mutex_unlock(&ring->lock);
+			continue;
+		}
+
+		while(tail != head)
+		{
+			const struct log_record *rec = (const void *)&ring->buf[tail % LOG_RING_SIZE];
+
+			if(rec->type == LOG_REC_PAD)
+				tail += LOG_RING_SIZE - tail % LOG_RING_SIZE;
+			else
+			{
+				process_log_record(rec);
+				tail += log_record_size(rec->len);
+			}
+		}
+
+		atomic_store_explicit(&ring->tail, tail, memory_order_release);
+	}
+
+	return NULL;
+}
+
+static void
+wake_log_writer(void)
+{
+	if(atomic_load(&log_ring.writer_idle))
+	{
+		pthread_mutex_lock(&log_ring.lock);
+		pthread_cond_signal(&log_ring.wakeup);
+		pthread_mutex_unlock(&log_ring.lock);
+	}
+}
+
+/* wait_log_writer()
+ *
+ * inputs	- none
+ * outputs	- none
+ * side effects - blocks until the writer has handled everything queued
+ */
+static void
+wait_log_writer(void)
+{
+	if(!log_ring.writer_running)
+		return;
+
+	pthread_mutex_lock(&log_ring.lock);
+	while(atomic_load(&log_ring.tail) != atomic_load(&log_ring.head))
+	{
+		pthread_cond_signal(&log_ring.wakeup);
+		pthread_cond_wait(&log_ring.drained, &log_ring.lock);
+	}
+	pthread_mutex_unlock(&log_ring.lock);
+}
+
+/* queue_log_record()
+ *
+ * inputs	- record type, log file, text and its length (without NUL)
+ * outputs	- true if the record was queued
+ * side effects - LOG_REC_LINE records are dropped when the ring is full,
+ *		  anything else waits for the writer to make room
+ */
+static bool
+queue_log_record(int type, int dest, const char *text, size_t len)
+{
+	struct log_ring *ring = &log_ring;
+	struct log_record *rec;
+	union
+	{
+		struct log_record rec;
+		char buf[sizeof(struct log_record) + BUFSIZE + PATH_MAX];
+	} direct;
+	uint64_t head, tail;
+	size_t size, offset, pad;
+
+	if(len > UINT16_MAX - 1)
+		len = UINT16_MAX - 1;
+
+	if(type == LOG_REC_OPEN)
+		log_table[dest].open = true;
+	else if(type == LOG_REC_CLOSE)
+		log_table[dest].open = false;
+
+	size = log_record_size(len + 1);
+
+	head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+	if(!ring->writer_running)
+	{
+		/* no writer to hand it to, so handle it here */
+		rec = &direct.rec;
+		if(sizeof(struct log_record) + len + 1 > sizeof(direct))
+			len = sizeof(direct) - sizeof(struct log_record) - 1;
+		goto fill;
+	}
+
+	for(;;)
+	{
+		offset = head % LOG_RING_SIZE;
+		pad = offset + size > LOG_RING_SIZE ? LOG_RING_SIZE - offset : 0;
+		tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+		if(LOG_RING_SIZE - (head - tail) >= pad + size)
+			break;
+
+		if(type == LOG_REC_LINE)
+		{
+			ring->dropped[dest]++;
+			ring->dropped_total++;
+			wake_log_writer();
+			return false;
+		}
+
+		wait_log_writer();
+	}
+
+	if(pad > 0)
+	{
+		rec = (void *)&ring->buf[offset];
+		rec->type = LOG_REC_PAD;
+		head += pad;
+	}
+
+	rec = (void *)&ring->buf[head % LOG_RING_SIZE];
+
+fill:
+	rec->type = type;
+	rec->dest = dest;
+	rec->flags = ConfigFileEntry.log_json ? LOG_RECF_JSON : 0;
+	rec->len = len + 1;
+	rec->dropped = 0;
+	rec->when = rb_current_time();
+	memcpy(rec + 1, text, len);
+	((char *)(rec + 1))[len] = '\0';
+
+	if(type == LOG_REC_LINE)
+	{
+		rec->dropped = ring->dropped[dest];
+		ring->dropped[dest] = 0;
+	}
+
+	if(!ring->writer_running)
+	{
+		process_log_record(rec);
+		if(type == LOG_REC_LINE && *log_table[dest].logfile != NULL)
+			fflush(*log_table[dest].logfile);
+		return true;
+	}
+
+	/* sequentially consistent, pairs with the writer going idle */
+	atomic_store(&ring->head, head + size);
+	wake_log_writer();
+	return true;
+}
+
+static void
+stop_log_writer(void)
+{
+	if(!log_ring.writer_running)
+		return;
+
+	pthread_mutex_lock(&log_ring.lock);
+	log_ring.writer_stop = true;
+	pthread_cond_signal(&log_ring.wakeup);
+	pthread_mutex_unlock(&log_ring.lock);
+
+	pthread_join(log_ring.writer, NULL);
+	log_ring.writer_running = false;
+	log_ring.writer_stop = false;
+}
+
+static void
+start_log_writer(void)
+{
+	if(log_ring.writer_running)
+		return;
+
+	if(pthread_create(&log_ring.writer, NULL, log_writer_thread, NULL) != 0)
+		return;
+
+	log_ring.writer_running = true;
+	atexit(stop_log_writer);
+}
+
+/* ilog_dropped()
+ *
+ * inputs	- none
+ * outputs	- number of log lines dropped because the writer fell behind
+ * side effects - none
+ */
+unsigned long
+ilog_dropped(void)
+{
+	return log_ring.dropped_total;
+}
+
 static void
 verify_logfile_access(const char *filename)
 {
@@ -121,16 +563,25 @@ init_main_logfile(void)
 	{
 		log_main = fopen(logFileName, "a");
 	}
+
+	/* after daemonising, so the writer lives in the right process */
+	start_log_writer();
 }
 
+/* open_logfiles()
+ *
+ * inputs	- none
+ * outputs	- none
+ * side effects - every log file is closed and reopened by the writer once
+ *		  the lines queued before it are written, so moving the
+ *		  files away and rehashing rotates them
+ */
 void
 open_logfiles(void)
 {
 	int i;
 
-	close_logfiles();
-
-	log_main = fopen(logFileName, "a");
+	queue_log_record(LOG_REC_OPEN, L_MAIN, logFileName, strlen(logFileName));
 
 	/* log_main is handled above, so just do the rest */
 	for(i = 1; i < LAST_LOGFILE; i++)
@@ -139,56 +590,53 @@ open_logfiles(void)
 		if(!EmptyString(*log_table[i].name))
 		{
 			verify_logfile_access(*log_table[i].name);
-			*log_table[i].logfile = fopen(*log_table[i].name, "a");
+			queue_log_record(LOG_REC_OPEN, i, *log_table[i].name, strlen(*log_table[i].name));
 		}
+		else
+			queue_log_record(LOG_REC_CLOSE, i, "", 0);
 	}
 }
 
+/* close_logfiles()
+ *
+ * inputs	- none
+ * outputs	- none
+ * side effects - every log file is closed once the lines queued before it
+ *		  are written; this waits for the writer, so only use it on
+ *		  the way out
+ */
 void
 close_logfiles(void)
 {
 	int i;
 
-	if(log_main != NULL)
-		fclose(log_main);
+	for(i = 0; i < LAST_LOGFILE; i++)
+		queue_log_record(LOG_REC_CLOSE, i, "", 0);
 
-	/* log_main is handled above, so just do the rest */
-	for(i = 1; i < LAST_LOGFILE; i++)
-	{
-		if(*log_table[i].logfile != NULL)
-		{
-			fclose(*log_table[i].logfile);
-			*log_table[i].logfile = NULL;
-		}
-	}
+	wait_log_writer();
 }
 
 void
 ilog(ilogfile dest, const char *format, ...)
 {
-	FILE *logfile = *log_table[dest].logfile;
 	char buf[BUFSIZE];
-	char buf2[MAX_DATE_STRING + 1 + BUFSIZE + 1];
 	va_list args;
+	int len;
 
-	if(logfile == NULL)
+	/* nothing configured for this one, don't bother queueing it */
+	if(!log_table[dest].open)
 		return;
 
 	va_start(args, format);
-	vsnprintf(buf, sizeof(buf), format, args);
+	len = vsnprintf(buf, sizeof(buf), format, args);
 	va_end(args);
 
-	snprintf(buf2, sizeof(buf2), "%s %s\n",
-			smalldate(rb_current_time()), buf);
-
-	if(fputs(buf2, logfile) < 0)
-	{
-		fclose(logfile);
-		*log_table[dest].logfile = NULL;
+	if(len < 0)
 		return;
-	}
+	if((size_t)len >= sizeof(buf))
+		len = sizeof(buf) - 1;
 
-	fflush(logfile);
+	queue_log_record(LOG_REC_LINE, dest, buf, len);
 }
 
 static void
@@ -285,14 +733,8 @@ const char *
 smalldate(time_t ltime)
 {
 	static char buf[MAX_DATE_STRING];
-	struct tm *lt;
-
-	lt = localtime(&ltime);
-
-	snprintf(buf, sizeof(buf), "%d/%d/%d %02d.%02d",
-		    lt->tm_year + 1900, lt->tm_mon + 1,
-		    lt->tm_mday, lt->tm_hour, lt->tm_min);
 
+	format_smalldate(buf, sizeof(buf), ltime);
 	return buf;
 }
 
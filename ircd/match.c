@@ -17,6 +17,7 @@
  *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  *
  */
+#define _GNU_SOURCE 1	/* memmem() */
 #include "stdinc.h"
 #include "defaults.h"
 #include "client.h"
@@ -308,6 +309,215 @@ match_esc(const char *mask, const char *name)
 	return 0;
 }
 
+/*
+ * Compiled masks.
+ *
+ * A mask that is checked against many names is worth compiling once.  The
+ * mask is case folded and split at its '*'s into pieces of fixed length,
+ * which may still hold '?'.  A name matches if the first piece matches its
+ * start (unless the mask starts with '*'), the last piece matches its end
+ * (unless the mask ends with '*') and the pieces in between can be found
+ * in order in what is left.  Taking the leftmost place for each of those
+ * is always right, so no backtracking is needed, and the search for a
+ * piece is a memmem() or memchr() over the folded name rather than a loop
+ * of table lookups.  The result is the same as match() gives.
+ */
+struct match_piece
+{
+	uint32_t off;		/* into text */
+	uint32_t len;
+	int32_t anchor;		/* first byte that is not '?', -1 if none */
+	bool wild;		/* holds a '?' */
+};
+
+struct match_prog
+{
+	uint32_t npieces;
+	uint32_t minlen;	/* shortest name that can match */
+	bool lead_star;
+	bool trail_star;
+	bool has_star;
+	const char *text;
+	struct match_piece piece[];
+};
+
+/* match_compile()
+ *
+ * inputs	- mask as taken by match()
+ * outputs	- compiled form
+ * side effects - none; free the result with match_free()
+ */
+struct match_prog *
+match_compile(const char *mask)
+{
+	struct match_prog *prog;
+	struct match_piece *piece;
+	size_t len = strlen(mask);
+	size_t npieces = 0;
+	char *text;
+
+	/* at most one piece per '*' plus one */
+	for(const char *p = mask; *p; p++)
+		if(*p == '*')
+			npieces++;
+	npieces++;
+
+	prog = rb_malloc(sizeof(struct match_prog) + sizeof(struct match_piece) * npieces + len + 1);
+	text = (char *)&prog->piece[npieces];
+	prog->text = text;
+	prog->lead_star = *mask == '*';
+	prog->trail_star = len > 0 && mask[len - 1] == '*';
+
+	for(size_t i = 0; i < len; )
+	{
+		if(mask[i] == '*')
+		{
+			prog->has_star = true;
+			i++;
+			continue;
+		}
+
+		piece = &prog->piece[prog->npieces++];
+		piece->off = i;
+		piece->anchor = -1;
+
+		for(; i < len && mask[i] != '*'; i++)
+		{
+			text[i] = irctolower(mask[i]);
+			if(mask[i] == '?')
+				piece->wild = true;
+			else if(piece->anchor < 0)
+				piece->anchor = i - piece->off;
+		}
+
+		piece->len = i - piece->off;
+		prog->minlen += piece->len;
+	}
+
+	return prog;
+}
+
+void
+match_free(struct match_prog *prog)
+{
+	rb_free(prog);
+}
+
+static inline bool
+piece_at(const struct match_prog *prog, const struct match_piece *piece, const char *s)
+{
+	const char *p = prog->text + piece->off;
+
+	if(!piece->wild)
+		return memcmp(p, s, piece->len) == 0;
+
+	for(size_t i = 0; i < piece->len; i++)
+		if(p[i] != s[i] && p[i] != '?')
+			return false;
+	return true;
+}
+
+/* leftmost place piece matches in s[0..len), or NULL */
+static const char *
+piece_find(const struct match_prog *prog, const struct match_piece *piece, const char *s, size_t len)
+{
+	const char *p = prog->text + piece->off;
+	const char *end, *hit;
+
+	if(piece->len > len)
+		return NULL;
+
+	if(!piece->wild)
+		return memmem(s, len, p, piece->len);
+
+	/* nothing but '?', so any place will do */
+	if(piece->anchor < 0)
+		return s;
+
+	/* look for the first fixed byte and check the rest around it */
+	end = s + len - piece->len + piece->anchor + 1;
+	for(const char *from = s + piece->anchor; from < end; from = hit + 1)
+	{
+		if((hit = memchr(from, p[piece->anchor], end - from)) == NULL)
+			return NULL;
+		if(piece_at(prog, piece, hit - piece->anchor))
+			return hit - piece->anchor;
+	}
+	return NULL;
+}
+
+/* match_folded()
+ *
+ * inputs	- compiled mask, name already folded with irctolower() and
+ *		  its length
+ * outputs	- 1 if the mask matches the name, 0 otherwise
+ * side effects - none
+ */
+int
+match_folded(const struct match_prog *prog, const char *name, size_t len)
+{
+	const struct match_piece *piece = prog->piece;
+	const struct match_piece *last = prog->piece + prog->npieces;
+	const char *s = name, *end = name + len;
+
+	if(len < prog->minlen)
+		return 0;
+
+	if(!prog->has_star)
+		return len == prog->minlen && (prog->npieces == 0 || piece_at(prog, piece, s));
+
+	if(!prog->lead_star)
+	{
+		if(!piece_at(prog, piece, s))
+			return 0;
+		s += piece->len;
+		piece++;
+	}
+
+	if(!prog->trail_star)
+	{
+		last--;
+		if(!piece_at(prog, last, end - last->len))
+			return 0;
+		end -= last->len;
+	}
+
+	for(; piece < last; piece++)
+	{
+		if((s = piece_find(prog, piece, s, end - s)) == NULL)
+			return 0;
+		s += piece->len;
+	}
+
+	return 1;
+}
+
+/* match_compiled()
+ *
+ * inputs	- compiled mask, name
+ * outputs	- 1 if the mask matches the name, 0 otherwise
+ * side effects - none
+ */
+int
+match_compiled(const struct match_prog *prog, const char *name)
+{
+	char buf[BUFSIZE], *folded = buf;
+	size_t len = strlen(name);
+	int result;
+
+	if(len >= sizeof(buf))
+		folded = rb_malloc(len + 1);
+
+	for(size_t i = 0; i <= len; i++)
+		folded[i] = irctolower(name[i]);
+
+	result = match_folded(prog, folded, len);
+
+	if(folded != buf)
+		rb_free(folded);
+	return result;
+}
+
 int comp_with_mask(void *addr, void *dest, unsigned int mask)
 {
 	if (memcmp(addr, dest, mask / 8) == 0)
@@ -586,6 +796,16 @@ int ircncmp(const char *s1, const char *s2, int n)
 	return (res);
 }
 
+static size_t fold_copy(char *dst, const char *src)
+{
+	size_t len;
+
+	for (len = 0; src[len] != '\0'; len++)
+		dst[len] = irctolower(src[len]);
+	dst[len] = '\0';
+	return len;
+}
+
 void matchset_for_client(struct Client *who, struct matchset *m)
 {
 	unsigned hostn = 0;
@@ -631,6 +851,11 @@ void matchset_for_client(struct Client *who, struct matchset *m)
 	{
 		m->ip[i][0] = '\0';
 	}
+
+	for (int i = 0; i < hostn; i++)
+		m->host_len[i] = fold_copy(m->host_fold[i], m->host[i]);
+	for (int i = 0; i < ipn; i++)
+		m->ip_len[i] = fold_copy(m->ip_fold[i], m->ip[i]);
 }
 
 bool client_matches_mask(struct Client *who, const char *mask)
@@ -641,19 +866,27 @@ bool client_matches_mask(struct Client *who, const char *mask)
 }
 
 bool matches_mask(const struct matchset *m, const char *mask)
+{
+	return matches_mask_compiled(m, mask, NULL);
+}
+
+/* As matches_mask(), with mask also compiled by match_compile() if prog
+ * is not NULL.
+ */
+bool matches_mask_compiled(const struct matchset *m, const char *mask, const struct match_prog *prog)
 {
 	for (int i = 0; i < ARRAY_SIZE(m->host); i++)
 	{
 		if (m->host[i][0] == '\0')
 			break;
-		if (match(mask, m->host[i]))
+		if (prog != NULL ? match_folded(prog, m->host_fold[i], m->host_len[i]) : match(mask, m->host[i]))
 			return true;
 	}
 	for (int i = 0; i < ARRAY_SIZE(m->ip); i++)
 	{
 		if (m->ip[i][0] == '\0')
 			break;
-		if (match(mask, m->ip[i]))
+		if (prog != NULL ? match_folded(prog, m->ip_fold[i], m->ip_len[i]) : match(mask, m->ip[i]))
 			return true;
 		if (match_cidr(mask, m->ip[i]))
 			return true;
@@ -0,0 +1,512 @@
+/*
+ * ircd/metrics.c
+ * Copyright (c) 2026 Ophion development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stdinc.h"
+#include "authproc.h"
+#include "channel.h"
+#include "client.h"
+#include "hash.h"
+#include "ircd.h"
+#include "logger.h"
+#include "metrics.h"
+#include "msg.h"
+#include "parse.h"
+#include "profile.h"
+#include "s_stats.h"
+#include "sslproc.h"
+#include "wsproc.h"
+
+#define METRICS_REQUEST_MAX	2048
+#define METRICS_TIMEOUT		10
+#define METRICS_MAX_CONNS	16
+
+struct metrics_buf
+{
+	char *data;
+	size_t len;
+	size_t alloc;
+};
+
+struct metrics_conn
+{
+	rb_fde_t *F;
+	char request[METRICS_REQUEST_MAX];
+	size_t request_len;
+	struct metrics_buf out;
+	size_t written;
+};
+
+static void metrics_read(rb_fde_t *F, void *data);
+static void metrics_write(rb_fde_t *F, void *data);
+
+static void metrics_printf(struct metrics_buf *, const char *, ...) AFP(2, 3);
+
+static void
+metrics_printf(struct metrics_buf *buf, const char *format, ...)
+{
+	va_list args;
+	int len;
+
+	for(;;)
+	{
+		va_start(args, format);
+		len = vsnprintf(buf->data + buf->len, buf->alloc - buf->len, format, args);
+		va_end(args);
+
+		if(len < 0)
+			return;
+
+		if((size_t)len < buf->alloc - buf->len)
+		{
+			buf->len += len;
+			return;
+		}
+
+		buf->alloc = (buf->alloc + len + 1) * 2;
+		buf->data = rb_realloc(buf->data, buf->alloc);
+	}
+}
+
+/* label values are quoted; escape what the text format requires */
+static const char *
+metrics_label(const char *value)
+{
+	static char buf[256];
+	size_t i = 0;
+
+	for(; *value != '\0' && i < sizeof(buf) - 2; value++)
+	{
+		if(*value == '\\' || *value == '"' || *value == '\n')
+		{
+			buf[i++] = '\\';
+			buf[i++] = *value == '\n' ? 'n' : *value;
+		}
+		else
+			buf[i++] = *value;
+	}
+	buf[i] = '\0';
+
+	return buf;
+}
+
+static void
+metrics_header(struct metrics_buf *buf, const char *name, const char *type, const char *help)
+{
+	metrics_printf(buf, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+struct metrics_queue
+{
+	const char *peer;
+	rb_dlink_list *list;
+	unsigned long long sendq;
+	unsigned long long recvq;
+};
+
+static void
+metrics_queues(struct metrics_buf *buf)
+{
+	struct metrics_queue queues[] = {
+		{ "client", &lclient_list },
+		{ "server", &serv_list },
+		{ "unknown", &unknown_list },
+	};
+	rb_dlink_node *ptr;
+
+	for(size_t i = 0; i < ARRAY_SIZE(queues); i++)
+	{
+		RB_DLINK_FOREACH(ptr, queues[i].list->head)
+		{
+			struct Client *client_p = ptr->data;
+
+			queues[i].sendq += rb_linebuf_len(&client_p->localClient->buf_sendq);
+			queues[i].recvq += rb_linebuf_len(&client_p->localClient->buf_recvq);
+		}
+	}
+
+	metrics_header(buf, "ircd_sendq_bytes", "gauge", "Data waiting to be sent.");
+	for(size_t i = 0; i < ARRAY_SIZE(queues); i++)
+		metrics_printf(buf, "ircd_sendq_bytes{peer=\"%s\"} %llu\n", queues[i].peer, queues[i].sendq);
+
+	metrics_header(buf, "ircd_recvq_bytes", "gauge", "Data received but not yet parsed.");
+	for(size_t i = 0; i < ARRAY_SIZE(queues); i++)
+		metrics_printf(buf, "ircd_recvq_bytes{peer=\"%s\"} %llu\n", queues[i].peer, queues[i].recvq);
+}
+
+static void
+metrics_blockheap_elements(size_t bused, size_t bfree, size_t bmemusage, size_t heapalloc,
+			   const char *desc, void *data)
+{
+	desc = metrics_label(desc);
+	metrics_printf(data, "ircd_blockheap_elements{heap=\"%s\",state=\"used\"} %zu\n", desc, bused);
+	metrics_printf(data, "ircd_blockheap_elements{heap=\"%s\",state=\"free\"} %zu\n", desc, bfree);
+}
+
+static void
+metrics_blockheap_bytes(size_t bused, size_t bfree, size_t bmemusage, size_t heapalloc,
+			const char *desc, void *data)
+{
+	desc = metrics_label(desc);
+	metrics_printf(data, "ircd_blockheap_bytes{heap=\"%s\",state=\"used\"} %zu\n", desc, bmemusage);
+	metrics_printf(data, "ircd_blockheap_bytes{heap=\"%s\",state=\"allocated\"} %zu\n", desc, heapalloc);
+}
+
+static const char *ssld_status_names[] = {
+	[SSLD_ACTIVE] = "active",
+	[SSLD_SHUTDOWN] = "shutdown",
+	[SSLD_DEAD] = "dead",
+};
+
+static void
+metrics_ssld(void *data, pid_t pid, int cli_count, enum ssld_status status, const char *version)
+{
+	metrics_printf(data, "ircd_helper_clients{helper=\"ssld\",instance=\"%ld\",status=\"%s\"} %d\n",
+		       (long)pid, ssld_status_names[status], cli_count);
+}
+
+static const char *wsockd_status_names[] = {
+	[WSOCKD_ACTIVE] = "active",
+	[WSOCKD_SHUTDOWN] = "shutdown",
+	[WSOCKD_DEAD] = "dead",
+};
+
+static void
+metrics_wsockd(void *data, pid_t pid, int cli_count, enum wsockd_status status,
+	       const struct wsockd_deflate_stats *deflate)
+{
+	metrics_printf(data, "ircd_helper_clients{helper=\"wsockd\",instance=\"%ld\",status=\"%s\"} %d\n",
+		       (long)pid, wsockd_status_names[status], cli_count);
+}
+
+static void
+metrics_wsockd_deflate(void *data, pid_t pid, int cli_count, enum wsockd_status status,
+		       const struct wsockd_deflate_stats *deflate)
+{
+	struct wsockd_deflate_stats *total = data;
+
+	total->negotiated += deflate->negotiated;
+	total->refused += deflate->refused;
+	total->memory += deflate->memory;
+	total->deflate_in += deflate->deflate_in;
+	total->deflate_out += deflate->deflate_out;
+	total->inflate_in += deflate->inflate_in;
+	total->inflate_out += deflate->inflate_out;
+	total->ns += deflate->ns;
+}
+
+static void
+metrics_authd(void *data, int id, bool running, unsigned int pending)
+{
+	metrics_printf(data, "ircd_helper_clients{helper=\"authd\",instance=\"%d\",status=\"%s\"} %u\n",
+		       id, running ? "active" : "dead", pending);
+}
+
+static void
+metrics_profile_sum(const char *kind, const char *name, const struct rb_histogram *hist, void *data)
+{
+	/* the loop histogram has its own metric */
+	if(!strcmp(kind, "loop"))
+		return;
+
+	metrics_printf(data, "ircd_profile_seconds_sum{kind=\"%s\",name=\"%s\"} %.9f\n",
+		       kind, metrics_label(name), hist->total_ns / 1e9);
+	metrics_printf(data, "ircd_profile_seconds_count{kind=\"%s\",name=\"%s\"} %lu\n",
+		       kind, metrics_label(name), hist->count);
+}
+
+static void
+metrics_loop(struct metrics_buf *buf)
+{
+	const struct rb_histogram *hist = rb_loop_profile();
+	unsigned long seen = 0;
+
+	metrics_header(buf, "ircd_event_loop_busy_seconds", "histogram",
+		       "Time from waking up to going back to poll, while profiling is enabled.");
+
+	/* bucket 0 is under 1us, bucket n ends at 2^n us */
+	for(int b = 0; b < RB_HISTOGRAM_BUCKETS - 1; b++)
+	{
+		seen += hist->bucket[b];
+		metrics_printf(buf, "ircd_event_loop_busy_seconds_bucket{le=\"%g\"} %lu\n",
+			       (double)(1UL << b) / 1e6, seen);
+	}
+	metrics_printf(buf, "ircd_event_loop_busy_seconds_bucket{le=\"+Inf\"} %lu\n", hist->count);
+	metrics_printf(buf, "ircd_event_loop_busy_seconds_sum %.9f\n", hist->total_ns / 1e9);
+	metrics_printf(buf, "ircd_event_loop_busy_seconds_count %lu\n", hist->count);
+}
+
+/* metrics_collect()
+ *
+ * inputs	- buffer to fill
+ * outputs	- none
+ * side effects - every metric is appended to buf in the text format
+ */
+static void
+metrics_collect(struct metrics_buf *buf)
+{
+	rb_dictionary_iter iter;
+	struct Message *msg;
+	size_t linebuf_count, linebuf_mem;
+	struct wsockd_deflate_stats deflate = { 0 };
+
+	metrics_header(buf, "ircd_start_time_seconds", "gauge", "When the server started.");
+	metrics_printf(buf, "ircd_start_time_seconds %lld\n", (long long)startup_time);
+
+	metrics_header(buf, "ircd_clients", "gauge", "Users on this server or the whole network.");
+	metrics_printf(buf, "ircd_clients{scope=\"local\"} %lu\n", rb_dlink_list_length(&lclient_list));
+	metrics_printf(buf, "ircd_clients{scope=\"global\"} %d\n", Count.total);
+
+	metrics_header(buf, "ircd_clients_max", "gauge", "Highest user count seen.");
+	metrics_printf(buf, "ircd_clients_max{scope=\"local\"} %d\n", Count.max_loc);
+	metrics_printf(buf, "ircd_clients_max{scope=\"global\"} %d\n", Count.max_tot);
+
+	metrics_header(buf, "ircd_invisible_clients", "gauge", "Users on the network with umode +i.");
+	metrics_printf(buf, "ircd_invisible_clients %d\n", Count.invisi);
+
+	metrics_header(buf, "ircd_opers", "gauge", "Opers on this server or the whole network.");
+	metrics_printf(buf, "ircd_opers{scope=\"local\"} %lu\n", rb_dlink_list_length(&local_oper_list));
+	metrics_printf(buf, "ircd_opers{scope=\"global\"} %d\n", Count.oper);
+
+	metrics_header(buf, "ircd_servers", "gauge", "Servers linked to this one or on the whole network.");
+	metrics_printf(buf, "ircd_servers{scope=\"local\"} %lu\n", rb_dlink_list_length(&serv_list));
+	metrics_printf(buf, "ircd_servers{scope=\"global\"} %lu\n", rb_dlink_list_length(&global_serv_list));
+
+	metrics_header(buf, "ircd_unknown_connections", "gauge", "Connections that have not registered yet.");
+	metrics_printf(buf, "ircd_unknown_connections %lu\n", rb_dlink_list_length(&unknown_list));
+
+	metrics_header(buf, "ircd_channels", "gauge", "Channels on the network.");
+	metrics_printf(buf, "ircd_channels %lu\n", rb_dlink_list_length(&global_channel_list));
+
+	metrics_header(buf, "ircd_connections_total", "counter", "Connections accepted and refused.");
+	metrics_printf(buf, "ircd_connections_total{result=\"accepted\"} %u\n", ServerStats.is_ac);
+	metrics_printf(buf, "ircd_connections_total{result=\"refused\"} %u\n", ServerStats.is_ref);
+	metrics_printf(buf, "ircd_connections_total{result=\"throttled\"} %u\n", ServerStats.is_thr);
+
+	metrics_header(buf, "ircd_closed_bytes_total", "counter", "Bytes moved by connections that have closed.");
+	metrics_printf(buf, "ircd_closed_bytes_total{peer=\"client\",direction=\"sent\"} %llu\n", ServerStats.is_cbs);
+	metrics_printf(buf, "ircd_closed_bytes_total{peer=\"client\",direction=\"received\"} %llu\n", ServerStats.is_cbr);
+	metrics_printf(buf, "ircd_closed_bytes_total{peer=\"server\",direction=\"sent\"} %llu\n", ServerStats.is_sbs);
+	metrics_printf(buf, "ircd_closed_bytes_total{peer=\"server\",direction=\"received\"} %llu\n", ServerStats.is_sbr);
+
+	metrics_queues(buf);
+
+	metrics_header(buf, "ircd_blockheap_elements", "gauge", "Elements in each block heap.");
+	rb_bh_usage_all(metrics_blockheap_elements, buf);
+	metrics_header(buf, "ircd_blockheap_bytes", "gauge", "Memory in each block heap.");
+	rb_bh_usage_all(metrics_blockheap_bytes, buf);
+
+	rb_count_rb_linebuf_memory(&linebuf_count, &linebuf_mem);
+	metrics_header(buf, "ircd_linebufs", "gauge", "Line buffers in use.");
+	metrics_printf(buf, "ircd_linebufs %zu\n", linebuf_count);
+	metrics_header(buf, "ircd_linebuf_bytes", "gauge", "Memory used by line buffers.");
+	metrics_printf(buf, "ircd_linebuf_bytes %zu\n", linebuf_mem);
+
+	metrics_header(buf, "ircd_commands_total", "counter", "Commands handled, by where they came from.");
+	RB_DICTIONARY_FOREACH(msg, &iter, cmd_dict)
+	{
+		const char *cmd = metrics_label(msg->cmd);
+
+		metrics_printf(buf, "ircd_commands_total{command=\"%s\",from=\"client\"} %u\n", cmd, msg->count - msg->rcount);
+		metrics_printf(buf, "ircd_commands_total{command=\"%s\",from=\"server\"} %u\n", cmd, msg->rcount);
+	}
+
+	metrics_header(buf, "ircd_command_bytes_total", "counter", "Bytes of each command received.");
+	RB_DICTIONARY_FOREACH(msg, &iter, cmd_dict)
+		metrics_printf(buf, "ircd_command_bytes_total{command=\"%s\"} %lu\n", metrics_label(msg->cmd), msg->bytes);
+
+	metrics_header(buf, "ircd_helpers", "gauge", "Helper processes running.");
+	metrics_printf(buf, "ircd_helpers{helper=\"ssld\"} %d\n", get_ssld_count());
+	metrics_printf(buf, "ircd_helpers{helper=\"wsockd\"} %d\n", get_wsockd_count());
+	metrics_printf(buf, "ircd_helpers{helper=\"authd\"} %d\n", get_authd_count());
+
+	metrics_header(buf, "ircd_helper_clients", "gauge", "Connections each helper is working on.");
+	ssld_foreach_info(metrics_ssld, buf);
+	wsockd_foreach_info(metrics_wsockd, buf);
+	authd_foreach_info(metrics_authd, buf);
+
+	wsockd_foreach_info(metrics_wsockd_deflate, &deflate);
+	metrics_header(buf, "ircd_wsockd_deflate_connections_total", "counter", "WebSocket compression offers accepted and refused.");
+	metrics_printf(buf, "ircd_wsockd_deflate_connections_total{result=\"negotiated\"} %" PRIu64 "\n", deflate.negotiated);
+	metrics_printf(buf, "ircd_wsockd_deflate_connections_total{result=\"refused\"} %" PRIu64 "\n", deflate.refused);
+	metrics_header(buf, "ircd_wsockd_deflate_memory_bytes", "gauge", "Memory held by WebSocket compression.");
+	metrics_printf(buf, "ircd_wsockd_deflate_memory_bytes %zu\n", deflate.memory);
+	metrics_header(buf, "ircd_wsockd_deflate_bytes_total", "counter", "WebSocket data before and after compression.");
+	metrics_printf(buf, "ircd_wsockd_deflate_bytes_total{direction=\"sent\",form=\"plain\"} %" PRIu64 "\n", deflate.deflate_in);
+	metrics_printf(buf, "ircd_wsockd_deflate_bytes_total{direction=\"sent\",form=\"compressed\"} %" PRIu64 "\n", deflate.deflate_out);
+	metrics_printf(buf, "ircd_wsockd_deflate_bytes_total{direction=\"received\",form=\"compressed\"} %" PRIu64 "\n", deflate.inflate_in);
+	metrics_printf(buf, "ircd_wsockd_deflate_bytes_total{direction=\"received\",form=\"plain\"} %" PRIu64 "\n", deflate.inflate_out);
+	metrics_header(buf, "ircd_wsockd_deflate_seconds_total", "counter", "Time wsockd spent compressing and inflating.");
+	metrics_printf(buf, "ircd_wsockd_deflate_seconds_total %.6f\n", deflate.ns / 1e9);
+
+	metrics_header(buf, "ircd_authd_restarts_total", "counter", "Times authd had to be restarted.");
+	metrics_printf(buf, "ircd_authd_restarts_total %u\n", get_authd_restarts());
+
+	metrics_header(buf, "ircd_log_dropped_total", "counter", "Log lines dropped because the log writer fell behind.");
+	metrics_printf(buf, "ircd_log_dropped_total %lu\n", ilog_dropped());
+
+	metrics_header(buf, "ircd_profiling_enabled", "gauge", "Whether PROFILE ON is in effect.");
+	metrics_printf(buf, "ircd_profiling_enabled %d\n", profile_enabled ? 1 : 0);
+
+	metrics_loop(buf);
+
+	metrics_header(buf, "ircd_profile_seconds", "summary",
+		       "Time spent in commands, hooks and events while profiling is enabled.");
+	profile_walk(metrics_profile_sum, buf);
+}
+
+static unsigned int metrics_conns;
+
+static void
+metrics_close(struct metrics_conn *conn)
+{
+	metrics_conns--;
+	rb_close(conn->F);
+	rb_free(conn->out.data);
+	rb_free(conn);
+}
+
+static void
+metrics_timeout(rb_fde_t *F, void *data)
+{
+	metrics_close(data);
+}
+
+static void
+metrics_respond(struct metrics_conn *conn)
+{
+	struct metrics_buf body = { NULL, 0, 0 };
+	const char *status = "200 OK";
+
+	if(strncmp(conn->request, "GET ", 4) != 0)
+	{
+		status = "405 Method Not Allowed";
+		metrics_printf(&body, "Only GET is supported\n");
+	}
+	else
+		metrics_collect(&body);
+
+	metrics_printf(&conn->out, "HTTP/1.0 %s\r\n"
+		       "Content-Type: text/plain; version=0.0.4\r\n"
+		       "Content-Length: %zu\r\n"
+		       "Connection: close\r\n\r\n", status, body.len);
+	metrics_printf(&conn->out, "%.*s", (int)body.len, body.data);
+	rb_free(body.data);
+
+	metrics_write(conn->F, conn);
+}
+
+static void
+metrics_write(rb_fde_t *F, void *data)
+{
+	struct metrics_conn *conn = data;
+	ssize_t len;
+
+	while(conn->written < conn->out.len)
+	{
+		len = rb_write(F, conn->out.data + conn->written, conn->out.len - conn->written);
+		if(len <= 0)
+		{
+			if(len < 0 && rb_ignore_errno(errno))
+			{
+				rb_setselect(F, RB_SELECT_WRITE, metrics_write, conn);
+				return;
+			}
+			break;
+		}
+
+		conn->written += len;
+	}
+
+	metrics_close(conn);
+}
+
+static void
+metrics_read(rb_fde_t *F, void *data)
+{
+	struct metrics_conn *conn = data;
+	ssize_t len;
+
+	for(;;)
+	{
+		len = rb_read(F, conn->request + conn->request_len,
+			      sizeof(conn->request) - 1 - conn->request_len);
+		if(len <= 0)
+		{
+			if(len < 0 && rb_ignore_errno(errno))
+			{
+				rb_setselect(F, RB_SELECT_READ, metrics_read, conn);
+				return;
+			}
+			metrics_close(conn);
+			return;
+		}
+
+		conn->request_len += len;
+		conn->request[conn->request_len] = '\0';
+
+		/* the headers are of no interest, only that they have ended */
+		if(strstr(conn->request, "\r\n\r\n") != NULL || strstr(conn->request, "\n\n") != NULL)
+		{
+			metrics_respond(conn);
+			return;
+		}
+
+		if(conn->request_len == sizeof(conn->request) - 1)
+		{
+			metrics_close(conn);
+			return;
+		}
+	}
+}
+
+/* metrics_accept()
+ *
+ * inputs	- freshly accepted connection on a metrics listener
+ * outputs	- none
+ * side effects - the request is read and answered from the event loop,
+ *		  the connection is closed once the response is written;
+ *		  past METRICS_MAX_CONNS at once, it is closed straight away
+ */
+void
+metrics_accept(rb_fde_t *F)
+{
+	struct metrics_conn *conn;
+
+	if(metrics_conns >= METRICS_MAX_CONNS)
+	{
+		rb_close(F);
+		return;
+	}
+
+	metrics_conns++;
+	conn = rb_malloc(sizeof *conn);
+	conn->F = F;
+	rb_settimeout(F, METRICS_TIMEOUT, metrics_timeout, conn);
+	metrics_read(F, conn);
+}
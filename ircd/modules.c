@@ -640,7 +640,7 @@ load_a_module(const char *path, bool warn, int origin, bool core)
 					int priority = m->priority;
 					if (priority == 0)
 						priority = HOOK_NORMAL;
-					add_hook_prio(m->hapi_name, m->fn, priority);
+					add_hook_filter(m->hapi_name, m->fn, priority, &m->filter);
 				}
 			}
 
@@ -756,6 +756,33 @@ modules_do_reload(void *info_)
 	rb_free(path);
 }
 
+/* a MODRESTART waiting for its rehash to load the config's modules */
+static bool modules_restarting;
+static unsigned int modules_restart_unloaded;
+
+/*
+ * modules_restart_done
+ *
+ * Called once a rehash has installed its config.  Finishes a MODRESTART
+ * now that the loadmodule lines have been applied again.
+ */
+void
+modules_restart_done(void)
+{
+	if(!modules_restarting)
+		return;
+
+	modules_restarting = false;
+
+	mod_notify_clicaps();
+
+	sendto_realops_snomask(SNO_GENERAL, L_NETWIDE,
+			     "Module Restart: %u modules unloaded, %lu modules loaded",
+			     modules_restart_unloaded, rb_dlink_list_length(&module_list));
+	ilog(L_MAIN, "Module Restart: %u modules unloaded, %lu modules loaded",
+	     modules_restart_unloaded, rb_dlink_list_length(&module_list));
+}
+
 void
 modules_do_restart(void *unused)
 {
@@ -785,12 +812,11 @@ modules_do_restart(void *unused)
 
 	load_all_modules(false);
 	load_core_modules(false);
-	rehash(false);
 
-	mod_notify_clicaps();
-
-	sendto_realops_snomask(SNO_GENERAL, L_NETWIDE,
-			     "Module Restart: %u modules unloaded, %lu modules loaded",
-			     modnum, rb_dlink_list_length(&module_list));
-	ilog(L_MAIN, "Module Restart: %u modules unloaded, %lu modules loaded", modnum, rb_dlink_list_length(&module_list));
+	/* the config is parsed in the background; the rest happens in
+	 * modules_restart_done() once its modules are back
+	 */
+	modules_restarting = true;
+	modules_restart_unloaded = modnum;
+	rehash(false, NULL);
 }
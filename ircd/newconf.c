@@ -34,6 +34,7 @@
 
 static int yy_defer_accept = 1;
 static int yy_wsock = 0;
+static int yy_metrics = 0;
 
 struct TopConf *conf_cur_block;
 static char *conf_cur_block_name = NULL;
@@ -289,6 +290,19 @@ conf_set_serverinfo_nicklen(void *data)
 	}
 }
 
+static void
+conf_set_log_format(void *data)
+{
+	char *val = data;
+
+	if(rb_strcasecmp(val, "json") == 0)
+		ConfigFileEntry.log_json = 1;
+	else if(rb_strcasecmp(val, "text") == 0)
+		ConfigFileEntry.log_json = 0;
+	else
+		conf_report_error("Invalid setting '%s' for log::format.", val);
+}
+
 static void
 conf_set_modules_module(void *data)
 {
@@ -357,7 +371,7 @@ static struct mode_table auth_table[] = {
 
 static struct mode_table connect_table[] = {
 	{ "autoconn",	SERVER_AUTOCONN		},
-	{ "compressed",	0			},
+	{ "compressed",	SERVER_COMPRESSED	},
 	{ "encrypted",	SERVER_ENCRYPTED	},
 	{ "topicburst",	SERVER_TB		},
 	{ "sctp",	SERVER_SCTP		},
@@ -841,6 +855,7 @@ conf_begin_listen(struct TopConf *tc)
 		listener_address[i] = NULL;
 	}
 	yy_wsock = 0;
+	yy_metrics = 0;
 	yy_defer_accept = 0;
 	return 0;
 }
@@ -853,6 +868,7 @@ conf_end_listen(struct TopConf *tc)
 		listener_address[i] = NULL;
 	}
 	yy_wsock = 0;
+	yy_metrics = 0;
 	yy_defer_accept = 0;
 	return 0;
 }
@@ -869,6 +885,12 @@ conf_set_listen_wsock(void *data)
 	yy_wsock = *(unsigned int *) data;
 }
 
+static void
+conf_set_listen_metrics(void *data)
+{
+	yy_metrics = *(unsigned int *) data;
+}
+
 static void
 conf_set_listen_port_both(void *data, int ssl, int sctp)
 {
@@ -880,13 +902,22 @@ conf_set_listen_port_both(void *data, int ssl, int sctp)
 			conf_report_error("listener::port argument is not an integer -- ignoring.");
 			continue;
 		}
+		if(yy_metrics && (ssl || sctp || yy_wsock))
+		{
+			conf_report_error("listener::metrics only works with a plain port -- ignoring.");
+			continue;
+		}
                 if(listener_address[0] == NULL)
                 {
-			if (sctp) {
+			if (yy_metrics) {
+				/* never expose metrics beyond this machine unless asked to */
+				add_tcp_listener(args->v.number, "127.0.0.1", AF_INET, 0, 0, 0, 1);
+				add_tcp_listener(args->v.number, "::1", AF_INET6, 0, 0, 0, 1);
+			} else if (sctp) {
 				conf_report_error("listener::sctp_port has no addresses -- ignoring.");
 			} else {
-				add_tcp_listener(args->v.number, NULL, AF_INET, ssl, ssl || yy_defer_accept, yy_wsock);
-				add_tcp_listener(args->v.number, NULL, AF_INET6, ssl, ssl || yy_defer_accept, yy_wsock);
+				add_tcp_listener(args->v.number, NULL, AF_INET, ssl, ssl || yy_defer_accept, yy_wsock, yy_metrics);
+				add_tcp_listener(args->v.number, NULL, AF_INET6, ssl, ssl || yy_defer_accept, yy_wsock, yy_metrics);
 			}
                 }
 		else
@@ -904,7 +935,7 @@ conf_set_listen_port_both(void *data, int ssl, int sctp)
 				conf_report_error("Warning -- ignoring listener::sctp_port -- SCTP support not available.");
 #endif
 			} else {
-				add_tcp_listener(args->v.number, listener_address[0], family, ssl, ssl || yy_defer_accept, yy_wsock);
+				add_tcp_listener(args->v.number, listener_address[0], family, ssl, ssl || yy_defer_accept, yy_wsock, yy_metrics);
 			}
                 }
 	}
@@ -1703,6 +1734,20 @@ conf_set_general_certfp_method(void *data)
 	}
 }
 
+static void
+conf_set_general_compression_level(void *data)
+{
+	int level = *(int *) data;
+
+	if(level < 1 || level > 9)
+	{
+		conf_report_error("Ignoring general::compression_level -- must be between 1 and 9");
+		return;
+	}
+
+	ConfigFileEntry.compression_level = level;
+}
+
 static void
 conf_set_general_oper_only_umodes(void *data)
 {
@@ -2347,6 +2392,272 @@ conf_set_opm_scan_ports_httpsconnect(void *data)
 /* public functions */
 
 
+/*
+ * Parsed configuration.
+ *
+ * The grammar does not act on what it reads: blocks, items, loadmodule
+ * statements and errors are recorded into a struct conf_parse, and
+ * conf_parse_apply() feeds them to the block and item handlers later on.
+ * Parsing therefore touches no server state and may run on another thread
+ * while the main loop keeps going.
+ */
+enum conf_parse_op_type
+{
+	CONF_OP_BLOCK_START,
+	CONF_OP_BLOCK_END,
+	CONF_OP_SET,
+	CONF_OP_LOADMODULE,
+	CONF_OP_ERROR,
+	CONF_OP_WARNING,
+	CONF_OP_SYNTAX_ERROR
+};
+
+struct conf_parse_op
+{
+	enum conf_parse_op_type type;
+	const char *file;
+	int lineno;
+	char *name;		/* block, item or module name, or the message */
+	char *label;		/* block label, or the offending line */
+	conf_parm_t *value;
+	rb_dlink_node node;
+};
+
+struct conf_parse_filename
+{
+	char *name;
+	rb_dlink_node node;
+};
+
+struct conf_parse
+{
+	rb_dlink_list ops;
+	rb_dlink_list files;
+	const char *failure;
+	int failure_errno;
+};
+
+int yyparse(void);
+
+/* the parse being recorded by this thread, if any.  Recording may happen off
+ * the main thread, so it only allocates with rb_malloc(), never from a
+ * block heap.
+ */
+static _Thread_local struct conf_parse *conf_recording;
+
+static void
+free_parm_list(conf_parm_t *list)
+{
+	while(list != NULL)
+	{
+		conf_parm_t *next = list->next;
+
+		if(list->type == CF_STRING || list->type == CF_QSTRING)
+			rb_free(list->v.string);
+		else if(list->type == CF_FLIST)
+			free_parm_list(list->v.list);
+
+		rb_free(list);
+		list = next;
+	}
+}
+
+static struct conf_parse_op *
+conf_parse_add(enum conf_parse_op_type type, const char *name, const char *label)
+{
+	struct conf_parse *parse = conf_recording;
+	struct conf_parse_op *op = rb_malloc(sizeof(struct conf_parse_op));
+	struct conf_parse_filename *file = parse->files.tail != NULL ? parse->files.tail->data : NULL;
+
+	/* ops in the same file share one copy of its name */
+	if(file == NULL || strcmp(file->name, current_file))
+	{
+		file = rb_malloc(sizeof(struct conf_parse_filename));
+		file->name = rb_strdup(current_file);
+		rb_dlinkAddTail(file, &file->node, &parse->files);
+	}
+
+	op->type = type;
+	op->file = file->name;
+	op->lineno = lineno;
+	op->name = name != NULL ? rb_strdup(name) : NULL;
+	op->label = label != NULL ? rb_strdup(label) : NULL;
+	rb_dlinkAddTail(op, &op->node, &parse->ops);
+
+	return op;
+}
+
+void
+conf_parse_block_start(const char *block, const char *label)
+{
+	conf_parse_add(CONF_OP_BLOCK_START, block, label);
+}
+
+void
+conf_parse_block_end(void)
+{
+	conf_parse_add(CONF_OP_BLOCK_END, NULL, NULL);
+}
+
+/* takes ownership of value */
+void
+conf_parse_set(const char *item, conf_parm_t *value)
+{
+	conf_parse_add(CONF_OP_SET, item, NULL)->value = value;
+}
+
+void
+conf_parse_loadmodule(const char *path)
+{
+	conf_parse_add(CONF_OP_LOADMODULE, path, NULL);
+}
+
+/* conf_parse_file()
+ *
+ * inputs	- open configuration file, its name
+ * outputs	- everything read from it and its includes
+ * side effects - uses the lexer, so only one parse may run at a time
+ */
+struct conf_parse *
+conf_parse_file(FILE *file, const char *filename)
+{
+	struct conf_parse *parse = rb_malloc(sizeof(struct conf_parse));
+
+	conf_fbfile_in = file;
+	rb_strlcpy(conffilebuf, filename, sizeof(conffilebuf));
+	current_file = conffilebuf;
+	lineno = 0;
+
+	conf_recording = parse;
+	yyparse();
+	conf_recording = NULL;
+
+	return parse;
+}
+
+/* conf_parse_apply()
+ *
+ * inputs	- a parsed configuration
+ * outputs	-
+ * side effects - runs the handlers for everything in it, in file order,
+ *		  with errors reported against the line they came from
+ */
+void
+conf_parse_apply(struct conf_parse *parse)
+{
+	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, parse->ops.head)
+	{
+		struct conf_parse_op *op = ptr->data;
+
+		current_file = (char *) op->file;
+		lineno = op->lineno;
+
+		switch(op->type)
+		{
+		case CONF_OP_BLOCK_START:
+			conf_start_block(op->name, op->label);
+			break;
+
+		case CONF_OP_BLOCK_END:
+			if(conf_cur_block)
+				conf_end_block(conf_cur_block);
+			break;
+
+		case CONF_OP_SET:
+			conf_call_set(conf_cur_block, op->name, op->value);
+			break;
+
+		case CONF_OP_LOADMODULE:
+		{
+			char *m_bn = rb_basename(op->name);
+
+			if(findmodule_byname(m_bn) == NULL)
+				load_one_module(op->name, MAPI_ORIGIN_EXTENSION, 0);
+
+			rb_free(m_bn);
+			break;
+		}
+
+		case CONF_OP_ERROR:
+			conf_report_error("%s", op->name);
+			break;
+
+		case CONF_OP_WARNING:
+			conf_report_warning("%s", op->name);
+			break;
+
+		case CONF_OP_SYNTAX_ERROR:
+			conf_report_syntax_error(op->name, op->label);
+			break;
+		}
+	}
+
+	current_file = conffilebuf;
+}
+
+/* conf_parse_fail()
+ *
+ * inputs	- a parsed configuration, what went wrong and its errno
+ * outputs	-
+ * side effects - keeps the failure with the parse, for whoever installs
+ *		  it on the main thread to report; what must be a literal
+ */
+void
+conf_parse_fail(struct conf_parse *parse, const char *what, int err)
+{
+	parse->failure = what;
+	parse->failure_errno = err;
+}
+
+const char *
+conf_parse_failure(struct conf_parse *parse, int *err)
+{
+	*err = parse->failure_errno;
+	return parse->failure;
+}
+
+void
+conf_parse_free(struct conf_parse *parse)
+{
+	rb_dlink_node *ptr, *next_ptr;
+
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, parse->ops.head)
+	{
+		struct conf_parse_op *op = ptr->data;
+
+		rb_free(op->name);
+		rb_free(op->label);
+		free_parm_list(op->value);
+		rb_free(op);
+	}
+
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, parse->files.head)
+	{
+		struct conf_parse_filename *file = ptr->data;
+
+		rb_free(file->name);
+		rb_free(file);
+	}
+
+	rb_free(parse);
+}
+
+void
+conf_report_syntax_error(const char *msg, const char *context)
+{
+	if(conf_recording != NULL)
+	{
+		conf_parse_add(CONF_OP_SYNTAX_ERROR, msg, context);
+		return;
+	}
+
+	ierror("\"%s\", line %d: %s at '%s'", current_file, lineno + 1, msg, context);
+	sendto_realops_snomask(SNO_GENERAL, L_ALL, "\"%s\", line %d: %s at '%s'",
+			     current_file, lineno + 1, msg, context);
+}
+
 void
 conf_report_error(const char *fmt, ...)
 {
@@ -2357,6 +2668,12 @@ conf_report_error(const char *fmt, ...)
 	vsnprintf(msg, BUFSIZE, fmt, ap);
 	va_end(ap);
 
+	if(conf_recording != NULL)
+	{
+		conf_parse_add(CONF_OP_ERROR, msg, NULL);
+		return;
+	}
+
 	if (testing_conf)
 	{
 		fprintf(stderr, "\"%s\", line %d: %s\n", current_file, lineno + 1, msg);
@@ -2377,6 +2694,12 @@ conf_report_warning(const char *fmt, ...)
 	vsnprintf(msg, BUFSIZE, fmt, ap);
 	va_end(ap);
 
+	if(conf_recording != NULL)
+	{
+		conf_parse_add(CONF_OP_WARNING, msg, NULL);
+		return;
+	}
+
 	if (testing_conf)
 	{
 		fprintf(stderr, "\"%s\", line %d: %s\n", current_file, lineno + 1, msg);
@@ -2599,7 +2922,12 @@ static struct ConfEntry conf_serverinfo_table[] =
 	{ "ssl_dh_params",      CF_QSTRING, NULL, 0, &ServerInfo.ssl_dh_params },
 	{ "ssl_cipher_list",	CF_QSTRING, NULL, 0, &ServerInfo.ssl_cipher_list },
 	{ "ssld_count",		CF_INT,	    NULL, 0, &ServerInfo.ssld_count },
+	{ "authd_count",	CF_INT,	    NULL, 0, &ServerInfo.authd_count },
 	{ "ssl_client_cert",	CF_YESNO,   NULL, 0, &ServerInfo.ssl_client_cert },
+	{ "wsockd_deflate",	CF_YESNO,   NULL, 0, &ServerInfo.wsockd_deflate },
+	{ "wsockd_deflate_context_takeover", CF_YESNO, NULL, 0, &ServerInfo.wsockd_deflate_context_takeover },
+	{ "wsockd_deflate_memory", CF_INT,  NULL, 0, &ServerInfo.wsockd_deflate_memory },
+	{ "helper_ring",	CF_YESNO,   NULL, 0, &ServerInfo.helper_ring },
 
 	{ "default_max_clients",CF_INT,     NULL, 0, &ServerInfo.default_max_clients },
 
@@ -2627,6 +2955,7 @@ static struct ConfEntry conf_log_table[] =
 	{ "fname_klinelog", 	CF_QSTRING, NULL, PATH_MAX, &ConfigFileEntry.fname_klinelog	},
 	{ "fname_operspylog", 	CF_QSTRING, NULL, PATH_MAX, &ConfigFileEntry.fname_operspylog	},
 	{ "fname_ioerrorlog", 	CF_QSTRING, NULL, PATH_MAX, &ConfigFileEntry.fname_ioerrorlog },
+	{ "format",		CF_STRING,  conf_set_log_format, 0, NULL },
 	{ "\0",			0,	    NULL, 0,          NULL }
 };
 
@@ -2779,6 +3108,7 @@ static struct ConfEntry conf_general_table[] =
 	{ "hide_opers_in_whois",	CF_YESNO, NULL, 0, &ConfigFileEntry.hide_opers_in_whois		},
 	{ "hide_opers",		CF_YESNO, NULL, 0, &ConfigFileEntry.hide_opers		},
 	{ "certfp_method",	CF_STRING, conf_set_general_certfp_method, 0, NULL },
+	{ "compression_level",	CF_INT,    conf_set_general_compression_level, 0, NULL },
 	{ "drain_reason",	CF_QSTRING, NULL, BUFSIZE, &ConfigFileEntry.drain_reason	},
 	{ "tls_ciphers_oper_only",	CF_YESNO, NULL, 0, &ConfigFileEntry.tls_ciphers_oper_only	},
 	{ "\0", 		0, 	  NULL, 0, NULL }
@@ -2850,6 +3180,7 @@ newconf_init()
 	add_top_conf("listen", conf_begin_listen, conf_end_listen, NULL);
 	add_conf_item("listen", "defer_accept", CF_YESNO, conf_set_listen_defer_accept);
 	add_conf_item("listen", "wsock", CF_YESNO, conf_set_listen_wsock);
+	add_conf_item("listen", "metrics", CF_YESNO, conf_set_listen_metrics);
 	add_conf_item("listen", "port", CF_INT | CF_FLIST, conf_set_listen_port);
 	add_conf_item("listen", "sslport", CF_INT | CF_FLIST, conf_set_listen_sslport);
 	add_conf_item("listen", "sctp_port", CF_INT | CF_FLIST, conf_set_listen_sctp_port);
@@ -22,6 +22,7 @@
  *  USA
  */
 #include "stdinc.h"
+#include "capture.h"
 #include "s_conf.h"
 #include "s_serv.h"
 #include "client.h"
@@ -268,6 +269,9 @@ read_packet(rb_fde_t * F, void *data)
 			return;
 		}
 
+		if(capture_active)
+			capture_data(client_p, readBuf, length);
+
 		if(client_p->localClient->lasttime < rb_current_time())
 			client_p->localClient->lasttime = rb_current_time();
 		client_p->flags &= ~FLAGS_PINGSENT;
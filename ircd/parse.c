@@ -40,6 +40,7 @@
 #include "s_serv.h"
 #include "packet.h"
 #include "s_assert.h"
+#include "profile.h"
 
 rb_dictionary *cmd_dict = NULL;
 rb_dictionary *alias_dict = NULL;
@@ -236,6 +237,18 @@ handle_command(struct Message *mptr, struct MsgBuf *msgbuf_p, struct Client *cli
 		return (-1);
 	}
 
+	if(rb_unlikely(profile_enabled))
+	{
+		/* the handler may unload the module mptr lives in */
+		struct rb_histogram *profile = mptr->profile;
+		uint64_t start = rb_monotonic_ns();
+
+		(*handler) (msgbuf_p, client_p, from, msgbuf_p->n_para, msgbuf_p->para);
+		if(profile != NULL)
+			rb_histogram_add(profile, rb_monotonic_ns() - start);
+		return (1);
+	}
+
 	(*handler) (msgbuf_p, client_p, from, msgbuf_p->n_para, msgbuf_p->para);
 	return (1);
 }
@@ -302,6 +315,7 @@ mod_add_cmd(struct Message *msg)
 	msg->count = 0;
 	msg->rcount = 0;
 	msg->bytes = 0;
+	msg->profile = profile_command(msg->cmd);
 
 	rb_dictionary_add(cmd_dict, msg->cmd, msg);
 }
@@ -28,16 +28,158 @@
 #include "s_assert.h"
 #include "logger.h"
 #include "send.h"
+#include "rb_radixtree.h"
 
 static rb_dlink_list privilegeset_list = {NULL, NULL, 0};
 
+static rb_radixtree *privilege_tree = NULL;
+static char *privilege_names[PRIVID_MAX];
+static int privilege_count = 0;
+
+static const char *core_privileges[PRIVID_CORE_COUNT] = {
+	[PRIVID_AUSPEX_CMODES]		= "auspex:cmodes",
+	[PRIVID_AUSPEX_HOSTNAME]	= "auspex:hostname",
+	[PRIVID_AUSPEX_OPER]		= "auspex:oper",
+	[PRIVID_AUSPEX_UMODES]		= "auspex:umodes",
+	[PRIVID_OPER_ADMIN]		= "oper:admin",
+	[PRIVID_OPER_CMODES]		= "oper:cmodes",
+	[PRIVID_OPER_DIE]		= "oper:die",
+	[PRIVID_OPER_GENERAL]		= "oper:general",
+	[PRIVID_OPER_GLOBAL_KILL]	= "oper:global_kill",
+	[PRIVID_OPER_GRANT]		= "oper:grant",
+	[PRIVID_OPER_HIDDEN]		= "oper:hidden",
+	[PRIVID_OPER_HIDDEN_ADMIN]	= "oper:hidden_admin",
+	[PRIVID_OPER_KLINE]		= "oper:kline",
+	[PRIVID_OPER_LOCAL_KILL]	= "oper:local_kill",
+	[PRIVID_OPER_MASS_NOTICE]	= "oper:mass_notice",
+	[PRIVID_OPER_OPERWALL]		= "oper:operwall",
+	[PRIVID_OPER_PRIVS]		= "oper:privs",
+	[PRIVID_OPER_REHASH]		= "oper:rehash",
+	[PRIVID_OPER_REMOTEBAN]		= "oper:remoteban",
+	[PRIVID_OPER_RESV]		= "oper:resv",
+	[PRIVID_OPER_ROUTING]		= "oper:routing",
+	[PRIVID_OPER_SPY]		= "oper:spy",
+	[PRIVID_OPER_TESTLINE]		= "oper:testline",
+	[PRIVID_OPER_UNKLINE]		= "oper:unkline",
+	[PRIVID_OPER_XLINE]		= "oper:xline",
+	[PRIVID_SNOMASK_NICK_CHANGES]	= "snomask:nick_changes",
+	[PRIVID_USERMODE_SERVNOTICE]	= "usermode:servnotice",
+};
+
+void
+init_privileges(void)
+{
+	int i;
+
+	privilege_tree = rb_radixtree_create("privileges", NULL);
+
+	for (i = 0; i < PRIVID_CORE_COUNT; i++)
+	{
+		int id = privilege_register(core_privileges[i]);
+		s_assert(id == i);
+	}
+}
+
+/*
+ * privilege_find
+ *
+ * inputs	- privilege name
+ * output	- bit slot of the privilege, or -1 if it has none
+ */
+int
+privilege_find(const char *priv)
+{
+	void *elem;
+
+	s_assert(priv != NULL);
+
+	elem = rb_radixtree_retrieve(privilege_tree, priv);
+	if (elem == NULL)
+		return -1;
+
+	return RB_POINTER_TO_INT(elem) - 1;
+}
+
+/*
+ * privilege_register
+ *
+ * inputs	- privilege name
+ * output	- bit slot of the privilege, or -1 if the table is full
+ * side effects	- a new slot is allocated if the name was not yet known
+ *
+ * Names that do not get a slot still work through privilegeset_in_set(),
+ * which falls back to scanning the privset string for them, but not
+ * through HasPrivilegeId().
+ */
+int
+privilege_register(const char *priv)
+{
+	int id;
+
+	s_assert(priv != NULL);
+
+	if ((id = privilege_find(priv)) >= 0)
+		return id;
+
+	if (privilege_count >= PRIVID_MAX)
+	{
+		ilog(L_MAIN, "Privilege table full, %s will use slow lookups", priv);
+		return -1;
+	}
+
+	id = privilege_count++;
+	privilege_names[id] = rb_strdup(priv);
+	rb_radixtree_add(privilege_tree, privilege_names[id], RB_INT_TO_POINTER(id + 1));
+
+	return id;
+}
+
+/* sets the bit of every privilege named in privs, registering new names */
+static void
+privilegeset_compile(struct PrivilegeSet *set, const char *privs)
+{
+	char *buf, *p, *next;
+
+	buf = LOCAL_COPY(privs);
+	for (p = rb_strtok_r(buf, " ", &next); p != NULL; p = rb_strtok_r(NULL, " ", &next))
+	{
+		int id = privilege_register(p);
+
+		if (id >= 0)
+			set->privbits[id / 32] |= 1U << (id % 32);
+	}
+}
+
+/* exact match of priv against the space separated names in privs */
+static bool
+privs_contain(const char *privs, const char *priv)
+{
+	size_t len = strlen(priv);
+	const char *p = privs;
+
+	while ((p = strstr(p, priv)) != NULL)
+	{
+		if ((p == privs || p[-1] == ' ') && (p[len] == '\0' || p[len] == ' '))
+			return true;
+		p += len;
+	}
+
+	return false;
+}
+
 int
 privilegeset_in_set(struct PrivilegeSet *set, const char *priv)
 {
+	int id;
+
 	s_assert(set != NULL);
 	s_assert(priv != NULL);
 
-	return strstr(set->privs, priv) != NULL;
+	if ((id = privilege_find(priv)) >= 0)
+		return privilegeset_has(set, id);
+
+	/* a name without a slot is in no privset unless the table overflowed */
+	return privilege_count >= PRIVID_MAX && privs_contain(set->privs, priv);
 }
 
 static struct PrivilegeSet *
@@ -82,6 +224,8 @@ privilegeset_set_new(const char *name, const char *privs, PrivilegeFlags flags)
 	}
 	set->privs = rb_strdup(privs);
 	set->flags = flags;
+	memset(set->privbits, 0, sizeof set->privbits);
+	privilegeset_compile(set, set->privs);
 
 	return set;
 }
@@ -117,6 +261,8 @@ privilegeset_extend(struct PrivilegeSet *parent, const char *name, const char *p
 	strcpy(set->privs, parent->privs);
 	strcat(set->privs, " ");
 	strcat(set->privs, privs);
+	memcpy(set->privbits, parent->privbits, sizeof set->privbits);
+	privilegeset_compile(set, privs);
 
 	return set;
 }
@@ -178,6 +324,7 @@ privilegeset_mark_all_illegal(void)
 		set->status |= CONF_ILLEGAL;
 		rb_free(set->privs);
 		set->privs = rb_strdup("");
+		memset(set->privbits, 0, sizeof set->privbits);
 		/* but do not free it yet */
 	}
 }
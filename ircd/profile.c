@@ -0,0 +1,207 @@
+/*
+ * ircd/profile.c
+ * Copyright (c) 2026 Ophion development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stdinc.h"
+#include "hook.h"
+#include "logger.h"
+#include "match.h"
+#include "profile.h"
+#include "rb_radixtree.h"
+
+bool profile_enabled = false;
+
+struct command_profile
+{
+	struct rb_histogram hist;
+	char name[];
+};
+
+static rb_radixtree *command_profiles;
+static time_t profile_started;
+
+void
+init_profile(void)
+{
+	command_profiles = rb_radixtree_create("command profiles", irccasecanon);
+}
+
+/* profile_command()
+ *
+ * inputs	- command name
+ * outputs	- histogram for that command, created if needed
+ * side effects - none
+ */
+struct rb_histogram *
+profile_command(const char *cmd)
+{
+	struct command_profile *prof = rb_radixtree_retrieve(command_profiles, cmd);
+
+	if(prof == NULL)
+	{
+		prof = rb_malloc(sizeof *prof + strlen(cmd) + 1);
+		strcpy(prof->name, cmd);
+		rb_radixtree_add(command_profiles, cmd, prof);
+	}
+
+	return &prof->hist;
+}
+
+void
+profile_set(bool enabled)
+{
+	if(enabled && !profile_enabled)
+		profile_started = rb_current_time();
+
+	profile_enabled = enabled;
+	rb_set_profiling(enabled);
+}
+
+time_t
+profile_since(void)
+{
+	return profile_enabled ? profile_started : 0;
+}
+
+void
+profile_clear(void)
+{
+	rb_radixtree_iteration_state iter;
+	struct command_profile *prof;
+
+	RB_RADIXTREE_FOREACH(prof, &iter, command_profiles)
+		memset(&prof->hist, 0, sizeof prof->hist);
+
+	for(int i = 0; i < num_hooks; i++)
+	{
+		if(hooks[i].name != NULL && hooks[i].profile != NULL)
+			memset(hooks[i].profile, 0, sizeof *hooks[i].profile);
+	}
+
+	rb_clear_profile();
+	profile_started = rb_current_time();
+}
+
+struct event_walk
+{
+	profile_walk_cb cb;
+	void *data;
+};
+
+static void
+walk_event(const char *name, const struct rb_histogram *hist, void *data)
+{
+	struct event_walk *walk = data;
+
+	walk->cb("event", name, hist, walk->data);
+}
+
+/* profile_walk()
+ *
+ * inputs	- callback, opaque data
+ * outputs	- none
+ * side effects - callback is called with every histogram that has samples,
+ *		  kind being "loop", "command", "hook" or "event"
+ */
+void
+profile_walk(profile_walk_cb cb, void *data)
+{
+	rb_radixtree_iteration_state iter;
+	struct command_profile *prof;
+	struct event_walk walk = { cb, data };
+
+	if(rb_loop_profile()->count > 0)
+		cb("loop", "iteration", rb_loop_profile(), data);
+
+	RB_RADIXTREE_FOREACH(prof, &iter, command_profiles)
+	{
+		if(prof->hist.count > 0)
+			cb("command", prof->name, &prof->hist, data);
+	}
+
+	for(int i = 0; i < num_hooks; i++)
+	{
+		if(hooks[i].name != NULL && hooks[i].profile != NULL && hooks[i].profile->count > 0)
+			cb("hook", hooks[i].name, hooks[i].profile, data);
+	}
+
+	rb_dump_event_profile(walk_event, &walk);
+}
+
+static void
+dump_one(const char *kind, const char *name, const struct rb_histogram *hist, void *data)
+{
+	FILE *f = data;
+
+	/* names come from commands and hooks, which modules are free to pick */
+	fputs("{\"kind\":", f);
+	write_json_string(f, kind);
+	fputs(",\"name\":", f);
+	write_json_string(f, name);
+	fprintf(f, ",\"count\":%lu,\"total_ns\":%llu,\"max_ns\":%llu,\"buckets\":[",
+		hist->count, (unsigned long long)hist->total_ns,
+		(unsigned long long)hist->max_ns);
+
+	for(int b = 0; b < RB_HISTOGRAM_BUCKETS; b++)
+		fprintf(f, "%s%lu", b ? "," : "", hist->bucket[b]);
+
+	fputs("]}\n", f);
+}
+
+/* profile_dump()
+ *
+ * inputs	- path to write to
+ * outputs	- 0 on success, -1 with errno set on failure
+ * side effects - every histogram is written to path as one JSON object per
+ *		  line; bucket n of "buckets" counts samples under 2^n us
+ */
+int
+profile_dump(const char *path)
+{
+	FILE *f;
+	int saved_errno;
+
+	if((f = fopen(path, "w")) == NULL)
+		return -1;
+
+	fprintf(f, "{\"kind\":\"header\",\"enabled\":%s,\"since\":%lld,\"now\":%lld}\n",
+		profile_enabled ? "true" : "false", (long long)profile_since(),
+		(long long)rb_current_time());
+
+	profile_walk(dump_one, f);
+
+	if(ferror(f))
+	{
+		saved_errno = errno;
+		fclose(f);
+		errno = saved_errno;
+		return -1;
+	}
+
+	return fclose(f) == 0 ? 0 : -1;
+}
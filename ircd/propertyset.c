@@ -45,70 +45,148 @@
 
 #include "propertyset.h"
 
-struct Property *
-propertyset_find(const rb_dlink_list *prop_list, const char *name)
+/*
+ * propertyset_search
+ *
+ * inputs	- property set, property name
+ * output	- index of the property, or where it would be inserted
+ * side effects	- *found is set if the property exists
+ */
+static unsigned int
+propertyset_search(const struct PropertySet *prop_list, const char *name, bool *found)
 {
-	rb_dlink_node *cur;
+	unsigned int lo = 0, hi = prop_list->count;
 
-	RB_DLINK_FOREACH(cur, prop_list->head)
-	{
-		struct Property *prop = cur->data;
+	*found = false;
 
-		if (!strcasecmp(prop->name, name))
-			return prop;
+	while (lo < hi)
+	{
+		unsigned int mid = lo + (hi - lo) / 2;
+		int cmp = strcasecmp(name, prop_list->props[mid]->name);
+
+		if (cmp == 0)
+		{
+			*found = true;
+			return mid;
+		}
+		else if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
 	}
 
-	return NULL;
+	return lo;
+}
+
+struct Property *
+propertyset_find(const struct PropertySet *prop_list, const char *name)
+{
+	unsigned int i;
+	bool found;
+
+	i = propertyset_search(prop_list, name, &found);
+
+	return found ? prop_list->props[i] : NULL;
 }
 
-static void
-propertyset_delete_one(rb_dlink_list *prop_list, struct Property *prop)
+static struct Property *
+property_new(const char *name, const char *value, const char *setter)
 {
-	s_assert(prop != NULL);
+	struct Property *prop;
+	size_t namelen = strlen(name) + 1;
+	size_t valuelen = strlen(value) + 1;
+	size_t setterlen = strlen(setter) + 1;
+
+	prop = rb_malloc(sizeof(*prop) + namelen + valuelen + setterlen);
+	prop->set_at = rb_current_time();
+	prop->name = (char *) (prop + 1);
+	prop->value = prop->name + namelen;
+	prop->setter = prop->value + valuelen;
 
-	rb_dlinkDelete(&prop->prop_node, prop_list);
+	memcpy(prop->name, name, namelen);
+	memcpy(prop->value, value, valuelen);
+	memcpy(prop->setter, setter, setterlen);
 
-	rb_free(prop->name);
-	rb_free(prop->value);
-	rb_free(prop->setter);
-	rb_free(prop);
+	return prop;
 }
 
 void
-propertyset_delete(rb_dlink_list *prop_list, const char *name)
+propertyset_delete(struct PropertySet *prop_list, const char *name)
 {
-	struct Property *prop = propertyset_find(prop_list, name);
+	unsigned int i;
+	bool found;
 
-	if (prop == NULL)
+	i = propertyset_search(prop_list, name, &found);
+	if (!found)
 		return;
 
-	propertyset_delete_one(prop_list, prop);
+	rb_free(prop_list->props[i]);
+
+	prop_list->count--;
+	memmove(&prop_list->props[i], &prop_list->props[i + 1],
+		(prop_list->count - i) * sizeof(struct Property *));
 }
 
 void
-propertyset_clear(rb_dlink_list *prop_list)
+propertyset_clear(struct PropertySet *prop_list)
+{
+	unsigned int i;
+
+	for (i = 0; i < prop_list->count; i++)
+		rb_free(prop_list->props[i]);
+
+	rb_free(prop_list->props);
+	prop_list->props = NULL;
+	prop_list->count = prop_list->alloc = 0;
+}
+
+/* gives an existing property a new value and setter, keeping its name and slot */
+static struct Property *
+property_update(struct Property *prop, const char *value, const char *setter)
 {
-	rb_dlink_node *cur, *next;
+	size_t namelen = strlen(prop->name) + 1;
+	size_t valuelen = strlen(value) + 1;
+	size_t setterlen = strlen(setter) + 1;
+
+	prop = rb_realloc(prop, sizeof(*prop) + namelen + valuelen + setterlen);
+	prop->set_at = rb_current_time();
+	prop->name = (char *) (prop + 1);
+	prop->value = prop->name + namelen;
+	prop->setter = prop->value + valuelen;
 
-	RB_DLINK_FOREACH_SAFE(cur, next, prop_list->head)
-		propertyset_delete_one(prop_list, cur->data);
+	memcpy(prop->value, value, valuelen);
+	memcpy(prop->setter, setter, setterlen);
+
+	return prop;
 }
 
 struct Property *
-propertyset_add(rb_dlink_list *prop_list, const char *name, const char *value, struct Client *setter_p)
+propertyset_add(struct PropertySet *prop_list, const char *name, const char *value, struct Client *setter_p)
 {
 	struct Property *prop;
+	unsigned int i;
+	bool found;
 
 	/* propertyset_add() actually behaves as an upsert. */
-	propertyset_delete(prop_list, name);
+	i = propertyset_search(prop_list, name, &found);
+	if (found)
+	{
+		prop_list->props[i] = property_update(prop_list->props[i], value, setter_p->name);
+		return prop_list->props[i];
+	}
 
-	prop = rb_malloc(sizeof(*prop));
-	prop->set_at = rb_current_time();
-	prop->name = rb_strdup(name);
-	prop->value = rb_strdup(value);
-	prop->setter = rb_strdup(setter_p->name);
+	prop = property_new(name, value, setter_p->name);
+
+	if (prop_list->count == prop_list->alloc)
+	{
+		prop_list->alloc = prop_list->alloc ? prop_list->alloc * 2 : 4;
+		prop_list->props = rb_realloc(prop_list->props, prop_list->alloc * sizeof(struct Property *));
+	}
 
-	rb_dlinkAdd(prop, &prop->prop_node, prop_list);
+	memmove(&prop_list->props[i + 1], &prop_list->props[i],
+		(prop_list->count - i) * sizeof(struct Property *));
+	prop_list->props[i] = prop;
+	prop_list->count++;
 
 	return prop;
 }
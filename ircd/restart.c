@@ -24,6 +24,7 @@
 
 #include "stdinc.h"
 #include "restart.h"
+#include "capture.h"
 #include "ircd.h"
 #include "send.h"
 #include "logger.h"
@@ -68,6 +69,9 @@ server_reboot(void)
 	 * bah, for now, the program ain't coming back to here, so forcibly
 	 * close everything the "wrong" way for now, and just LEAVE...
 	 */
+	capture_stop();
+	close_logfiles();	/* waits for queued log lines to hit the disk */
+
 	for (i = 0; i < maxconnections; ++i)
 		close(i);
 
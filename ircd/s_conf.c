@@ -55,9 +55,11 @@
 #include "authproc.h"
 #include "supported.h"
 
+#include <pthread.h>
+#include <stdatomic.h>
+
 struct config_server_hide ConfigServerHide;
 
-extern int yyparse(void);		/* defined in y.tab.c */
 extern char yy_linebuf[16384];		/* defined in ircd_lexer.l */
 
 static rb_bh *confitem_heap = NULL;
@@ -71,9 +73,12 @@ rb_dictionary *prop_bans_dict;
 /* internally defined functions */
 static void set_default_conf(void);
 static void validate_conf(void);
-static void read_conf(void);
 static void clear_out_old_conf(void);
 
+struct rehash_timing;
+static FILE *open_conf_file(bool cold);
+static void install_conf(struct conf_parse *, bool cold, struct rehash_timing *);
+
 static void expire_prop_bans(void *);
 static void expire_temp_kd(void *list);
 static void reorganise_temp_kd(void *list);
@@ -637,28 +642,114 @@ attach_conf(struct Client *client_p, struct ConfItem *aconf)
 	return (0);
 }
 
-/*
- * rehash
- *
- * Actual REHASH service routine. Called with sig == 0 if it has been called
- * as a result of an operator issuing this command, else assume it has been
- * called as a result of the server receiving a HUP signal.
+/* REHASH parses the config file on a worker thread, see conf_parse_file();
+ * only installing the result happens on the main loop.
  */
-bool
-rehash(bool sig)
+struct rehash_timing
+{
+	double parse;
+	double clear;
+	double load;
+	double validate;
+	double post;
+};
+
+static rb_fde_t *conf_parse_rfd, *conf_parse_wfd;
+static struct conf_parse *_Atomic conf_parse_result;
+static double conf_parse_time;
+
+static bool rehash_running;
+static bool rehash_again;
+static bool rehash_sig;
+static char rehash_requester[IDLEN];
+static char rehash_again_requester[IDLEN];
+
+/* milliseconds since *lap, which is moved on to now */
+static double
+lap_ms(struct timespec *lap)
+{
+	struct timespec now;
+	double ms;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (now.tv_sec - lap->tv_sec) * 1000.0 + (now.tv_nsec - lap->tv_nsec) / 1000000.0;
+	*lap = now;
+
+	return ms;
+}
+
+static void *
+conf_parse_thread(void *file)
 {
+	struct conf_parse *parse;
+	struct timespec lap;
+
+	clock_gettime(CLOCK_MONOTONIC, &lap);
+	parse = conf_parse_file(file, ConfigFileEntry.configfile);
+	fclose(file);
+	conf_parse_time = lap_ms(&lap);
+
+	/* nothing here may log: the logger belongs to the main thread.  If the
+	 * wakeup is lost, the next rehash() picks the result up instead and
+	 * reports the failure.
+	 */
+	atomic_store(&conf_parse_result, parse);
+	if(write(rb_get_fd(conf_parse_wfd), "", 1) < 0)
+	{
+		int err = errno;
+
+		/* take it back to note why, unless it was picked up already */
+		if((parse = atomic_exchange(&conf_parse_result, NULL)) != NULL)
+		{
+			conf_parse_fail(parse, "unable to signal the main loop", err);
+			atomic_store(&conf_parse_result, parse);
+		}
+	}
+
+	return NULL;
+}
+
+static void
+report_rehash_timing(struct Client *requester, const struct rehash_timing *timing)
+{
+	double blocked = timing->clear + timing->load + timing->validate + timing->post;
+
+	ilog(L_MAIN, "Rehash timing: parse %.1fms (background), clear %.1fms, load %.1fms, "
+	     "validate %.1fms, rehash hooks %.1fms",
+	     timing->parse, timing->clear, timing->load, timing->validate, timing->post);
+
+	if(requester != NULL)
+		sendto_one_notice(requester, ":*** Notice -- Rehash complete in %.1fms: parse %.1fms (background), "
+				"clear %.1fms, load %.1fms, validate %.1fms, rehash hooks %.1fms",
+				blocked, timing->parse, timing->clear, timing->load,
+				timing->validate, timing->post);
+}
+
+static void
+finish_rehash(struct conf_parse *parse, double parse_time)
+{
+	struct rehash_timing timing = { .parse = parse_time };
+	hook_data_rehash hdata = { rehash_sig };
+	struct Client *requester = NULL;
+	struct timespec lap;
 	rb_dlink_node *n;
+	const char *failure;
+	int err;
 
-	hook_data_rehash hdata = { sig };
+	if(rehash_requester[0] != '\0')
+		requester = find_id(rehash_requester);
 
-	if(sig)
-		sendto_realops_snomask(SNO_GENERAL, L_ALL,
-				     "Got signal SIGHUP, reloading ircd conf. file");
+	if((failure = conf_parse_failure(parse, &err)) != NULL)
+		ierror("conf parse: %s: %s", failure, strerror(err));
 
-	rehash_authd();
+	/* config errors go to a remote oper as well */
+	if(requester != NULL && !MyConnect(requester))
+		remote_rehash_oper_p = requester;
 
-	/* don't close listeners until we know we can go ahead with the rehash */
-	read_conf_files(false);
+	install_conf(parse, false, &timing);
+	conf_parse_free(parse);
+
+	clock_gettime(CLOCK_MONOTONIC, &lap);
 
 	if(ServerInfo.description != NULL)
 		rb_strlcpy(me.info, ServerInfo.description, sizeof(me.info));
@@ -678,6 +769,105 @@ rehash(bool sig)
 	}
 
 	call_hook(h_rehash, &hdata);
+	timing.post = lap_ms(&lap);
+
+	remote_rehash_oper_p = NULL;
+	rehash_running = false;
+
+	report_rehash_timing(requester, &timing);
+
+	modules_restart_done();
+
+	if(rehash_again)
+	{
+		rehash_again = false;
+		rehash(false, rehash_again_requester[0] != '\0' ? find_id(rehash_again_requester) : NULL);
+		rehash_again_requester[0] = '\0';
+	}
+}
+
+static void
+conf_parse_done(rb_fde_t *F, void *unused)
+{
+	struct conf_parse *parse;
+	char buf[16];
+
+	while(rb_read(F, buf, sizeof(buf)) > 0)
+		;
+
+	rb_setselect(F, RB_SELECT_READ, conf_parse_done, NULL);
+
+	if((parse = atomic_exchange(&conf_parse_result, NULL)) == NULL)
+		return;
+
+	finish_rehash(parse, conf_parse_time);
+}
+
+/*
+ * rehash
+ *
+ * Actual REHASH service routine. Called with sig == 0 if it has been called
+ * as a result of an operator issuing this command, else assume it has been
+ * called as a result of the server receiving a HUP signal.  source_p, if
+ * not NULL, is told how long each stage took once the new config is in.
+ */
+bool
+rehash(bool sig, struct Client *source_p)
+{
+	struct conf_parse *parse;
+	pthread_t thread;
+	FILE *file;
+
+	if(sig)
+		sendto_realops_snomask(SNO_GENERAL, L_ALL,
+				     "Got signal SIGHUP, reloading ircd conf. file");
+
+	/* a finished parse that could not wake us up */
+	if(rehash_running && (parse = atomic_exchange(&conf_parse_result, NULL)) != NULL)
+		finish_rehash(parse, conf_parse_time);
+
+	if(rehash_running)
+	{
+		/* the running parse may have missed the latest edits */
+		rehash_again = true;
+		if(source_p != NULL)
+		{
+			rb_strlcpy(rehash_again_requester, source_p->id, sizeof(rehash_again_requester));
+			sendto_one_notice(source_p, ":*** Notice -- A rehash is already in progress, "
+					"the config file will be read again when it completes");
+		}
+		return false;
+	}
+
+	rehash_authd();
+
+	/* don't close listeners until we know we can go ahead with the rehash */
+	if((file = open_conf_file(false)) == NULL)
+	{
+		modules_restart_done();
+		return false;
+	}
+
+	rehash_running = true;
+	rehash_sig = sig;
+	rb_strlcpy(rehash_requester, source_p != NULL ? source_p->id : "", sizeof(rehash_requester));
+
+	if(conf_parse_rfd == NULL && rb_pipe(&conf_parse_rfd, &conf_parse_wfd, "conf parse notify") == 0)
+		rb_setselect(conf_parse_rfd, RB_SELECT_READ, conf_parse_done, NULL);
+
+	if(conf_parse_rfd == NULL || pthread_create(&thread, NULL, conf_parse_thread, file) != 0)
+	{
+		struct timespec lap;
+
+		/* no worker, parse right here */
+		clock_gettime(CLOCK_MONOTONIC, &lap);
+		parse = conf_parse_file(file, ConfigFileEntry.configfile);
+		fclose(file);
+		finish_rehash(parse, lap_ms(&lap));
+		return false;
+	}
+
+	pthread_detach(thread);
 	return false;
 }
 
@@ -763,6 +953,7 @@ set_default_conf(void)
 	ConfigFileEntry.fname_klinelog = NULL;
 	ConfigFileEntry.fname_operspylog = NULL;
 	ConfigFileEntry.fname_ioerrorlog = NULL;
+	ConfigFileEntry.log_json = 0;
 	ConfigFileEntry.hide_spoof_ips = true;
 	ConfigFileEntry.hide_error_messages = 1;
 	ConfigFileEntry.dots_in_ident = 0;
@@ -838,6 +1029,7 @@ set_default_conf(void)
 
 	ConfigFileEntry.nicklen = NICKLEN;
 	ConfigFileEntry.certfp_method = RB_SSL_CERTFP_METH_CERT_SHA1;
+	ConfigFileEntry.compression_level = 6;
 	ConfigFileEntry.hide_opers_in_whois = 0;
 	ConfigFileEntry.hide_opers = 0;
 
@@ -850,28 +1042,6 @@ set_default_conf(void)
 	STSInfo.preload = 0;
 }
 
-/*
- * read_conf()
- *
- *
- * inputs       - None
- * output       - None
- * side effects	- Read configuration file.
- */
-static void
-read_conf(void)
-{
-	lineno = 0;
-
-	set_default_conf();	/* Set default values prior to conf parsing */
-	yyparse();		/* Load the values from the conf */
-	validate_conf();	/* Check to make sure some values are still okay. */
-	/* Some global values are also loaded here. */
-	check_class();		/* Make sure classes are valid */
-	privilegeset_delete_all_illegal();
-	construct_cflags_strings();
-}
-
 static void
 validate_conf(void)
 {
@@ -890,9 +1060,17 @@ validate_conf(void)
 	if(ServerInfo.ssld_count < 1)
 		ServerInfo.ssld_count = 1;
 
+	if(ServerInfo.authd_count < 1)
+		ServerInfo.authd_count = 1;
+	else if(ServerInfo.authd_count > AUTHD_MAX_COUNT)
+		ServerInfo.authd_count = AUTHD_MAX_COUNT;
+
 	/* XXX: configurable? */
 	ServerInfo.wsockd_count = 1;
 
+	if(ServerInfo.wsockd_deflate_memory < 0)
+		ServerInfo.wsockd_deflate_memory = 0;
+
 	if(!rb_setup_ssl_server(ServerInfo.ssl_cert, ServerInfo.ssl_private_key, ServerInfo.ssl_dh_params, ServerInfo.ssl_cipher_list, ServerInfo.ssl_client_cert))
 	{
 		ilog(L_MAIN, "WARNING: Unable to setup SSL.");
@@ -909,11 +1087,19 @@ validate_conf(void)
 		start_ssldaemon(start);
 	}
 
+	if(ServerInfo.authd_count > get_authd_count())
+	{
+		int start = ServerInfo.authd_count - get_authd_count();
+		/* start up additional authd if needed */
+		start_authd_instances(start);
+	}
+
 	if(ServerInfo.wsockd_count > get_wsockd_count())
 	{
 		int start = ServerInfo.wsockd_count - get_wsockd_count();
 		start_wsockd(start);
 	}
+	wsockd_update_config();
 
 	/* General conf */
 	if (ConfigFileEntry.default_operstring == NULL)
@@ -1130,6 +1316,7 @@ bool lookup_prop_ban(struct ConfItem *aconf)
 void
 deactivate_conf(struct ConfItem *aconf, time_t now)
 {
+	rb_dlink_node *ptr;
 	int i;
 
 	switch (aconf->status)
@@ -1156,10 +1343,12 @@ deactivate_conf(struct ConfItem *aconf, time_t now)
 			aconf->clients--;
 			break;
 		case CONF_XLINE:
-			rb_dlinkFindDestroy(aconf, &xline_conf_list);
+			if((ptr = rb_dlinkFind(aconf, &xline_conf_list)) != NULL)
+				remove_xline_conf(ptr);
 			break;
 		case CONF_RESV_NICK:
-			rb_dlinkFindDestroy(aconf, &resv_conf_list);
+			if((ptr = rb_dlinkFind(aconf, &resv_conf_list)) != NULL)
+				remove_nick_resv_conf(ptr);
 			break;
 		case CONF_RESV_CHANNEL:
 			del_from_resv_hash(aconf->host, aconf);
@@ -1417,32 +1606,19 @@ get_printable_kline(struct Client *source_p, struct ConfItem *aconf,
 }
 
 /*
- * read_conf_files
+ * open_conf_file
  *
  * inputs       - cold start
- * output       - none
- * side effects - read all conf files needed, ircd.conf kline.conf etc.
+ * output       - the main config file, or NULL
+ * side effects - a cold start is aborted if it cannot be opened
  */
-void
-read_conf_files(bool cold)
+static FILE *
+open_conf_file(bool cold)
 {
-	const char *filename;
-
-	conf_fbfile_in = NULL;
-
-	filename = ConfigFileEntry.configfile;
-
-	/* We need to know the initial filename for the yyerror() to report
-	   FIXME: The full path is in conffilenamebuf first time since we
-	   dont know anything else
-
-	   - Gozem 2002-07-21
+	const char *filename = ConfigFileEntry.configfile;
+	FILE *file;
 
-
-	 */
-	rb_strlcpy(conffilebuf, filename, sizeof(conffilebuf));
-
-	if((conf_fbfile_in = fopen(filename, "r")) == NULL)
+	if((file = fopen(filename, "r")) == NULL)
 	{
 		if(cold)
 		{
@@ -1461,20 +1637,73 @@ read_conf_files(bool cold)
 		{
 			sendto_realops_snomask(SNO_GENERAL, L_ALL,
 					     "Can't open file '%s' - aborting rehash!", filename);
-			return;
+			return NULL;
 		}
 	}
 
+	return file;
+}
+
+/*
+ * install_conf
+ *
+ * inputs       - parsed configuration, cold start, timings to fill in
+ * output       - none
+ * side effects - replaces the running configuration with the parsed one.
+ *		  Nothing before this point has touched the old one.
+ */
+static void
+install_conf(struct conf_parse *parse, bool cold, struct rehash_timing *timing)
+{
+	struct timespec lap;
+
+	clock_gettime(CLOCK_MONOTONIC, &lap);
+
 	if(!cold)
-	{
 		clear_out_old_conf();
-	}
+
+	timing->clear = lap_ms(&lap);
 
 	call_hook(h_conf_read_start, NULL);
-	read_conf();
+	set_default_conf();	/* Set default values prior to conf parsing */
+	conf_parse_apply(parse);	/* Load the values from the conf */
+	timing->load = lap_ms(&lap);
+
+	validate_conf();	/* Check to make sure some values are still okay. */
+	/* Some global values are also loaded here. */
+	check_class();		/* Make sure classes are valid */
+	privilegeset_delete_all_illegal();
+	construct_cflags_strings();
 	call_hook(h_conf_read_end, NULL);
+	timing->validate = lap_ms(&lap);
+}
+
+/*
+ * read_conf_files
+ *
+ * inputs       - cold start
+ * output       - none
+ * side effects - read all conf files needed, ircd.conf kline.conf etc.
+ *		  This parses on the spot; REHASH goes through rehash().
+ */
+void
+read_conf_files(bool cold)
+{
+	struct rehash_timing timing = { 0 };
+	struct conf_parse *parse;
+	struct timespec lap;
+	FILE *file;
+
+	if((file = open_conf_file(cold)) == NULL)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &lap);
+	parse = conf_parse_file(file, ConfigFileEntry.configfile);
+	fclose(file);
+	timing.parse = lap_ms(&lap);
 
-	fclose(conf_fbfile_in);
+	install_conf(parse, cold, &timing);
+	conf_parse_free(parse);
 }
 
 /*
@@ -1529,6 +1758,11 @@ clear_out_old_conf(void)
 	ServerInfo.network_name = NULL;
 
 	ServerInfo.ssld_count = 1;
+	ServerInfo.authd_count = 1;
+	ServerInfo.wsockd_deflate = true;
+	ServerInfo.wsockd_deflate_context_takeover = true;
+	ServerInfo.wsockd_deflate_memory = 64 * 1024 * 1024;
+	ServerInfo.helper_ring = false;
 
 	/* clean out AdminInfo */
 	rb_free(AdminInfo.name);
@@ -1702,9 +1936,7 @@ yyerror(const char *msg)
 
 	strip_tabs(newlinebuf, yy_linebuf, sizeof(newlinebuf));
 
-	ierror("\"%s\", line %d: %s at '%s'", conffilebuf, lineno + 1, msg, newlinebuf);
-	sendto_realops_snomask(SNO_GENERAL, L_ALL, "\"%s\", line %d: %s at '%s'",
-			     conffilebuf, lineno + 1, msg, newlinebuf);
+	conf_report_syntax_error(msg, newlinebuf);
 
 }
 
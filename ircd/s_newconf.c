@@ -45,6 +45,7 @@
 #include "s_assert.h"
 #include "logger.h"
 #include "dns.h"
+#include "globset.h"
 
 rb_dlink_list shared_conf_list;
 rb_dlink_list cluster_conf_list;
@@ -58,6 +59,10 @@ rb_dlink_list tgchange_list;
 
 rb_patricia_tree_t *tgchange_tree;
 
+/* indexes over xline_conf_list and resv_conf_list, see globset.c */
+static struct GlobSet *xline_globset;
+static struct GlobSet *resv_nick_globset;
+
 static rb_bh *nd_heap = NULL;
 
 static void expire_temp_rxlines(void *unused);
@@ -70,6 +75,8 @@ void
 init_s_newconf(void)
 {
 	tgchange_tree = rb_new_patricia(PATRICIA_BITS);
+	xline_globset = globset_create("xline masks");
+	resv_nick_globset = globset_create("nick resv masks");
 	nd_heap = rb_bh_create(sizeof(struct nd_entry), ND_HEAP_SIZE, "nd_heap");
 	expire_nd_entries_ev = rb_event_addish("expire_nd_entries", expire_nd_entries, NULL, 30);
 	expire_temp_rxlines_ev = rb_event_addish("expire_temp_rxlines", expire_temp_rxlines, NULL, 60);
@@ -134,8 +141,8 @@ clear_s_newconf_bans(void)
 		if(aconf->hold)
 			continue;
 
+		remove_xline_conf(ptr);
 		free_conf(aconf);
-		rb_dlinkDestroy(ptr, &xline_conf_list);
 	}
 
 	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, resv_conf_list.head)
@@ -146,8 +153,8 @@ clear_s_newconf_bans(void)
 		if(aconf->hold)
 			continue;
 
+		remove_nick_resv_conf(ptr);
 		free_conf(aconf);
-		rb_dlinkDestroy(ptr, &resv_conf_list);
 	}
 
 	clear_resv_hash();
@@ -569,79 +576,82 @@ disable_server_conf_autoconn(const char *name)
 	}
 }
 
-struct ConfItem *
-find_xline(const char *gecos, int counter)
+/* add_xline_conf()
+ *
+ * inputs	- X-line to add
+ * outputs	- none
+ * side effects - adds the X-line to xline_conf_list and its match index
+ */
+void
+add_xline_conf(struct ConfItem *aconf)
 {
-	struct ConfItem *aconf;
-	rb_dlink_node *ptr;
+	rb_dlinkAddAlloc(aconf, &xline_conf_list);
+	globset_add(xline_globset, aconf->host, aconf);
+}
 
-	RB_DLINK_FOREACH(ptr, xline_conf_list.head)
-	{
-		aconf = ptr->data;
+/* remove_xline_conf()
+ *
+ * inputs	- node of the X-line in xline_conf_list
+ * outputs	- none
+ * side effects - unlinks the X-line; must be called before free_conf()
+ */
+void
+remove_xline_conf(rb_dlink_node *ptr)
+{
+	struct ConfItem *aconf = ptr->data;
 
-		if(match_esc(aconf->host, gecos))
-		{
-			if(counter)
-				aconf->port++;
-			return aconf;
-		}
-	}
+	globset_delete(xline_globset, aconf->host, aconf);
+	rb_dlinkDestroy(ptr, &xline_conf_list);
+}
 
-	return NULL;
+void
+add_nick_resv_conf(struct ConfItem *aconf)
+{
+	rb_dlinkAddAlloc(aconf, &resv_conf_list);
+	globset_add(resv_nick_globset, aconf->host, aconf);
+}
+
+void
+remove_nick_resv_conf(rb_dlink_node *ptr)
+{
+	struct ConfItem *aconf = ptr->data;
+
+	globset_delete(resv_nick_globset, aconf->host, aconf);
+	rb_dlinkDestroy(ptr, &resv_conf_list);
 }
 
 struct ConfItem *
-find_xline_mask(const char *gecos)
+find_xline(const char *gecos, int counter)
 {
-	struct ConfItem *aconf;
-	rb_dlink_node *ptr;
+	struct ConfItem *aconf = globset_match(xline_globset, gecos);
 
-	RB_DLINK_FOREACH(ptr, xline_conf_list.head)
-	{
-		aconf = ptr->data;
+	if(aconf != NULL && counter)
+		aconf->port++;
 
-		if(!irccmp(aconf->host, gecos))
-			return aconf;
-	}
+	return aconf;
+}
 
-	return NULL;
+struct ConfItem *
+find_xline_mask(const char *gecos)
+{
+	return globset_find_mask(xline_globset, gecos);
 }
 
 struct ConfItem *
 find_nick_resv(const char *name)
 {
-	struct ConfItem *aconf;
-	rb_dlink_node *ptr;
-
-	RB_DLINK_FOREACH(ptr, resv_conf_list.head)
-	{
-		aconf = ptr->data;
+	struct ConfItem *aconf = globset_match(resv_nick_globset, name);
 
-		if(match_esc(aconf->host, name))
-		{
-			aconf->port++;
-			return aconf;
-		}
-	}
+	if(aconf != NULL)
+		aconf->port++;
 
-	return NULL;
+	return aconf;
 }
 
 struct ConfItem *
 find_nick_resv_mask(const char *name)
 {
-	struct ConfItem *aconf;
-	rb_dlink_node *ptr;
-
-	RB_DLINK_FOREACH(ptr, resv_conf_list.head)
-	{
-		aconf = ptr->data;
-
-		if(!irccmp(aconf->host, name))
-			return aconf;
-	}
-
-	return NULL;
+	return globset_find_mask(resv_nick_globset, name);
 }
 
 /* clean_resv_nick()
@@ -781,8 +791,8 @@ expire_temp_rxlines(void *unused)
 				sendto_realops_snomask(SNO_GENERAL, L_ALL,
 						"Temporary RESV for [%s] expired",
 						aconf->host);
+			remove_nick_resv_conf(ptr);
 			free_conf(aconf);
-			rb_dlinkDestroy(ptr, &resv_conf_list);
 		}
 	}
 
@@ -798,8 +808,8 @@ expire_temp_rxlines(void *unused)
 				sendto_realops_snomask(SNO_GENERAL, L_ALL,
 						"Temporary X-line for [%s] expired",
 						aconf->host);
+			remove_xline_conf(ptr);
 			free_conf(aconf);
-			rb_dlinkDestroy(ptr, &xline_conf_list);
 		}
 	}
 }
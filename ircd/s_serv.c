@@ -86,6 +86,7 @@ unsigned int CAP_EUID;
 unsigned int CAP_EOPMOD;
 unsigned int CAP_BAN;
 unsigned int CAP_MLOCK;
+unsigned int CAP_ZIP;
 
 unsigned int CLICAP_MULTI_PREFIX;
 unsigned int CLICAP_ACCOUNT_NOTIFY;
@@ -95,6 +96,7 @@ unsigned int CLICAP_USERHOST_IN_NAMES;
 unsigned int CLICAP_CAP_NOTIFY;
 unsigned int CLICAP_CHGHOST;
 unsigned int CLICAP_ECHO_MESSAGE;
+unsigned int CLICAP_BATCH;
 
 /*
  * initialize our builtin capability table. --nenolod
@@ -125,6 +127,7 @@ init_builtin_capabs(void)
 	CAP_EOPMOD = capability_put(serv_capindex, "EOPMOD", NULL);
 	CAP_BAN = capability_put(serv_capindex, "BAN", NULL);
 	CAP_MLOCK = capability_put(serv_capindex, "MLOCK", NULL);
+	CAP_ZIP = capability_put(serv_capindex, "ZIP", NULL);
 
 	capability_require(serv_capindex, "QS");
 	capability_require(serv_capindex, "EX");
@@ -141,6 +144,7 @@ init_builtin_capabs(void)
 	CLICAP_CAP_NOTIFY = capability_put(cli_capindex, "cap-notify", NULL);
 	CLICAP_CHGHOST = capability_put(cli_capindex, "chghost", NULL);
 	CLICAP_ECHO_MESSAGE = capability_put(cli_capindex, "echo-message", NULL);
+	CLICAP_BATCH = capability_put(cli_capindex, "batch", NULL);
 }
 
 static CNCB serv_connect_callback;
@@ -444,6 +448,11 @@ check_server(const char *name, struct Client *client_p)
 	if(!ServerConfTb(server_p))
 		ClearCap(client_p, CAP_TB);
 
+	/* likewise ZIP, which also needs an ssld that can do it, and a
+	 * descriptor to hand it, which a ring channel is not */
+	if(!ServerConfCompressed(server_p) || !ircd_zlib_ok || rb_fd_ring(client_p->localClient->F))
+		ClearCap(client_p, CAP_ZIP);
+
 	return 0;
 }
 
@@ -829,7 +838,9 @@ server_estab(struct Client *client_p)
 
 		/* pass info to new server */
 		send_capabilities(client_p, default_server_capabs | CAP_MASK
-				  | (ServerConfTb(server_p) ? CAP_TB : 0));
+				  | (ServerConfTb(server_p) ? CAP_TB : 0)
+				  | (ServerConfCompressed(server_p) && ircd_zlib_ok
+				     && !rb_fd_ring(client_p->localClient->F) ? CAP_ZIP : 0));
 
 		sendto_one(client_p, "SERVER %s 1 :%s%s",
 			   me.name,
@@ -837,6 +848,10 @@ server_estab(struct Client *client_p)
 			   (me.info[0]) ? (me.info) : "IRCers United");
 	}
 
+	/* everything from here on goes through ssld's compressor */
+	if(IsCapable(client_p, CAP_ZIP))
+		start_zlib_session(client_p);
+
 	if(!rb_set_buffers(client_p->localClient->F, READBUF_SIZE))
 		ilog_error("rb_set_buffers failed for server");
 
@@ -1341,7 +1356,8 @@ serv_connect_callback(rb_fde_t *F, int status, void *data)
 
 	/* pass my info to the new server */
 	send_capabilities(client_p, default_server_capabs | CAP_MASK
-			  | (ServerConfTb(server_p) ? CAP_TB : 0));
+			  | (ServerConfTb(server_p) ? CAP_TB : 0)
+			  | (ServerConfCompressed(server_p) && ircd_zlib_ok ? CAP_ZIP : 0));
 
 	sendto_one(client_p, "SERVER %s 1 :%s%s",
 		   me.name,
@@ -1050,7 +1050,7 @@ user_mode(struct Client *client_p, struct Client *source_p, int parc, const char
 
 	if(source_p != target_p)
 	{
-		if (HasPrivilege(source_p, "auspex:umodes") && parc < 3)
+		if (HasPrivilegeId(source_p, PRIVID_AUSPEX_UMODES) && parc < 3)
 			show_other_user_mode(source_p, target_p);
 		else
 			sendto_one(source_p, form_str(ERR_USERSDONTMATCH), me.name, source_p->name);
@@ -1157,7 +1157,7 @@ user_mode(struct Client *client_p, struct Client *source_p, int parc, const char
 			if (MyConnect(source_p))
 			{
 				if((ConfigFileEntry.oper_only_umodes & UMODE_SERVNOTICE) &&
-						(!IsOper(source_p) || !HasPrivilege(source_p, "usermode:servnotice")))
+						(!IsOper(source_p) || !HasPrivilegeId(source_p, PRIVID_USERMODE_SERVNOTICE)))
 				{
 					if (what == MODE_ADD || source_p->umodes & UMODE_SERVNOTICE)
 						badflag = true;
@@ -1219,7 +1219,7 @@ user_mode(struct Client *client_p, struct Client *source_p, int parc, const char
 	if(MyClient(source_p))
 	{
 		if ((ConfigFileEntry.oper_only_umodes & UMODE_SERVNOTICE) &&
-				!HasPrivilege(source_p, "usermode:servnotice"))
+				!HasPrivilegeId(source_p, PRIVID_USERMODE_SERVNOTICE))
 			source_p->umodes &= ~UMODE_SERVNOTICE;
 		if (!(source_p->umodes & UMODE_SERVNOTICE) && source_p->snomask != 0)
 		{
@@ -1448,7 +1448,7 @@ oper_up(struct Client *source_p, struct oper_conf *oper_p)
 	if(!IsOperOperwall(source_p))
 		source_p->umodes &= ~UMODE_OPERWALL;
 	if((ConfigFileEntry.oper_only_umodes & UMODE_SERVNOTICE) &&
-			!HasPrivilege(source_p, "usermode:servnotice"))
+			!HasPrivilegeId(source_p, PRIVID_USERMODE_SERVNOTICE))
 	{
 		source_p->umodes &= ~UMODE_SERVNOTICE;
 		source_p->snomask = 0;
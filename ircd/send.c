@@ -43,6 +43,42 @@
 #define send_linebuf(a,b) _send_linebuf((a->from ? a->from : a) ,b)
 
 #define CLIENT_CAPS_ONLY(x)	((IsClient((x)) && (x)->localClient) ? (x)->localClient->caps : 0)
+#define ALL_CLIENT_CAPS		(~0U)	/* recipients not known up front */
+
+/* how much a corked client may have queued before it is written to anyway */
+#define CORK_FLUSH_SIZE		16384
+
+/* The IRCv3 batch currently open, see send_batch_begin() */
+static struct
+{
+	bool open;
+	int tagging;		/* sends are part of the batch while nonzero */
+	char ref[16];
+	char type[16];
+	char params[BUFSIZE];
+	rb_dlink_list clients;
+} batch;
+
+/* the first message of the batch for target_p opens it */
+static void
+send_batch_join(struct Client *target_p)
+{
+	if(IsCork(target_p))
+		return;
+
+	SetCork(target_p);
+	rb_dlinkAddAlloc(target_p, &batch.clients);
+
+	if(IsCapable(target_p, CLICAP_BATCH))
+		sendto_one(target_p, ":%s BATCH +%s %s %s", me.name, batch.ref, batch.type, batch.params);
+}
+
+static inline void
+send_batch_tag(struct MsgBuf *msgbuf)
+{
+	if(batch.tagging > 0)
+		msgbuf_append_tag(msgbuf, "batch", batch.ref, CLICAP_BATCH);
+}
 
 static void send_queued_write(rb_fde_t *F, void *data);
 
@@ -102,7 +138,14 @@ _send_linebuf(struct Client *to, buf_head_t *linebuf)
 	 */
 	to->localClient->sendM += 1;
 	me.localClient->sendM += 1;
-	if(rb_linebuf_len(&to->localClient->buf_sendq) > 0)
+
+	/* a corked client only holds back lines of the batch; it is written
+	 * to once enough has piled up, when it is uncorked, or as soon as
+	 * anything outside the batch (a PING, say) is sent to it
+	 */
+	if(rb_linebuf_len(&to->localClient->buf_sendq) > 0 &&
+	   (!IsCork(to) || batch.tagging == 0 ||
+	    rb_linebuf_len(&to->localClient->buf_sendq) >= CORK_FLUSH_SIZE))
 		send_queued(to);
 	return 0;
 }
@@ -258,22 +301,28 @@ linebuf_put_msgf(buf_head_t *linebuf, const rb_strf_t *message, const char *form
 
 /* build_msgbuf_tags
  *
- * inputs       - msgbuf object, client the message is from
+ * inputs       - msgbuf object, client the message is from,
+ *                capabilities of the recipients
  * outputs      - none
  * side effects - a msgbuf object is populated with an origin and relevant tags
  * notes        - to make this reentrant, find a solution for `buf` below
+ *              - tag hooks for capabilities none of the recipients have
+ *                are not called at all
  */
 static void
-build_msgbuf_tags(struct MsgBuf *msgbuf, struct Client *from)
+build_msgbuf_tags(struct MsgBuf *msgbuf, struct Client *from, unsigned int caps)
 {
 	hook_data hdata;
 
 	msgbuf_init(msgbuf);
 
+	if(caps == 0 || hooks[h_outbound_msgbuf].ncalls == 0)
+		return;
+
 	hdata.client = from;
 	hdata.arg1 = msgbuf;
 
-	call_hook(h_outbound_msgbuf, &hdata);
+	call_hook_filtered(h_outbound_msgbuf, &hdata, caps, HOOK_ANY, HOOK_ANY);
 }
 
 /* sendto_one()
@@ -299,7 +348,7 @@ sendto_one(struct Client *target_p, const char *pattern, ...)
 
 	rb_linebuf_newbuf(&linebuf);
 
-	build_msgbuf_tags(&msgbuf, &me);
+	build_msgbuf_tags(&msgbuf, &me, CLIENT_CAPS_ONLY(target_p));
 	va_start(args, pattern);
 	linebuf_put_tags(&linebuf, &msgbuf, target_p, &strings);
 	va_end(args);
@@ -334,7 +383,7 @@ sendto_one_prefix(struct Client *target_p, struct Client *source_p,
 		return;
 	}
 
-	build_msgbuf_tags(&msgbuf, source_p);
+	build_msgbuf_tags(&msgbuf, source_p, CLIENT_CAPS_ONLY(target_p));
 
 	rb_linebuf_newbuf(&linebuf);
 	va_start(args, pattern);
@@ -372,7 +421,7 @@ sendto_one_notice(struct Client *target_p, const char *pattern, ...)
 		return;
 	}
 
-	build_msgbuf_tags(&msgbuf, &me);
+	build_msgbuf_tags(&msgbuf, &me, CLIENT_CAPS_ONLY(target_p));
 
 	rb_linebuf_newbuf(&linebuf);
 	va_start(args, pattern);
@@ -411,7 +460,7 @@ sendto_one_numeric(struct Client *target_p, int numeric, const char *pattern, ..
 		return;
 	}
 
-	build_msgbuf_tags(&msgbuf, &me);
+	build_msgbuf_tags(&msgbuf, &me, CLIENT_CAPS_ONLY(target_p));
 
 	rb_linebuf_newbuf(&linebuf);
 	va_start(args, pattern);
@@ -511,7 +560,7 @@ sendto_channel_flags(struct Client *one, int type, struct Client *source_p,
 
 	current_serial++;
 
-	build_msgbuf_tags(&msgbuf, source_p);
+	build_msgbuf_tags(&msgbuf, source_p, ALL_CLIENT_CAPS);
 
 	va_start(args, pattern);
 	vsnprintf(buf, sizeof buf, pattern, args);
@@ -595,7 +644,7 @@ sendto_channel_opmod(struct Client *one, struct Client *source_p,
 	rb_linebuf_newbuf(&rb_linebuf_old);
 	rb_linebuf_newbuf(&rb_linebuf_new);
 
-	build_msgbuf_tags(&msgbuf, source_p);
+	build_msgbuf_tags(&msgbuf, source_p, ALL_CLIENT_CAPS);
 
 	current_serial++;
 	const char *statusmsg_prefix = (ConfigChannel.opmod_send_statusmsg ? "@" : "");
@@ -692,7 +741,8 @@ _sendto_channel_local(struct Client *source_p, int type, const char *priv, struc
 	struct MsgBuf_cache msgbuf_cache;
 	rb_strf_t strings = { .format = pattern, .format_args = args, .next = NULL };
 
-	build_msgbuf_tags(&msgbuf, source_p);
+	build_msgbuf_tags(&msgbuf, source_p, ALL_CLIENT_CAPS);
+	send_batch_tag(&msgbuf);
 
 	msgbuf_cache_init(&msgbuf_cache, &msgbuf, &strings);
 
@@ -710,6 +760,8 @@ _sendto_channel_local(struct Client *source_p, int type, const char *priv, struc
 		if (priv != NULL && !HasPrivilege(target_p, priv))
 			continue;
 
+		if (batch.tagging > 0)
+			send_batch_join(target_p);
 		_send_linebuf(target_p, msgbuf_cache_get(&msgbuf_cache, CLIENT_CAPS_ONLY(target_p)));
 	}
 
@@ -763,7 +815,8 @@ _sendto_channel_local_with_capability_butone(struct Client *source_p, struct Cli
 	struct MsgBuf_cache msgbuf_cache;
 	rb_strf_t strings = { .format = pattern, .format_args = args, .next = NULL };
 
-	build_msgbuf_tags(&msgbuf, source_p);
+	build_msgbuf_tags(&msgbuf, source_p, ALL_CLIENT_CAPS);
+	send_batch_tag(&msgbuf);
 	msgbuf_cache_init(&msgbuf_cache, &msgbuf, &strings);
 
 	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, chptr->locmembers.head)
@@ -782,6 +835,8 @@ _sendto_channel_local_with_capability_butone(struct Client *source_p, struct Cli
 		if(type && ((msptr->flags & type) == 0))
 			continue;
 
+		if(batch.tagging > 0)
+			send_batch_join(target_p);
 		_send_linebuf(target_p, msgbuf_cache_get(&msgbuf_cache, CLIENT_CAPS_ONLY(target_p)));
 	}
 
@@ -842,7 +897,7 @@ sendto_channel_local_butone(struct Client *one, int type, struct Channel *chptr,
 	struct MsgBuf_cache msgbuf_cache;
 	rb_strf_t strings = { .format = pattern, .format_args = &args, .next = NULL };
 
-	build_msgbuf_tags(&msgbuf, one);
+	build_msgbuf_tags(&msgbuf, one, ALL_CLIENT_CAPS);
 
 	va_start(args, pattern);
 	msgbuf_cache_init(&msgbuf_cache, &msgbuf, &strings);
@@ -878,7 +933,8 @@ sendto_channel_local_butone(struct Client *one, int type, struct Channel *chptr,
  *		- pattern to send
  * output	- NONE
  * side effects	- Sends a message to all people on local server who are
- * 		  in same channel with user.
+ * 		  in same channel with user, as part of the open batch
+ *		  if there is one.
  *		  used by m_nick.c and exit_one_client.
  */
 void
@@ -897,7 +953,8 @@ sendto_common_channels_local(struct Client *user, int cap, int negcap, const cha
 	struct MsgBuf_cache msgbuf_cache;
 	rb_strf_t strings = { .format = pattern, .format_args = &args, .next = NULL };
 
-	build_msgbuf_tags(&msgbuf, user);
+	build_msgbuf_tags(&msgbuf, user, ALL_CLIENT_CAPS);
+	send_batch_tag(&msgbuf);
 
 	va_start(args, pattern);
 	msgbuf_cache_init(&msgbuf_cache, &msgbuf, &strings);
@@ -922,6 +979,8 @@ sendto_common_channels_local(struct Client *user, int cap, int negcap, const cha
 				continue;
 
 			target_p->serial = current_serial;
+			if(batch.tagging > 0)
+				send_batch_join(target_p);
 			send_linebuf(target_p, msgbuf_cache_get(&msgbuf_cache, CLIENT_CAPS_ONLY(target_p)));
 		}
 	}
@@ -937,6 +996,116 @@ sendto_common_channels_local(struct Client *user, int cap, int negcap, const cha
 	msgbuf_cache_free(&msgbuf_cache);
 }
 
+/* send_batch_begin()
+ *
+ * inputs	- batch type, parameters for the BATCH line
+ * outputs	- true if a new batch was opened, which the caller should
+ *		  send_batch_close() when it is done with it
+ * side effects - until send_batch_end(), messages to local channel members
+ *		  are tagged as part of the batch for clients with the batch
+ *		  capability.  The batch stays open after send_batch_end(),
+ *		  so a later send_batch_begin() with the same type and
+ *		  parameters carries on with it; anything else closes it and
+ *		  opens a new one.  Every local client the batch reaches is
+ *		  corked until send_batch_close(), so its share of the batch
+ *		  goes out in as few writes as possible; anything sent to it
+ *		  outside the batch meanwhile is written out straight away,
+ *		  along with what was held back.
+ */
+bool
+send_batch_begin(const char *type, const char *params)
+{
+	static unsigned long batch_id;
+
+	if(batch.open && (strcmp(batch.type, type) || strcmp(batch.params, params)))
+	{
+		/* a different batch can't start inside this one */
+		if(batch.tagging > 0)
+		{
+			batch.tagging++;
+			return false;
+		}
+		send_batch_close();
+	}
+
+	batch.tagging++;
+	if(batch.open)
+		return false;
+
+	batch.open = true;
+	snprintf(batch.ref, sizeof(batch.ref), "%lx%lx",
+		 (unsigned long)rb_current_time() & 0xfffff, ++batch_id);
+	rb_strlcpy(batch.type, type, sizeof(batch.type));
+	rb_strlcpy(batch.params, params, sizeof(batch.params));
+	return true;
+}
+
+void
+send_batch_end(void)
+{
+	s_assert(batch.tagging > 0);
+	if(batch.tagging > 0)
+		batch.tagging--;
+}
+
+/* send_batch_close()
+ *
+ * inputs	- none
+ * outputs	- none
+ * side effects - the open batch, if any, is ended for every client it
+ *		  reached, and they are uncorked and written to
+ */
+void
+send_batch_close(void)
+{
+	rb_dlink_node *ptr, *next_ptr;
+
+	if(!batch.open)
+		return;
+
+	batch.open = false;
+
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, batch.clients.head)
+	{
+		struct Client *target_p = ptr->data;
+
+		if(IsCapable(target_p, CLICAP_BATCH))
+			sendto_one(target_p, ":%s BATCH -%s", me.name, batch.ref);
+
+		ClearCork(target_p);
+		send_pop_queue(target_p);
+		rb_free_rb_dlink_node(ptr);
+	}
+
+	batch.clients.head = batch.clients.tail = NULL;
+	batch.clients.length = 0;
+}
+
+/* send_batch_type()
+ *
+ * inputs	- none
+ * outputs	- type of the open batch, or NULL
+ * side effects - none
+ */
+const char *
+send_batch_type(void)
+{
+	return batch.open ? batch.type : NULL;
+}
+
+/* send_batch_remove()
+ *
+ * inputs	- local client going away
+ * outputs	- none
+ * side effects - the client is forgotten by the open batch
+ */
+void
+send_batch_remove(struct Client *client_p)
+{
+	if(IsCork(client_p) && rb_dlinkFindDestroy(client_p, &batch.clients))
+		ClearCork(client_p);
+}
+
 /*
  * sendto_common_channels_local_butone()
  *
@@ -964,7 +1133,7 @@ sendto_common_channels_local_butone(struct Client *user, int cap, int negcap, co
 	struct MsgBuf_cache msgbuf_cache;
 	rb_strf_t strings = { .format = pattern, .format_args = &args, .next = NULL };
 
-	build_msgbuf_tags(&msgbuf, user);
+	build_msgbuf_tags(&msgbuf, user, ALL_CLIENT_CAPS);
 
 	va_start(args, pattern);
 	msgbuf_cache_init(&msgbuf_cache, &msgbuf, &strings);
@@ -1020,7 +1189,7 @@ sendto_match_butone(struct Client *one, struct Client *source_p,
 
 	rb_linebuf_newbuf(&rb_linebuf_remote);
 
-	build_msgbuf_tags(&msgbuf, source_p);
+	build_msgbuf_tags(&msgbuf, source_p, ALL_CLIENT_CAPS);
 
 	va_start(args, pattern);
 	vsnprintf(buf, sizeof(buf), pattern, args);
@@ -1143,7 +1312,7 @@ sendto_local_clients_with_capability(int cap, const char *pattern, ...)
 	struct MsgBuf_cache msgbuf_cache;
 	rb_strf_t strings = { .format = pattern, .format_args = &args, .next = NULL };
 
-	build_msgbuf_tags(&msgbuf, &me);
+	build_msgbuf_tags(&msgbuf, &me, ALL_CLIENT_CAPS);
 
 	va_start(args, pattern);
 	msgbuf_cache_init(&msgbuf_cache, &msgbuf, &strings);
@@ -1179,7 +1348,7 @@ sendto_monitor(struct Client *source_p, struct monitor *monptr, const char *patt
 	struct MsgBuf_cache msgbuf_cache;
 	rb_strf_t strings = { .format = pattern, .format_args = &args, .next = NULL };
 
-	build_msgbuf_tags(&msgbuf, source_p);
+	build_msgbuf_tags(&msgbuf, source_p, ALL_CLIENT_CAPS);
 
 	va_start(args, pattern);
 	msgbuf_cache_init(&msgbuf_cache, &msgbuf, &strings);
@@ -1222,7 +1391,7 @@ _sendto_anywhere(struct Client *dest_p, struct Client *target_p,
 		} else {
 			struct MsgBuf msgbuf;
 
-			build_msgbuf_tags(&msgbuf, source_p);
+			build_msgbuf_tags(&msgbuf, source_p, CLIENT_CAPS_ONLY(dest_p));
 
 			linebuf_put_tagsf(&linebuf, &msgbuf, dest_p, &strings,
 				IsPerson(source_p) ? ":%1$s!%4$s@%5$s %2$s %3$s " : ":%1$s %2$s %3$s ",
@@ -1297,7 +1466,7 @@ sendto_realops_snomask(int flags, int level, const char *pattern, ...)
 	struct MsgBuf msgbuf;
 	struct MsgBuf_cache msgbuf_cache;
 
-	build_msgbuf_tags(&msgbuf, &me);
+	build_msgbuf_tags(&msgbuf, &me, ALL_CLIENT_CAPS);
 
 	/* rather a lot of copying around, oh well -- jilles */
 	va_start(args, pattern);
@@ -1359,7 +1528,7 @@ sendto_realops_snomask_from(int flags, int level, struct Client *source_p,
 	struct MsgBuf_cache msgbuf_cache;
 	rb_strf_t strings = { .format = pattern, .format_args = &args, .next = NULL };
 
-	build_msgbuf_tags(&msgbuf, &me);
+	build_msgbuf_tags(&msgbuf, &me, ALL_CLIENT_CAPS);
 
 	va_start(args, pattern);
 	msgbuf_cache_initf(&msgbuf_cache, &msgbuf, &strings,
@@ -1405,7 +1574,7 @@ sendto_wallops_flags(int flags, struct Client *source_p, const char *pattern, ..
 	struct MsgBuf_cache msgbuf_cache;
 	rb_strf_t strings = { .format = pattern, .format_args = &args, .next = NULL };
 
-	build_msgbuf_tags(&msgbuf, source_p);
+	build_msgbuf_tags(&msgbuf, source_p, ALL_CLIENT_CAPS);
 
 	va_start(args, pattern);
 	if (IsPerson(source_p)) {
@@ -1444,7 +1613,7 @@ kill_client(struct Client *target_p, struct Client *diedie, const char *pattern,
 	struct MsgBuf msgbuf;
 	rb_strf_t strings = { .format = pattern, .format_args = &args, .next = NULL };
 
-	build_msgbuf_tags(&msgbuf, &me);
+	build_msgbuf_tags(&msgbuf, &me, ALL_CLIENT_CAPS);
 
 	rb_linebuf_newbuf(&linebuf);
 
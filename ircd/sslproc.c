@@ -43,6 +43,8 @@ static char nul = '\0';
 
 #define MAXPASSFD 4
 #define READSIZE 1024
+#define ZIPSTATS_TIME 60
+#define SSLD_RING_SIZE (4 * 1024 * 1024)
 typedef struct _ssl_ctl_buf
 {
 	rb_dlink_node node;
@@ -65,11 +67,14 @@ struct _ssl_ctl
 	uint8_t shutdown;
 	uint8_t dead;
 	char version[256];
+	rb_ring *ring;
+	bool ring_ok;		/* ssld has attached to the ring */
 };
 
 static void ssld_update_config_one(ssl_ctl_t *ctl);
 static void send_new_ssl_certs_one(ssl_ctl_t * ctl);
 static void send_certfp_method(ssl_ctl_t *ctl);
+static void ssld_setup_ring(ssl_ctl_t *ctl);
 
 
 static rb_dlink_list ssl_daemons;
@@ -133,6 +138,8 @@ free_ssl_daemon(ssl_ctl_t * ctl)
 		rb_free(ctl_buf->buf);
 		rb_free(ctl_buf);
 	}
+	if(ctl->ring != NULL)
+		rb_ring_destroy(ctl->ring);
 	rb_close(ctl->F);
 	rb_close(ctl->P);
 	rb_dlinkDelete(&ctl->node, &ssl_daemons);
@@ -188,6 +195,8 @@ ssl_killall(void)
 		if(!ctl->shutdown)
 			ssld_count--;
 		rb_kill(ctl->pid, SIGKILL);
+		if(ctl->ring != NULL)
+			rb_ring_shutdown(ctl->ring);
 		if(!ctl->cli_count)
 			free_ssl_daemon(ctl);
 	}
@@ -201,6 +210,8 @@ ssl_dead(ssl_ctl_t * ctl)
 
 	ctl->dead = 1;
 	rb_kill(ctl->pid, SIGKILL);	/* make sure the process is really gone */
+	if(ctl->ring != NULL)
+		rb_ring_shutdown(ctl->ring);	/* and that our ends of its channels see it */
 
 	if(!ctl->shutdown)
 	{
@@ -340,6 +351,7 @@ start_ssldaemon(int count)
 		ctl = allocate_ssl_daemon(F1, P2, pid);
 		if(ircd_ssl_ok)
 			ssld_update_config_one(ctl);
+		ssld_setup_ring(ctl);
 		ssl_read_ctl(ctl->F, ctl);
 		ssl_do_pipe(P2, ctl);
 
@@ -497,6 +509,58 @@ ssl_process_certfp(ssl_ctl_t * ctl, ssl_ctl_buf_t * ctl_buf)
 	client_p->certfp = certfp_string;
 }
 
+static void
+ssl_process_zipstats(ssl_ctl_t * ctl, ssl_ctl_buf_t * ctl_buf)
+{
+	struct Client *server;
+	struct ZipStats *zips;
+	char *parv[7];
+
+	if(ctl_buf->buf[ctl_buf->buflen - 1] != '\0')
+		return;		/* bogus message..drop it.. XXX should warn here */
+
+	/* S name in in_wire out out_wire ns */
+	if(rb_string_to_array(ctl_buf->buf, parv, 7) != 7)
+		return;
+
+	server = find_server(NULL, parv[1]);
+	if(server == NULL || !MyConnect(server) || server->localClient->zipstats == NULL)
+		return;
+
+	zips = server->localClient->zipstats;
+
+	zips->in += strtoull(parv[2], NULL, 10);
+	zips->in_wire += strtoull(parv[3], NULL, 10);
+	zips->out += strtoull(parv[4], NULL, 10);
+	zips->out_wire += strtoull(parv[5], NULL, 10);
+	zips->ns += strtoull(parv[6], NULL, 10);
+
+	if(zips->in > 0)
+		zips->in_ratio = ((double) (zips->in - zips->in_wire) / (double) zips->in) * 100.00;
+	if(zips->out > 0)
+		zips->out_ratio = ((double) (zips->out - zips->out_wire) / (double) zips->out) * 100.00;
+}
+
+static void
+ssl_process_ring(ssl_ctl_t * ctl, ssl_ctl_buf_t * ctl_buf)
+{
+	static const char *no_ring = "ssld could not attach to its ring, using socketpairs";
+
+	if(ctl->ring == NULL)
+		return;
+
+	if(ctl_buf->buflen == 2 && ctl_buf->buf[1] == '1')
+	{
+		ctl->ring_ok = true;
+		return;
+	}
+
+	ilog(L_MAIN, "%s", no_ring);
+	sendto_realops_snomask(SNO_GENERAL, L_ALL, "%s", no_ring);
+	rb_ring_destroy(ctl->ring);
+	ctl->ring = NULL;
+}
+
 static void
 ssl_process_cmd_recv(ssl_ctl_t * ctl)
 {
@@ -546,6 +610,13 @@ ssl_process_cmd_recv(ssl_ctl_t * ctl)
 			if (len > sizeof(ctl->version) - 1)
 				len = sizeof(ctl->version) - 1;
 			strncpy(ctl->version, &ctl_buf->buf[1], len);
+			break;
+		case 'R':
+			ssl_process_ring(ctl, ctl_buf);
+			break;
+		case 'S':
+			ssl_process_zipstats(ctl, ctl_buf);
+			break;
 		case 'z':
 			ircd_zlib_ok = 0;
 			break;
@@ -753,7 +824,39 @@ ssld_update_config(void)
 			continue;
 
 		ssld_update_config_one(ctl);
+		ssld_setup_ring(ctl);
+	}
+}
+
+/*
+ * ssld_setup_ring
+ *
+ * If serverinfo::helper_ring is set and this ssld has no ring yet, create
+ * one and hand it over.  Connections go over socketpairs until ssld says
+ * it has attached, and for good if it can't.
+ */
+static void
+ssld_setup_ring(ssl_ctl_t *ctl)
+{
+	rb_fde_t *F[RB_RING_FDS];
+
+	if(!ServerInfo.helper_ring || ctl->ring != NULL)
+		return;
+
+	if(!rb_supports_ring())
+	{
+		ilog(L_MAIN, "serverinfo::helper_ring is not supported on this system, using socketpairs");
+		return;
+	}
+
+	ctl->ring = rb_ring_create(SSLD_RING_SIZE, F);
+	if(ctl->ring == NULL)
+	{
+		ilog(L_MAIN, "Unable to create a ring for ssld, using socketpairs: %s", strerror(errno));
+		return;
 	}
+
+	ssl_cmd_write_queue(ctl, F, RB_RING_FDS, "R", 1);
 }
 
 ssl_ctl_t *
@@ -775,6 +878,37 @@ start_ssld_accept(rb_fde_t * sslF, rb_fde_t * plainF, uint32_t id)
 	return ctl;
 }
 
+/*
+ * start_ssld_accept_ring
+ *
+ * Like start_ssld_accept, but with the plaintext side on the ssld's ring
+ * rather than a socketpair; on success *plainF is our end of it.  Returns
+ * NULL, having done nothing, if the ring is off or not (yet) usable.
+ */
+ssl_ctl_t *
+start_ssld_accept_ring(rb_fde_t * sslF, rb_fde_t ** plainF, uint32_t id)
+{
+	ssl_ctl_t *ctl;
+	char buf[5];
+
+	if(!ServerInfo.helper_ring)
+		return NULL;
+
+	ctl = which_ssld();
+	if(!ctl || !ctl->ring_ok)
+		return NULL;
+
+	*plainF = rb_ring_open(ctl->ring, id, "Incoming ssld Connection");
+	if(*plainF == NULL)
+		return NULL;
+
+	buf[0] = 'A';
+	uint32_to_buf(&buf[1], id);
+	ctl->cli_count++;
+	ssl_cmd_write_queue(ctl, &sslF, 1, buf, sizeof(buf));
+	return ctl;
+}
+
 ssl_ctl_t *
 start_ssld_connect(rb_fde_t * sslF, rb_fde_t * plainF, uint32_t id)
 {
@@ -795,6 +929,131 @@ start_ssld_connect(rb_fde_t * sslF, rb_fde_t * plainF, uint32_t id)
 	return ctl;
 }
 
+/*
+ * drain_linebuf
+ *
+ * Empty a linebuf into buf as the bytes that were, or would have been,
+ * on the wire, leaving out whatever of the first line was already sent.
+ */
+static size_t
+drain_linebuf(buf_head_t * bufhead, char *buf, size_t len)
+{
+	size_t skip = bufhead->writeofs;
+	size_t total = 0;
+	int cpylen;
+
+	while((cpylen = rb_linebuf_get(bufhead, buf + total, len - total, LINEBUF_PARTIAL, LINEBUF_RAW)) > 0)
+		total += cpylen;
+
+	bufhead->writeofs = 0;
+
+	if(skip > total)
+		skip = total;
+	memmove(buf, buf + skip, total - skip);
+	return total - skip;
+}
+
+/*
+ * start_zlib_session
+ *
+ * Hand a server link that negotiated ZIP over to ssld for compression.
+ * The peer switches over right after its SERVER, so anything left in
+ * the recvq is already compressed and goes along to be inflated, while
+ * anything still in the sendq was meant to go out as it is.
+ *
+ * ssld runs on this machine, so the recvq length goes in host order.
+ */
+_Static_assert(READBUF_SIZE <= UINT16_MAX, "recvq length must fit the 'Z' command");
+
+void
+start_zlib_session(void *data)
+{
+	struct Client *server = data;
+	static const size_t hdr = 1 + sizeof(uint32_t) + 1 + sizeof(uint16_t);
+	rb_fde_t *F[2];
+	rb_fde_t *xF1, *xF2;
+	uint16_t recvqlen;
+	size_t len, sendqlen;
+	char *buf;
+
+	send_queued(server);
+	if(IsAnyDead(server))
+		return;
+
+	len = rb_linebuf_len(&server->localClient->buf_recvq);
+	sendqlen = rb_linebuf_len(&server->localClient->buf_sendq);
+	if(hdr + len + sendqlen > READBUF_SIZE)
+	{
+		exit_client(server, server, &me, "ssld readbuf exceeded");
+		return;
+	}
+
+	buf = rb_malloc(hdr + len + sendqlen);
+	buf[0] = 'Z';
+	server->localClient->zconnid = connid_get(server);
+	uint32_to_buf(&buf[1], server->localClient->zconnid);
+	buf[5] = (char) ConfigFileEntry.compression_level;
+
+	/* fits: the READBUF_SIZE check above bounds it */
+	recvqlen = drain_linebuf(&server->localClient->buf_recvq, &buf[hdr], len);
+	memcpy(&buf[6], &recvqlen, sizeof(recvqlen));
+	len = hdr + recvqlen;
+	len += drain_linebuf(&server->localClient->buf_sendq, &buf[len], sendqlen);
+
+	if(rb_socketpair(AF_UNIX, SOCK_STREAM, 0, &xF1, &xF2, "Initial zlib socketpairs") == -1)
+	{
+		rb_free(buf);
+		exit_client(server, server, &me, "Error creating zlib socketpair");
+		return;
+	}
+
+	server->localClient->z_ctl = which_ssld();
+	if(server->localClient->z_ctl == NULL)
+	{
+		rb_close(xF1);
+		rb_close(xF2);
+		rb_free(buf);
+		exit_client(server, server, &me, "Error finding available ssld");
+		return;
+	}
+
+	F[0] = server->localClient->F;
+	F[1] = xF1;
+	server->localClient->F = xF2;
+	rb_note(F[0], "Server zlib connection");
+	rb_note(F[1], "Server zlib plaintext");
+
+	server->localClient->zipstats = rb_malloc(sizeof(struct ZipStats));
+	server->localClient->z_ctl->cli_count++;
+	ssl_cmd_write_queue(server->localClient->z_ctl, F, 2, buf, len);
+	rb_free(buf);
+
+	/* ssld owns the old socket now, read from our end of the pair */
+	rb_setselect(server->localClient->F, RB_SELECT_READ, read_packet, server);
+}
+
+static void
+collect_zipstats(void *unused)
+{
+	rb_dlink_node *ptr;
+	struct Client *target_p;
+	char buf[sizeof(uint8_t) + sizeof(uint32_t) + HOSTLEN];
+	size_t len;
+
+	RB_DLINK_FOREACH(ptr, serv_list.head)
+	{
+		target_p = ptr->data;
+		if(target_p->localClient->z_ctl == NULL)
+			continue;
+
+		buf[0] = 'S';
+		uint32_to_buf(&buf[1], target_p->localClient->zconnid);
+		len = sizeof(uint8_t) + sizeof(uint32_t);
+		len += rb_strlcpy(&buf[len], target_p->name, sizeof(buf) - len) + 1;
+		ssl_cmd_write_queue(target_p->localClient->z_ctl, NULL, 0, buf, len);
+	}
+}
+
 void
 ssld_decrement_clicount(ssl_ctl_t * ctl)
 {
@@ -853,4 +1112,5 @@ void
 init_ssld(void)
 {
 	rb_event_addish("cleanup_dead_ssld", cleanup_dead_ssl, NULL, 60);
+	rb_event_addish("collect_zipstats", collect_zipstats, NULL, ZIPSTATS_TIME);
 }
@@ -38,16 +38,7 @@ static int add_hashed_target(struct Client *source_p, uint32_t hashv);
 struct Channel *
 find_allowing_channel(struct Client *source_p, struct Client *target_p)
 {
-	rb_dlink_node *ptr;
-	struct membership *msptr;
-
-	RB_DLINK_FOREACH(ptr, source_p->user->channel.head)
-	{
-		msptr = ptr->data;
-		if (is_chanop_voiced(msptr) && IsMember(target_p, msptr->chptr))
-			return msptr->chptr;
-	}
-	return NULL;
+	return find_common_channel(source_p, target_p, CHFL_CHANOP|CHFL_VOICE|CHFL_ADMIN);
 }
 
 int
@@ -35,9 +35,11 @@
 #include "packet.h"
 
 static void ws_read_ctl(rb_fde_t * F, void *data);
+static void wsockd_update_config_one(ws_ctl_t *ctl);
 static int wsockd_count;
 
 #define MAXPASSFD 4
+#define WSOCKD_RING_SIZE (4 * 1024 * 1024)
 #define READSIZE 1024
 typedef struct _ws_ctl_buf
 {
@@ -60,6 +62,9 @@ struct ws_ctl
 	rb_dlink_list writeq;
 	uint8_t shutdown;
 	uint8_t dead;
+	struct wsockd_deflate_stats deflate;
+	rb_ring *ring;
+	bool ring_ok;		/* wsockd has attached to the ring */
 };
 
 static rb_dlink_list wsock_daemons;
@@ -123,6 +128,8 @@ free_ws_daemon(ws_ctl_t * ctl)
 		rb_free(ctl_buf->buf);
 		rb_free(ctl_buf);
 	}
+	if(ctl->ring != NULL)
+		rb_ring_destroy(ctl->ring);
 	rb_close(ctl->F);
 	rb_close(ctl->P);
 	rb_dlinkDelete(&ctl->node, &wsock_daemons);
@@ -189,6 +196,8 @@ ws_dead(ws_ctl_t * ctl)
 
 	ctl->dead = 1;
 	rb_kill(ctl->pid, SIGKILL);	/* make sure the process is really gone */
+	if(ctl->ring != NULL)
+		rb_ring_shutdown(ctl->ring);	/* and that our ends of its channels see it */
 
 	if(!ctl->shutdown)
 	{
@@ -327,6 +336,7 @@ start_wsockd(int count)
 		rb_close(F2);
 		rb_close(P1);
 		ctl = allocate_ws_daemon(F1, P2, pid);
+		wsockd_update_config_one(ctl);
 		ws_read_ctl(ctl->F, ctl);
 		ws_do_pipe(P2, ctl);
 
@@ -360,6 +370,41 @@ ws_process_dead_fd(ws_ctl_t * ctl, ws_ctl_buf_t * ctl_buf)
 	exit_client(client_p, client_p, &me, reason);
 }
 
+static void
+ws_process_stats(ws_ctl_t * ctl, ws_ctl_buf_t * ctl_buf)
+{
+	struct wsockd_deflate_stats *st = &ctl->deflate;
+
+	if(ctl_buf->buf[ctl_buf->buflen - 1] != '\0')
+		return;
+
+	if(sscanf(&ctl_buf->buf[1], "%" SCNu64 " %" SCNu64 " %zu %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64,
+		  &st->negotiated, &st->refused, &st->memory,
+		  &st->deflate_in, &st->deflate_out,
+		  &st->inflate_in, &st->inflate_out, &st->ns) != 8)
+		memset(st, 0, sizeof(*st));
+}
+
+
+static void
+ws_process_ring(ws_ctl_t * ctl, ws_ctl_buf_t * ctl_buf)
+{
+	static const char *no_ring = "wsockd could not attach to its ring, using socketpairs";
+
+	if(ctl->ring == NULL)
+		return;
+
+	if(ctl_buf->buflen == 2 && ctl_buf->buf[1] == '1')
+	{
+		ctl->ring_ok = true;
+		return;
+	}
+
+	ilog(L_MAIN, "%s", no_ring);
+	sendto_realops_snomask(SNO_GENERAL, L_ALL, "%s", no_ring);
+	rb_ring_destroy(ctl->ring);
+	ctl->ring = NULL;
+}
 
 static void
 ws_process_cmd_recv(ws_ctl_t * ctl)
@@ -378,6 +423,12 @@ ws_process_cmd_recv(ws_ctl_t * ctl)
 		case 'D':
 			ws_process_dead_fd(ctl, ctl_buf);
 			break;
+		case 'R':
+			ws_process_ring(ctl, ctl_buf);
+			break;
+		case 'S':
+			ws_process_stats(ctl, ctl_buf);
+			break;
 		default:
 			ilog(L_MAIN, "Received invalid command from wsockd: %s", ctl_buf->buf);
 			sendto_realops_snomask(SNO_GENERAL, L_ALL, "Received invalid command from wsockd");
@@ -530,6 +581,98 @@ start_wsockd_accept(rb_fde_t * sslF, rb_fde_t * plainF, uint32_t id)
 	return ctl;
 }
 
+/*
+ * start_wsockd_accept_ring
+ *
+ * Like start_wsockd_accept, but with the plaintext side on the wsockd's
+ * ring rather than a socketpair; on success *plainF is our end of it.
+ * Returns NULL, having done nothing, if the ring is off or not (yet) usable.
+ */
+ws_ctl_t *
+start_wsockd_accept_ring(rb_fde_t * wsF, rb_fde_t ** plainF, uint32_t id)
+{
+	ws_ctl_t *ctl;
+	char buf[5];
+
+	if(!ServerInfo.helper_ring)
+		return NULL;
+
+	ctl = which_wsockd();
+	if(!ctl || !ctl->ring_ok)
+		return NULL;
+
+	*plainF = rb_ring_open(ctl->ring, id, "Incoming wsockd Connection");
+	if(*plainF == NULL)
+		return NULL;
+
+	buf[0] = 'A';
+	uint32_to_buf(&buf[1], id);
+	ctl->cli_count++;
+	ws_cmd_write_queue(ctl, &wsF, 1, buf, sizeof(buf));
+	return ctl;
+}
+
+/*
+ * wsockd_setup_ring
+ *
+ * If serverinfo::helper_ring is set and this wsockd has no ring yet,
+ * create one and hand it over.  Connections go over socketpairs until
+ * wsockd says it has attached, and for good if it can't.
+ */
+static void
+wsockd_setup_ring(ws_ctl_t *ctl)
+{
+	rb_fde_t *F[RB_RING_FDS];
+
+	if(!ServerInfo.helper_ring || ctl->ring != NULL)
+		return;
+
+	if(!rb_supports_ring())
+	{
+		ilog(L_MAIN, "serverinfo::helper_ring is not supported on this system, using socketpairs");
+		return;
+	}
+
+	ctl->ring = rb_ring_create(WSOCKD_RING_SIZE, F);
+	if(ctl->ring == NULL)
+	{
+		ilog(L_MAIN, "Unable to create a ring for wsockd, using socketpairs: %s", strerror(errno));
+		return;
+	}
+
+	ws_cmd_write_queue(ctl, F, RB_RING_FDS, "R", 1);
+}
+
+static void
+wsockd_update_config_one(ws_ctl_t *ctl)
+{
+	char buf[7];
+
+	buf[0] = 'O';
+	buf[1] = ServerInfo.wsockd_deflate;
+	buf[2] = ServerInfo.wsockd_deflate_context_takeover;
+	uint32_to_buf(&buf[3], ServerInfo.wsockd_deflate_memory);
+	ws_cmd_write_queue(ctl, NULL, 0, buf, sizeof(buf));
+
+	wsockd_setup_ring(ctl);
+}
+
+void
+wsockd_update_config(void)
+{
+	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, wsock_daemons.head)
+	{
+		ws_ctl_t *ctl = ptr->data;
+
+		if(ctl->dead || ctl->shutdown)
+			continue;
+
+		wsockd_update_config_one(ctl);
+	}
+}
+
 void
 wsockd_decrement_clicount(ws_ctl_t * ctl)
 {
@@ -570,7 +713,8 @@ get_wsockd_count(void)
 }
 
 void
-wsockd_foreach_info(void (*func)(void *data, pid_t pid, int cli_count, enum wsockd_status status), void *data)
+wsockd_foreach_info(void (*func)(void *data, pid_t pid, int cli_count, enum wsockd_status status,
+		    const struct wsockd_deflate_stats *deflate), void *data)
 {
 	rb_dlink_node *ptr, *next;
 	ws_ctl_t *ctl;
@@ -579,7 +723,8 @@ wsockd_foreach_info(void (*func)(void *data, pid_t pid, int cli_count, enum wsoc
 		ctl = ptr->data;
 		func(data, ctl->pid, ctl->cli_count,
 			ctl->dead ? WSOCKD_DEAD :
-				(ctl->shutdown ? WSOCKD_SHUTDOWN : WSOCKD_ACTIVE));
+				(ctl->shutdown ? WSOCKD_SHUTDOWN : WSOCKD_ACTIVE),
+			&ctl->deflate);
 	}
 }
 
@@ -81,12 +81,16 @@ struct acceptdata
 	void *data;
 };
 
-/* Only have open flags for now, could be more later */
+/* Only have open and ring flags for now, could be more later */
 #define FLAG_OPEN	0x1
 #define IsFDOpen(F)	(F->flags & FLAG_OPEN)
 #define SetFDOpen(F)	(F->flags |= FLAG_OPEN)
 #define ClearFDOpen(F)	(F->flags &= ~FLAG_OPEN)
 
+/* a channel on an rb_ring, with no descriptor behind it */
+#define FLAG_RING	0x2
+#define IsFDRing(F)	(F->flags & FLAG_RING)
+
 #if !defined(SHUT_RDWR) && defined(_WIN32)
 # define SHUT_RDWR SD_BOTH
 #endif
@@ -114,6 +118,7 @@ struct _fde
 	void *ssl;
 	unsigned int handshake_count;
 	unsigned long ssl_errno;
+	struct ring_chan *ring;
 };
 
 typedef void (*comm_event_cb_t) (void *);
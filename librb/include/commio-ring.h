@@ -0,0 +1,34 @@
+/*
+ *  librb: shared memory transport between processes
+ *  commio-ring.h: A header for the ring channel hooks in commio
+ *
+ *  Copyright (C) 2026 Ophion development team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ *
+ */
+
+#ifndef _COMMIO_RING_H
+#define _COMMIO_RING_H
+
+rb_fde_t *rb_open_ring(struct ring_chan *chan, const char *desc);
+
+ssize_t rb_ring_read(rb_fde_t *F, void *buf, size_t count);
+ssize_t rb_ring_writev(rb_fde_t *F, const struct rb_iovec *vector, int count);
+void rb_ring_setselect(rb_fde_t *F, unsigned int type, PF * handler, void *client_data);
+void rb_ring_close(rb_fde_t *F);
+
+#endif
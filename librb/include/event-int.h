@@ -34,5 +34,6 @@ struct ev_entry
 	void *data;
 	void *comm_ptr;
 	int dead;
+	struct rb_histogram profile;
 };
 void rb_event_io_register_all(void);
@@ -45,5 +45,8 @@ void rb_set_back_events(time_t);
 void rb_dump_events(void (*func) (char *, void *), void *ptr);
 void rb_run_one_event(struct ev_entry *);
 time_t rb_event_next(void);
+void rb_event_profiling(int enabled);
+void rb_event_clear_profile(void);
+void rb_dump_event_profile(void (*func) (const char *, const struct rb_histogram *, void *), void *ptr);
 
 #endif /* INCLUDED_event_h */
@@ -49,9 +49,12 @@ rb_helper_write(rb_helper *helper, const char *format, ...)
 __attribute((format(printf, 2, 3)));
      void rb_helper_write_queue(rb_helper *helper, const char *format, ...)
 	__attribute((format(printf, 2, 3)));
+     void rb_helper_write_batch(rb_helper *helper, const char *format, ...)
+	__attribute((format(printf, 2, 3)));
 #else
 void rb_helper_write(rb_helper *helper, const char *format, ...);
 void rb_helper_write_queue(rb_helper *helper, const char *format, ...);
+void rb_helper_write_batch(rb_helper *helper, const char *format, ...);
 #endif
 void rb_helper_write_flush(rb_helper *helper);
 
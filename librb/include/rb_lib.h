@@ -221,6 +221,26 @@ void rb_lib_init(log_cb * xilog, restart_cb * irestart, die_cb * idie, int close
 		 size_t dh_size, size_t fd_heap_size);
 void rb_lib_loop(long delay) __attribute__((noreturn));
 
+/* Latency histogram: bucket 0 counts samples under 1us, bucket n counts
+ * samples of [2^(n-1), 2^n) us, and the last bucket everything above.
+ */
+#define RB_HISTOGRAM_BUCKETS	24
+
+struct rb_histogram
+{
+	unsigned long count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	unsigned long bucket[RB_HISTOGRAM_BUCKETS];
+};
+
+uint64_t rb_monotonic_ns(void);
+void rb_histogram_add(struct rb_histogram *, uint64_t ns);
+uint64_t rb_histogram_percentile(const struct rb_histogram *, unsigned int pct);
+void rb_set_profiling(int enabled);
+const struct rb_histogram *rb_loop_profile(void);
+void rb_clear_profile(void);
+
 time_t rb_current_time(void);
 const struct timeval *rb_current_time_tv(void);
 pid_t rb_spawn_process(const char *, const char **);
@@ -252,6 +272,7 @@ pid_t rb_getpid(void);
 #include <rb_event.h>
 #include <rb_helper.h>
 #include <rb_rawbuf.h>
+#include <rb_ring.h>
 #include <rb_patricia.h>
 
 #endif
@@ -0,0 +1,55 @@
+/*
+ *  librb: shared memory transport between processes
+ *  rb_ring.h: A header for ring.c
+ *
+ *  Copyright (C) 2026 Ophion development team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ *
+ */
+
+#ifndef RB_LIB_H
+# error "Do not use rb_ring.h directly"
+#endif
+
+#ifndef INCLUDED_RB_RING_H__
+#define INCLUDED_RB_RING_H__
+
+/*
+ * A ring carries many byte streams ("channels") between two processes
+ * over one memfd-backed mapping: a single-producer single-consumer ring
+ * per direction, each with an eventfd doorbell.  A channel is an rb_fde_t
+ * without a descriptor of its own; rb_read, rb_write, rb_writev,
+ * rb_setselect and rb_close work on it as they do on a socket.
+ *
+ * One side creates the ring and passes the three descriptors it is given
+ * (memory, then the two doorbells) to the other, which attaches to them.
+ * Both sides then open channels by an id they agree on out of band.
+ */
+
+typedef struct _rb_ring rb_ring;
+
+#define RB_RING_FDS	3
+
+int rb_supports_ring(void);
+rb_ring *rb_ring_create(size_t size, rb_fde_t *peerF[RB_RING_FDS]);
+rb_ring *rb_ring_attach(rb_fde_t *F[RB_RING_FDS]);
+rb_fde_t *rb_ring_open(rb_ring *ring, uint32_t id, const char *desc);
+void rb_ring_shutdown(rb_ring *ring);
+void rb_ring_destroy(rb_ring *ring);
+int rb_fd_ring(rb_fde_t *F);
+
+#endif
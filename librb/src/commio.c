@@ -27,6 +27,7 @@
 #include <rb_lib.h>
 #include <commio-int.h>
 #include <commio-ssl.h>
+#include <commio-ring.h>
 #include <event-int.h>
 #ifdef HAVE_WRITEV
 #include <sys/uio.h>
@@ -109,6 +110,14 @@ rb_close_pending_fds(void)
 	{
 		F = ptr->data;
 
+		rb_dlinkDelete(ptr, &closed_list);
+
+		if(IsFDRing(F))
+		{
+			rb_bh_free(fd_heap, F);
+			continue;
+		}
+
 		number_fd--;
 
 #ifdef _WIN32
@@ -118,7 +127,6 @@ rb_close_pending_fds(void)
 #endif
 			close(F->fd);
 
-		rb_dlinkDelete(ptr, &closed_list);
 		rb_bh_free(fd_heap, F);
 	}
 }
@@ -195,6 +203,8 @@ rb_set_buffers(rb_fde_t *F, int size)
 {
 	if(F == NULL)
 		return 0;
+	if(IsFDRing(F))
+		return 1;
 	if(setsockopt
 	   (F->fd, SOL_SOCKET, SO_RCVBUF, (char *)&size, sizeof(size))
 	   || setsockopt(F->fd, SOL_SOCKET, SO_SNDBUF, (char *)&size, sizeof(size)))
@@ -218,6 +228,8 @@ rb_set_nb(rb_fde_t *F)
 	rb_platform_fd_t fd;
 	if(F == NULL)
 		return 0;
+	if(IsFDRing(F))
+		return 1;
 	fd = F->fd;
 
 	if((res = rb_setup_fd(F)))
@@ -1094,6 +1106,28 @@ rb_open(rb_platform_fd_t fd, uint8_t type, const char *desc)
 	return F;
 }
 
+/*
+ * rb_open_ring() - open an rb_fde_t for a ring channel
+ *
+ * There is no descriptor behind it, so it stays out of the fd table
+ * and is not counted against rb_maxconnections.
+ */
+rb_fde_t *
+rb_open_ring(struct ring_chan *chan, const char *desc)
+{
+	rb_fde_t *F;
+
+	F = rb_bh_alloc(fd_heap);
+	F->fd = -1;
+	F->type = RB_FD_NONE;
+	F->flags = FLAG_OPEN | FLAG_RING;
+	F->ring = chan;
+
+	if(desc != NULL)
+		F->desc = rb_strndup(desc, FD_DESC_SZ);
+	return F;
+}
+
 
 /* Called to close a given filedescriptor */
 void
@@ -1104,6 +1138,17 @@ rb_close(rb_fde_t *F)
 	if(F == NULL)
 		return;
 
+	if(IsFDRing(F))
+	{
+		lrb_assert(IsFDOpen(F));
+		rb_settimeout(F, 0, NULL, NULL);
+		rb_ring_close(F);
+		rb_free(F->desc);
+		ClearFDOpen(F);
+		rb_dlinkAdd(F, &F->node, &closed_list);
+		return;
+	}
+
 	fd = F->fd;
 	type = F->type;
 	lrb_assert(IsFDOpen(F));
@@ -1211,6 +1256,16 @@ rb_fd_ssl(rb_fde_t *F)
 	return 0;
 }
 
+int
+rb_fd_ring(rb_fde_t *F)
+{
+	if(F == NULL)
+		return 0;
+	if(IsFDRing(F))
+		return 1;
+	return 0;
+}
+
 rb_platform_fd_t
 rb_get_fd(rb_fde_t *F)
 {
@@ -1232,6 +1287,9 @@ rb_read(rb_fde_t *F, void *buf, int count)
 	if(F == NULL)
 		return 0;
 
+	if(IsFDRing(F))
+		return rb_ring_read(F, buf, count);
+
 	/* This needs to be *before* RB_FD_SOCKET otherwise you'll process
 	 * an SSL socket as a regular socket
 	 */
@@ -1264,6 +1322,12 @@ rb_write(rb_fde_t *F, const void *buf, int count)
 	if(F == NULL)
 		return 0;
 
+	if(IsFDRing(F))
+	{
+		struct rb_iovec vec = { (void *)buf, count };
+		return rb_ring_writev(F, &vec, 1);
+	}
+
 #ifdef HAVE_SSL
 	if(F->type & RB_FD_SSL)
 	{
@@ -1323,6 +1387,8 @@ rb_writev(rb_fde_t *F, struct rb_iovec * vector, int count)
 		errno = EBADF;
 		return -1;
 	}
+	if(IsFDRing(F))
+		return rb_ring_writev(F, vector, count);
 #ifdef HAVE_SSL
 	if(F->type & RB_FD_SSL)
 	{
@@ -2302,6 +2368,11 @@ rb_init_netio(void)
 void
 rb_setselect(rb_fde_t *F, unsigned int type, PF * handler, void *client_data)
 {
+	if(IsFDRing(F))
+	{
+		rb_ring_setselect(F, type, handler, client_data);
+		return;
+	}
 	setselect_handler(F, type, handler, client_data);
 }
 
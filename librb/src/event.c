@@ -51,6 +51,7 @@ static char last_event_ran[EV_NAME_LEN];
 static rb_dlink_list event_list;
 
 static time_t event_time_min = -1;
+static int event_profiling;
 
 /*
  * struct ev_entry *
@@ -192,12 +193,27 @@ rb_event_addish(const char *name, EVH * func, void *arg, time_t delta_ish)
 		rb_event_frequency(delta_ish), delta_ish);
 }
 
+static void
+call_event(struct ev_entry *ev)
+{
+	uint64_t start;
+
+	if(rb_likely(!event_profiling))
+	{
+		ev->func(ev->arg);
+		return;
+	}
+
+	start = rb_monotonic_ns();
+	ev->func(ev->arg);
+	rb_histogram_add(&ev->profile, rb_monotonic_ns() - start);
+}
 
 void
 rb_run_one_event(struct ev_entry *ev)
 {
 	rb_strlcpy(last_event_ran, ev->name, sizeof(last_event_ran));
-	ev->func(ev->arg);
+	call_event(ev);
 	if(!ev->frequency)
 	{
 		rb_event_delete(ev);
@@ -238,7 +254,7 @@ rb_event_run(void)
 		if(ev->when <= rb_current_time())
 		{
 			rb_strlcpy(last_event_ran, ev->name, sizeof(last_event_ran));
-			ev->func(ev->arg);
+			call_event(ev);
 
 			/* event is scheduled more than once */
 			if(ev->frequency)
@@ -291,6 +307,39 @@ rb_event_init(void)
 	rb_strlcpy(last_event_ran, "NONE", sizeof(last_event_ran));
 }
 
+void
+rb_event_profiling(int enabled)
+{
+	event_profiling = enabled;
+}
+
+void
+rb_event_clear_profile(void)
+{
+	rb_dlink_node *ptr;
+	struct ev_entry *ev;
+
+	RB_DLINK_FOREACH(ptr, event_list.head)
+	{
+		ev = ptr->data;
+		memset(&ev->profile, 0, sizeof(ev->profile));
+	}
+}
+
+void
+rb_dump_event_profile(void (*func) (const char *, const struct rb_histogram *, void *), void *ptr)
+{
+	rb_dlink_node *dptr;
+	struct ev_entry *ev;
+
+	RB_DLINK_FOREACH(dptr, event_list.head)
+	{
+		ev = dptr->data;
+		if(!ev->dead && ev->profile.count > 0)
+			func(ev->name, &ev->profile, ptr);
+	}
+}
+
 void
 rb_dump_events(void (*func) (char *, void *), void *ptr)
 {
@@ -227,6 +227,25 @@ rb_helper_write_flush(rb_helper *helper)
 	rb_helper_write_sendq(helper->ofd, helper);
 }
 
+/*
+ * rb_helper_write_batch
+ * queues a line and flushes the sendq once the pipe is next writable, so
+ * that every line written during one pass of the event loop goes out in a
+ * single write
+ */
+void
+rb_helper_write_batch(rb_helper *helper, const char *format, ...)
+{
+	va_list ap;
+	rb_strf_t strings = { .format = format, .format_args = &ap, .next = NULL };
+
+	va_start(ap, format);
+	rb_linebuf_put(&helper->sendq, &strings);
+	va_end(ap);
+
+	rb_setselect(helper->ofd, RB_SELECT_WRITE, rb_helper_write_sendq, helper);
+}
+
 
 void
 rb_helper_write(rb_helper *helper, const char *format, ...)
@@ -255,7 +255,7 @@ rb_rawbuf_get(rawbuf_head_t * rb, void *data, int len)
 	{
 		rb->written = 0;
 		rb_rawbuf_done(rb, buf);
-		rb->len -= len;
+		rb->len -= cpylen;
 		return cpylen;
 	}
 
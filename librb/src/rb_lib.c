@@ -32,6 +32,9 @@ static restart_cb *rb_restart;
 static die_cb *rb_die;
 
 static struct timeval rb_time;
+static int rb_profiling;
+static uint64_t loop_woke;
+static struct rb_histogram loop_profile;
 static char errbuf[512];
 
 /* this doesn't do locales...oh well i guess */
@@ -181,6 +184,99 @@ rb_set_time(void)
 		rb_set_back_events(rb_time.tv_sec - newtime.tv_sec);
 
 	memcpy(&rb_time, &newtime, sizeof(struct timeval));
+
+	/* the first time update of a loop iteration comes right after the wait */
+	if(rb_unlikely(rb_profiling) && loop_woke == 0)
+		loop_woke = rb_monotonic_ns();
+}
+
+uint64_t
+rb_monotonic_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void
+rb_histogram_add(struct rb_histogram *hist, uint64_t ns)
+{
+	uint64_t us = ns / 1000;
+	unsigned int b = 0;
+
+	while(us != 0 && b < RB_HISTOGRAM_BUCKETS - 1)
+	{
+		us >>= 1;
+		b++;
+	}
+
+	hist->count++;
+	hist->total_ns += ns;
+	if(ns > hist->max_ns)
+		hist->max_ns = ns;
+	hist->bucket[b]++;
+}
+
+/*
+ * rb_histogram_percentile
+ *
+ * inputs	- histogram, percentile
+ * output	- upper bound in ns of the bucket the percentile falls in,
+ *		  or the largest sample if that is smaller
+ * side effects	- none
+ */
+uint64_t
+rb_histogram_percentile(const struct rb_histogram *hist, unsigned int pct)
+{
+	unsigned long want, seen = 0;
+	uint64_t bound;
+
+	if(hist->count == 0)
+		return 0;
+
+	want = (hist->count * pct + 99) / 100;
+	for(unsigned int b = 0; b < RB_HISTOGRAM_BUCKETS; b++)
+	{
+		seen += hist->bucket[b];
+		if(seen >= want)
+		{
+			bound = (uint64_t)1000 << b;
+			return bound < hist->max_ns ? bound : hist->max_ns;
+		}
+	}
+
+	return hist->max_ns;
+}
+
+void
+rb_set_profiling(int enabled)
+{
+	rb_profiling = enabled;
+	loop_woke = 0;
+	rb_event_profiling(enabled);
+}
+
+const struct rb_histogram *
+rb_loop_profile(void)
+{
+	return &loop_profile;
+}
+
+void
+rb_clear_profile(void)
+{
+	memset(&loop_profile, 0, sizeof(loop_profile));
+	rb_event_clear_profile();
+}
+
+/* time from waking up to going back to sleep */
+static void
+loop_profile_mark(void)
+{
+	if(rb_unlikely(rb_profiling) && loop_woke != 0)
+		rb_histogram_add(&loop_profile, rb_monotonic_ns() - loop_woke);
+	loop_woke = 0;
 }
 
 extern const char *librb_serno;
@@ -223,7 +319,10 @@ rb_lib_loop(long delay)
 	if(rb_io_supports_event())
 	{
 		while(1)
+		{
 			rb_select(-1);
+			loop_profile_mark();
+		}
 	}
 
 
@@ -246,6 +345,7 @@ rb_lib_loop(long delay)
 		else
 			rb_select(delay);
 		rb_event_run();
+		loop_profile_mark();
 	}
 }
 
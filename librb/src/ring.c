@@ -0,0 +1,1194 @@
+/*
+ *  librb: shared memory transport between processes
+ *  ring.c: byte stream channels over memfd-backed rings
+ *
+ *  Copyright (C) 2026 Ophion development team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ *
+ */
+
+#define _GNU_SOURCE 1		/* Needed for memfd_create */
+#include <librb_config.h>
+#include <rb_lib.h>
+#include <commio-int.h>
+#include <commio-ring.h>
+
+#if defined(HAVE_MEMFD_CREATE) && defined(HAVE_EVENTFD)
+#include <stdatomic.h>
+#if ATOMIC_LLONG_LOCK_FREE == 2
+#define USE_RING 1
+#endif
+#endif
+
+#ifdef USE_RING
+
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+
+/*
+ * The mapping holds a header page and then one data area per direction:
+ * [0] carries records from the creator to the attacher, [1] the other
+ * way.  Each direction has exactly one producer, which alone moves head,
+ * and one consumer, which alone moves tail; both only ever grow.
+ *
+ * A record is an 8 byte header (channel id, then type and length) and,
+ * for data, the payload padded to 8 bytes.  Headers never wrap; payloads
+ * may.
+ *
+ * Doorbells: a consumer that finds its ring empty sets "sleeping" and
+ * looks once more before waiting on its eventfd, and a producer that
+ * publishes a new head rings the bell if it finds "sleeping" set.  The
+ * same handshake on "full" lets a producer wait for space.
+ */
+
+#define RING_MAGIC		0x676e6972
+#define RING_VERSION		1
+#define RING_MIN_SIZE		(64 * 1024)
+#define RING_MAX_SIZE		(64 * 1024 * 1024)
+#define RING_DATA_OFFSET	4096
+
+#define RING_REC_MAX		16384		/* largest payload in one record */
+#define RING_WINDOW		(64 * 1024)	/* unread bytes a channel may have in flight */
+#define RING_CREDIT		(RING_WINDOW / 4)	/* credit is returned in chunks this big */
+#define RING_CHAN_HASH		256
+
+#define REC_DATA		0
+#define REC_CLOSE		1
+#define REC_CREDIT		2
+
+#define REC_HDR			8
+#define REC_ALIGN(x)		(((x) + 7) & ~(uint64_t)7)
+#define REC_MIN_SPACE		(REC_HDR + 8)
+#define REC_TYPE(x)		((x) >> 24)
+#define REC_LEN(x)		((x) & 0xffffff)
+
+struct ring_half
+{
+	_Alignas(64) _Atomic uint64_t head;
+	_Atomic uint32_t sleeping;
+	_Alignas(64) _Atomic uint64_t tail;
+	_Atomic uint32_t full;
+};
+
+struct ring_shared
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t size;
+	struct ring_half half[2];
+};
+
+_Static_assert(sizeof(struct ring_shared) <= RING_DATA_OFFSET, "ring header does not fit");
+
+struct ring_rec
+{
+	uint32_t id;
+	uint32_t len;
+};
+
+struct ring_chan
+{
+	rb_dlink_node node;		/* in ring->chans, or ring->reap once freed */
+	rb_dlink_node pnode;		/* in ring->pending */
+	rb_dlink_node bnode;		/* in ring->blocked */
+	rb_ring *ring;
+	rb_fde_t *F;			/* NULL until opened here, and once closed */
+	rawbuf_head_t *rxbuf;		/* received but not read yet */
+	uint32_t id;
+	uint32_t tx_unacked;		/* sent but not credited back yet */
+	uint32_t rx_uncredited;		/* read but not credited yet */
+	bool closed;			/* closed on this side */
+	bool close_queued;		/* our close record is still to be sent */
+	bool peer_closed;
+	bool pending;
+	bool blocked;
+};
+
+struct _rb_ring
+{
+	void *map;
+	size_t maplen;
+	uint64_t size;
+	uint64_t mask;
+	struct ring_half *rx;
+	struct ring_half *tx;
+	uint8_t *rx_data;
+	uint8_t *tx_data;
+	uint64_t rx_tail;
+	uint64_t tx_head;
+	rb_fde_t *rx_bell;
+	rb_fde_t *tx_bell;
+	rb_dlink_list chans[RING_CHAN_HASH];
+	rb_dlink_list pending;		/* channels with a handler ready to run */
+	rb_dlink_list blocked;		/* channels waiting for space in tx */
+	rb_dlink_list reap;		/* channels freed while busy */
+	unsigned int nchans;
+	unsigned int busy;
+	bool creator;
+	bool dead;
+	bool destroyed;
+	bool kicked;
+
+	/* the record a read handler is being run for, read in place */
+	struct ring_chan *cur;
+	uint64_t cur_pos;
+	uint32_t cur_left;
+};
+
+static void ring_rx(rb_fde_t *F, void *data);
+
+static void
+ring_bell(rb_fde_t *F)
+{
+	uint64_t one = 1;
+
+	/* this only fails once the counter is saturated, which wakes the
+	 * reader just the same */
+	if(write(rb_get_fd(F), &one, sizeof(one)) < 0)
+		return;
+}
+
+static void
+ring_kick(rb_ring *ring)
+{
+	if(ring->kicked)
+		return;
+	ring->kicked = true;
+	ring_bell(ring->rx_bell);
+}
+
+static uint64_t
+ring_space(rb_ring *ring)
+{
+	return ring->size - (ring->tx_head - atomic_load(&ring->tx->tail));
+}
+
+/*
+ * ring_room
+ *
+ * Checks for need bytes of space in tx.  When there are not, asks the
+ * consumer to ring us once it frees some, and looks again in case it
+ * did so before it could see the request.
+ */
+static bool
+ring_room(rb_ring *ring, uint64_t need)
+{
+	if(ring_space(ring) >= need)
+		return true;
+	atomic_store(&ring->tx->full, 1);
+	return ring_space(ring) >= need;
+}
+
+static void
+ring_publish(rb_ring *ring)
+{
+	atomic_store(&ring->tx->head, ring->tx_head);
+	if(atomic_load(&ring->tx->sleeping) && atomic_exchange(&ring->tx->sleeping, 0))
+		ring_bell(ring->tx_bell);
+}
+
+static void
+ring_put_header(rb_ring *ring, uint32_t id, uint32_t type, uint32_t len)
+{
+	struct ring_rec rec;
+
+	rec.id = id;
+	rec.len = type << 24 | len;
+	memcpy(ring->tx_data + (ring->tx_head & ring->mask), &rec, sizeof(rec));
+}
+
+static void
+ring_copy_in(rb_ring *ring, uint64_t pos, const void *src, size_t len)
+{
+	size_t off = pos & ring->mask;
+	size_t n = ring->size - off;
+
+	if(n > len)
+		n = len;
+	memcpy(ring->tx_data + off, src, n);
+	if(len > n)
+		memcpy(ring->tx_data, (const uint8_t *)src + n, len - n);
+}
+
+static void
+ring_copy_out(rb_ring *ring, uint64_t pos, void *dst, size_t len)
+{
+	size_t off = pos & ring->mask;
+	size_t n = ring->size - off;
+
+	if(n > len)
+		n = len;
+	memcpy(dst, ring->rx_data + off, n);
+	if(len > n)
+		memcpy((uint8_t *)dst + n, ring->rx_data, len - n);
+}
+
+/* sends a record with no payload; a dead ring swallows it */
+static bool
+ring_send_ctl(rb_ring *ring, uint32_t id, uint32_t type, uint32_t value)
+{
+	if(ring->dead)
+		return true;
+	if(!ring_room(ring, REC_HDR))
+		return false;
+	ring_put_header(ring, id, type, value);
+	ring->tx_head += REC_HDR;
+	ring_publish(ring);
+	return true;
+}
+
+static struct ring_chan *
+ring_find(rb_ring *ring, uint32_t id)
+{
+	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, ring->chans[id % RING_CHAN_HASH].head)
+	{
+		struct ring_chan *chan = ptr->data;
+		if(chan->id == id)
+			return chan;
+	}
+	return NULL;
+}
+
+static struct ring_chan *
+chan_new(rb_ring *ring, uint32_t id)
+{
+	struct ring_chan *chan = rb_malloc(sizeof(struct ring_chan));
+
+	chan->ring = ring;
+	chan->id = id;
+	chan->rxbuf = rb_new_rawbuffer();
+	rb_dlinkAdd(chan, &chan->node, &ring->chans[id % RING_CHAN_HASH]);
+	ring->nchans++;
+	return chan;
+}
+
+static void
+ring_reap(rb_ring *ring)
+{
+	rb_dlink_node *ptr, *next;
+
+	RB_DLINK_FOREACH_SAFE(ptr, next, ring->reap.head)
+	{
+		rb_dlinkDelete(ptr, &ring->reap);
+		rb_free(ptr->data);
+	}
+}
+
+/* channels may be freed from inside their own handlers, so while the
+ * ring is busy they are only unhooked, and freed on the way out */
+static void
+chan_free(struct ring_chan *chan)
+{
+	rb_ring *ring = chan->ring;
+
+	rb_dlinkDelete(&chan->node, &ring->chans[chan->id % RING_CHAN_HASH]);
+	if(chan->pending)
+		rb_dlinkDelete(&chan->pnode, &ring->pending);
+	if(chan->blocked)
+		rb_dlinkDelete(&chan->bnode, &ring->blocked);
+	chan->pending = chan->blocked = false;
+	if(chan->rxbuf != NULL)
+		rb_free_rawbuffer(chan->rxbuf);
+	chan->rxbuf = NULL;
+	ring->nchans--;
+
+	rb_dlinkAdd(chan, &chan->node, &ring->reap);
+	if(ring->busy == 0)
+		ring_reap(ring);
+}
+
+static bool
+ring_maybe_free(rb_ring *ring)
+{
+	if(!ring->destroyed || ring->nchans > 0 || ring->busy > 0)
+		return false;
+
+	ring_reap(ring);
+	munmap(ring->map, ring->maplen);
+	rb_close(ring->rx_bell);
+	rb_close(ring->tx_bell);
+	rb_free(ring);
+	return true;
+}
+
+static void
+chan_pending(struct ring_chan *chan)
+{
+	rb_ring *ring = chan->ring;
+
+	if(!chan->pending)
+	{
+		chan->pending = true;
+		rb_dlinkAddTail(chan, &chan->pnode, &ring->pending);
+	}
+	if(ring->busy == 0)
+		ring_kick(ring);
+}
+
+static void
+chan_block(struct ring_chan *chan)
+{
+	if(chan->blocked)
+		return;
+	chan->blocked = true;
+	rb_dlinkAddTail(chan, &chan->bnode, &chan->ring->blocked);
+}
+
+/*
+ * chan_flush_ctl
+ *
+ * Sends the credit and close records that are due.  Returns false if
+ * tx is too full for them; the caller blocks the channel until it isn't.
+ */
+static bool
+chan_flush_ctl(struct ring_chan *chan)
+{
+	rb_ring *ring = chan->ring;
+
+	if(!chan->closed && chan->rx_uncredited >= RING_CREDIT)
+	{
+		if(!ring_send_ctl(ring, chan->id, REC_CREDIT, chan->rx_uncredited))
+			return false;
+		chan->rx_uncredited = 0;
+	}
+	if(chan->close_queued)
+	{
+		if(!ring_send_ctl(ring, chan->id, REC_CLOSE, 0))
+			return false;
+		chan->close_queued = false;
+	}
+	return true;
+}
+
+static bool
+chan_readable(struct ring_chan *chan)
+{
+	rb_ring *ring = chan->ring;
+
+	if(rb_rawbuf_length(chan->rxbuf) > 0)
+		return true;
+	if(ring->cur == chan && ring->cur_left > 0)
+		return true;
+	return chan->peer_closed || ring->dead;
+}
+
+static bool
+chan_writable(struct ring_chan *chan)
+{
+	rb_ring *ring = chan->ring;
+
+	if(chan->peer_closed || ring->dead)
+		return true;
+	return chan->tx_unacked < RING_WINDOW && ring_space(ring) >= REC_MIN_SPACE;
+}
+
+/* a write handler is armed: run it if it can make progress, or arrange
+ * to be told when it can.  Credit arriving covers the window. */
+static void
+chan_want_write(struct ring_chan *chan)
+{
+	if(chan_writable(chan))
+		chan_pending(chan);
+	else if(chan->tx_unacked < RING_WINDOW)
+	{
+		chan_block(chan);
+		if(ring_room(chan->ring, REC_MIN_SPACE))
+			chan_pending(chan);
+	}
+}
+
+static void
+chan_run(struct ring_chan *chan)
+{
+	rb_fde_t *F = chan->F;
+	PF *hdl;
+	void *data;
+
+	if(F == NULL)
+		return;
+
+	if(F->read_handler != NULL && chan_readable(chan))
+	{
+		hdl = F->read_handler;
+		data = F->read_data;
+		F->read_handler = NULL;
+		F->read_data = NULL;
+		hdl(F, data);
+	}
+
+	if(chan->F != F || F->write_handler == NULL)
+		return;
+
+	/* others woken with us may have used up the space */
+	if(!chan_writable(chan))
+	{
+		chan_want_write(chan);
+		return;
+	}
+
+	hdl = F->write_handler;
+	data = F->write_data;
+	F->write_handler = NULL;
+	F->write_data = NULL;
+	hdl(F, data);
+}
+
+/*
+ * ring_recv_data
+ *
+ * Hands a data record to its channel.  If the channel is waiting to
+ * read and has nothing buffered, its handler reads the record straight
+ * out of the ring; whatever it leaves is copied into the channel's
+ * buffer along with data for channels that are not reading.
+ */
+static void
+ring_recv_data(rb_ring *ring, uint32_t id, uint64_t pos, uint32_t len)
+{
+	struct ring_chan *chan = ring_find(ring, id);
+	rb_fde_t *F;
+	size_t off, n;
+
+	if(chan == NULL)
+	{
+		/* the creator opened the channel and wrote to it before its
+		 * request to open our end arrived: hold the data for it */
+		if(ring->creator)
+			return;
+		chan = chan_new(ring, id);
+	}
+	if(chan->closed)
+		return;
+
+	F = chan->F;
+	if(F != NULL && F->read_handler != NULL && rb_rawbuf_length(chan->rxbuf) == 0)
+	{
+		PF *hdl = F->read_handler;
+		void *data = F->read_data;
+
+		F->read_handler = NULL;
+		F->read_data = NULL;
+
+		ring->cur = chan;
+		ring->cur_pos = pos;
+		ring->cur_left = len;
+		hdl(F, data);
+		ring->cur = NULL;
+
+		if(chan->F != F || ring->cur_left == 0)
+			return;
+		pos = ring->cur_pos;
+		len = ring->cur_left;
+	}
+
+	off = pos & ring->mask;
+	n = ring->size - off;
+	if(n > len)
+		n = len;
+	rb_rawbuf_append(chan->rxbuf, ring->rx_data + off, n);
+	if(len > n)
+		rb_rawbuf_append(chan->rxbuf, ring->rx_data, len - n);
+
+	if(F != NULL && F->read_handler != NULL)
+		chan_pending(chan);
+}
+
+static void
+ring_recv_close(rb_ring *ring, uint32_t id)
+{
+	struct ring_chan *chan = ring_find(ring, id);
+
+	if(chan == NULL)
+	{
+		if(ring->creator)
+			return;
+		chan = chan_new(ring, id);
+	}
+
+	chan->peer_closed = true;
+	if(chan->closed)
+	{
+		if(!chan->close_queued)
+			chan_free(chan);
+		return;
+	}
+	if(chan->F != NULL && (chan->F->read_handler != NULL || chan->F->write_handler != NULL))
+		chan_pending(chan);
+}
+
+static void
+ring_recv_credit(rb_ring *ring, uint32_t id, uint32_t len)
+{
+	struct ring_chan *chan = ring_find(ring, id);
+
+	if(chan == NULL)
+		return;
+
+	chan->tx_unacked -= len < chan->tx_unacked ? len : chan->tx_unacked;
+	if(chan->F != NULL && chan->F->write_handler != NULL)
+		chan_want_write(chan);
+}
+
+static void
+ring_drain(rb_ring *ring)
+{
+	struct ring_rec rec;
+	uint64_t head, tail = ring->rx_tail;
+	uint64_t budget = ring->size;
+	uint32_t type, len;
+
+	while(!ring->dead)
+	{
+		head = atomic_load_explicit(&ring->rx->head, memory_order_acquire);
+		if(head == tail)
+		{
+			atomic_store(&ring->rx->sleeping, 1);
+			if(atomic_load(&ring->rx->head) == tail)
+				return;
+			atomic_store(&ring->rx->sleeping, 0);
+			continue;
+		}
+
+		/* don't starve everything else while the peer keeps writing */
+		if(budget == 0)
+		{
+			ring_kick(ring);
+			return;
+		}
+
+		memcpy(&rec, ring->rx_data + (tail & ring->mask), sizeof(rec));
+		type = REC_TYPE(rec.len);
+		len = REC_LEN(rec.len);
+
+		if(head - tail > ring->size || type > REC_CREDIT ||
+		   (type == REC_DATA && (len == 0 || len > RING_REC_MAX ||
+					  REC_HDR + REC_ALIGN(len) > head - tail)))
+		{
+			rb_lib_log("ring: bad record from peer, shutting down the ring");
+			rb_ring_shutdown(ring);
+			return;
+		}
+
+		switch(type)
+		{
+		case REC_DATA:
+			ring_recv_data(ring, rec.id, tail + REC_HDR, len);
+			tail += REC_HDR + REC_ALIGN(len);
+			break;
+		case REC_CLOSE:
+			ring_recv_close(ring, rec.id);
+			tail += REC_HDR;
+			break;
+		case REC_CREDIT:
+			ring_recv_credit(ring, rec.id, len);
+			tail += REC_HDR;
+			break;
+		}
+
+		budget = budget > tail - ring->rx_tail ? budget - (tail - ring->rx_tail) : 0;
+		ring->rx_tail = tail;
+		atomic_store(&ring->rx->tail, tail);
+		if(atomic_load(&ring->rx->full) && atomic_exchange(&ring->rx->full, 0))
+			ring_bell(ring->tx_bell);
+	}
+}
+
+/* tx may have space again: send what was held back and wake writers */
+static void
+ring_unblock(rb_ring *ring)
+{
+	rb_dlink_node *ptr, *next;
+
+	RB_DLINK_FOREACH_SAFE(ptr, next, ring->blocked.head)
+	{
+		struct ring_chan *chan = ptr->data;
+
+		if(ring_space(ring) < REC_MIN_SPACE)
+			break;
+
+		rb_dlinkDelete(ptr, &ring->blocked);
+		chan->blocked = false;
+
+		if(!chan_flush_ctl(chan))
+		{
+			chan_block(chan);
+			break;
+		}
+		if(chan->closed)
+		{
+			if(chan->peer_closed)
+				chan_free(chan);
+			continue;
+		}
+		if(chan->F != NULL && chan->F->write_handler != NULL)
+			chan_want_write(chan);
+	}
+
+	if(rb_dlink_list_length(&ring->blocked) > 0 && ring_room(ring, REC_MIN_SPACE))
+		ring_kick(ring);
+}
+
+/* runs the channels that were ready when we started; any that become
+ * ready meanwhile wait for the next pass, so one can't starve the rest */
+static void
+ring_run_pending(rb_ring *ring)
+{
+	unsigned long n = rb_dlink_list_length(&ring->pending);
+	rb_dlink_node *ptr;
+
+	while(n-- > 0 && (ptr = ring->pending.head) != NULL)
+	{
+		struct ring_chan *chan = ptr->data;
+
+		rb_dlinkDelete(ptr, &ring->pending);
+		chan->pending = false;
+		chan_run(chan);
+	}
+}
+
+static void
+ring_rx(rb_fde_t *F, void *data)
+{
+	rb_ring *ring = data;
+	uint64_t count;
+
+	/* reset the doorbell; the peer and ring_kick() both ring it */
+	if(read(rb_get_fd(F), &count, sizeof(count)) < 0 && !rb_ignore_errno(errno))
+		rb_lib_log("ring: doorbell read failed: %s", strerror(errno));
+	ring->kicked = false;
+
+	ring->busy++;
+	ring_drain(ring);
+	if(!ring->dead)
+		ring_unblock(ring);
+	ring_run_pending(ring);
+	ring->busy--;
+
+	if(rb_dlink_list_length(&ring->pending) > 0)
+		ring_kick(ring);
+	ring_reap(ring);
+	if(ring_maybe_free(ring))
+		return;
+	rb_setselect(F, RB_SELECT_READ, ring_rx, ring);
+}
+
+static rb_ring *
+ring_new(void *map, size_t maplen, bool creator)
+{
+	struct ring_shared *shm = map;
+	rb_ring *ring = rb_malloc(sizeof(rb_ring));
+	uint8_t *data = (uint8_t *)map + RING_DATA_OFFSET;
+	int t = creator ? 0 : 1;
+
+	ring->map = map;
+	ring->maplen = maplen;
+	ring->size = shm->size;
+	ring->mask = shm->size - 1;
+	ring->creator = creator;
+	ring->tx = &shm->half[t];
+	ring->rx = &shm->half[!t];
+	ring->tx_data = data + t * shm->size;
+	ring->rx_data = data + !t * shm->size;
+	ring->tx_head = atomic_load(&ring->tx->head);
+	ring->rx_tail = atomic_load(&ring->rx->tail);
+
+	rb_init_rawbuffers(1024);
+	return ring;
+}
+
+static void
+ring_start(rb_ring *ring, rb_fde_t *rx_bell, rb_fde_t *tx_bell)
+{
+	ring->rx_bell = rx_bell;
+	ring->tx_bell = tx_bell;
+	rb_set_nb(rx_bell);
+	rb_set_nb(tx_bell);
+	rb_setselect(rx_bell, RB_SELECT_READ, ring_rx, ring);
+}
+
+int
+rb_supports_ring(void)
+{
+	return 1;
+}
+
+/*
+ * rb_ring_create
+ *
+ * Creates a ring with size bytes (rounded up to a power of two) each
+ * way.  peerF is filled in with the descriptors to hand to the process
+ * at the other end, which passes them to rb_ring_attach().
+ */
+rb_ring *
+rb_ring_create(size_t size, rb_fde_t *peerF[RB_RING_FDS])
+{
+	struct ring_shared *shm;
+	rb_ring *ring;
+	size_t maplen;
+	uint64_t sz;
+	void *map;
+	int memfd, bell[2] = { -1, -1 }, peer_bell[2] = { -1, -1 };
+	int i;
+
+	for(sz = RING_MIN_SIZE; sz < size && sz < RING_MAX_SIZE; sz <<= 1)
+		;
+	maplen = RING_DATA_OFFSET + 2 * sz;
+
+	memfd = memfd_create("librb ring", MFD_CLOEXEC);
+	if(memfd < 0)
+		return NULL;
+
+	if(ftruncate(memfd, maplen) < 0 ||
+	   (map = mmap(NULL, maplen, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0)) == MAP_FAILED)
+	{
+		close(memfd);
+		return NULL;
+	}
+
+	for(i = 0; i < 2; i++)
+	{
+		if((bell[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0 ||
+		   (peer_bell[i] = fcntl(bell[i], F_DUPFD_CLOEXEC, 0)) < 0)
+			break;
+	}
+	if(i < 2)
+	{
+		for(i = 0; i < 2; i++)
+		{
+			if(bell[i] >= 0)
+				close(bell[i]);
+			if(peer_bell[i] >= 0)
+				close(peer_bell[i]);
+		}
+		munmap(map, maplen);
+		close(memfd);
+		return NULL;
+	}
+
+	/* a new memfd reads as zeroes, so the indexes start at 0 */
+	shm = map;
+	shm->magic = RING_MAGIC;
+	shm->version = RING_VERSION;
+	shm->size = sz;
+	atomic_store(&shm->half[0].sleeping, 1);
+	atomic_store(&shm->half[1].sleeping, 1);
+
+	ring = ring_new(map, maplen, true);
+	ring_start(ring, rb_open(bell[1], RB_FD_PIPE, "ring doorbell"),
+		   rb_open(bell[0], RB_FD_PIPE, "ring doorbell"));
+
+	peerF[0] = rb_open(memfd, RB_FD_UNKNOWN, "ring memory");
+	peerF[1] = rb_open(peer_bell[0], RB_FD_PIPE, "ring doorbell");
+	peerF[2] = rb_open(peer_bell[1], RB_FD_PIPE, "ring doorbell");
+	return ring;
+}
+
+/*
+ * rb_ring_attach
+ *
+ * Attaches to a ring made by rb_ring_create() in another process, from
+ * the descriptors it handed out.  They are consumed either way.
+ */
+rb_ring *
+rb_ring_attach(rb_fde_t *F[RB_RING_FDS])
+{
+	struct ring_shared *shm;
+	struct stat st;
+	rb_ring *ring;
+	void *map = MAP_FAILED;
+	size_t maplen = 0;
+	int i;
+
+	for(i = 0; i < RB_RING_FDS; i++)
+		if(F[i] == NULL)
+			goto fail;
+
+	if(fstat(rb_get_fd(F[0]), &st) < 0 || st.st_size < RING_DATA_OFFSET)
+		goto fail;
+	maplen = st.st_size;
+	map = mmap(NULL, maplen, PROT_READ | PROT_WRITE, MAP_SHARED, rb_get_fd(F[0]), 0);
+	if(map == MAP_FAILED)
+		goto fail;
+
+	shm = map;
+	if(shm->magic != RING_MAGIC || shm->version != RING_VERSION ||
+	   shm->size < RING_MIN_SIZE || shm->size > RING_MAX_SIZE ||
+	   (shm->size & (shm->size - 1)) != 0 ||
+	   maplen != RING_DATA_OFFSET + 2 * shm->size)
+		goto fail;
+
+	/* mapped, so the memfd itself is done with; rb_recv_fd_buf() types
+	 * it as a file, which rb_close() doesn't expect */
+	rb_set_type(F[0], RB_FD_UNKNOWN);
+	rb_close(F[0]);
+
+	rb_set_type(F[1], RB_FD_PIPE);
+	rb_set_type(F[2], RB_FD_PIPE);
+	ring = ring_new(map, maplen, false);
+	ring_start(ring, F[1], F[2]);
+	return ring;
+
+fail:
+	if(map != MAP_FAILED)
+		munmap(map, maplen);
+	if(F[0] != NULL)
+		rb_set_type(F[0], RB_FD_UNKNOWN);
+	for(i = 0; i < RB_RING_FDS; i++)
+		rb_close(F[i]);
+	return NULL;
+}
+
+/*
+ * rb_ring_open
+ *
+ * Opens channel id on the ring.  Returns NULL if the ring is dead, or
+ * the id is still in use: the creator may only reuse an id once both
+ * ends have closed it.
+ */
+rb_fde_t *
+rb_ring_open(rb_ring *ring, uint32_t id, const char *desc)
+{
+	struct ring_chan *chan;
+
+	if(ring->dead)
+	{
+		errno = EPIPE;
+		return NULL;
+	}
+
+	chan = ring_find(ring, id);
+	if(chan != NULL && chan->closed && !ring->creator && ring->busy == 0)
+	{
+		/* the creator's close for the old channel went into the ring
+		 * before it asked for this one: catch up with it */
+		ring->busy++;
+		ring_drain(ring);
+		ring->busy--;
+		if(rb_dlink_list_length(&ring->pending) > 0)
+			ring_kick(ring);
+		ring_reap(ring);
+		chan = ring_find(ring, id);
+	}
+
+	if(chan == NULL)
+		chan = chan_new(ring, id);
+	else if(chan->F != NULL || chan->closed)
+	{
+		errno = EEXIST;
+		return NULL;
+	}
+
+	chan->F = rb_open_ring(chan, desc);
+	return chan->F;
+}
+
+/*
+ * rb_ring_shutdown
+ *
+ * The process at the other end is gone: channels read end of file and
+ * fail writes with EPIPE from now on.
+ */
+void
+rb_ring_shutdown(rb_ring *ring)
+{
+	rb_dlink_node *ptr, *next;
+	int i;
+
+	if(ring->dead)
+		return;
+	ring->dead = true;
+
+	for(i = 0; i < RING_CHAN_HASH; i++)
+	{
+		RB_DLINK_FOREACH_SAFE(ptr, next, ring->chans[i].head)
+		{
+			struct ring_chan *chan = ptr->data;
+
+			if(chan->F == NULL)
+			{
+				chan_free(chan);
+				continue;
+			}
+			chan->close_queued = false;
+			if(chan->blocked)
+			{
+				rb_dlinkDelete(&chan->bnode, &ring->blocked);
+				chan->blocked = false;
+			}
+			if(chan->F->read_handler != NULL || chan->F->write_handler != NULL)
+				chan_pending(chan);
+		}
+	}
+}
+
+/*
+ * rb_ring_destroy
+ *
+ * Shuts the ring down and frees it once the last of its channels is
+ * closed.
+ */
+void
+rb_ring_destroy(rb_ring *ring)
+{
+	rb_ring_shutdown(ring);
+	ring->destroyed = true;
+	ring_maybe_free(ring);
+}
+
+ssize_t
+rb_ring_read(rb_fde_t *F, void *buf, size_t count)
+{
+	struct ring_chan *chan = F->ring;
+	rb_ring *ring = chan->ring;
+	uint8_t *p = buf;
+	size_t got = 0, n;
+	int len;
+
+	while(got < count && (len = rb_rawbuf_get(chan->rxbuf, p + got, count - got)) > 0)
+		got += len;
+
+	if(got < count && ring->cur == chan && ring->cur_left > 0)
+	{
+		n = count - got;
+		if(n > ring->cur_left)
+			n = ring->cur_left;
+		ring_copy_out(ring, ring->cur_pos, p + got, n);
+		ring->cur_pos += n;
+		ring->cur_left -= n;
+		got += n;
+	}
+
+	if(got > 0)
+	{
+		chan->rx_uncredited += got;
+		if(chan->rx_uncredited >= RING_CREDIT && !chan_flush_ctl(chan))
+			chan_block(chan);
+		return got;
+	}
+
+	if(chan->peer_closed || ring->dead)
+		return 0;
+
+	errno = EAGAIN;
+	return -1;
+}
+
+ssize_t
+rb_ring_writev(rb_fde_t *F, const struct rb_iovec *vector, int count)
+{
+	struct ring_chan *chan = F->ring;
+	rb_ring *ring = chan->ring;
+	size_t total = 0, written = 0, off = 0, len, left, n;
+	uint64_t pos, space;
+	int i;
+
+	if(chan->peer_closed || ring->dead)
+	{
+		errno = EPIPE;
+		return -1;
+	}
+
+	for(i = 0; i < count; i++)
+		total += vector[i].iov_len;
+	if(total == 0)
+		return 0;
+
+	i = 0;
+	while(written < total && chan->tx_unacked < RING_WINDOW)
+	{
+		len = total - written;
+		if(len > RING_REC_MAX)
+			len = RING_REC_MAX;
+		if(len > RING_WINDOW - chan->tx_unacked)
+			len = RING_WINDOW - chan->tx_unacked;
+
+		space = ring_space(ring);
+		if(space < REC_HDR + REC_ALIGN(len))
+		{
+			if(!ring_room(ring, REC_MIN_SPACE))
+				break;
+			space = ring_space(ring);
+			if(space < REC_HDR + REC_ALIGN(len))
+				len = (space - REC_HDR) & ~(uint64_t)7;
+		}
+
+		ring_put_header(ring, chan->id, REC_DATA, len);
+		pos = ring->tx_head + REC_HDR;
+		for(left = len; left > 0;)
+		{
+			n = vector[i].iov_len - off;
+			if(n > left)
+				n = left;
+			ring_copy_in(ring, pos, (const uint8_t *)vector[i].iov_base + off, n);
+			pos += n;
+			off += n;
+			left -= n;
+			if(off == vector[i].iov_len)
+			{
+				i++;
+				off = 0;
+			}
+		}
+
+		ring->tx_head += REC_HDR + REC_ALIGN(len);
+		chan->tx_unacked += len;
+		written += len;
+	}
+
+	if(written == 0)
+	{
+		errno = EAGAIN;
+		return -1;
+	}
+
+	ring_publish(ring);
+	return written;
+}
+
+void
+rb_ring_setselect(rb_fde_t *F, unsigned int type, PF * handler, void *client_data)
+{
+	struct ring_chan *chan = F->ring;
+
+	if(type & RB_SELECT_READ)
+	{
+		F->read_handler = handler;
+		F->read_data = client_data;
+	}
+	if(type & RB_SELECT_WRITE)
+	{
+		F->write_handler = handler;
+		F->write_data = client_data;
+	}
+
+	if(handler == NULL || chan == NULL)
+		return;
+
+	if((type & RB_SELECT_READ) && chan_readable(chan))
+		chan_pending(chan);
+	if(type & RB_SELECT_WRITE)
+		chan_want_write(chan);
+}
+
+void
+rb_ring_close(rb_fde_t *F)
+{
+	struct ring_chan *chan = F->ring;
+	rb_ring *ring = chan->ring;
+
+	F->read_handler = NULL;
+	F->read_data = NULL;
+	F->write_handler = NULL;
+	F->write_data = NULL;
+	F->ring = NULL;
+
+	chan->F = NULL;
+	chan->closed = true;
+	rb_free_rawbuffer(chan->rxbuf);
+	chan->rxbuf = NULL;
+	if(chan->pending)
+	{
+		rb_dlinkDelete(&chan->pnode, &ring->pending);
+		chan->pending = false;
+	}
+
+	if(!ring->dead)
+	{
+		chan->close_queued = true;
+		if(!chan_flush_ctl(chan))
+		{
+			chan_block(chan);
+			return;
+		}
+	}
+
+	if(chan->peer_closed || ring->dead)
+	{
+		chan_free(chan);
+		ring_maybe_free(ring);
+	}
+}
+
+#else /* USE_RING */
+
+int
+rb_supports_ring(void)
+{
+	return 0;
+}
+
+rb_ring *
+rb_ring_create(size_t size, rb_fde_t *peerF[RB_RING_FDS])
+{
+	errno = ENOSYS;
+	return NULL;
+}
+
+rb_ring *
+rb_ring_attach(rb_fde_t *F[RB_RING_FDS])
+{
+	int i;
+
+	for(i = 0; i < RB_RING_FDS; i++)
+		rb_close(F[i]);
+	errno = ENOSYS;
+	return NULL;
+}
+
+rb_fde_t *
+rb_ring_open(rb_ring *ring, uint32_t id, const char *desc)
+{
+	errno = ENOSYS;
+	return NULL;
+}
+
+void
+rb_ring_shutdown(rb_ring *ring)
+{
+}
+
+void
+rb_ring_destroy(rb_ring *ring)
+{
+}
+
+ssize_t
+rb_ring_read(rb_fde_t *F, void *buf, size_t count)
+{
+	errno = EBADF;
+	return -1;
+}
+
+ssize_t
+rb_ring_writev(rb_fde_t *F, const struct rb_iovec *vector, int count)
+{
+	errno = EBADF;
+	return -1;
+}
+
+void
+rb_ring_setselect(rb_fde_t *F, unsigned int type, PF * handler, void *client_data)
+{
+}
+
+void
+rb_ring_close(rb_fde_t *F)
+{
+}
+
+#endif /* USE_RING */
@@ -41,7 +41,7 @@ static void cap_account_tag_process(hook_data *);
 unsigned int CLICAP_ACCOUNT_TAG = 0;
 
 mapi_hfn_list_av1 cap_account_tag_hfnlist[] = {
-	{ "outbound_msgbuf", (hookfn) cap_account_tag_process },
+	{ "outbound_msgbuf", (hookfn) cap_account_tag_process, HOOK_NORMAL, { .caps = &CLICAP_ACCOUNT_TAG } },
 	{ NULL, NULL }
 };
 mapi_cap_list_av2 cap_account_tag_cap_list[] = {
@@ -41,7 +41,7 @@ static void cap_server_time_process(hook_data *);
 unsigned int CLICAP_SERVER_TIME = 0;
 
 mapi_hfn_list_av1 cap_server_time_hfnlist[] = {
-	{ "outbound_msgbuf", (hookfn) cap_server_time_process },
+	{ "outbound_msgbuf", (hookfn) cap_server_time_process, HOOK_NORMAL, { .caps = &CLICAP_SERVER_TIME } },
 	{ NULL, NULL }
 };
 mapi_cap_list_av2 cap_server_time_cap_list[] = {
@@ -49,22 +49,38 @@ mapi_cap_list_av2 cap_server_time_cap_list[] = {
 	{ 0, NULL, NULL, NULL }
 };
 
+/* The tag is built from the time of the current event loop pass, so it
+ * only needs formatting again when that moves on to another millisecond,
+ * and the date part only when it moves on to another second.
+ */
 static void
 cap_server_time_process(hook_data *data)
 {
 	static char buf[BUFSIZE];
+	static time_t last_sec = -1;
+	static long last_msec = -1;
+	static size_t datelen;
 	struct MsgBuf *msgbuf = data->arg1;
-	struct timeval tv;
+	const struct timeval *tv = rb_current_time_tv();
+	long msec = tv->tv_usec / 1000;
 
-	if (!rb_gettimeofday(&tv, NULL)) {
-		if (strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S.", gmtime(&tv.tv_sec)) == 0)
+	if (tv->tv_sec != last_sec)
+	{
+		datelen = strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S.", gmtime(&tv->tv_sec));
+		if (datelen == 0)
 			return;
 
-		if (rb_snprintf_append(buf, sizeof(buf), "%03uZ", (int)tv.tv_usec / 1000) < 0)
-			return;
+		last_sec = tv->tv_sec;
+		last_msec = -1;
+	}
 
-		msgbuf_append_tag(msgbuf, "time", buf, CLICAP_SERVER_TIME);
+	if (msec != last_msec)
+	{
+		snprintf(buf + datelen, sizeof(buf) - datelen, "%03ldZ", msec);
+		last_msec = msec;
 	}
+
+	msgbuf_append_tag(msgbuf, "time", buf, CLICAP_SERVER_TIME);
 }
 
 DECLARE_MODULE_AV2(cap_server_time, NULL, NULL, NULL, NULL, cap_server_time_hfnlist, cap_server_time_cap_list, NULL, cap_server_time_desc);
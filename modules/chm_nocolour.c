@@ -43,7 +43,7 @@ static unsigned int mode_nocolour;
 static void chm_nocolour_process(hook_data_privmsg_channel *);
 
 mapi_hfn_list_av1 chm_nocolour_hfnlist[] = {
-	{ "privmsg_channel", (hookfn) chm_nocolour_process },
+	{ "privmsg_channel", (hookfn) chm_nocolour_process, HOOK_NORMAL, { .chmodes = &mode_nocolour } },
 	{ NULL, NULL }
 };
 
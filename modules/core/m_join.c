@@ -47,6 +47,9 @@ static const char join_desc[] = "Provides the JOIN and TS6 SJOIN commands to fac
 static void m_join(struct MsgBuf *, struct Client *, struct Client *, int, const char **);
 static void ms_join(struct MsgBuf *, struct Client *, struct Client *, int, const char **);
 static void ms_sjoin(struct MsgBuf *, struct Client *, struct Client *, int, const char **);
+static void do_sjoin(struct MsgBuf *, struct Client *, struct Client *, int, const char **);
+static void h_join_server_eob(struct Client *);
+static void netjoin_close(void);
 
 static int h_can_create_channel;
 static int h_channel_join;
@@ -71,7 +74,18 @@ mapi_hlist_av1 join_hlist[] = {
 	{ NULL, NULL },
 };
 
-DECLARE_MODULE_AV2(join, NULL, NULL, join_clist, join_hlist, NULL, NULL, NULL, join_desc);
+mapi_hfn_list_av1 join_hfnlist[] = {
+	{ "server_eob", (hookfn) h_join_server_eob },
+	{ NULL, NULL },
+};
+
+static void
+_moddeinit(void)
+{
+	netjoin_close();
+}
+
+DECLARE_MODULE_AV2(join, NULL, _moddeinit, join_clist, join_hlist, join_hfnlist, NULL, NULL, join_desc);
 
 static void do_join_0(struct Client *client_p, struct Client *source_p);
 static bool check_channel_name_loc(struct Client *source_p, const char *name);
@@ -511,8 +525,83 @@ ms_join(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source_
 		      source_p->id, (long) chptr->channelts, chptr->chname);
 }
 
+/* longest a netjoin batch is held open waiting for the burst to end */
+#define NETJOIN_BATCH_TIME	1
+
+static time_t netjoin_started;
+static struct ev_entry *netjoin_ev;
+
+/* close the netjoin batch, if that is the one open */
+static void
+netjoin_close(void)
+{
+	const char *type = send_batch_type();
+
+	if(netjoin_ev != NULL)
+	{
+		rb_event_delete(netjoin_ev);
+		netjoin_ev = NULL;
+	}
+
+	if(type != NULL && !strcmp(type, "netjoin"))
+		send_batch_close();
+}
+
+/* a burst that stalls must not keep its recipients corked */
+static void
+netjoin_timeout(void *unused)
+{
+	netjoin_ev = NULL;
+	netjoin_close();
+}
+
+/*
+ * ms_sjoin
+ *
+ * SJOINs received while a server is bursting are sent to local users as
+ * part of a "netjoin" batch, so a client sees the whole netjoin as one
+ * unit and each gets its JOINs and MODEs in as few writes as possible.
+ * The batch is closed at end of burst, when another batch starts, or
+ * once it has been open for NETJOIN_BATCH_TIME.
+ */
 static void
 ms_sjoin(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source_p, int parc, const char *parv[])
+{
+	const char *type;
+	char params[BUFSIZE];
+
+	if(HasSentEob(source_p))
+	{
+		do_sjoin(msgbuf_p, client_p, source_p, parc, parv);
+		return;
+	}
+
+	if(rb_current_time() - netjoin_started >= NETJOIN_BATCH_TIME)
+		netjoin_close();
+
+	type = send_batch_type();
+	if(type == NULL || strcmp(type, "netjoin"))
+	{
+		netjoin_started = rb_current_time();
+		if(netjoin_ev != NULL)
+			rb_event_delete(netjoin_ev);
+		netjoin_ev = rb_event_addonce("netjoin_timeout", netjoin_timeout, NULL, NETJOIN_BATCH_TIME);
+	}
+
+	snprintf(params, sizeof(params), "%s %s", source_p->servptr->name, source_p->name);
+	send_batch_begin("netjoin", params);
+	do_sjoin(msgbuf_p, client_p, source_p, parc, parv);
+	send_batch_end();
+}
+
+static void
+h_join_server_eob(struct Client *source_p)
+{
+	netjoin_close();
+}
+
+static void
+do_sjoin(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source_p, int parc, const char *parv[])
 {
 	static char modebuf[MODEBUFLEN];
 	static char parabuf[MODEBUFLEN];
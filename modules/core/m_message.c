@@ -491,7 +491,7 @@ msg_channel(enum message_type msgtype,
 	hdata.text = text;
 	hdata.approved = 0;
 
-	call_hook(h_privmsg_channel, &hdata);
+	call_hook_filtered(h_privmsg_channel, &hdata, HOOK_ANY, HOOK_ANY, chptr->mode.mode);
 
 	/* memory buffer address may have changed, update pointer */
 	text = hdata.text;
@@ -576,7 +576,7 @@ msg_channel_opmod(enum message_type msgtype,
 	hdata.text = text;
 	hdata.approved = 0;
 
-	call_hook(h_privmsg_channel, &hdata);
+	call_hook_filtered(h_privmsg_channel, &hdata, HOOK_ANY, HOOK_ANY, chptr->mode.mode);
 
 	/* memory buffer address may have changed, update pointer */
 	text = hdata.text;
@@ -657,7 +657,7 @@ msg_channel_flags(enum message_type msgtype, struct Client *client_p,
 	hdata.text = text;
 	hdata.approved = 0;
 
-	call_hook(h_privmsg_channel, &hdata);
+	call_hook_filtered(h_privmsg_channel, &hdata, HOOK_ANY, HOOK_ANY, chptr->mode.mode);
 
 	/* memory buffer address may have changed, update pointer */
 	text = hdata.text;
@@ -771,7 +771,7 @@ msg_client(enum message_type msgtype,
 	hdata.text = text;
 	hdata.approved = 0;
 
-	call_hook(h_privmsg_user, &hdata);
+	call_hook_filtered(h_privmsg_user, &hdata, HOOK_ANY, target_p->umodes, HOOK_ANY);
 
 	/* buffer location may have changed. */
 	text = hdata.text;
@@ -197,7 +197,7 @@ do_message_hook(struct Client *source_p, struct Channel *chptr, const char **rea
 	hdata.text = *reason;
 	hdata.approved = 0;
 
-	call_hook(h_privmsg_channel, &hdata);
+	call_hook_filtered(h_privmsg_channel, &hdata, HOOK_ANY, HOOK_ANY, chptr->mode.mode);
 
 	/* The reason may have been changed by a hook... */
 	*reason = hdata.text;
@@ -0,0 +1,134 @@
+/*
+ * modules/m_capture.c
+ * Copyright (c) 2026 Ophion development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stdinc.h"
+#include "capture.h"
+#include "client.h"
+#include "ircd.h"
+#include "logger.h"
+#include "match.h"
+#include "modules.h"
+#include "msg.h"
+#include "numeric.h"
+#include "s_conf.h"
+#include "s_newconf.h"
+#include "s_serv.h"
+#include "send.h"
+
+#define CAPTURE_DEFAULT_MB	100
+
+static const char capture_desc[] =
+	"Provides the CAPTURE command to record inbound traffic for replay";
+
+static void mo_capture(struct MsgBuf *, struct Client *, struct Client *, int, const char **);
+
+struct Message capture_msgtab = {
+	"CAPTURE", 0, 0, 0, 0,
+	{mg_unreg, mg_not_oper, mg_ignore, mg_ignore, mg_ignore, {mo_capture, 0}}
+};
+
+mapi_clist_av1 capture_clist[] = { &capture_msgtab, NULL };
+
+static void
+capture_deinit(void)
+{
+	capture_stop();
+}
+
+DECLARE_MODULE_AV2(capture, NULL, capture_deinit, capture_clist, NULL, NULL, NULL, NULL, capture_desc);
+
+/*
+ * mo_capture
+ *	parv[1] = START or STOP; with none, show the state
+ *	parv[2] = size limit in megabytes for START
+ */
+static void
+mo_capture(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source_p, int parc, const char *parv[])
+{
+	char path[PATH_MAX];
+	size_t written, limit;
+	unsigned int connections;
+	int mb = CAPTURE_DEFAULT_MB;
+
+	if(!IsOperAdmin(source_p))
+	{
+		sendto_one(source_p, form_str(ERR_NOPRIVS),
+			   me.name, source_p->name, "admin");
+		return;
+	}
+
+	if(parc < 2 || EmptyString(parv[1]))
+	{
+		if(!capture_active)
+		{
+			sendto_one_notice(source_p, ":No traffic capture is running");
+			return;
+		}
+
+		capture_status(&written, &limit, &connections);
+		sendto_one_notice(source_p, ":Capturing traffic: %zu of %zu bytes written, %u connections",
+				  written, limit, connections);
+		return;
+	}
+
+	if(!irccmp(parv[1], "START"))
+	{
+		if(parc > 2 && (mb = atoi(parv[2])) <= 0)
+		{
+			sendto_one_notice(source_p, ":Invalid size limit %s", parv[2]);
+			return;
+		}
+
+		snprintf(path, sizeof(path), "%s%ccapture-%lld.cap",
+			 ircd_paths[IRCD_PATH_LOG], RB_PATH_SEPARATOR, (long long)rb_current_time());
+
+		if(capture_start(path, (size_t)mb * 1024 * 1024) < 0)
+		{
+			sendto_one_notice(source_p, ":Unable to write %s: %s", path, strerror(errno));
+			return;
+		}
+
+		sendto_realops_snomask(SNO_GENERAL, L_ALL, "%s started a traffic capture to %s (limit %dMB)",
+				       get_oper_name(source_p), path, mb);
+	}
+	else if(!irccmp(parv[1], "STOP"))
+	{
+		if(!capture_active)
+		{
+			sendto_one_notice(source_p, ":No traffic capture is running");
+			return;
+		}
+
+		capture_stop();
+		sendto_realops_snomask(SNO_GENERAL, L_ALL, "%s stopped the traffic capture",
+				       get_oper_name(source_p));
+	}
+	else
+		sendto_one_notice(source_p, ":Usage: CAPTURE [START [megabytes]|STOP]");
+}
@@ -36,7 +36,7 @@ mo_grant(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source
 {
 	struct Client *target_p;
 
-	if(!HasPrivilege(source_p, "oper:grant"))
+	if(!HasPrivilegeId(source_p, PRIVID_OPER_GRANT))
 	{
 		sendto_one(source_p, form_str(ERR_NOPRIVS), me.name, source_p->name, "grant");
 		return;
@@ -384,16 +384,18 @@ handle_access_upsert(struct Channel *chptr, struct Client *source_p, const char
 static void
 apply_access_entries(struct Channel *chptr, struct Client *client_p)
 {
-	struct AccessEntry *ae = channel_access_match(chptr, client_p);
-	if (ae == NULL)
+	struct membership *msptr = find_channel_membership(chptr, client_p);
+	s_assert(msptr != NULL);
+	if (msptr == NULL)
 		return;
 
-	char mode_char = ae_level_char(ae->flags);
-	if (!mode_char)
+	unsigned int flags = channel_access_level(chptr, msptr);
+	if (flags == 0)
 		return;
 
-	struct membership *msptr = find_channel_membership(chptr, client_p);
-	s_assert(msptr != NULL);
+	char mode_char = ae_level_char(flags);
+	if (!mode_char)
+		return;
 
 	sendto_channel_local(&me, ALL_MEMBERS, chptr, ":%s MODE %s +%c %s",
 			me.name, chptr->chname, mode_char, client_p->name);
@@ -401,7 +403,7 @@ apply_access_entries(struct Channel *chptr, struct Client *client_p)
 			":%s TMODE %ld %s +%c %s",
 			me.id, (long) chptr->channelts, chptr->chname,
 			mode_char, client_p->id);
-	msptr->flags |= ae->flags;
+	msptr->flags |= flags;
 }
 
 static void
@@ -88,34 +88,69 @@ ircx_prop_deinit(void)
 
 DECLARE_MODULE_AV2(ircx_prop, ircx_prop_init, ircx_prop_deinit, ircx_prop_clist, ircx_prop_hlist, NULL, NULL, NULL, ircx_prop_desc);
 
+static void
+handle_prop_show(const struct PropMatch *prop_match, struct Client *source_p, const struct Property *prop, int alevel)
+{
+	hook_data_prop_activity prop_activity;
+
+	prop_activity.client = source_p;
+	prop_activity.target = prop_match->target_name;
+	prop_activity.prop_list = prop_match->prop_list;
+	prop_activity.key = prop->name;
+	prop_activity.alevel = alevel;
+	prop_activity.approved = 1;
+	prop_activity.target_ptr = prop_match->target;
+
+	call_hook(h_prop_show, &prop_activity);
+
+	if (!prop_activity.approved)
+		return;
+
+	sendto_one_numeric(source_p, RPL_PROPLIST, form_str(RPL_PROPLIST),
+		prop_match->target_name, prop->name, prop->value);
+}
+
+/*
+ * Properties are shown straight out of the set; with a key list each key
+ * is looked up instead of matching the list against every property, and
+ * a key listed twice is shown once.
+ */
 static void
 handle_prop_list(const struct PropMatch *prop_match, struct Client *source_p, const char *keys, int alevel)
 {
-	rb_dlink_node *iter;
+	struct Property *prop;
+	unsigned int i, nshown = 0;
 
-	RB_DLINK_FOREACH(iter, prop_match->prop_list->head)
+	if (keys == NULL)
 	{
-		struct Property *prop = iter->data;
-		hook_data_prop_activity prop_activity;
+		PROPERTYSET_FOREACH(prop, i, prop_match->prop_list)
+			handle_prop_show(prop_match, source_p, prop, alevel);
+	}
+	else
+	{
+		char *keybuf = LOCAL_COPY(keys);
+		char *key, *next;
+		struct Property **shown = NULL;
 
-		if (keys != NULL && rb_strcasestr(keys, prop->name) == NULL)
-			continue;
+		if (propertyset_count(prop_match->prop_list) > 0)
+			shown = rb_malloc(sizeof(*shown) * propertyset_count(prop_match->prop_list));
 
-		prop_activity.client = source_p;
-		prop_activity.target = prop_match->target_name;
-		prop_activity.prop_list = prop_match->prop_list;
-		prop_activity.key = prop->name;
-		prop_activity.alevel = alevel;
-		prop_activity.approved = 1;
-		prop_activity.target_ptr = prop_match->target;
+		for (key = rb_strtok_r(keybuf, ",", &next); key != NULL; key = rb_strtok_r(NULL, ",", &next))
+		{
+			if ((prop = propertyset_find(prop_match->prop_list, key)) == NULL)
+				continue;
 
-		call_hook(h_prop_show, &prop_activity);
+			for (i = 0; i < nshown; i++)
+				if (shown[i] == prop)
+					break;
+			if (i < nshown)
+				continue;
 
-		if (!prop_activity.approved)
-			continue;
+			shown[nshown++] = prop;
+			handle_prop_show(prop_match, source_p, prop, alevel);
+		}
 
-		sendto_one_numeric(source_p, RPL_PROPLIST, form_str(RPL_PROPLIST),
-			prop_match->target_name, prop->name, prop->value);
+		rb_free(shown);
 	}
 
 	sendto_one_numeric(source_p, RPL_PROPEND, form_str(RPL_PROPEND), prop_match->target_name);
@@ -127,18 +162,18 @@ handle_prop_upsert_or_delete(const struct PropMatch *prop_match, struct Client *
 	struct Property *property;
 	hook_data_prop_activity prop_activity;
 
-	propertyset_delete(prop_match->prop_list, prop);
-
 	/* deletion: value is empty string */
 	if (! *value)
 	{
+		propertyset_delete(prop_match->prop_list, prop);
 		sendto_one(source_p, ":%s!%s@%s PROP %s %s :", source_p->name, source_p->username, source_p->host,
 			prop_match->target_name, prop);
 		goto broadcast;
 	}
 
-	/* enforce MAXPROP on upsert */
-	if (rb_dlink_list_length(prop_match->prop_list) >= ConfigChannel.max_prop)
+	/* enforce MAXPROP on new keys; an existing one is updated in place */
+	if (propertyset_find(prop_match->prop_list, prop) == NULL &&
+	    propertyset_count(prop_match->prop_list) >= ConfigChannel.max_prop)
 	{
 		sendto_one_numeric(source_p, ERR_PROP_TOOMANY, form_str(ERR_PROP_TOOMANY), prop_match->target_name);
 		return;
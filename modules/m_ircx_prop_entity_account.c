@@ -89,12 +89,11 @@ can_write_to_account_property(struct Client *source_p, struct Account *target_p,
 static inline void
 burst_account(struct Client *client_p, struct Account *account_p)
 {
-	rb_dlink_node *it;
+	struct Property *prop;
+	unsigned int i;
 
-	RB_DLINK_FOREACH(it, account_p->prop_list.head)
+	PROPERTYSET_FOREACH(prop, i, &account_p->prop_list)
 	{
-		struct Property *prop = it->data;
-
 		/* :source TPROP target creationTS updateTS propName [:propValue] */
 		sendto_one(client_p, ":%s TPROP account:%s %ld %ld %s :%s",
 			use_id(&me), account_p->name, account_p->creation_ts, prop->set_at, prop->name, prop->value);
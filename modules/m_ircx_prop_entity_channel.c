@@ -133,12 +133,11 @@ h_prop_burst_channel(void *vdata)
 	hook_data_channel *hchaninfo = vdata;
 	struct Channel *chptr = hchaninfo->chptr;
 	struct Client *client_p = hchaninfo->client;
-	rb_dlink_node *it;
+	struct Property *prop;
+	unsigned int i;
 
-	RB_DLINK_FOREACH(it, chptr->prop_list.head)
+	PROPERTYSET_FOREACH(prop, i, &chptr->prop_list)
 	{
-		struct Property *prop = it->data;
-
 		/* :source TPROP target creationTS updateTS propName [:propValue] */
 		sendto_one(client_p, ":%s TPROP %s %ld %ld %s :%s",
 			use_id(&me), chptr->chname, chptr->channelts, prop->set_at, prop->name, prop->value);
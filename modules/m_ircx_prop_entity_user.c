@@ -89,15 +89,14 @@ h_prop_burst_client(void *vdata)
 	hook_data_client *hclientinfo = vdata;
 	struct Client *client_p = hclientinfo->client;
 	struct Client *burst_p = hclientinfo->target;
-	rb_dlink_node *it;
+	struct Property *prop;
+	unsigned int i;
 
 	if (burst_p->user == NULL)
 		return;
 
-	RB_DLINK_FOREACH(it, burst_p->user->prop_list.head)
+	PROPERTYSET_FOREACH(prop, i, &burst_p->user->prop_list)
 	{
-		struct Property *prop = it->data;
-
 		/* :source TPROP target creationTS updateTS propName [:propValue] */
 		sendto_one(client_p, ":%s TPROP %s %ld %ld %s :%s",
 			use_id(&me), use_id(burst_p), burst_p->tsinfo, prop->set_at, prop->name, prop->value);
@@ -65,7 +65,7 @@ h_prop_channel_join(void *vdata)
 	if (!MyClient(source_p))
 		return;
 
-	rb_dlink_list *prop_list = &chptr->prop_list;
+	struct PropertySet *prop_list = &chptr->prop_list;
 	struct Property *prop = propertyset_find(prop_list, "ONJOIN");
 
 	if (prop != NULL)
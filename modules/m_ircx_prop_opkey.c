@@ -71,7 +71,7 @@ h_prop_channel_join(void *vdata)
 	if (rb_likely(data->key == NULL))
 		return;
 
-	rb_dlink_list *prop_list = &chptr->prop_list;
+	struct PropertySet *prop_list = &chptr->prop_list;
 	struct Property *prop = propertyset_find(prop_list, "HOSTKEY");
 
 	if (prop == NULL)
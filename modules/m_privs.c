@@ -177,7 +177,7 @@ mo_privs(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source
 		}
 	}
 
-	if (target_p != source_p && !HasPrivilege(source_p, "oper:privs"))
+	if (target_p != source_p && !HasPrivilegeId(source_p, PRIVID_OPER_PRIVS))
 	{
 		sendto_one(source_p, form_str(ERR_NOPRIVS),
 			   me.name, source_p->name, "privs");
@@ -0,0 +1,110 @@
+/*
+ * modules/m_profile.c
+ * Copyright (c) 2026 Ophion development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stdinc.h"
+#include "client.h"
+#include "ircd.h"
+#include "logger.h"
+#include "match.h"
+#include "modules.h"
+#include "msg.h"
+#include "numeric.h"
+#include "profile.h"
+#include "s_conf.h"
+#include "s_newconf.h"
+#include "s_serv.h"
+#include "send.h"
+
+static const char profile_desc[] =
+	"Provides the PROFILE command to control command, hook and event latency accounting";
+
+static void mo_profile(struct MsgBuf *, struct Client *, struct Client *, int, const char **);
+
+struct Message profile_msgtab = {
+	"PROFILE", 0, 0, 0, 0,
+	{mg_unreg, mg_not_oper, mg_ignore, mg_ignore, mg_ignore, {mo_profile, 0}}
+};
+
+mapi_clist_av1 profile_clist[] = { &profile_msgtab, NULL };
+
+DECLARE_MODULE_AV2(profile, NULL, NULL, profile_clist, NULL, NULL, NULL, NULL, profile_desc);
+
+/*
+ * mo_profile
+ *	parv[1] = ON, OFF, RESET or DUMP; with none, show the state
+ */
+static void
+mo_profile(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source_p, int parc, const char *parv[])
+{
+	char path[PATH_MAX];
+
+	if(!IsOperAdmin(source_p))
+	{
+		sendto_one(source_p, form_str(ERR_NOPRIVS),
+			   me.name, source_p->name, "admin");
+		return;
+	}
+
+	if(parc < 2 || EmptyString(parv[1]))
+	{
+		sendto_one_notice(source_p, ":Profiling is %s, see STATS w",
+				  profile_enabled ? "enabled" : "disabled");
+		return;
+	}
+
+	if(!irccmp(parv[1], "ON"))
+	{
+		profile_set(true);
+		sendto_realops_snomask(SNO_GENERAL, L_ALL, "%s enabled profiling",
+				       get_oper_name(source_p));
+	}
+	else if(!irccmp(parv[1], "OFF"))
+	{
+		profile_set(false);
+		sendto_realops_snomask(SNO_GENERAL, L_ALL, "%s disabled profiling",
+				       get_oper_name(source_p));
+	}
+	else if(!irccmp(parv[1], "RESET"))
+	{
+		profile_clear();
+		sendto_one_notice(source_p, ":Profiling counters cleared");
+	}
+	else if(!irccmp(parv[1], "DUMP"))
+	{
+		snprintf(path, sizeof(path), "%s%cprofile.json",
+			 ircd_paths[IRCD_PATH_LOG], RB_PATH_SEPARATOR);
+
+		if(profile_dump(path) < 0)
+			sendto_one_notice(source_p, ":Unable to write %s: %s", path, strerror(errno));
+		else
+			sendto_one_notice(source_p, ":Profile written to %s", path);
+	}
+	else
+		sendto_one_notice(source_p, ":Usage: PROFILE [ON|OFF|RESET|DUMP]");
+}
@@ -194,8 +194,8 @@ rehash_txlines(struct Client *source_p)
 		if(!aconf->hold || aconf->lifetime)
 			continue;
 
+		remove_xline_conf(ptr);
 		free_conf(aconf);
-		rb_dlinkDestroy(ptr, &xline_conf_list);
 	}
 }
 
@@ -228,8 +228,8 @@ rehash_tresvs(struct Client *source_p)
 		if(!aconf->hold || aconf->lifetime)
 			continue;
 
+		remove_nick_resv_conf(ptr);
 		free_conf(aconf);
-		rb_dlinkDestroy(ptr, &resv_conf_list);
 	}
 }
 
@@ -350,7 +350,7 @@ do_rehash(struct Client *source_p, const char *type)
 			remote_rehash_oper_p = source_p;
 		ilog(L_MAIN, "REHASH From %s[%s]", get_oper_name(source_p),
 		     source_p->sockhost);
-		rehash(false);
+		rehash(false, source_p);
 		remote_rehash_oper_p = NULL;
 	}
 }
@@ -355,7 +355,7 @@ parse_resv(struct Client *source_p, const char *name, const char *reason, int te
 			bandb_add(BANDB_RESV, source_p, aconf->host, NULL, aconf->passwd, NULL, 0);
 		}
 
-		rb_dlinkAddAlloc(aconf, &resv_conf_list);
+		add_nick_resv_conf(aconf);
 		resv_nick_fnc(aconf->host, aconf->passwd, temp_time);
 	}
 	else
@@ -640,7 +640,7 @@ remove_resv(struct Client *source_p, const char *name, int propagated)
 					       get_oper_name(source_p), name);
 		}
 		/* already have ptr from the loop above.. */
-		rb_dlinkDestroy(ptr, &resv_conf_list);
+		remove_nick_resv_conf(ptr);
 	}
 	free_conf(aconf);
 
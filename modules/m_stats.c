@@ -46,7 +46,10 @@
 #include "whowas.h"
 #include "rb_radixtree.h"
 #include "sslproc.h"
+#include "wsproc.h"
 #include "s_assert.h"
+#include "logger.h"
+#include "profile.h"
 
 static const char stats_desc[] =
 	"Provides the STATS command to inspect various server/network information";
@@ -125,7 +128,9 @@ static void stats_servers(struct Client *);
 static void stats_tgecos(struct Client *);
 static void stats_gecos(struct Client *);
 static void stats_class(struct Client *);
+static void stats_profile(struct Client *);
 static void stats_memory(struct Client *);
+static void stats_ziplinks(struct Client *);
 static void stats_servlinks(struct Client *);
 static void stats_ltrace(struct Client *, int, const char **);
 static void stats_comm(struct Client *);
@@ -185,11 +190,13 @@ static struct stats_cmd stats_cmd_table[256] = {
 	['U'] = HANDLER_NORM(stats_shared,	false,	"oper:general"),
 	['v'] = HANDLER_NORM(stats_servers,	false,	NULL),
 	['V'] = HANDLER_NORM(stats_servers,	false,	NULL),
+	['w'] = HANDLER_NORM(stats_profile,	true,	NULL),
 	['x'] = HANDLER_NORM(stats_tgecos,	false,	"oper:general"),
 	['X'] = HANDLER_NORM(stats_gecos,	false,	"oper:general"),
 	['y'] = HANDLER_NORM(stats_class,	false,	NULL),
 	['Y'] = HANDLER_NORM(stats_class,	false,	NULL),
 	['z'] = HANDLER_NORM(stats_memory,	false,	"oper:general"),
+	['Z'] = HANDLER_NORM(stats_ziplinks,	false,	"oper:general"),
 	['?'] = HANDLER_NORM(stats_servlinks,	false,	NULL),
 };
 
@@ -288,6 +295,12 @@ stats_dns_servers (struct Client *source_p)
 	{
 		sendto_one_numeric(source_p, RPL_STATSDEBUG, "A %s", (char *)n->data);
 	}
+
+	/* counters are as of the previous query; fetch fresh ones for next time */
+	if(dns_cache_stats[0] != '\0')
+		sendto_one_numeric(source_p, RPL_STATSDEBUG, "A cache %s", dns_cache_stats);
+
+	refresh_dns_cache_stats();
 }
 
 static void
@@ -500,6 +513,86 @@ stats_events (struct Client *source_p)
 	rb_dump_events(stats_events_cb, source_p);
 }
 
+struct profile_row
+{
+	const char *kind;
+	const char *name;
+	const struct rb_histogram *hist;
+};
+
+struct profile_rows
+{
+	struct profile_row *row;
+	size_t count;
+	size_t alloc;
+};
+
+static void
+stats_profile_collect(const char *kind, const char *name, const struct rb_histogram *hist, void *data)
+{
+	struct profile_rows *rows = data;
+
+	if(rows->count == rows->alloc)
+	{
+		rows->alloc = rows->alloc ? rows->alloc * 2 : 64;
+		rows->row = rb_realloc(rows->row, rows->alloc * sizeof(*rows->row));
+	}
+
+	rows->row[rows->count].kind = kind;
+	rows->row[rows->count].name = name;
+	rows->row[rows->count].hist = hist;
+	rows->count++;
+}
+
+static int
+stats_profile_cmp(const void *a, const void *b)
+{
+	const struct profile_row *ra = a, *rb = b;
+
+	if(ra->hist->total_ns != rb->hist->total_ns)
+		return ra->hist->total_ns < rb->hist->total_ns ? 1 : -1;
+	return strcmp(ra->name, rb->name);
+}
+
+/* stats_profile()
+ *
+ * Everything the profiler has samples for, most expensive first.  Times
+ * are in microseconds; p50 and p99 are bucket bounds, see rb_histogram.
+ */
+static void
+stats_profile (struct Client *source_p)
+{
+	struct profile_rows rows = { NULL, 0, 0 };
+
+	if(profile_enabled)
+		sendto_one_numeric(source_p, RPL_STATSDEBUG,
+				   "w :Profiling enabled for %lld seconds",
+				   (long long)(rb_current_time() - profile_since()));
+	else
+		sendto_one_numeric(source_p, RPL_STATSDEBUG,
+				   "w :Profiling disabled, use PROFILE ON to enable");
+
+	profile_walk(stats_profile_collect, &rows);
+	if(rows.count > 1)
+		qsort(rows.row, rows.count, sizeof(*rows.row), stats_profile_cmp);
+
+	for(size_t i = 0; i < rows.count; i++)
+	{
+		const struct rb_histogram *hist = rows.row[i].hist;
+
+		sendto_one_numeric(source_p, RPL_STATSDEBUG,
+				   "w :%s %s calls %lu total %llu avg %llu p50 %llu p99 %llu max %llu",
+				   rows.row[i].kind, rows.row[i].name, hist->count,
+				   (unsigned long long)(hist->total_ns / 1000),
+				   (unsigned long long)(hist->total_ns / hist->count / 1000),
+				   (unsigned long long)(rb_histogram_percentile(hist, 50) / 1000),
+				   (unsigned long long)(rb_histogram_percentile(hist, 99) / 1000),
+				   (unsigned long long)(hist->max_ns / 1000));
+	}
+
+	rb_free(rows.row);
+}
+
 static void
 stats_prop_klines(struct Client *source_p)
 {
@@ -794,7 +887,7 @@ stats_oper(struct Client *source_p)
 		sendto_one_numeric(source_p, RPL_STATSOLINE,
 				form_str(RPL_STATSOLINE),
 				oper_p->username, oper_p->host, oper_p->name,
-				HasPrivilege(source_p, "oper:privs") ? oper_p->privset->name : "0", "-1");
+				HasPrivilegeId(source_p, PRIVID_OPER_PRIVS) ? oper_p->privset->name : "0", "-1");
 	}
 }
 
@@ -929,10 +1022,29 @@ stats_ssld_foreach(void *data, pid_t pid, int cli_count, enum ssld_status status
 			version);
 }
 
+static void
+stats_wsockd_foreach(void *data, pid_t pid, int cli_count, enum wsockd_status status,
+		     const struct wsockd_deflate_stats *deflate)
+{
+	struct Client *source_p = data;
+
+	sendto_one_numeric(source_p, RPL_STATSDEBUG,
+			"S :%u %c %u :wsockd deflate %" PRIu64 " refused %" PRIu64 " memory %zu"
+			" out %" PRIu64 "/%" PRIu64 " in %" PRIu64 "/%" PRIu64 " time %" PRIu64 "ms",
+			pid,
+			status == WSOCKD_DEAD ? 'D' : (status == WSOCKD_SHUTDOWN ? 'S' : 'A'),
+			cli_count,
+			deflate->negotiated, deflate->refused, deflate->memory,
+			deflate->deflate_out, deflate->deflate_in,
+			deflate->inflate_in, deflate->inflate_out,
+			deflate->ns / 1000000);
+}
+
 static void
 stats_ssld(struct Client *source_p)
 {
 	ssld_foreach_info(stats_ssld_foreach, source_p);
+	wsockd_foreach_info(stats_wsockd_foreach, source_p);
 }
 
 static void
@@ -1475,6 +1587,38 @@ stats_memory (struct Client *source_p)
 			   "z :Remote client Memory in use: %ld(%ld)",
 			   (long)remote_client_count,
 			   (long)remote_client_memory_used);
+
+	sendto_one_numeric(source_p, RPL_STATSDEBUG,
+			   "z :Log lines dropped: %lu", ilog_dropped());
+}
+
+static void
+stats_ziplinks (struct Client *source_p)
+{
+	rb_dlink_node *ptr;
+	struct Client *target_p;
+	struct ZipStats *zips;
+	int j = 0;
+
+	RB_DLINK_FOREACH (ptr, serv_list.head)
+	{
+		target_p = ptr->data;
+		zips = target_p->localClient->zipstats;
+		if(zips == NULL)
+			continue;
+
+		j++;
+		sendto_one_numeric(source_p, RPL_STATSDEBUG,
+				   "Z :ZipLinks stats for %s send[%.2f%% compression "
+				   "(%llu kB data/%llu kB wire)] recv[%.2f%% compression "
+				   "(%llu kB data/%llu kB wire)] cpu[%llu ms]",
+				   target_p->name,
+				   zips->out_ratio, zips->out >> 10, zips->out_wire >> 10,
+				   zips->in_ratio, zips->in >> 10, zips->in_wire >> 10,
+				   zips->ns / 1000000);
+	}
+
+	sendto_one_numeric(source_p, RPL_STATSDEBUG, "Z :%u ziplink(s)", j);
 }
 
 static void
@@ -1517,6 +1661,18 @@ stats_servlinks (struct Client *source_p)
 			(rb_current_time() > target_p->localClient->lasttime) ?
 			 (rb_current_time() - target_p->localClient->lasttime) : 0,
 			IsOperGeneral (source_p) ? show_capabilities (target_p) : "TS");
+
+		if(IsOperGeneral(source_p) && target_p->localClient->zipstats != NULL)
+		{
+			struct ZipStats *zips = target_p->localClient->zipstats;
+
+			sendto_one_numeric(source_p, RPL_STATSDEBUG,
+					   "? :%s zip: sent %llu/%llu (%.2f%%) recv %llu/%llu (%.2f%%) cpu %llums",
+					   target_p->name,
+					   zips->out_wire, zips->out, zips->out_ratio,
+					   zips->in_wire, zips->in, zips->in_ratio,
+					   zips->ns / 1000000);
+		}
 	}
 
 	sendto_one_numeric(source_p, RPL_STATSDEBUG,
@@ -75,7 +75,7 @@ mo_testline(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *sou
 	char *puser, *phost, *reason, *operreason;
 	char reasonbuf[BUFSIZE];
 
-	if (!HasPrivilege(source_p, "oper:testline"))
+	if (!HasPrivilegeId(source_p, PRIVID_OPER_TESTLINE))
 	{
 		sendto_one(source_p, form_str(ERR_NOPRIVS),
 			   me.name, source_p->name, "testline");
@@ -238,7 +238,7 @@ mo_testgecos(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *so
 {
 	struct ConfItem *aconf;
 
-	if (!HasPrivilege(source_p, "oper:testline"))
+	if (!HasPrivilegeId(source_p, PRIVID_OPER_TESTLINE))
 	{
 		sendto_one(source_p, form_str(ERR_NOPRIVS),
 			   me.name, source_p->name, "testline");
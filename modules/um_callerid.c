@@ -87,21 +87,6 @@ um_callerid_moddeinit(void)
 static const char um_callerid_desc[] =
 	"Provides usermodes +g and +G which restrict messages from unauthorized users.";
 
-static bool
-has_common_channel(struct Client *source_p, struct Client *target_p)
-{
-	rb_dlink_node *ptr;
-
-	RB_DLINK_FOREACH(ptr, source_p->user->channel.head)
-	{
-		struct membership *msptr = ptr->data;
-		if (IsMember(target_p, msptr->chptr))
-			return true;
-	}
-
-	return false;
-}
-
 static bool
 allow_message(struct Client *source_p, struct Client *target_p)
 {
@@ -111,9 +96,6 @@ allow_message(struct Client *source_p, struct Client *target_p)
 	if (!IsSetAnyCallerID(target_p))
 		return true;
 
-	if (IsSetRelaxedCallerID(target_p) && has_common_channel(source_p, target_p) && !IsSetStrictCallerID(target_p))
-		return true;
-
 	if (IsServer(source_p))
 		return true;
 
@@ -121,6 +103,10 @@ allow_message(struct Client *source_p, struct Client *target_p)
 	if (IsOperGeneral(source_p))
 		return true;
 
+	if (IsSetRelaxedCallerID(target_p) && !IsSetStrictCallerID(target_p) &&
+	    find_common_channel(source_p, target_p, 0) != NULL)
+		return true;
+
 	if (accept_message(source_p, target_p))
 		return true;
 
@@ -139,7 +139,7 @@ h_hdl_privmsg_user(void *vdata)
 
 static mapi_hfn_list_av1 um_regonlymsg_hfnlist[] = {
 	{ "invite", h_hdl_invite },
-	{ "privmsg_user", h_hdl_privmsg_user },
+	{ "privmsg_user", h_hdl_privmsg_user, HOOK_NORMAL, { .umodes = &user_modes['R'] } },
 	{ NULL, NULL }
 };
 
@@ -22,6 +22,10 @@
 
 #include "stdinc.h"
 
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
 #define MAXPASSFD 4
 #ifndef READBUF_SIZE
 #define READBUF_SIZE 16384
@@ -62,10 +66,23 @@ typedef struct _mod_ctl
 	rb_fde_t *F_pipe;
 	rb_dlink_list readq;
 	rb_dlink_list writeq;
+	rb_ring *ring;			/* plaintext channels to the ircd, if it set one up */
 } mod_ctl_t;
 
 static mod_ctl_t *mod_ctl;
 
+#ifdef HAVE_LIBZ
+typedef struct _zlib_stream
+{
+	z_stream instream;
+	z_stream outstream;
+	uint64_t ns;			/* time spent in zlib since the last stats */
+	bool stalled;			/* inflate stopped for the ircd to catch up */
+	size_t pending_len;
+	uint8_t pending[READBUF_SIZE];	/* input left over when it did */
+} zlib_stream_t;
+#endif
+
 typedef struct _conn
 {
 	rb_dlink_node node;
@@ -92,6 +109,7 @@ typedef struct _conn
 #define FLAG_SSL_W_WANTS_R 0x10	/* output needs to wait until input possible */
 #define FLAG_SSL_R_WANTS_W 0x20	/* input needs to wait until output possible */
 #define FLAG_ZIPSSL	0x40
+#define FLAG_ZIP_CORK	0x80	/* not reading the remote end until the ircd catches up */
 
 #define IsSSL(x) ((x)->flags & FLAG_SSL)
 #define IsZip(x) ((x)->flags & FLAG_ZIP)
@@ -100,6 +118,7 @@ typedef struct _conn
 #define IsSSLWWantsR(x) ((x)->flags & FLAG_SSL_W_WANTS_R)
 #define IsSSLRWantsW(x) ((x)->flags & FLAG_SSL_R_WANTS_W)
 #define IsZipSSL(x)	((x)->flags & FLAG_ZIPSSL)
+#define IsZipCork(x)	((x)->flags & FLAG_ZIP_CORK)
 
 #define SetSSL(x) ((x)->flags |= FLAG_SSL)
 #define SetZip(x) ((x)->flags |= FLAG_ZIP)
@@ -107,10 +126,12 @@ typedef struct _conn
 #define SetDead(x) ((x)->flags |= FLAG_DEAD)
 #define SetSSLWWantsR(x) ((x)->flags |= FLAG_SSL_W_WANTS_R)
 #define SetSSLRWantsW(x) ((x)->flags |= FLAG_SSL_R_WANTS_W)
+#define SetZipCork(x) ((x)->flags |= FLAG_ZIP_CORK)
 
 #define ClearCork(x) ((x)->flags &= ~FLAG_CORK)
 #define ClearSSLWWantsR(x) ((x)->flags &= ~FLAG_SSL_W_WANTS_R)
 #define ClearSSLRWantsW(x) ((x)->flags &= ~FLAG_SSL_R_WANTS_W)
+#define ClearZipCork(x) ((x)->flags &= ~FLAG_ZIP_CORK)
 
 #define NO_WAIT 0x0
 #define WAIT_PLAIN 0x1
@@ -135,7 +156,14 @@ static void mod_cmd_write_queue(mod_ctl_t * ctl, const void *data, size_t len);
 static const char *remote_closed = "Remote host closed the connection";
 static bool ssld_ssl_ok;
 static int certfp_method = RB_SSL_CERTFP_METH_CERT_SHA1;
+#ifdef HAVE_LIBZ
+static bool zlib_ok = true;
+#else
 static bool zlib_ok = false;
+#endif
+
+/* stop reading the remote end while this much inflated data waits for the ircd */
+#define PLAIN_BACKLOG_MAX	(64 * 1024)
 
 
 static conn_t *
@@ -165,6 +193,16 @@ free_conn(conn_t * conn)
 {
 	rb_free_rawbuffer(conn->modbuf_out);
 	rb_free_rawbuffer(conn->plainbuf_out);
+#ifdef HAVE_LIBZ
+	if(IsZip(conn))
+	{
+		zlib_stream_t *stream = conn->stream;
+
+		inflateEnd(&stream->instream);
+		deflateEnd(&stream->outstream);
+		rb_free(stream);
+	}
+#endif
 	rb_free(conn);
 }
 
@@ -321,9 +359,26 @@ conn_mod_write(conn_t * conn, void *data, size_t len)
 static void
 conn_plain_write(conn_t * conn, void *data, size_t len)
 {
+	int retlen;
+
 	if(IsDead(conn))	/* again no point in queueing to dead men */
 		return;
-	rb_rawbuf_append(conn->plainbuf_out, data, len);
+
+	/* with nothing queued ahead of it, hand it to the ircd right away
+	 * instead of copying it into plainbuf_out and flushing later */
+	if(rb_rawbuf_length(conn->plainbuf_out) == 0)
+	{
+		retlen = rb_write(conn->plain_fd, data, len);
+		if(retlen > 0)
+		{
+			conn->plain_out += retlen;
+			data = (char *) data + retlen;
+			len -= retlen;
+		}
+	}
+
+	if(len > 0)
+		rb_rawbuf_append(conn->plainbuf_out, data, len);
 }
 
 static void
@@ -355,6 +410,98 @@ plain_check_cork(conn_t * conn)
 	return false;
 }
 
+#ifdef HAVE_LIBZ
+/*
+ * zlib_deflate
+ *
+ * Compress what the ircd sent and queue it for the remote end.  Each
+ * read is flushed on its own, so nothing waits for more data to come.
+ */
+static void
+zlib_deflate(conn_t * conn, void *buf, size_t len)
+{
+	zlib_stream_t *stream = conn->stream;
+	z_stream *outstream = &stream->outstream;
+	uint8_t outbuf[READBUF_SIZE];
+	uint64_t start = rb_monotonic_ns();
+	int ret;
+
+	outstream->next_in = buf;
+	outstream->avail_in = len;
+
+	do
+	{
+		outstream->next_out = outbuf;
+		outstream->avail_out = sizeof(outbuf);
+
+		ret = deflate(outstream, Z_SYNC_FLUSH);
+		if(ret != Z_OK && ret != Z_BUF_ERROR)
+		{
+			stream->ns += rb_monotonic_ns() - start;
+			close_conn(conn, WAIT_PLAIN, "Deflate failed: %s", zError(ret));
+			return;
+		}
+
+		conn_mod_write(conn, outbuf, sizeof(outbuf) - outstream->avail_out);
+	}
+	while(outstream->avail_out == 0);
+
+	stream->ns += rb_monotonic_ns() - start;
+}
+
+/*
+ * zlib_inflate
+ *
+ * Inflate data from the remote end and queue it for the ircd.  A burst
+ * can inflate a very long way, so once PLAIN_BACKLOG_MAX is queued the
+ * rest of the input is kept back and the remote end is not read again
+ * until the ircd has taken some of it in.
+ */
+static void
+zlib_inflate(conn_t * conn, void *buf, size_t len)
+{
+	zlib_stream_t *stream = conn->stream;
+	z_stream *instream = &stream->instream;
+	uint8_t outbuf[READBUF_SIZE];
+	uint64_t start = rb_monotonic_ns();
+	int ret;
+
+	instream->next_in = buf;
+	instream->avail_in = len;
+
+	do
+	{
+		instream->next_out = outbuf;
+		instream->avail_out = sizeof(outbuf);
+
+		ret = inflate(instream, Z_NO_FLUSH);
+		if(ret != Z_OK && ret != Z_BUF_ERROR)
+		{
+			stream->ns += rb_monotonic_ns() - start;
+			if(len > 6 && !memcmp("ERROR ", buf, 6))
+				close_conn(conn, WAIT_PLAIN, "Received uncompressed ERROR");
+			else
+				close_conn(conn, WAIT_PLAIN, "Inflate failed: %s", zError(ret));
+			return;
+		}
+
+		conn_plain_write(conn, outbuf, sizeof(outbuf) - instream->avail_out);
+	}
+	while((instream->avail_in > 0 || instream->avail_out == 0) &&
+		rb_rawbuf_length(conn->plainbuf_out) < PLAIN_BACKLOG_MAX);
+
+	stream->ns += rb_monotonic_ns() - start;
+
+	if(rb_rawbuf_length(conn->plainbuf_out) >= PLAIN_BACKLOG_MAX)
+	{
+		memmove(stream->pending, instream->next_in, instream->avail_in);
+		stream->pending_len = instream->avail_in;
+		stream->stalled = instream->avail_in > 0 || instream->avail_out == 0;
+		SetZipCork(conn);
+		rb_setselect(conn->mod_fd, RB_SELECT_READ, NULL, NULL);
+	}
+}
+#endif
 
 static void
 conn_plain_read_cb(rb_fde_t *fd, void *data)
@@ -392,11 +539,24 @@ conn_plain_read_cb(rb_fde_t *fd, void *data)
 		}
 		conn->plain_in += length;
 
-		conn_mod_write(conn, inbuf, length);
+#ifdef HAVE_LIBZ
+		if(IsZip(conn))
+			zlib_deflate(conn, inbuf, length);
+		else
+#endif
+			conn_mod_write(conn, inbuf, length);
 		if(IsDead(conn))
 			return;
 		if(plain_check_cork(conn))
 			return;
+
+		/* bail if short read, the ircd's end has nothing more for now */
+		if(length < (int) sizeof(inbuf))
+		{
+			rb_setselect(conn->plain_fd, RB_SELECT_READ, conn_plain_read_cb, conn);
+			conn_mod_write_sendq(conn->mod_fd, conn);
+			return;
+		}
 	}
 }
 
@@ -448,6 +608,21 @@ conn_mod_read_cb(rb_fde_t *fd, void *data)
 			return;
 	}
 
+#ifdef HAVE_LIBZ
+	if(IsZip(conn) && ((zlib_stream_t *) conn->stream)->stalled)
+	{
+		zlib_stream_t *stream = conn->stream;
+
+		stream->stalled = false;
+		zlib_inflate(conn, stream->pending, stream->pending_len);
+		if(IsZipCork(conn))
+		{
+			conn_plain_write_sendq(conn->plain_fd, conn);
+			return;
+		}
+	}
+#endif
+
 	while(1)
 	{
 		if(IsDead(conn))
@@ -485,6 +660,19 @@ conn_mod_read_cb(rb_fde_t *fd, void *data)
 			return;
 		}
 		conn->mod_in += length;
+#ifdef HAVE_LIBZ
+		if(IsZip(conn))
+		{
+			zlib_inflate(conn, inbuf, length);
+			if(IsZipCork(conn))
+			{
+				/* try to write */
+				conn_plain_write_sendq(conn->plain_fd, conn);
+				return;
+			}
+			continue;
+		}
+#endif
 		conn_plain_write(conn, inbuf, length);
 	}
 }
@@ -513,6 +701,12 @@ conn_plain_write_sendq(rb_fde_t *fd, void *data)
 		rb_setselect(conn->plain_fd, RB_SELECT_WRITE, conn_plain_write_sendq, conn);
 	else
 		rb_setselect(conn->plain_fd, RB_SELECT_WRITE, NULL, NULL);
+
+	if(IsZipCork(conn) && rb_rawbuf_length(conn->plainbuf_out) < PLAIN_BACKLOG_MAX / 2)
+	{
+		ClearZipCork(conn);
+		conn_mod_read_cb(conn->mod_fd, conn);
+	}
 }
 
 static int
@@ -631,6 +825,52 @@ cleanup_bad_message(mod_ctl_t * ctl, mod_ctl_buf_t * ctlb)
 		rb_close(ctlb->F[i]);
 }
 
+/*
+ * ring_plain_fd
+ *
+ * A connection handed over with only its remote end has its plaintext
+ * end on the ring, under the connection id: open that into the message
+ * in place of a passed descriptor.  If there is no ring to open it on,
+ * the connection is dropped and false returned.
+ */
+static bool
+ring_plain_fd(mod_ctl_t * ctl, mod_ctl_buf_t * ctlb)
+{
+	static const char *reason = "no ring channel for the plaintext side";
+	uint8_t buf[256];
+
+	if(ctlb->nfds == 2)
+		return true;
+
+	if(ctl->ring != NULL)
+		ctlb->F[1] = rb_ring_open(ctl->ring, buf_to_uint32(&ctlb->buf[1]), "ircd ring channel");
+	if(ctlb->F[1] != NULL)
+	{
+		ctlb->nfds = 2;
+		return true;
+	}
+
+	cleanup_bad_message(ctl, ctlb);
+	buf[0] = 'D';
+	memcpy(&buf[1], &ctlb->buf[1], 4);
+	rb_strlcpy((char *) &buf[5], reason, sizeof(buf) - 5);
+	mod_cmd_write_queue(ctl, buf, strlen(reason) + 1 + 5);
+	return false;
+}
+
+static void
+ssl_process_ring(mod_ctl_t * ctl, mod_ctl_buf_t * ctlb)
+{
+	char reply[2] = { 'R', '0' };
+
+	if(ctl->ring != NULL)
+		cleanup_bad_message(ctl, ctlb);
+	else if((ctl->ring = rb_ring_attach(ctlb->F)) != NULL)
+		reply[1] = '1';
+
+	mod_cmd_write_queue(ctl, reply, sizeof(reply));
+}
+
 static void
 ssl_process_accept(mod_ctl_t * ctl, mod_ctl_buf_t * ctlb)
 {
@@ -679,6 +919,81 @@ ssl_process_connect(mod_ctl_t * ctl, mod_ctl_buf_t * ctlb)
 	rb_ssl_start_connected(ctlb->F[0], ssl_process_connect_cb, conn, 10);
 }
 
+#ifdef HAVE_LIBZ
+/*
+ * zlib_process
+ *
+ * Start compressing a server link.  The message is the connection id,
+ * the compression level, the length of what the ircd had already read
+ * from the link and that data, then anything the ircd could not get
+ * written before handing the link over, which still goes out as is.
+ */
+static void
+zlib_process(mod_ctl_t * ctl, mod_ctl_buf_t * ctlb)
+{
+	static const size_t hdr = 1 + sizeof(uint32_t) + 1 + sizeof(uint16_t);
+	zlib_stream_t *stream;
+	conn_t *conn;
+	uint16_t recvqlen;
+	uint8_t level;
+	uint32_t id;
+
+	conn = make_conn(ctl, ctlb->F[0], ctlb->F[1]);
+	if(rb_get_type(conn->mod_fd) == RB_FD_UNKNOWN)
+		rb_set_type(conn->mod_fd, RB_FD_SOCKET);
+
+	if(rb_get_type(conn->plain_fd) == RB_FD_UNKNOWN)
+		rb_set_type(conn->plain_fd, RB_FD_SOCKET);
+
+	id = buf_to_uint32(&ctlb->buf[1]);
+	conn_add_id_hash(conn, id);
+
+	level = ctlb->buf[5];
+	memcpy(&recvqlen, &ctlb->buf[6], sizeof(recvqlen));
+
+	if(hdr + recvqlen > ctlb->buflen)
+	{
+		close_conn(conn, WAIT_PLAIN, "Bad zlib setup from ircd");
+		return;
+	}
+
+	stream = rb_malloc(sizeof(zlib_stream_t));
+	if(inflateInit2(&stream->instream, MAX_WBITS) != Z_OK)
+	{
+		rb_free(stream);
+		close_conn(conn, WAIT_PLAIN, "Unable to set up zlib");
+		return;
+	}
+	if(deflateInit(&stream->outstream, level) != Z_OK)
+	{
+		inflateEnd(&stream->instream);
+		rb_free(stream);
+		close_conn(conn, WAIT_PLAIN, "Unable to set up zlib");
+		return;
+	}
+
+	conn->stream = stream;
+	SetZip(conn);
+
+	if(ctlb->buflen > hdr + recvqlen)
+		conn_mod_write(conn, &ctlb->buf[hdr + recvqlen], ctlb->buflen - hdr - recvqlen);
+
+	if(recvqlen > 0)
+	{
+		conn->mod_in += recvqlen;
+		zlib_inflate(conn, &ctlb->buf[hdr], recvqlen);
+		if(IsDead(conn))
+			return;
+	}
+
+	if(IsZipCork(conn))
+		conn_plain_write_sendq(conn->plain_fd, conn);
+	else
+		conn_mod_read_cb(conn->mod_fd, conn);
+	conn_plain_read_cb(conn->plain_fd, conn);
+}
+#endif
+
 static void
 process_stats(mod_ctl_t * ctl, mod_ctl_buf_t * ctlb)
 {
@@ -686,6 +1001,7 @@ process_stats(mod_ctl_t * ctl, mod_ctl_buf_t * ctlb)
 	conn_t *conn;
 	uint8_t *odata;
 	uint32_t id;
+	uint64_t ns = 0;
 
 	id = buf_to_uint32(&ctlb->buf[1]);
 
@@ -695,11 +1011,22 @@ process_stats(mod_ctl_t * ctl, mod_ctl_buf_t * ctlb)
 	if(conn == NULL)
 		return;
 
-	snprintf(outstat, sizeof(outstat), "S %s %llu %llu %llu %llu", odata,
+#ifdef HAVE_LIBZ
+
+	if(IsZip(conn))
+		ns = ((zlib_stream_t *) conn->stream)->ns;
+#endif
+
+	snprintf(outstat, sizeof(outstat), "S %s %llu %llu %llu %llu %llu", odata,
 			(unsigned long long)conn->plain_out,
 			(unsigned long long)conn->mod_in,
 			(unsigned long long)conn->plain_in,
-			(unsigned long long)conn->mod_out);
+			(unsigned long long)conn->mod_out,
+			(unsigned long long)ns);
+#ifdef HAVE_LIBZ
+	if(IsZip(conn))
+		((zlib_stream_t *) conn->stream)->ns = 0;
+#endif
 	conn->plain_out = 0;
 	conn->plain_in = 0;
 	conn->mod_in = 0;
@@ -802,12 +1129,15 @@ mod_process_cmd_recv(mod_ctl_t * ctl)
 		{
 		case 'A':
 			{
-				if (ctl_buf->nfds != 2 || ctl_buf->buflen != 5)
+				if ((ctl_buf->nfds != 2 && ctl_buf->nfds != 1) || ctl_buf->buflen != 5)
 				{
 					cleanup_bad_message(ctl, ctl_buf);
 					break;
 				}
 
+				if(!ring_plain_fd(ctl, ctl_buf))
+					break;
+
 				if(!ssld_ssl_ok)
 				{
 					send_nossl_support(ctl, ctl_buf);
@@ -852,6 +1182,16 @@ mod_process_cmd_recv(mod_ctl_t * ctl)
 				ssl_new_keys(ctl, ctl_buf);
 				break;
 			}
+		case 'R':
+			{
+				if (ctl_buf->nfds != RB_RING_FDS)
+				{
+					cleanup_bad_message(ctl, ctl_buf);
+					break;
+				}
+				ssl_process_ring(ctl, ctl_buf);
+				break;
+			}
 		case 'S':
 			{
 				process_stats(ctl, ctl_buf);
@@ -859,8 +1199,19 @@ mod_process_cmd_recv(mod_ctl_t * ctl)
 			}
 
 		case 'Z':
-			send_nozlib_support(ctl, ctl_buf);
-			break;
+			{
+				if (ctl_buf->nfds != 2 || ctl_buf->buflen < 8)
+				{
+					cleanup_bad_message(ctl, ctl_buf);
+					break;
+				}
+#ifdef HAVE_LIBZ
+				zlib_process(ctl, ctl_buf);
+#else
+				send_nozlib_support(ctl, ctl_buf);
+#endif
+				break;
+			}
 
 		default:
 			break;
@@ -0,0 +1,149 @@
+/*
+ * tests/test_buffers.c
+ * Copyright (c) 2026 Ophion development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Checks the librb raw and line buffers with data that arrives and is
+ * taken out in pieces of random size, the way wsockd and the ircd use
+ * them: every byte has to come out once, in order, and the queued length
+ * has to agree with what is left.
+ */
+
+#include "rb_lib.h"
+#include "unittest.h"
+
+#define STREAM_LEN	(2 * 1024 * 1024)
+#define MAX_PIECE	3000
+#define LINES		3000
+#define MAX_LINE	510
+
+static unsigned char stream[STREAM_LEN];
+static unsigned char out[STREAM_LEN];
+
+static void
+test_rawbuf(void)
+{
+	rawbuf_head_t *rb = rb_new_rawbuffer();
+	size_t in = 0, taken = 0;
+	int got;
+
+	for(size_t i = 0; i < STREAM_LEN; i++)
+		stream[i] = test_rand();
+
+	while(taken < STREAM_LEN)
+	{
+		size_t n = 1 + test_rand() % MAX_PIECE;
+
+		/* feed a little more now and then, so the queue grows and shrinks */
+		if(in < STREAM_LEN && test_rand() % 3 != 0)
+		{
+			if(n > STREAM_LEN - in)
+				n = STREAM_LEN - in;
+			rb_rawbuf_append(rb, stream + in, n);
+			in += n;
+		}
+
+		/* ask for more than is queued about as often as for less */
+		n = 1 + test_rand() % MAX_PIECE;
+		if(n > STREAM_LEN - taken)
+			n = STREAM_LEN - taken;
+		got = rb_rawbuf_get(rb, out + taken, n);
+		CHECK(got >= 0 && (size_t)got <= n);
+		if(got > 0)
+			taken += got;
+
+		if(!CHECK((size_t)rb_rawbuf_length(rb) == in - taken))
+			break;
+	}
+
+	CHECK(memcmp(stream, out, STREAM_LEN) == 0);
+	CHECK(rb_rawbuf_length(rb) == 0);
+	CHECK(rb_rawbuf_get(rb, out, 1) == 0);
+	rb_free_rawbuffer(rb);
+}
+
+static void
+test_linebuf(void)
+{
+	static char *lines[LINES];
+	buf_head_t lb;
+	char buf[MAX_LINE + 1];
+	size_t len = 0, pos = 0;
+	int next = 0, got;
+
+	for(int i = 0; i < LINES; i++)
+	{
+		size_t n = 1 + test_rand() % MAX_LINE;
+
+		lines[i] = rb_malloc(n + 1);
+		for(size_t j = 0; j < n; j++)
+			lines[i][j] = 'a' + test_rand() % 26;
+
+		memcpy(stream + len, lines[i], n);
+		len += n;
+		memcpy(stream + len, "\r\n", 2);
+		len += 2;
+	}
+
+	rb_linebuf_newbuf(&lb);
+
+	while(pos < len)
+	{
+		size_t n = 1 + test_rand() % MAX_PIECE;
+
+		if(n > len - pos)
+			n = len - pos;
+		rb_linebuf_parse(&lb, (char *)stream + pos, n, 0);
+		pos += n;
+
+		while((got = rb_linebuf_get(&lb, buf, sizeof buf, LINEBUF_COMPLETE, LINEBUF_PARSED)) > 0)
+		{
+			if(!CHECK(next < LINES && strcmp(buf, lines[next]) == 0))
+				fprintf(stderr, "  line %d differs\n", next);
+			next++;
+		}
+	}
+
+	CHECK(next == LINES);
+	CHECK(rb_linebuf_len(&lb) == 0);
+
+	rb_linebuf_donebuf(&lb);
+	for(int i = 0; i < LINES; i++)
+		rb_free(lines[i]);
+}
+
+int
+main(int argc, char *argv[])
+{
+	test_init();
+
+	test_rawbuf();
+	test_linebuf();
+
+	return test_done("buffers");
+}
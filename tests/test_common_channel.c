@@ -0,0 +1,142 @@
+/*
+ * tests/test_common_channel.c
+ * Copyright (c) 2026 Ophion development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Checks find_common_channel() against a plain table of who is on which
+ * channel, through a long run of random joins and parts.  There are more
+ * channels than summary bits, so channels share bits and the summaries go
+ * stale on parts, which are the cases the query has to get right.
+ */
+
+#include "stdinc.h"
+#include "client.h"
+#include "channel.h"
+#include "hook.h"
+#include "unittest.h"
+
+#define USERS		50
+#define CHANNELS	300
+#define ROUNDS		50000
+
+/* what the table holds for each user and channel */
+#define NOT_ON		0
+#define ON		1
+#define OPPED		2
+
+static struct Client *users[USERS];
+static struct Channel *channels[CHANNELS];
+static unsigned char table[USERS][CHANNELS];
+
+static struct Client *
+new_user(void)
+{
+	struct Client *client_p = rb_malloc(sizeof(struct Client));
+
+	client_p->user = rb_malloc(sizeof(struct User));
+	client_p->status = STAT_CLIENT;
+	return client_p;
+}
+
+static void
+check_query(int a, int b)
+{
+	struct Channel *chptr;
+	struct membership *msptr;
+	bool common = false, common_opped = false;
+
+	for(int c = 0; c < CHANNELS; c++)
+	{
+		if(table[a][c] == NOT_ON || table[b][c] == NOT_ON)
+			continue;
+		common = true;
+		if(table[a][c] == OPPED)
+			common_opped = true;
+	}
+
+	chptr = find_common_channel(users[a], users[b], 0);
+	CHECK((chptr != NULL) == common);
+	if(chptr != NULL)
+		CHECK(find_channel_membership(chptr, users[b]) != NULL);
+
+	chptr = find_common_channel(users[a], users[b], CHFL_CHANOP);
+	CHECK((chptr != NULL) == common_opped);
+	if(chptr != NULL)
+	{
+		msptr = find_channel_membership(chptr, users[a]);
+		CHECK(msptr != NULL && (msptr->flags & CHFL_CHANOP));
+		CHECK(find_channel_membership(chptr, users[b]) != NULL);
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct membership *msptr;
+	char name[16];
+
+	test_init();
+	init_hook();
+	init_channels();
+
+	for(int u = 0; u < USERS; u++)
+		users[u] = new_user();
+
+	for(int c = 0; c < CHANNELS; c++)
+	{
+		snprintf(name, sizeof name, "#c%d", c);
+		channels[c] = allocate_channel(name);
+		/* kept when the last member parts, so the table stays valid */
+		channels[c]->mode.mode = MODE_PERMANENT;
+	}
+
+	for(int r = 0; r < ROUNDS; r++)
+	{
+		int u = test_rand() % USERS, c = test_rand() % CHANNELS;
+
+		if((msptr = find_channel_membership(channels[c], users[u])) != NULL)
+		{
+			remove_user_from_channel(msptr);
+			table[u][c] = NOT_ON;
+		}
+		else if(test_rand() % 2)
+		{
+			add_user_to_channel(channels[c], users[u], CHFL_CHANOP);
+			table[u][c] = OPPED;
+		}
+		else
+		{
+			add_user_to_channel(channels[c], users[u], 0);
+			table[u][c] = ON;
+		}
+
+		check_query(test_rand() % USERS, test_rand() % USERS);
+	}
+
+	return test_done("common_channel");
+}
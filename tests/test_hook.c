@@ -0,0 +1,97 @@
+/*
+ * tests/test_hook.c
+ * Copyright (c) 2026 Ophion development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Checks that hook functions can add and remove hooks, and register
+ * enough new ones to move the hook table, while the hook that called them
+ * is running.  Best run under a memory checker.
+ */
+
+#include "stdinc.h"
+#include "hook.h"
+#include "unittest.h"
+
+static int h_test;
+static int first_calls, second_calls, extra_calls;
+
+static void
+second_fn(void *arg)
+{
+	second_calls++;
+}
+
+static void
+extra_fn(void *arg)
+{
+	extra_calls++;
+}
+
+/* removes itself, adds second_fn and fills the hook table */
+static void
+first_fn(void *arg)
+{
+	char name[32];
+
+	first_calls++;
+	remove_hook("test", first_fn);
+	add_hook("test", second_fn);
+
+	for(int i = 0; i < 2000; i++)
+	{
+		snprintf(name, sizeof name, "test%d", i);
+		add_hook(name, extra_fn);
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	test_init();
+	init_hook();
+
+	h_test = register_hook("test");
+	add_hook("test", first_fn);
+	add_hook("test", extra_fn);
+
+	/* extra_fn was in the list first_fn started with, second_fn wasn't */
+	call_hook(h_test, NULL);
+	CHECK(first_calls == 1);
+	CHECK(second_calls == 0);
+	CHECK(extra_calls == 1);
+
+	call_hook(h_test, NULL);
+	CHECK(first_calls == 1);
+	CHECK(second_calls == 1);
+	CHECK(extra_calls == 2);
+
+	call_hook(register_hook("test1999"), NULL);
+	CHECK(extra_calls == 3);
+
+	return test_done("hook");
+}
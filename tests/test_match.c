@@ -0,0 +1,135 @@
+/*
+ * tests/test_match.c
+ * Copyright (c) 2026 Ophion development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Checks that match_compiled() gives the same answer as match(): first on
+ * a table of masks picked to hit each path of the compiled matcher, then
+ * on random masks and names over a small alphabet, where stars, question
+ * marks and near misses are common.
+ */
+
+#include "stdinc.h"
+#include "match.h"
+#include "unittest.h"
+
+#define RANDOM_PAIRS	1000000
+
+static const struct
+{
+	const char *mask;
+	const char *name;
+	int result;
+} cases[] = {
+	{ "", "", 1 },
+	{ "", "a", 0 },
+	{ "*", "", 1 },
+	{ "*", "anything", 1 },
+	{ "?", "", 0 },
+	{ "?", "x", 1 },
+	{ "???", "ab", 0 },
+	{ "nick!user@host", "NICK!User@Host", 1 },
+	{ "nick!user@host", "nick!user@hos", 0 },
+	{ "[nick]", "{NICK}", 1 },
+	{ "*!*@*.example.*", "nick!foobar@host.example.org", 1 },
+	{ "*!*@*.example.*", "nick!foobar@host.example", 0 },
+	{ "*!*foo*@*", "nick!foobar@host.example.org", 1 },
+	{ "nick*!*bar*@*", "nick!foobar@host.example.org", 1 },
+	{ "nick*!*baz*@*", "nick!foobar@host.example.org", 0 },
+	{ "*a?c*", "xxabcxx", 1 },
+	{ "*a?c*", "xxacxx", 0 },
+	{ "a*a", "a", 0 },
+	{ "a*a", "aa", 1 },
+	{ "*aab", "aaaab", 1 },
+	{ "*ab*ab", "abab", 1 },
+	{ "*ab*ab", "aba", 0 },
+	{ "*??*??", "abc", 0 },
+	{ "*??*??", "abcd", 1 },
+	{ "*!*@198.51.*", "x!y@198.51.100.7", 1 },
+	{ "*!*@198.51.*", "x!y@198.52.100.7", 0 },
+};
+
+static void
+check_pair(const char *mask, const char *name)
+{
+	struct match_prog *prog = match_compile(mask);
+	int expect = match(mask, name) != 0;
+
+	if(!CHECK((match_compiled(prog, name) != 0) == expect))
+		fprintf(stderr, "  mask \"%s\" name \"%s\": match() gives %d\n", mask, name, expect);
+	match_free(prog);
+}
+
+static void
+random_string(char *buf, size_t maxlen, const char *alphabet)
+{
+	size_t len = test_rand() % (maxlen + 1);
+	size_t n = strlen(alphabet);
+
+	for(size_t i = 0; i < len; i++)
+		buf[i] = alphabet[test_rand() % n];
+	buf[len] = '\0';
+}
+
+int
+main(int argc, char *argv[])
+{
+	char mask[16], name[24], *longname;
+	struct match_prog *prog;
+
+	test_init();
+
+	for(size_t i = 0; i < ARRAY_SIZE(cases); i++)
+	{
+		prog = match_compile(cases[i].mask);
+		if(!CHECK(match_compiled(prog, cases[i].name) == cases[i].result) ||
+		   !CHECK(match(cases[i].mask, cases[i].name) == cases[i].result))
+			fprintf(stderr, "  mask \"%s\" name \"%s\"\n", cases[i].mask, cases[i].name);
+		match_free(prog);
+	}
+
+	/* upper and lower case letters, so folding matters, plus the wildcards
+	 * and some punctuation that names can't hold */
+	for(size_t i = 0; i < RANDOM_PAIRS; i++)
+	{
+		random_string(mask, sizeof(mask) - 1, "abAB*?!@.");
+		random_string(name, sizeof(name) - 1, "abAB!@.");
+		check_pair(mask, name);
+	}
+
+	/* names too long for match_compiled()'s stack buffer */
+	longname = rb_malloc(BUFSIZE * 2 + 1);
+	memset(longname, 'a', BUFSIZE * 2);
+	longname[BUFSIZE * 2 - 1] = 'b';
+	check_pair("*ab", longname);
+	check_pair("a*b*", longname);
+	check_pair("*ba*", longname);
+	rb_free(longname);
+
+	return test_done("match");
+}
@@ -0,0 +1,245 @@
+/*
+ * tests/test_ssld.c
+ * Copyright (c) 2026 Ophion development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Checks the compressed server link handling in ssld, which is built into
+ * the test with its main() renamed: the handover, where the ircd passes
+ * along compressed data it had already read and plain data it had not yet
+ * sent, and the backlog limit that stops a burst from being inflated all
+ * at once while the ircd isn't keeping up.
+ */
+
+#define main ssld_main
+#include "../ssld/ssld.c"
+#undef main
+
+#include "unittest.h"
+
+#ifdef HAVE_LIBZ
+
+#define BURST_LEN	(2 * 1024 * 1024)
+
+static uint8_t burst[BURST_LEN];
+static uint8_t zburst[BURST_LEN];
+static uint8_t out[BURST_LEN];
+
+/* a link, and the far ends of its sockets: the server and the ircd */
+struct test_link
+{
+	conn_t *conn;
+	rb_fde_t *remote;
+	rb_fde_t *ircd;
+	rb_fde_t *ctl_peer;
+};
+
+static size_t
+drain(rb_fde_t *F, uint8_t *buf, size_t len, size_t size)
+{
+	ssize_t n;
+
+	while(len < size && (n = rb_read(F, buf + len, size - len)) > 0)
+		len += n;
+	return len;
+}
+
+static size_t
+compress_all(z_stream *z, const void *data, size_t len, uint8_t *zbuf, size_t size)
+{
+	z->next_in = (Bytef *)data;
+	z->avail_in = len;
+	z->next_out = zbuf;
+	z->avail_out = size;
+	deflate(z, Z_SYNC_FLUSH);
+	return size - z->avail_out;
+}
+
+/* hand a link over with a 'Z' command, as start_zlib_session() does */
+static void
+start_link(struct test_link *tl, const uint8_t *recvq, uint16_t recvqlen, const char *sendq)
+{
+	mod_ctl_t *ctl = rb_malloc(sizeof(mod_ctl_t));
+	mod_ctl_buf_t ctlb;
+	uint8_t buf[READBUF_SIZE];
+	size_t sendqlen = strlen(sendq);
+	uint32_t id = 42;
+
+	rb_socketpair(AF_UNIX, SOCK_STREAM, 0, &ctlb.F[0], &tl->remote, "test remote");
+	rb_socketpair(AF_UNIX, SOCK_STREAM, 0, &ctlb.F[1], &tl->ircd, "test ircd");
+	rb_socketpair(AF_UNIX, SOCK_DGRAM, 0, &ctl->F, &tl->ctl_peer, "test ctl");
+	rb_set_nb(tl->remote);
+	rb_set_nb(tl->ircd);
+
+	buf[0] = 'Z';
+	uint32_to_buf(&buf[1], id);
+	buf[5] = 6;
+	memcpy(&buf[6], &recvqlen, sizeof(recvqlen));
+	if(recvqlen > 0)
+		memcpy(&buf[8], recvq, recvqlen);
+	memcpy(&buf[8 + recvqlen], sendq, sendqlen);
+
+	ctlb.buf = buf;
+	ctlb.buflen = 8 + recvqlen + sendqlen;
+	ctlb.nfds = 2;
+	zlib_process(ctl, &ctlb);
+
+	tl->conn = conn_find_by_id(id);
+}
+
+static void
+free_link(struct test_link *tl)
+{
+	mod_ctl_t *ctl = tl->conn->ctl;
+
+	close_conn(tl->conn, NO_WAIT, NULL);
+	clean_dead_conns(NULL);
+	rb_close(tl->remote);
+	rb_close(tl->ircd);
+	rb_close(tl->ctl_peer);
+	rb_close(ctl->F);
+	rb_free(ctl);
+}
+
+static void
+test_handover(void)
+{
+	static const char lines[] = "PASS x TS 6 :00A\r\nCAPAB :ZIP\r\nSERVER a 1 :a\r\n";
+	static const char more[] = "SVINFO 6 6 0 :0\r\nPING :a\r\n";
+	static const char sendq[] = "SERVER b 1 :b\r\n";
+	struct test_link tl;
+	z_stream remote, check;
+	uint8_t zbuf[256], plain[256];
+	size_t zlen, len;
+
+	memset(&remote, 0, sizeof remote);
+	deflateInit(&remote, Z_DEFAULT_COMPRESSION);
+
+	/* what the ircd had read already, and what the remote end sends later */
+	zlen = compress_all(&remote, lines, strlen(lines), zbuf, sizeof zbuf);
+	start_link(&tl, zbuf, zlen, sendq);
+	if(!CHECK(tl.conn != NULL))
+		return;
+
+	zlen = compress_all(&remote, more, strlen(more), zbuf, sizeof zbuf);
+	rb_write(tl.remote, zbuf, zlen);
+	conn_mod_read_cb(tl.conn->mod_fd, tl.conn);
+
+	len = drain(tl.ircd, out, 0, sizeof out);
+	CHECK(len == strlen(lines) + strlen(more));
+	CHECK(memcmp(out, lines, strlen(lines)) == 0);
+	CHECK(memcmp(out + strlen(lines), more, strlen(more)) == 0);
+
+	/* the unsent sendq goes out as it was, compression starts after it */
+	rb_write(tl.ircd, more, strlen(more));
+	conn_plain_read_cb(tl.conn->plain_fd, tl.conn);
+	len = drain(tl.remote, out, 0, sizeof out);
+	CHECK(len > strlen(sendq) && memcmp(out, sendq, strlen(sendq)) == 0);
+
+	memset(&check, 0, sizeof check);
+	inflateInit(&check);
+	check.next_in = out + strlen(sendq);
+	check.avail_in = len - strlen(sendq);
+	check.next_out = plain;
+	check.avail_out = sizeof plain;
+	inflate(&check, Z_SYNC_FLUSH);
+	CHECK(sizeof plain - check.avail_out == strlen(more));
+	CHECK(memcmp(plain, more, strlen(more)) == 0);
+
+	inflateEnd(&check);
+	deflateEnd(&remote);
+	free_link(&tl);
+}
+
+static void
+test_backlog(void)
+{
+	struct test_link tl;
+	z_stream remote;
+	size_t zlen, zpos = 0, len = 0;
+	int sndbuf = 4096;
+
+	for(size_t i = 0; i < BURST_LEN; i++)
+		burst[i] = i % 80 == 79 ? '\n' : 'a' + i % 7;
+
+	memset(&remote, 0, sizeof remote);
+	deflateInit(&remote, Z_BEST_COMPRESSION);
+	zlen = compress_all(&remote, burst, BURST_LEN, zburst, sizeof zburst);
+	deflateEnd(&remote);
+
+	start_link(&tl, NULL, 0, "");
+	if(!CHECK(tl.conn != NULL))
+		return;
+
+	/* a small socket buffer towards the ircd, so the backlog builds */
+	setsockopt(rb_get_fd(tl.conn->plain_fd), SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof sndbuf);
+
+	while(zpos < zlen)
+	{
+		ssize_t n = rb_write(tl.remote, zburst + zpos, zlen - zpos);
+
+		if(n > 0)
+			zpos += n;
+		conn_mod_read_cb(tl.conn->mod_fd, tl.conn);
+		if(!CHECK(!IsDead(tl.conn)))
+			break;
+
+		/* the burst inflates to far more than the limit, so it is hit */
+		if(zpos == zlen)
+			CHECK(IsZipCork(tl.conn));
+		CHECK(rb_rawbuf_length(tl.conn->plainbuf_out) < PLAIN_BACKLOG_MAX + READBUF_SIZE);
+	}
+
+	/* the ircd catches up, and reading the remote end resumes */
+	for(int round = 0; len < BURST_LEN && round < 100000; round++)
+	{
+		len = drain(tl.ircd, out, len, sizeof out);
+		conn_plain_write_sendq(tl.conn->plain_fd, tl.conn);
+		if(!CHECK(!IsDead(tl.conn)))
+			break;
+		CHECK(rb_rawbuf_length(tl.conn->plainbuf_out) < PLAIN_BACKLOG_MAX + READBUF_SIZE);
+	}
+
+	CHECK(len == BURST_LEN);
+	CHECK(memcmp(out, burst, BURST_LEN) == 0);
+
+	free_link(&tl);
+}
+#endif
+
+int
+main(int argc, char *argv[])
+{
+	test_init();
+
+#ifdef HAVE_LIBZ
+	test_handover();
+	test_backlog();
+#endif
+
+	return test_done("ssld");
+}
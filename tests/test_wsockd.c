@@ -0,0 +1,324 @@
+/*
+ * tests/test_wsockd.c
+ * Copyright (c) 2026 Ophion development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Checks the wsockd frame parser.  Its pieces are static, so wsockd.c is
+ * built into the test with its main() renamed.  A stream of frames of
+ * every length form, fragmented messages with a ping in the middle and
+ * several lines to a frame is fed in pieces of random size, and what
+ * comes out on the plain side must be the lines that went in.
+ */
+
+#define main wsockd_main
+#include "../wsockd/wsockd.c"
+#undef main
+
+#include "unittest.h"
+
+#define BIG_FRAME	70000
+#define MAX_PIECE	300
+
+static const uint8_t test_mask[WEBSOCKET_MASK_LENGTH] = { 0x12, 0x34, 0x56, 0x78 };
+
+static uint8_t stream[2 * BIG_FRAME];
+static size_t stream_len;
+static char expect[2 * BIG_FRAME];
+static size_t expect_len;
+
+/* append a masked client frame, using the length form asked for */
+static void
+add_frame_rsv(int opcode, bool fin, int rsv, const char *payload, size_t len, int lenform)
+{
+	uint8_t *p = stream + stream_len;
+
+	*p++ = (fin ? 0x80 : 0) | rsv | opcode;
+	if(lenform == 0)
+		*p++ = 0x80 | len;
+	else if(lenform == 1)
+	{
+		*p++ = 0x80 | 126;
+		*p++ = len >> 8;
+		*p++ = len;
+	}
+	else
+	{
+		*p++ = 0x80 | 127;
+		for(int i = 7; i >= 0; i--)
+			*p++ = (uint64_t)len >> (8 * i);
+	}
+
+	memcpy(p, test_mask, sizeof(test_mask));
+	p += sizeof(test_mask);
+	for(size_t i = 0; i < len; i++)
+		*p++ = payload[i] ^ test_mask[i % WEBSOCKET_MASK_LENGTH];
+
+	stream_len = p - stream;
+}
+
+static void
+add_frame(int opcode, bool fin, const char *payload, size_t len, int lenform)
+{
+	add_frame_rsv(opcode, fin, 0, payload, len, lenform);
+}
+
+static void
+add_expect(const char *text, size_t len)
+{
+	memcpy(expect + expect_len, text, len);
+	expect_len += len;
+}
+
+/* a connection, and the far ends of its sockets that the ircd would hold */
+struct test_conn
+{
+	conn_t *conn;
+	rb_fde_t *mod_peer;
+	rb_fde_t *plain_peer;
+	rb_fde_t *ctl_peer;
+};
+
+static void
+make_test_conn(struct test_conn *tc)
+{
+	mod_ctl_t *ctl = rb_malloc(sizeof(mod_ctl_t));
+	rb_fde_t *mod_fd, *plain_fd;
+
+	rb_socketpair(AF_UNIX, SOCK_STREAM, 0, &mod_fd, &tc->mod_peer, "test mod");
+	rb_socketpair(AF_UNIX, SOCK_STREAM, 0, &plain_fd, &tc->plain_peer, "test plain");
+	rb_socketpair(AF_UNIX, SOCK_DGRAM, 0, &ctl->F, &tc->ctl_peer, "test ctl");
+	rb_set_nb(tc->mod_peer);
+	rb_set_nb(tc->plain_peer);
+
+	tc->conn = make_conn(ctl, mod_fd, plain_fd);
+	SetKeyed(tc->conn);
+}
+
+static void
+free_test_conn(struct test_conn *tc)
+{
+	mod_ctl_t *ctl = tc->conn->ctl;
+
+	if(!IsDead(tc->conn))
+	{
+		close_conn(tc->conn, NO_WAIT, NULL);
+		rb_close(tc->plain_peer);
+	}
+	else
+	{
+		/* closed with a reason, so waiting for the ircd to hang up */
+		rb_close(tc->plain_peer);
+		conn_plain_read_shutdown_cb(tc->conn->plain_fd, tc->conn);
+	}
+	clean_dead_conns(NULL);
+
+	rb_close(tc->mod_peer);
+	rb_close(tc->ctl_peer);
+	rb_close(ctl->F);
+	rb_free(ctl);
+}
+
+static size_t
+drain(rb_fde_t *F, char *buf, size_t len, size_t size)
+{
+	ssize_t n;
+
+	while(len < size && (n = rb_read(F, buf + len, size - len)) > 0)
+		len += n;
+	return len;
+}
+
+static void
+test_unmask(void)
+{
+	uint8_t buf[64], want[64];
+
+	for(int round = 0; round < 1000; round++)
+	{
+		size_t len = test_rand() % sizeof(buf);
+		uint64_t offset = test_rand() % 16;
+
+		for(size_t i = 0; i < len; i++)
+			buf[i] = want[i] = test_rand();
+		for(size_t i = 0; i < len; i++)
+			want[i] ^= test_mask[(offset + i) % WEBSOCKET_MASK_LENGTH];
+
+		ws_frame_unmask(buf, len, test_mask, offset);
+		CHECK(memcmp(buf, want, len) == 0);
+	}
+}
+
+static void
+test_stream(void)
+{
+	static char big[BIG_FRAME], out[2 * BIG_FRAME];
+	static const uint8_t pong[] = { 0x8a, 0x02, 'p', 'p' };
+	char modout[64];
+	struct test_conn tc;
+	conn_t *conn;
+	size_t pos = 0, outlen = 0, modlen;
+
+	make_test_conn(&tc);
+	conn = tc.conn;
+
+	/* the end of a message ends its line */
+	add_frame(WEBSOCKET_OPCODE_TEXT_FRAME, true, "NICK a", 6, 0);
+	add_expect("NICK a\r\n", 8);
+
+	/* two lines to a frame */
+	add_frame(WEBSOCKET_OPCODE_TEXT_FRAME, true, "USER a\r\nPING :x\r\n", 17, 0);
+	add_expect("USER a\r\nPING :x\r\n", 17);
+
+	/* a line over three fragments, with a ping between, and each of the
+	 * three length forms */
+	add_frame(WEBSOCKET_OPCODE_TEXT_FRAME, false, "PRIVMSG #c :hel", 15, 0);
+	add_frame(WEBSOCKET_OPCODE_PING_FRAME, true, "pp", 2, 0);
+	add_frame(WEBSOCKET_OPCODE_CONTINUATION_FRAME, false, "lo wor", 6, 1);
+	add_frame(WEBSOCKET_OPCODE_CONTINUATION_FRAME, true, "ld", 2, 2);
+	add_expect("PRIVMSG #c :hello world\r\n", 25);
+
+	/* one frame bigger than any buffer on the way, full of lines */
+	for(size_t i = 0; i < sizeof(big); i++)
+		big[i] = i % 100 == 99 ? '\n' : 'a' + i % 26;
+	add_frame(WEBSOCKET_OPCODE_BINARY_FRAME, true, big, sizeof(big), 2);
+	add_expect(big, sizeof(big));
+
+	while(pos < stream_len)
+	{
+		size_t n = 1 + test_rand() % MAX_PIECE;
+
+		if(n > stream_len - pos)
+			n = stream_len - pos;
+		rb_rawbuf_append(conn->modbuf_in, stream + pos, n);
+		pos += n;
+
+		conn_mod_process(conn);
+		if(!CHECK(!IsDead(conn)))
+			break;
+		outlen = drain(tc.plain_peer, out, outlen, sizeof(out));
+	}
+
+	/* whatever the socket would not take yet */
+	while(rb_linebuf_len(&conn->plainbuf_out) > 0 && outlen < sizeof(out))
+	{
+		conn_plain_write_sendq(conn->plain_fd, conn);
+		outlen = drain(tc.plain_peer, out, outlen, sizeof(out));
+	}
+
+	CHECK(outlen == expect_len);
+	CHECK(memcmp(out, expect, expect_len) == 0);
+
+	conn_mod_write_sendq(conn->mod_fd, conn);
+	modlen = drain(tc.mod_peer, modout, 0, sizeof(modout));
+	CHECK(modlen == sizeof(pong) && memcmp(modout, pong, sizeof(pong)) == 0);
+
+	free_test_conn(&tc);
+}
+
+/* a continuation frame with no message to continue is an error */
+static void
+test_stray_continuation(void)
+{
+	struct test_conn tc;
+
+	make_test_conn(&tc);
+	stream_len = 0;
+	add_frame(WEBSOCKET_OPCODE_CONTINUATION_FRAME, true, "x", 1, 0);
+	rb_rawbuf_append(tc.conn->modbuf_in, stream, stream_len);
+	conn_mod_process(tc.conn);
+	CHECK(IsDead(tc.conn));
+
+	free_test_conn(&tc);
+}
+
+#ifdef HAVE_LIBZ
+/* when compressing what we send fails, what the client sends must still
+ * be inflated, and what we send from then on goes out uncompressed
+ */
+static void
+test_deflate_failure(void)
+{
+	static const char line[] = "PRIVMSG #c :hello\r\n";
+	struct test_conn tc;
+	z_stream client;
+	uint8_t zbuf[128], small[2];
+	char resp[128], out[128];
+	size_t zlen, outlen;
+
+	deflate_enabled = true;
+	make_test_conn(&tc);
+	CHECK(ws_deflate_negotiate(tc.conn, "permessage-deflate", resp, sizeof resp));
+
+	/* no room for the output makes deflate give up */
+	CHECK(ws_deflate(tc.conn, (void *)line, strlen(line), small, sizeof small) < 0);
+	CHECK(tc.conn->zout == NULL);
+	CHECK(tc.conn->zin != NULL);
+
+	conn_mod_write_frame(tc.conn, (void *)"PING :x", 7);
+	conn_mod_write_sendq(tc.conn->mod_fd, tc.conn);
+	outlen = drain(tc.mod_peer, out, 0, sizeof out);
+	CHECK(outlen == 9 && (uint8_t)out[0] == (0x80 | WEBSOCKET_OPCODE_TEXT_FRAME));
+
+	memset(&client, 0, sizeof client);
+	deflateInit2(&client, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+	client.next_in = (Bytef *)line;
+	client.avail_in = strlen(line);
+	client.next_out = zbuf;
+	client.avail_out = sizeof zbuf;
+	deflate(&client, Z_SYNC_FLUSH);
+	zlen = sizeof zbuf - client.avail_out - 4;
+	deflateEnd(&client);
+
+	stream_len = 0;
+	add_frame_rsv(WEBSOCKET_OPCODE_TEXT_FRAME, true, WEBSOCKET_RSV1, (char *)zbuf, zlen, 0);
+	rb_rawbuf_append(tc.conn->modbuf_in, stream, stream_len);
+	conn_mod_process(tc.conn);
+	CHECK(!IsDead(tc.conn));
+
+	outlen = drain(tc.plain_peer, out, 0, sizeof out);
+	CHECK(outlen == strlen(line) && memcmp(out, line, outlen) == 0);
+
+	free_test_conn(&tc);
+	deflate_enabled = false;
+}
+#endif
+
+int
+main(int argc, char *argv[])
+{
+	test_init();
+
+	test_unmask();
+	test_stream();
+	test_stray_continuation();
+#ifdef HAVE_LIBZ
+	test_deflate_failure();
+#endif
+
+	return test_done("wsockd");
+}
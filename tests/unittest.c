@@ -0,0 +1,80 @@
+/*
+ * tests/unittest.c
+ * Copyright (c) 2026 Ophion development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "rb_lib.h"
+#include "unittest.h"
+
+/* failed checks are reported individually up to this many */
+#define MAX_REPORTED	20
+
+unsigned int test_failures;
+
+static uint64_t rand_state = 0x9e3779b97f4a7c15ULL;
+
+bool
+test_check(bool ok, const char *expr, const char *file, int line)
+{
+	if(ok)
+		return true;
+
+	if(++test_failures <= MAX_REPORTED)
+		fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expr);
+	return false;
+}
+
+/* xorshift64*, as in the microbenchmarks */
+uint64_t
+test_rand(void)
+{
+	rand_state ^= rand_state >> 12;
+	rand_state ^= rand_state << 25;
+	rand_state ^= rand_state >> 27;
+	return rand_state * 2685821657736338717ULL;
+}
+
+void
+test_init(void)
+{
+	rb_lib_init(NULL, NULL, NULL, 0, 1024, 1024, 1024);
+	rb_linebuf_init(4096);
+	rb_init_rawbuffers(1024);
+}
+
+int
+test_done(const char *name)
+{
+	if(test_failures > 0)
+	{
+		printf("%s: %u checks failed\n", name, test_failures);
+		return 1;
+	}
+
+	printf("%s: ok\n", name);
+	return 0;
+}
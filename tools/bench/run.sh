@@ -0,0 +1,47 @@
+#!/bin/sh
+# Runs benchmark scenarios against an installed ircd.  The server is
+# started afresh with tools/bench/ircd.conf for each scenario so that the
+# results do not depend on what ran before.
+
+case $# in
+0|1) printf 'Usage: %s prefix ircbench [scenario.conf ...]\n' "$0" >&2; exit 64 ;;
+esac
+prefix=${1:?} ircbench=${2:?}
+shift 2
+benchdir=$(cd "$(dirname "$0")" && pwd) || exit 2
+[ $# -gt 0 ] || set -- "$benchdir/fanout.conf" "$benchdir/netburst.conf" \
+	"$benchdir/kline-storm.conf" "$benchdir/reconnect-storm.conf"
+
+dir=$(mktemp -d "${TMPDIR:-/tmp}/ircbench.XXXXXXXXXX") || exit 2
+ircdpid=
+trap '[ -z "$ircdpid" ] || kill $ircdpid 2>/dev/null; rm -rf "$dir"' 0
+cp "$benchdir/ircd.conf" "$dir/ircd.conf" || exit 2
+
+# the generator and the server both need a descriptor per client
+ulimit -n 65536 2>/dev/null || ulimit -n "$(ulimit -Hn)"
+
+rc=0
+for scenario; do
+	name=${scenario##*/}
+	name=${name%.conf}
+	rm -f "$dir/ircd.pid"
+	"$prefix/bin/ophion" -configfile "$dir/ircd.conf" -pidfile "$dir/ircd.pid" \
+		-logfile "$dir/ircd.log" || exit 2
+	tries=0
+	until [ -s "$dir/ircd.pid" ] || [ $tries -ge 50 ]; do
+		sleep 0.1
+		tries=$((tries + 1))
+	done
+	ircdpid=$(cat "$dir/ircd.pid") || { cat "$dir/ircd.log"; exit 2; }
+	sleep 1
+
+	echo "=== $name"
+	"$ircbench" "$scenario" server_pid="$ircdpid" || rc=1
+
+	kill "$ircdpid"
+	while kill -0 "$ircdpid" 2>/dev/null; do
+		sleep 0.1
+	done
+	ircdpid=
+done
+exit $rc
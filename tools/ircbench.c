@@ -0,0 +1,1308 @@
+/*
+ * tools/ircbench.c
+ * Copyright (c) 2026 Ophion development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * A load generator for benchmarking the ircd.  It runs a scenario file
+ * (see tools/bench/) against a server on this machine: it opens and
+ * registers a crowd of clients, spreads them over channels, drives
+ * PRIVMSG/JOIN/PART/NICK/WHO/KLINE traffic at the configured rates and
+ * optionally links as a server to send netbursts.  At the end it prints
+ * latency percentiles and the server's CPU and memory use.
+ *
+ * Usage: ircbench scenario.conf [key=value ...]
+ */
+
+#include "rb_lib.h"
+#include <sys/resource.h>
+#include <math.h>
+
+#define READBUF_SIZE	16384
+#define MAX_PENDING	16
+#define MAX_SAMPLES	(1 << 21)
+#define MAX_CHANNELS	(1 << 16)
+#define TICK_MS		5
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(x)	(sizeof(x) / sizeof((x)[0]))
+#endif
+
+struct scenario
+{
+	char host[64];
+	int port;
+	int server_pid;
+	char server_pidfile[256];
+	unsigned int seed;
+
+	int clients;
+	int connect_rate;
+	int warmup;
+	int duration;
+
+	int channels;
+	int channels_per_client;
+	char distribution[16];
+	double zipf_s;
+
+	double privmsg_rate;
+	double join_rate;
+	double part_rate;
+	double nick_rate;
+	double who_rate;
+	double reconnect_rate;
+	int message_size;
+
+	char oper_name[64];
+	char oper_password[64];
+	double kline_rate;
+	double kline_hit_ratio;
+
+	char link_name[64];
+	char link_password[64];
+	char link_sid[4];
+	int burst_users;
+	int burst_channels_per_user;
+	int burst_rounds;
+	int burst_interval;
+};
+
+static struct scenario sc = {
+	.host = "127.0.0.1",
+	.port = 6667,
+	.seed = 1,
+	.clients = 100,
+	.connect_rate = 500,
+	.warmup = 2,
+	.duration = 30,
+	.channels = 10,
+	.channels_per_client = 1,
+	.distribution = "uniform",
+	.zipf_s = 1.0,
+	.message_size = 100,
+	.kline_hit_ratio = 0.0,
+	.link_name = "bench.link",
+	.link_sid = "99B",
+	.burst_channels_per_user = 1,
+	.burst_interval = 5,
+};
+
+enum conf_type { CONF_INT, CONF_DOUBLE, CONF_STRING };
+
+static const struct
+{
+	const char *name;
+	enum conf_type type;
+	size_t offset;
+	size_t len;
+} conf_table[] = {
+#define CONF_ITEM(name, type) { #name, type, offsetof(struct scenario, name), sizeof(((struct scenario *)0)->name) }
+	CONF_ITEM(host, CONF_STRING),
+	CONF_ITEM(port, CONF_INT),
+	CONF_ITEM(server_pid, CONF_INT),
+	CONF_ITEM(server_pidfile, CONF_STRING),
+	CONF_ITEM(seed, CONF_INT),
+	CONF_ITEM(clients, CONF_INT),
+	CONF_ITEM(connect_rate, CONF_INT),
+	CONF_ITEM(warmup, CONF_INT),
+	CONF_ITEM(duration, CONF_INT),
+	CONF_ITEM(channels, CONF_INT),
+	CONF_ITEM(channels_per_client, CONF_INT),
+	CONF_ITEM(distribution, CONF_STRING),
+	CONF_ITEM(zipf_s, CONF_DOUBLE),
+	CONF_ITEM(privmsg_rate, CONF_DOUBLE),
+	CONF_ITEM(join_rate, CONF_DOUBLE),
+	CONF_ITEM(part_rate, CONF_DOUBLE),
+	CONF_ITEM(nick_rate, CONF_DOUBLE),
+	CONF_ITEM(who_rate, CONF_DOUBLE),
+	CONF_ITEM(reconnect_rate, CONF_DOUBLE),
+	CONF_ITEM(message_size, CONF_INT),
+	CONF_ITEM(oper_name, CONF_STRING),
+	CONF_ITEM(oper_password, CONF_STRING),
+	CONF_ITEM(kline_rate, CONF_DOUBLE),
+	CONF_ITEM(kline_hit_ratio, CONF_DOUBLE),
+	CONF_ITEM(link_name, CONF_STRING),
+	CONF_ITEM(link_password, CONF_STRING),
+	CONF_ITEM(link_sid, CONF_STRING),
+	CONF_ITEM(burst_users, CONF_INT),
+	CONF_ITEM(burst_channels_per_user, CONF_INT),
+	CONF_ITEM(burst_rounds, CONF_INT),
+	CONF_ITEM(burst_interval, CONF_INT),
+#undef CONF_ITEM
+};
+
+/* latencies are kept in microseconds; past MAX_SAMPLES a uniform
+ * reservoir sample is kept instead
+ */
+struct sample_set
+{
+	const char *name;
+	uint32_t *v;
+	size_t n;
+	unsigned long long seen;
+	uint64_t max_us;
+};
+
+enum sample_kind { S_DELIVERY, S_CONNECT, S_WHO, S_KLINE, S_BURST, S_LAST };
+
+static struct sample_set samples[S_LAST] = {
+	[S_DELIVERY] = { "privmsg delivery" },
+	[S_CONNECT] = { "registration" },
+	[S_WHO] = { "WHO reply" },
+	[S_KLINE] = { "KLINE round trip" },
+	[S_BURST] = { "netburst" },
+};
+
+enum conn_state { CS_IDLE, CS_CONNECTING, CS_REGISTERING, CS_READY };
+
+struct pending
+{
+	enum sample_kind kind;
+	uint64_t sent;
+};
+
+struct bench_conn
+{
+	int id;
+	bool link;
+	enum conn_state state;
+	rb_fde_t *F;
+	uint64_t connect_start;
+	unsigned int nick_changes;
+	bool oper;
+
+	char rbuf[READBUF_SIZE];
+	size_t rlen;
+	char *obuf;
+	size_t olen;
+	size_t oalloc;
+	bool write_pending;
+	bool dirty;
+
+	struct pending pending[MAX_PENDING];
+	unsigned int pending_head;
+	unsigned int pending_count;
+
+	unsigned short *chans;
+	int nchans;
+};
+
+static struct bench_conn *conns;
+static struct bench_conn **dirty;
+static int dirty_count;
+static struct bench_conn link_conn = { .id = -1, .link = true };
+static int *connect_queue;
+static int connect_head, connect_count;
+static int ready_count;
+static double *zipf_cdf;
+
+static struct rb_sockaddr_storage server_addr;
+static uint64_t run_start, measure_start, measure_end;
+static bool measuring;
+static char *padding;
+
+static struct
+{
+	unsigned long long privmsg_sent;
+	unsigned long long privmsg_received;
+	unsigned long long joins, parts, nicks, whos, klines, reconnects;
+	unsigned long long connects, disconnects;
+} totals, interval;
+
+static struct rb_histogram interval_delivery;
+
+#define COUNT(field)	do { interval.field++; if(measuring) totals.field++; } while(0)
+
+static int burst_round;
+static uint64_t burst_next;
+
+static uint64_t rng_state;
+
+static uint64_t
+rng(void)
+{
+	/* xorshift64*, repeatable for a given seed */
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 2685821657736338717ULL;
+}
+
+static double
+rng_unit(void)
+{
+	return (rng() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int
+rng_below(int n)
+{
+	return n > 0 ? (int)(rng() % (uint64_t)n) : 0;
+}
+
+static void
+record_sample(enum sample_kind kind, uint64_t ns)
+{
+	struct sample_set *set = &samples[kind];
+	uint64_t us = ns / 1000;
+
+	if(!measuring && kind != S_BURST)
+		return;
+
+	if(us > UINT32_MAX)
+		us = UINT32_MAX;
+	if(us > set->max_us)
+		set->max_us = us;
+
+	set->seen++;
+	if(set->n < MAX_SAMPLES)
+	{
+		if(set->v == NULL)
+			set->v = rb_malloc(sizeof(uint32_t) * MAX_SAMPLES);
+		set->v[set->n++] = us;
+	}
+	else
+	{
+		uint64_t slot = rng() % set->seen;
+
+		if(slot < MAX_SAMPLES)
+			set->v[slot] = us;
+	}
+}
+
+static int
+cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static double
+percentile_ms(const struct sample_set *set, double pct)
+{
+	size_t i = (size_t)(pct / 100.0 * (set->n - 1) + 0.5);
+
+	return set->v[i] / 1000.0;
+}
+
+/* Scenario files hold "key = value" lines; '#' starts a comment. */
+static bool
+set_option(const char *key, const char *value)
+{
+	for(size_t i = 0; i < ARRAY_SIZE(conf_table); i++)
+	{
+		char *field = (char *)&sc + conf_table[i].offset;
+
+		if(strcmp(key, conf_table[i].name))
+			continue;
+
+		switch(conf_table[i].type)
+		{
+		case CONF_INT:
+			*(int *)field = atoi(value);
+			break;
+		case CONF_DOUBLE:
+			*(double *)field = atof(value);
+			break;
+		case CONF_STRING:
+			rb_strlcpy(field, value, conf_table[i].len);
+			break;
+		}
+		return true;
+	}
+
+	fprintf(stderr, "ircbench: unknown option %s\n", key);
+	return false;
+}
+
+static bool
+parse_assignment(char *line)
+{
+	char *eq, *key, *value, *end;
+
+	if((end = strchr(line, '#')) != NULL)
+		*end = '\0';
+
+	key = line + strspn(line, " \t");
+	if(*key == '\0' || *key == '\n')
+		return true;
+
+	if((eq = strchr(key, '=')) == NULL)
+	{
+		fprintf(stderr, "ircbench: expected key = value, got %s", key);
+		return false;
+	}
+
+	*eq = '\0';
+	for(end = eq; end > key && isspace((unsigned char)end[-1]); end--)
+		end[-1] = '\0';
+
+	value = eq + 1 + strspn(eq + 1, " \t\"");
+	for(end = value + strlen(value); end > value && (isspace((unsigned char)end[-1]) || end[-1] == '"'); end--)
+		end[-1] = '\0';
+
+	return set_option(key, value);
+}
+
+static bool
+load_scenario(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char line[512];
+	bool ok = true;
+
+	if(f == NULL)
+	{
+		fprintf(stderr, "ircbench: %s: %s\n", path, strerror(errno));
+		return false;
+	}
+
+	while(ok && fgets(line, sizeof line, f) != NULL)
+		ok = parse_assignment(line);
+
+	fclose(f);
+	return ok;
+}
+
+static int
+pick_channel(void)
+{
+	int lo = 0, hi = sc.channels - 1;
+	double u;
+
+	if(zipf_cdf == NULL)
+		return rng_below(sc.channels);
+
+	u = rng_unit();
+	while(lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+
+		if(zipf_cdf[mid] < u)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static void
+setup_distribution(void)
+{
+	double total = 0;
+
+	if(!strcmp(sc.distribution, "uniform"))
+		return;
+
+	if(strcmp(sc.distribution, "zipf"))
+	{
+		fprintf(stderr, "ircbench: unknown distribution %s, using uniform\n", sc.distribution);
+		return;
+	}
+
+	/* channel k gets members in proportion to 1/(k+1)^s */
+	zipf_cdf = rb_malloc(sizeof(double) * sc.channels);
+	for(int k = 0; k < sc.channels; k++)
+	{
+		total += 1.0 / pow(k + 1, sc.zipf_s);
+		zipf_cdf[k] = total;
+	}
+	for(int k = 0; k < sc.channels; k++)
+		zipf_cdf[k] /= total;
+}
+
+static void conn_read(rb_fde_t *F, void *data);
+static void conn_flush(rb_fde_t *F, void *data);
+static void conn_close(struct bench_conn *conn, const char *why);
+
+static void conn_send(struct bench_conn *, const char *, ...) AFP(2, 3);
+
+static void
+conn_send(struct bench_conn *conn, const char *format, ...)
+{
+	va_list args;
+	int len;
+
+	if(conn->F == NULL)
+		return;
+
+	for(;;)
+	{
+		va_start(args, format);
+		len = vsnprintf(conn->obuf + conn->olen, conn->oalloc - conn->olen, format, args);
+		va_end(args);
+
+		if(len < 0)
+			return;
+
+		if((size_t)len + 2 < conn->oalloc - conn->olen)
+			break;
+
+		conn->oalloc = (conn->oalloc + len + 3) * 2;
+		conn->obuf = rb_realloc(conn->obuf, conn->oalloc);
+	}
+
+	memcpy(conn->obuf + conn->olen + len, "\r\n", 2);
+	conn->olen += len + 2;
+
+	/* written out once per loop, so a command and its PING share a packet */
+	if(!conn->dirty)
+	{
+		conn->dirty = true;
+		dirty[dirty_count++] = conn;
+	}
+}
+
+static void
+flush_dirty(void)
+{
+	for(int i = 0; i < dirty_count; i++)
+	{
+		struct bench_conn *conn = dirty[i];
+
+		conn->dirty = false;
+		if(conn->F != NULL && !conn->write_pending && conn->olen > 0)
+			conn_flush(conn->F, conn);
+	}
+	dirty_count = 0;
+}
+
+static void
+conn_flush(rb_fde_t *F, void *data)
+{
+	struct bench_conn *conn = data;
+	size_t done = 0;
+	ssize_t len;
+
+	conn->write_pending = false;
+
+	while(done < conn->olen)
+	{
+		len = rb_write(F, conn->obuf + done, conn->olen - done);
+		if(len <= 0)
+		{
+			if(len < 0 && rb_ignore_errno(errno))
+			{
+				conn->write_pending = true;
+				rb_setselect(F, RB_SELECT_WRITE, conn_flush, conn);
+				break;
+			}
+			conn_close(conn, len < 0 ? strerror(errno) : "connection closed");
+			return;
+		}
+		done += len;
+	}
+
+	memmove(conn->obuf, conn->obuf + done, conn->olen - done);
+	conn->olen -= done;
+}
+
+static void
+push_pending(struct bench_conn *conn, enum sample_kind kind)
+{
+	struct pending *p;
+
+	if(conn->pending_count == MAX_PENDING)
+		return;
+
+	p = &conn->pending[(conn->pending_head + conn->pending_count++) % MAX_PENDING];
+	p->kind = kind;
+	p->sent = rb_monotonic_ns();
+}
+
+static void
+pop_pending(struct bench_conn *conn, enum sample_kind kind)
+{
+	struct pending *p;
+
+	if(conn->pending_count == 0)
+		return;
+
+	p = &conn->pending[conn->pending_head];
+	if(p->kind != kind)
+		return;
+
+	record_sample(kind, rb_monotonic_ns() - p->sent);
+	conn->pending_head = (conn->pending_head + 1) % MAX_PENDING;
+	conn->pending_count--;
+}
+
+static void
+queue_connect(int id)
+{
+	connect_queue[(connect_head + connect_count++) % sc.clients] = id;
+}
+
+static bool
+in_channel(struct bench_conn *conn, int chan)
+{
+	for(int i = 0; i < conn->nchans; i++)
+		if(conn->chans[i] == chan)
+			return true;
+	return false;
+}
+
+static void
+join_channel(struct bench_conn *conn, int chan)
+{
+	if(conn->nchans >= sc.channels_per_client * 2 || in_channel(conn, chan))
+		return;
+
+	conn->chans[conn->nchans++] = chan;
+	conn_send(conn, "JOIN #bench%d", chan);
+}
+
+static void
+conn_close(struct bench_conn *conn, const char *why)
+{
+	if(conn->F == NULL)
+		return;
+
+	if(conn->state == CS_READY && !conn->link)
+		ready_count--;
+
+	rb_close(conn->F);
+	conn->F = NULL;
+	conn->state = CS_IDLE;
+	conn->olen = conn->rlen = 0;
+	conn->write_pending = false;
+	conn->pending_count = 0;
+	conn->nchans = 0;
+	conn->oper = false;
+
+	totals.disconnects++;
+
+	if(conn->link)
+	{
+		if(why != NULL)
+			fprintf(stderr, "ircbench: link closed: %s\n", why);
+		return;
+	}
+
+	queue_connect(conn->id);
+}
+
+static void
+client_registered(struct bench_conn *conn)
+{
+	int want = sc.channels_per_client;
+
+	conn->state = CS_READY;
+	ready_count++;
+	record_sample(S_CONNECT, rb_monotonic_ns() - conn->connect_start);
+
+	if(conn->id == 0 && sc.oper_name[0] != '\0')
+		conn_send(conn, "OPER %s %s", sc.oper_name, sc.oper_password);
+
+	for(int tries = 0; conn->nchans < want && tries < want * 4; tries++)
+		join_channel(conn, pick_channel());
+}
+
+static void
+link_burst(struct bench_conn *conn)
+{
+	time_t now = time(NULL);
+	int nchannels = sc.channels > 0 ? sc.channels : 1;
+	rb_dlink_list *members = rb_malloc(sizeof(rb_dlink_list) * nchannels);
+	char uid[10];
+
+	conn_send(conn, "PASS %s TS 6 :%s", sc.link_password, sc.link_sid);
+	conn_send(conn, "CAPAB :QS EX IE KLN UNKLN ENCAP TB SERVICES EUID EOPMOD MLOCK");
+	conn_send(conn, "SERVER %s 1 :ircbench link", sc.link_name);
+	conn_send(conn, "SVINFO 6 6 0 :%ld", (long)now);
+
+	for(int i = 0; i < sc.burst_users; i++)
+	{
+		int n = i;
+
+		/* UIDs are the SID and six of [A-Z0-9], the first a letter */
+		for(int c = 8; c > 3; c--, n /= 36)
+			uid[c] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"[n % 36];
+		uid[3] = 'A' + n % 26;
+		memcpy(uid, sc.link_sid, 3);
+		uid[9] = '\0';
+
+		conn_send(conn, ":%s EUID l%dr%d 1 %ld +i burst%d bench.link 127.0.0.1 %s * * :ircbench burst",
+			  sc.link_sid, i, burst_round, (long)now, i, uid);
+
+		for(int j = 0; j < sc.burst_channels_per_user; j++)
+		{
+			int chan = sc.channels > 0 ? pick_channel() : 0;
+
+			rb_dlinkAddAlloc(rb_strdup(uid), &members[chan]);
+		}
+	}
+
+	for(int chan = 0; chan < nchannels; chan++)
+	{
+		rb_dlink_node *ptr, *next;
+		char buf[512];
+		int prefix, len = 0;
+
+		prefix = snprintf(buf, sizeof buf, ":%s SJOIN %ld #bench%d +nt :",
+				  sc.link_sid, (long)now, chan);
+
+		RB_DLINK_FOREACH_SAFE(ptr, next, members[chan].head)
+		{
+			if(prefix + len + 10 > 450)
+			{
+				conn_send(conn, "%.*s", prefix + len - 1, buf);
+				len = 0;
+			}
+			len += snprintf(buf + prefix + len, sizeof buf - prefix - len, "%s ", (char *)ptr->data);
+			rb_free(ptr->data);
+			rb_dlinkDestroy(ptr, &members[chan]);
+		}
+
+		if(len > 0)
+			conn_send(conn, "%.*s", prefix + len - 1, buf);
+	}
+
+	rb_free(members);
+
+	/* the PONG marks the point where the server has processed all of it */
+	conn_send(conn, "PING :%s", sc.link_sid);
+	push_pending(conn, S_BURST);
+}
+
+static void
+handle_privmsg(struct bench_conn *conn, const char *text)
+{
+	unsigned long long sent;
+
+	if(sscanf(text, "ircbench %llu", &sent) != 1)
+		return;
+
+	record_sample(S_DELIVERY, rb_monotonic_ns() - sent);
+	rb_histogram_add(&interval_delivery, rb_monotonic_ns() - sent);
+	COUNT(privmsg_received);
+}
+
+static void
+handle_line(struct bench_conn *conn, char *line)
+{
+	char *prefix = NULL, *command, *params, *trailing = NULL;
+
+	if(*line == ':')
+	{
+		prefix = line + 1;
+		if((line = strchr(line, ' ')) == NULL)
+			return;
+		*line++ = '\0';
+	}
+
+	command = line;
+	if((params = strchr(line, ' ')) != NULL)
+	{
+		*params++ = '\0';
+		if(*params == ':')
+			trailing = params + 1;
+		else if((trailing = strstr(params, " :")) != NULL)
+			*trailing++ = '\0', trailing++;
+	}
+	else
+		params = "";
+
+	if(!strcmp(command, "PRIVMSG"))
+	{
+		if(trailing != NULL)
+			handle_privmsg(conn, trailing);
+	}
+	else if(!strcmp(command, "PING"))
+	{
+		if(conn->link)
+			conn_send(conn, ":%s PONG %s :%s", sc.link_sid, sc.link_name, prefix != NULL ? prefix : params);
+		else
+			conn_send(conn, "PONG :%s", trailing != NULL ? trailing : params);
+	}
+	else if(!strcmp(command, "PONG"))
+	{
+		if(conn->link)
+		{
+			uint64_t start = conn->pending_count ? conn->pending[conn->pending_head].sent : 0;
+
+			pop_pending(conn, S_BURST);
+			if(start != 0)
+			{
+				fprintf(stderr, "ircbench: burst %d of %d users took %.1f ms\n", burst_round + 1,
+					sc.burst_users, (rb_monotonic_ns() - start) / 1e6);
+				burst_round++;
+				burst_next = rb_monotonic_ns() + (uint64_t)sc.burst_interval * 1000000000ULL;
+			}
+		}
+		else
+			pop_pending(conn, S_KLINE);
+	}
+	else if(!strcmp(command, "001") && conn->state == CS_REGISTERING)
+		client_registered(conn);
+	else if(!strcmp(command, "315"))
+		pop_pending(conn, S_WHO);
+	else if(!strcmp(command, "381"))
+		conn->oper = true;
+	else if(!strcmp(command, "433") && conn->state == CS_REGISTERING)
+		conn_send(conn, "NICK b%dx%u", conn->id, ++conn->nick_changes);
+	else if(!strcmp(command, "ERROR"))
+		conn_close(conn, trailing);
+}
+
+static void
+conn_read(rb_fde_t *F, void *data)
+{
+	struct bench_conn *conn = data;
+	ssize_t len;
+
+	for(;;)
+	{
+		char *line, *eol;
+
+		len = rb_read(F, conn->rbuf + conn->rlen, sizeof(conn->rbuf) - 1 - conn->rlen);
+		if(len <= 0)
+		{
+			if(len < 0 && rb_ignore_errno(errno))
+				break;
+			conn_close(conn, len < 0 ? strerror(errno) : "connection closed");
+			return;
+		}
+
+		conn->rlen += len;
+		conn->rbuf[conn->rlen] = '\0';
+
+		line = conn->rbuf;
+		while((eol = strchr(line, '\n')) != NULL)
+		{
+			*eol = '\0';
+			if(eol > line && eol[-1] == '\r')
+				eol[-1] = '\0';
+			handle_line(conn, line);
+
+			/* the line may have closed us */
+			if(conn->F != F)
+				return;
+			line = eol + 1;
+		}
+
+		conn->rlen -= line - conn->rbuf;
+		memmove(conn->rbuf, line, conn->rlen);
+
+		/* a line that fills the buffer is not one we care about */
+		if(conn->rlen == sizeof(conn->rbuf) - 1)
+			conn->rlen = 0;
+	}
+
+	rb_setselect(F, RB_SELECT_READ, conn_read, conn);
+}
+
+static void
+conn_connected(rb_fde_t *F, int status, void *data)
+{
+	struct bench_conn *conn = data;
+
+	if(status != RB_OK)
+	{
+		conn_close(conn, rb_errstr(status));
+		return;
+	}
+
+	totals.connects++;
+
+	if(conn->link)
+	{
+		conn->state = CS_READY;
+		link_burst(conn);
+	}
+	else
+	{
+		conn->state = CS_REGISTERING;
+		conn_send(conn, "NICK b%d", conn->id);
+		conn_send(conn, "USER b%d 0 * :ircbench client", conn->id);
+	}
+
+	conn_read(F, conn);
+}
+
+static void
+conn_start(struct bench_conn *conn)
+{
+	conn->F = rb_socket(GET_SS_FAMILY(&server_addr), SOCK_STREAM, 0, "ircbench");
+	if(conn->F == NULL)
+	{
+		fprintf(stderr, "ircbench: socket: %s\n", strerror(errno));
+		return;
+	}
+
+	conn->state = CS_CONNECTING;
+	conn->connect_start = rb_monotonic_ns();
+	conn->nick_changes = 0;
+	rb_connect_tcp(conn->F, (struct sockaddr *)&server_addr, NULL, conn_connected, conn, 30);
+}
+
+static struct bench_conn *
+random_ready(bool allow_oper)
+{
+	/* a few probes are enough while most clients are up */
+	for(int tries = 0; tries < 8; tries++)
+	{
+		struct bench_conn *conn = &conns[rng_below(sc.clients)];
+
+		if(conn->state == CS_READY && (allow_oper || conn->id != 0 || sc.oper_name[0] == '\0'))
+			return conn;
+	}
+	return NULL;
+}
+
+static void
+do_privmsg(void)
+{
+	struct bench_conn *conn = random_ready(false);
+
+	if(conn == NULL || conn->nchans == 0)
+		return;
+
+	conn_send(conn, "PRIVMSG #bench%d :ircbench %llu %.*s", conn->chans[rng_below(conn->nchans)],
+		  (unsigned long long)rb_monotonic_ns(), sc.message_size, padding);
+	COUNT(privmsg_sent);
+}
+
+static void
+do_join(void)
+{
+	struct bench_conn *conn = random_ready(false);
+
+	if(conn == NULL)
+		return;
+
+	join_channel(conn, pick_channel());
+	COUNT(joins);
+}
+
+static void
+do_part(void)
+{
+	struct bench_conn *conn = random_ready(false);
+	int i;
+
+	if(conn == NULL || conn->nchans == 0)
+		return;
+
+	i = rng_below(conn->nchans);
+	conn_send(conn, "PART #bench%d", conn->chans[i]);
+	conn->chans[i] = conn->chans[--conn->nchans];
+	COUNT(parts);
+}
+
+static void
+do_nick(void)
+{
+	struct bench_conn *conn = random_ready(false);
+
+	if(conn == NULL)
+		return;
+
+	conn_send(conn, "NICK b%dn%u", conn->id, ++conn->nick_changes);
+	COUNT(nicks);
+}
+
+static void
+do_who(void)
+{
+	struct bench_conn *conn = random_ready(false);
+
+	if(conn == NULL || conn->nchans == 0)
+		return;
+
+	conn_send(conn, "WHO #bench%d", conn->chans[rng_below(conn->nchans)]);
+	push_pending(conn, S_WHO);
+	COUNT(whos);
+}
+
+static void
+do_reconnect(void)
+{
+	struct bench_conn *conn = random_ready(false);
+
+	if(conn == NULL)
+		return;
+
+	conn_send(conn, "QUIT :ircbench reconnect");
+	conn_close(conn, NULL);
+	COUNT(reconnects);
+}
+
+static void
+do_kline(void)
+{
+	struct bench_conn *oper = &conns[0];
+
+	if(!oper->oper)
+		return;
+
+	if(sc.clients > 1 && rng_unit() < sc.kline_hit_ratio)
+		conn_send(oper, "KLINE 1 *b%d@127.0.0.1 :ircbench", 1 + rng_below(sc.clients - 1));
+	else
+		conn_send(oper, "KLINE 1 *@198.51.%d.%d :ircbench", rng_below(256), rng_below(256));
+
+	/* the PONG comes back once the K-line has been applied to everyone */
+	conn_send(oper, "PING :kline");
+	push_pending(oper, S_KLINE);
+	COUNT(klines);
+}
+
+static const struct
+{
+	double *rate;
+	void (*fn)(void);
+} actions[] = {
+	{ &sc.privmsg_rate, do_privmsg },
+	{ &sc.join_rate, do_join },
+	{ &sc.part_rate, do_part },
+	{ &sc.nick_rate, do_nick },
+	{ &sc.who_rate, do_who },
+	{ &sc.reconnect_rate, do_reconnect },
+	{ &sc.kline_rate, do_kline },
+};
+
+static double credit[ARRAY_SIZE(actions)];
+
+static void
+run_actions(double elapsed)
+{
+	for(size_t i = 0; i < ARRAY_SIZE(actions); i++)
+	{
+		credit[i] += *actions[i].rate * elapsed;
+		for(; credit[i] >= 1.0; credit[i] -= 1.0)
+			actions[i].fn();
+	}
+}
+
+static void
+run_connects(double elapsed)
+{
+	static double connect_credit;
+
+	connect_credit += sc.connect_rate * elapsed;
+	for(; connect_credit >= 1.0 && connect_count > 0; connect_credit -= 1.0)
+	{
+		int id = connect_queue[connect_head];
+
+		connect_head = (connect_head + 1) % sc.clients;
+		connect_count--;
+		conn_start(&conns[id]);
+	}
+
+	/* don't bank credit while nothing is waiting */
+	if(connect_count == 0)
+		connect_credit = 0;
+}
+
+static void
+run_bursts(uint64_t now)
+{
+	if(sc.burst_users == 0 || burst_round >= sc.burst_rounds || now < burst_next)
+		return;
+
+	if(link_conn.F == NULL)
+	{
+		conn_start(&link_conn);
+		burst_next = UINT64_MAX;
+	}
+	else if(link_conn.pending_count == 0)
+	{
+		/* splitting off again exercises the netsplit path as well */
+		conn_close(&link_conn, NULL);
+		burst_next = now + 1000000000ULL;
+	}
+}
+
+struct proc_usage
+{
+	bool valid;
+	double cpu_seconds;
+	long rss_kb;
+	long hwm_kb;
+};
+
+static struct proc_usage
+read_proc_usage(int pid)
+{
+	struct proc_usage usage = { false, 0, 0, 0 };
+	char path[64], line[1024];
+	unsigned long utime, stime;
+	FILE *f;
+	char *p;
+
+	if(pid <= 0)
+		return usage;
+
+	snprintf(path, sizeof path, "/proc/%d/stat", pid);
+	if((f = fopen(path, "r")) == NULL)
+		return usage;
+
+	/* fields after the parenthesised command name; utime and stime are 14 and 15 */
+	if(fgets(line, sizeof line, f) != NULL && (p = strrchr(line, ')')) != NULL &&
+	   sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) == 2)
+	{
+		usage.valid = true;
+		usage.cpu_seconds = (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+	}
+	fclose(f);
+
+	snprintf(path, sizeof path, "/proc/%d/status", pid);
+	if((f = fopen(path, "r")) == NULL)
+		return usage;
+
+	while(fgets(line, sizeof line, f) != NULL)
+	{
+		sscanf(line, "VmRSS: %ld", &usage.rss_kb);
+		sscanf(line, "VmHWM: %ld", &usage.hwm_kb);
+	}
+	fclose(f);
+
+	return usage;
+}
+
+static double
+own_cpu_seconds(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+static void
+print_interval(uint64_t now)
+{
+	double t = (now - run_start) / 1e9;
+
+	fprintf(stderr, "[%6.1fs] %s ready %d/%d  sent %llu/s  delivered %llu/s  p50 %.2fms p99 %.2fms",
+		t, measuring ? "measure" : now < measure_start ? "ramp   " : "done   ",
+		ready_count, sc.clients, interval.privmsg_sent, interval.privmsg_received,
+		rb_histogram_percentile(&interval_delivery, 50) / 1e6,
+		rb_histogram_percentile(&interval_delivery, 99) / 1e6);
+
+	if(interval.joins + interval.parts + interval.nicks + interval.whos + interval.klines + interval.reconnects)
+		fprintf(stderr, "  join %llu part %llu nick %llu who %llu kline %llu reconnect %llu",
+			interval.joins, interval.parts, interval.nicks, interval.whos,
+			interval.klines, interval.reconnects);
+	fputc('\n', stderr);
+
+	memset(&interval, 0, sizeof interval);
+	memset(&interval_delivery, 0, sizeof interval_delivery);
+}
+
+static void
+print_report(const struct proc_usage *before, const struct proc_usage *after, double own_cpu)
+{
+	double secs = (measure_end - measure_start) / 1e9;
+
+	printf("\nscenario: %d clients, %d channels (%s), %.1fs measured\n",
+	       sc.clients, sc.channels, sc.distribution, secs);
+	printf("privmsg: %llu sent, %llu delivered (%.0f/s)\n", totals.privmsg_sent,
+	       totals.privmsg_received, totals.privmsg_received / secs);
+	printf("commands: %llu join, %llu part, %llu nick, %llu who, %llu kline, %llu reconnect\n",
+	       totals.joins, totals.parts, totals.nicks, totals.whos, totals.klines, totals.reconnects);
+	printf("connections: %llu made, %llu lost\n", totals.connects, totals.disconnects);
+
+	printf("\n%-18s %10s %9s %9s %9s %9s %9s\n", "latency (ms)", "samples", "p50", "p90", "p99", "p99.9", "max");
+	for(int i = 0; i < S_LAST; i++)
+	{
+		struct sample_set *set = &samples[i];
+
+		if(set->n == 0)
+			continue;
+
+		qsort(set->v, set->n, sizeof(uint32_t), cmp_u32);
+		printf("%-18s %10llu %9.3f %9.3f %9.3f %9.3f %9.3f\n", set->name, set->seen,
+		       percentile_ms(set, 50), percentile_ms(set, 90), percentile_ms(set, 99),
+		       percentile_ms(set, 99.9), set->max_us / 1000.0);
+	}
+
+	if(before->valid && after->valid)
+		printf("\nserver: %.1f%% cpu, %ld kB rss, %ld kB peak rss\n",
+		       100.0 * (after->cpu_seconds - before->cpu_seconds) / secs, after->rss_kb, after->hwm_kb);
+	else
+		printf("\nserver: cpu and memory unknown, set server_pid or server_pidfile\n");
+
+	printf("ircbench: %.1f%% cpu%s\n", 100.0 * own_cpu / secs,
+	       own_cpu / secs > 0.9 ? " (the load generator may be the bottleneck)" : "");
+}
+
+static int
+find_server_pid(void)
+{
+	FILE *f;
+	int pid = 0;
+
+	if(sc.server_pid > 0 || sc.server_pidfile[0] == '\0')
+		return sc.server_pid;
+
+	if((f = fopen(sc.server_pidfile, "r")) != NULL)
+	{
+		if(fscanf(f, "%d", &pid) != 1)
+			pid = 0;
+		fclose(f);
+	}
+	return pid;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct proc_usage before, after;
+	struct rlimit rl;
+	double own_cpu_start = 0;
+	uint64_t last, next_report;
+	int maxfds, pid;
+
+	if(argc < 2)
+	{
+		fprintf(stderr, "usage: %s scenario.conf [key=value ...]\n", argv[0]);
+		return 2;
+	}
+
+	if(!load_scenario(argv[1]))
+		return 2;
+
+	for(int i = 2; i < argc; i++)
+	{
+		char *arg = rb_strdup(argv[i]);
+
+		if(!parse_assignment(arg))
+			return 2;
+		rb_free(arg);
+	}
+
+	if(sc.clients < 1 || sc.channels < 1 || sc.channels > MAX_CHANNELS || sc.message_size < 0)
+	{
+		fprintf(stderr, "ircbench: need at least one client and 1 to %d channels\n", MAX_CHANNELS);
+		return 2;
+	}
+
+	if(sc.channels_per_client > sc.channels)
+		sc.channels_per_client = sc.channels;
+
+	maxfds = sc.clients + 64;
+	if(getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < (rlim_t)maxfds)
+	{
+		rl.rlim_cur = rl.rlim_max < (rlim_t)maxfds ? rl.rlim_max : (rlim_t)maxfds;
+		setrlimit(RLIMIT_NOFILE, &rl);
+		if(rl.rlim_cur < (rlim_t)maxfds)
+		{
+			fprintf(stderr, "ircbench: only %lu file descriptors available\n", (unsigned long)rl.rlim_cur);
+			sc.clients = rl.rlim_cur - 64;
+			maxfds = rl.rlim_cur;
+		}
+	}
+
+	rb_lib_init(NULL, NULL, NULL, 0, maxfds, 1024, maxfds);
+	rb_set_time();
+
+	if(rb_inet_pton_sock(sc.host, &server_addr) <= 0)
+	{
+		fprintf(stderr, "ircbench: %s is not an IP address\n", sc.host);
+		return 2;
+	}
+	SET_SS_PORT(&server_addr, htons(sc.port));
+
+	rng_state = sc.seed ? sc.seed : 1;
+	setup_distribution();
+
+	padding = rb_malloc(sc.message_size + 1);
+	for(int i = 0; i < sc.message_size; i++)
+		padding[i] = 'a' + i % 26;
+
+	conns = rb_malloc(sizeof(struct bench_conn) * sc.clients);
+	connect_queue = rb_malloc(sizeof(int) * sc.clients);
+	dirty = rb_malloc(sizeof(struct bench_conn *) * (sc.clients + 1));
+	for(int i = 0; i < sc.clients; i++)
+	{
+		conns[i].id = i;
+		conns[i].chans = rb_malloc(sizeof(unsigned short) * sc.channels_per_client * 2 + 1);
+		queue_connect(i);
+	}
+
+	run_start = last = rb_monotonic_ns();
+	measure_start = UINT64_MAX;
+	next_report = run_start + 1000000000ULL;
+	pid = find_server_pid();
+	before = read_proc_usage(pid);
+
+	for(;;)
+	{
+		uint64_t now;
+		double elapsed;
+
+		rb_select(TICK_MS);
+		now = rb_monotonic_ns();
+		elapsed = (now - last) / 1e9;
+		last = now;
+
+		run_connects(elapsed);
+
+		/* the clock starts once every client is up, or after a minute regardless */
+		if(measure_start == UINT64_MAX &&
+		   (ready_count == sc.clients || now - run_start > 60 * 1000000000ULL))
+			measure_start = now + (uint64_t)sc.warmup * 1000000000ULL;
+
+		/* traffic starts with the warmup */
+		if(measure_start != UINT64_MAX)
+			run_actions(elapsed);
+
+		if(!measuring && now >= measure_start && measure_end == 0)
+		{
+			measuring = true;
+			before = read_proc_usage(pid);
+			own_cpu_start = own_cpu_seconds();
+			burst_next = now;
+		}
+
+		if(measuring)
+		{
+			run_bursts(now);
+
+			if(now >= measure_start + (uint64_t)sc.duration * 1000000000ULL)
+			{
+				measure_end = now;
+				measuring = false;
+				after = read_proc_usage(pid);
+				print_interval(now);
+				print_report(&before, &after, own_cpu_seconds() - own_cpu_start);
+				return 0;
+			}
+		}
+
+		flush_dirty();
+
+		if(now >= next_report)
+		{
+			print_interval(now);
+			next_report += 1000000000ULL;
+		}
+	}
+}
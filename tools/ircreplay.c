@@ -0,0 +1,534 @@
+/*
+ * tools/ircreplay.c
+ * Copyright (c) 2026 Ophion development team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Replays a traffic capture taken with CAPTURE START against a server on
+ * this machine.  Every captured connection gets its own socket, opened at
+ * the time it was first seen, and is fed exactly the bytes the original
+ * server read from it, either at the original pace (scaled by -s) or as
+ * fast as the server takes them (-s 0).  PINGs from the server are
+ * answered so that replayed clients are not timed out; everything else
+ * the server sends is read and thrown away.
+ *
+ * Usage: ircreplay [-s speed] [-d] capture.cap [host [port]]
+ */
+
+#include "rb_lib.h"
+#include "capture.h"
+#include <sys/resource.h>
+
+#define READBUF_SIZE	16384
+#define BATCH_RECORDS	1024
+#define TICK_MS		5
+
+enum replay_state
+{
+	RS_UNUSED,
+	RS_CONNECTING,
+	RS_OPEN,
+	RS_DONE,
+};
+
+struct replay_conn
+{
+	rb_fde_t *F;
+	enum replay_state state;
+	bool closing;		/* close once the output is written */
+	bool write_pending;
+	char *obuf;
+	size_t olen, osize;
+	char rbuf[READBUF_SIZE];
+	size_t rlen;
+};
+
+static struct replay_conn *conns;
+static uint32_t nconns;
+static unsigned int open_count;
+static struct rb_sockaddr_storage server_addr;
+
+static unsigned char *capture;
+static size_t capture_len;
+
+static struct
+{
+	unsigned long long records;
+	unsigned long long connections;
+	unsigned long long bytes_out;
+	unsigned long long bytes_in;
+	unsigned long long pings;
+	unsigned long long failures;
+} totals;
+
+static void conn_flush(rb_fde_t *F, void *data);
+
+static uint64_t
+get_be(const unsigned char *p, int bytes)
+{
+	uint64_t v = 0;
+
+	while(bytes-- > 0)
+		v = (v << 8) | *p++;
+	return v;
+}
+
+static bool
+load_capture(const char *path)
+{
+	FILE *f;
+	long len;
+
+	if((f = fopen(path, "rb")) == NULL)
+	{
+		fprintf(stderr, "ircreplay: %s: %s\n", path, strerror(errno));
+		return false;
+	}
+
+	fseek(f, 0, SEEK_END);
+	len = ftell(f);
+	rewind(f);
+
+	if(len < CAPTURE_HEADER_LEN)
+	{
+		fprintf(stderr, "ircreplay: %s: too short to be a capture\n", path);
+		fclose(f);
+		return false;
+	}
+
+	capture = rb_malloc(len);
+	capture_len = len;
+	if(fread(capture, 1, len, f) != (size_t)len)
+	{
+		fprintf(stderr, "ircreplay: %s: read error\n", path);
+		fclose(f);
+		return false;
+	}
+	fclose(f);
+
+	if(memcmp(capture, CAPTURE_MAGIC, 8))
+	{
+		fprintf(stderr, "ircreplay: %s: not a capture file\n", path);
+		return false;
+	}
+
+	return true;
+}
+
+/* The record at off, or false at the end of the file.  A record cut short
+ * by a capture that was never stopped cleanly also ends the replay.
+ */
+static bool
+next_record(size_t off, int *type, uint32_t *id, uint64_t *usec, const unsigned char **data, size_t *len)
+{
+	if(off + CAPTURE_RECORD_LEN > capture_len)
+		return false;
+
+	*type = capture[off];
+	*id = get_be(capture + off + 1, 4);
+	*usec = get_be(capture + off + 5, 8);
+	*len = get_be(capture + off + 13, 2);
+	*data = capture + off + CAPTURE_RECORD_LEN;
+
+	return off + CAPTURE_RECORD_LEN + *len <= capture_len;
+}
+
+static struct replay_conn *
+get_conn(uint32_t id)
+{
+	if(id >= nconns)
+	{
+		uint32_t n = nconns ? nconns : 64;
+
+		while(n <= id)
+			n *= 2;
+		conns = rb_realloc(conns, sizeof(struct replay_conn) * n);
+		memset(conns + nconns, 0, sizeof(struct replay_conn) * (n - nconns));
+		nconns = n;
+	}
+
+	return &conns[id];
+}
+
+static void
+conn_close(struct replay_conn *conn)
+{
+	if(conn->F == NULL)
+		return;
+
+	rb_close(conn->F);
+	conn->F = NULL;
+	conn->state = RS_DONE;
+	conn->olen = 0;
+	open_count--;
+}
+
+static void
+conn_write(struct replay_conn *conn, const void *buf, size_t len)
+{
+	if(conn->state != RS_CONNECTING && conn->state != RS_OPEN)
+		return;
+
+	if(conn->olen + len > conn->osize)
+	{
+		while(conn->olen + len > conn->osize)
+			conn->osize = conn->osize ? conn->osize * 2 : 4096;
+		conn->obuf = rb_realloc(conn->obuf, conn->osize);
+	}
+
+	memcpy(conn->obuf + conn->olen, buf, len);
+	conn->olen += len;
+
+	if(conn->state == RS_OPEN && !conn->write_pending)
+		conn_flush(conn->F, conn);
+}
+
+static void
+conn_flush(rb_fde_t *F, void *data)
+{
+	struct replay_conn *conn = data;
+	size_t done = 0;
+	ssize_t len;
+
+	conn->write_pending = false;
+
+	while(done < conn->olen)
+	{
+		len = rb_write(F, conn->obuf + done, conn->olen - done);
+		if(len <= 0)
+		{
+			if(len < 0 && rb_ignore_errno(errno))
+			{
+				conn->write_pending = true;
+				rb_setselect(F, RB_SELECT_WRITE, conn_flush, conn);
+				break;
+			}
+			conn_close(conn);
+			return;
+		}
+		done += len;
+		totals.bytes_out += len;
+	}
+
+	memmove(conn->obuf, conn->obuf + done, conn->olen - done);
+	conn->olen -= done;
+
+	if(conn->olen == 0 && conn->closing)
+		conn_close(conn);
+}
+
+/* Answer "PING :token" so the server does not time the client out; PINGs
+ * with a prefix come over server links, where the captured traffic already
+ * holds the answers.
+ */
+static void
+handle_line(struct replay_conn *conn, char *line)
+{
+	char reply[READBUF_SIZE];
+	char *arg;
+
+	if(strncmp(line, "PING ", 5))
+		return;
+
+	arg = line + 5;
+	if(*arg == ':')
+		arg++;
+
+	snprintf(reply, sizeof reply, "PONG :%s\r\n", arg);
+	conn_write(conn, reply, strlen(reply));
+	totals.pings++;
+}
+
+static void
+conn_read(rb_fde_t *F, void *data)
+{
+	struct replay_conn *conn = data;
+	ssize_t len;
+
+	for(;;)
+	{
+		char *line, *eol;
+
+		len = rb_read(F, conn->rbuf + conn->rlen, sizeof(conn->rbuf) - conn->rlen);
+		if(len <= 0)
+		{
+			if(len < 0 && rb_ignore_errno(errno))
+				rb_setselect(F, RB_SELECT_READ, conn_read, conn);
+			else
+				conn_close(conn);
+			return;
+		}
+
+		totals.bytes_in += len;
+		conn->rlen += len;
+
+		line = conn->rbuf;
+		while((eol = memchr(line, '\n', conn->rlen - (line - conn->rbuf))) != NULL)
+		{
+			*eol = '\0';
+			if(eol > line && eol[-1] == '\r')
+				eol[-1] = '\0';
+			handle_line(conn, line);
+			if(conn->F == NULL)
+				return;
+			line = eol + 1;
+		}
+
+		conn->rlen -= line - conn->rbuf;
+		memmove(conn->rbuf, line, conn->rlen);
+
+		/* a line longer than the buffer is nothing we need to look at */
+		if(conn->rlen == sizeof(conn->rbuf))
+			conn->rlen = 0;
+	}
+}
+
+static void
+conn_connected(rb_fde_t *F, int status, void *data)
+{
+	struct replay_conn *conn = data;
+
+	if(status != RB_OK)
+	{
+		fprintf(stderr, "ircreplay: connect: %s\n", rb_errstr(status));
+		totals.failures++;
+		conn_close(conn);
+		return;
+	}
+
+	conn->state = RS_OPEN;
+	if(conn->olen > 0)
+		conn_flush(F, conn);
+	if(conn->F != NULL)
+		conn_read(F, conn);
+}
+
+static void
+replay_record(int type, uint32_t id, const unsigned char *data, size_t len)
+{
+	struct replay_conn *conn = get_conn(id);
+
+	totals.records++;
+
+	switch(type)
+	{
+	case CAPTURE_OPEN:
+		if(conn->state != RS_UNUSED)
+			break;
+
+		conn->F = rb_socket(GET_SS_FAMILY(&server_addr), SOCK_STREAM, 0, "ircreplay");
+		if(conn->F == NULL)
+		{
+			fprintf(stderr, "ircreplay: socket: %s\n", strerror(errno));
+			totals.failures++;
+			conn->state = RS_DONE;
+			break;
+		}
+
+		conn->state = RS_CONNECTING;
+		open_count++;
+		totals.connections++;
+		rb_connect_tcp(conn->F, (struct sockaddr *)&server_addr, NULL, conn_connected, conn, 30);
+		break;
+
+	case CAPTURE_DATA:
+		conn_write(conn, data, len);
+		break;
+
+	case CAPTURE_CLOSE:
+		if(conn->F == NULL)
+			break;
+		conn->closing = true;
+		if(conn->state == RS_OPEN && conn->olen == 0)
+			conn_close(conn);
+		break;
+	}
+}
+
+static bool
+output_pending(void)
+{
+	for(uint32_t i = 0; i < nconns; i++)
+		if(conns[i].F != NULL && (conns[i].state == RS_CONNECTING || conns[i].olen > 0))
+			return true;
+	return false;
+}
+
+static void
+dump_capture(void)
+{
+	static const char *const names[] = { "?", "open", "data", "close" };
+	size_t off = CAPTURE_HEADER_LEN;
+	const unsigned char *data;
+	uint64_t usec;
+	uint32_t id;
+	size_t len;
+	int type;
+
+	printf("# capture started %lld\n", (long long)get_be(capture + 8, 8));
+
+	while(next_record(off, &type, &id, &usec, &data, &len))
+	{
+		printf("%llu.%06llu %u %s", (unsigned long long)(usec / 1000000),
+		       (unsigned long long)(usec % 1000000), id,
+		       type >= CAPTURE_OPEN && type <= CAPTURE_CLOSE ? names[type] : names[0]);
+
+		if(len > 0)
+		{
+			putchar(' ');
+			for(size_t i = 0; i < len; i++)
+			{
+				if(data[i] == '\n')
+					fputs("\\n", stdout);
+				else if(data[i] == '\r')
+					fputs("\\r", stdout);
+				else if(data[i] < 0x20 || data[i] == '\\' || data[i] >= 0x7f)
+					printf("\\x%02x", data[i]);
+				else
+					putchar(data[i]);
+			}
+		}
+		putchar('\n');
+		off += CAPTURE_RECORD_LEN + len;
+	}
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: ircreplay [-s speed] [-d] capture.cap [host [port]]\n"
+			"  -s speed   replay speed, 1 for the captured pace, 0 for as fast as possible\n"
+			"  -d         print the capture instead of replaying it\n");
+	exit(2);
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *host = "127.0.0.1";
+	int port = 6667;
+	double speed = 1;
+	bool dump = false;
+	struct rlimit rl;
+	size_t off = CAPTURE_HEADER_LEN;
+	uint64_t start, elapsed;
+	int c;
+
+	while((c = getopt(argc, argv, "s:d")) != -1)
+	{
+		switch(c)
+		{
+		case 's':
+			speed = atof(optarg);
+			if(speed < 0)
+				usage();
+			break;
+		case 'd':
+			dump = true;
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if(optind >= argc || argc - optind > 3)
+		usage();
+
+	if(!load_capture(argv[optind]))
+		return 2;
+
+	if(dump)
+	{
+		dump_capture();
+		return 0;
+	}
+
+	if(argc - optind > 1)
+		host = argv[optind + 1];
+	if(argc - optind > 2)
+		port = atoi(argv[optind + 2]);
+
+	/* every captured connection may be open at once */
+	if(getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max)
+	{
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+	getrlimit(RLIMIT_NOFILE, &rl);
+
+	rb_lib_init(NULL, NULL, NULL, 0, rl.rlim_cur, 1024, rl.rlim_cur);
+	rb_set_time();
+
+	if(rb_inet_pton_sock(host, &server_addr) <= 0)
+	{
+		fprintf(stderr, "ircreplay: %s is not an IP address\n", host);
+		return 2;
+	}
+	SET_SS_PORT(&server_addr, htons(port));
+
+	start = rb_monotonic_ns();
+
+	for(;;)
+	{
+		const unsigned char *data;
+		uint64_t usec, now;
+		uint32_t id;
+		size_t len;
+		int type, batch = 0;
+		bool more;
+
+		now = rb_monotonic_ns();
+		while((more = next_record(off, &type, &id, &usec, &data, &len)))
+		{
+			if(speed > 0 && start + (uint64_t)(usec * 1000 / speed) > now)
+				break;
+			/* keep reading replies while going flat out */
+			if(++batch > BATCH_RECORDS)
+				break;
+
+			replay_record(type, id, data, len);
+			off += CAPTURE_RECORD_LEN + len;
+		}
+
+		if(!more && !output_pending())
+			break;
+
+		rb_select(speed > 0 || !more ? TICK_MS : 0);
+		rb_set_time();
+	}
+
+	elapsed = rb_monotonic_ns() - start;
+
+	printf("replayed %llu records over %llu connections in %.3fs\n",
+	       totals.records, totals.connections, elapsed / 1e9);
+	printf("sent %llu bytes, received %llu bytes, answered %llu pings, %llu failed connections\n",
+	       totals.bytes_out, totals.bytes_in, totals.pings, totals.failures);
+	if(off < capture_len)
+		printf("capture ends with a partial record\n");
+
+	return 0;
+}
@@ -23,6 +23,10 @@
 #include "stdinc.h"
 #include "sha1.h"
 
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
 #define MAXPASSFD 4
 #ifndef READBUF_SIZE
 #define READBUF_SIZE 16384
@@ -31,6 +35,8 @@
 #define WEBSOCKET_SERVER_KEY "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
 #define WEBSOCKET_ANSWER_STRING_1 "HTTP/1.1 101 Switching Protocols\r\nAccess-Control-Allow-Origin: *\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: "
 #define WEBSOCKET_ANSWER_STRING_2 "\r\n\r\n"
+#define WEBSOCKET_EXTENSIONS_STRING "\r\nSec-WebSocket-Extensions: "
+#define WEBSOCKET_PROTOCOL_STRING "\r\nSec-WebSocket-Protocol: "
 
 static void setup_signals(void);
 static pid_t ppid;
@@ -67,10 +73,18 @@ typedef struct _mod_ctl
 	rb_fde_t *F_pipe;
 	rb_dlink_list readq;
 	rb_dlink_list writeq;
+	rb_ring *ring;			/* plaintext channels to the ircd, if it set one up */
 } mod_ctl_t;
 
 static mod_ctl_t *mod_ctl;
 
+/* an incremental UTF-8 check, see utf8_validate() */
+struct utf8_state
+{
+	uint8_t need;			/* continuation bytes still to come */
+	uint8_t lo, hi;			/* range of the next one */
+};
+
 typedef struct _conn
 {
 	rb_dlink_node node;
@@ -93,15 +107,56 @@ typedef struct _conn
 	uint8_t flags;
 
 	char client_key[37];		/* maximum 36 bytes + nul */
+
+	/* incoming frame being parsed, see conn_mod_process() */
+	uint8_t frame_hdr[14];		/* 2 + 8 byte length + 4 byte mask, at most */
+	uint8_t frame_hdrlen;		/* header bytes read so far */
+	bool frame_active;		/* header done, reading the payload */
+	uint8_t frame_opcode;
+	uint8_t frame_mask[4];
+	bool frame_masked;
+	bool frame_fin;
+	uint64_t frame_len;		/* payload length */
+	uint64_t frame_pos;		/* payload bytes read so far */
+
+	uint8_t ctl_buf[125];		/* control frame payload */
+
+	bool in_message;		/* fragmented data message in progress */
+	char msg_last;			/* last byte of it so far */
+	bool msg_utf8;			/* it must be valid UTF-8 */
+	struct utf8_state utf8;		/* how far into a character it is */
+
+	uint8_t subprotocol;		/* WS_SUBPROTOCOL_*, from the handshake */
+
+#ifdef HAVE_LIBZ
+	/* permessage-deflate, see ws_deflate_negotiate() */
+	z_stream *zout;
+	z_stream *zin;
+	bool server_takeover;		/* keep our compression context between messages */
+	bool client_takeover;
+	bool msg_compressed;		/* the message being received is compressed */
+	size_t msg_inflated;		/* bytes it has inflated to so far */
+	size_t zmemory;			/* estimated zlib memory of both streams */
+#endif
 } conn_t;
 
+#define WEBSOCKET_OPCODE_CONTINUATION_FRAME	0x0
 #define WEBSOCKET_OPCODE_TEXT_FRAME		0x1
+#define WEBSOCKET_OPCODE_BINARY_FRAME		0x2
 #define WEBSOCKET_OPCODE_CLOSE_FRAME		0x8
 #define WEBSOCKET_OPCODE_PING_FRAME		0x9
 #define WEBSOCKET_OPCODE_PONG_FRAME		0xA
 
 #define WEBSOCKET_MASK_LENGTH 4
 
+/* IRCv3 websocket subprotocols; without one, text frames as ever */
+#define WS_SUBPROTOCOL_NONE	0
+#define WS_SUBPROTOCOL_BINARY	1	/* binary.ircv3.net */
+#define WS_SUBPROTOCOL_TEXT	2	/* text.ircv3.net, UTF-8 only */
+
+#define WEBSOCKET_RSV1			0x40	/* set on compressed messages */
+#define WEBSOCKET_RSV_MASK		0x70
+
 #define WEBSOCKET_MAX_UNEXTENDED_PAYLOAD_DATA_LENGTH 126
 
 typedef struct {
@@ -146,10 +201,20 @@ ws_frame_set_fin(ws_frame_hdr_t *header, int fin)
 	header->opcode_rsv_fin |= (fin << 7) & (0x1 << 7);
 }
 
+static inline void
+ws_frame_set_rsv1(ws_frame_hdr_t *header, int rsv1)
+{
+	header->opcode_rsv_fin &= ~WEBSOCKET_RSV1;
+	header->opcode_rsv_fin |= rsv1 ? WEBSOCKET_RSV1 : 0;
+}
+
 static void close_conn(conn_t * conn, int wait_plain, const char *fmt, ...);
 static void conn_mod_read_cb(rb_fde_t *fd, void *data);
 static void conn_plain_read_cb(rb_fde_t *fd, void *data);
 static void conn_plain_process_recvq(conn_t *conn);
+#ifdef HAVE_LIBZ
+static void ws_deflate_free(conn_t *conn);
+#endif
 
 #define FLAG_CORK	0x01
 #define FLAG_DEAD	0x02
@@ -247,6 +312,10 @@ free_conn(conn_t * conn)
 	rb_free_rawbuffer(conn->modbuf_in);
 	rb_free_rawbuffer(conn->modbuf_out);
 
+#ifdef HAVE_LIBZ
+	ws_deflate_free(conn);
+#endif
+
 	rb_free(conn);
 }
 
@@ -331,13 +400,24 @@ conn_mod_write(conn_t * conn, void *data, size_t len)
 	rb_rawbuf_append(conn->modbuf_out, data, len);
 }
 
+/* binary.ircv3.net gets binary frames, everyone else text */
+static inline int
+ws_data_opcode(const conn_t *conn)
+{
+	if (conn->subprotocol == WS_SUBPROTOCOL_BINARY)
+		return WEBSOCKET_OPCODE_BINARY_FRAME;
+
+	return WEBSOCKET_OPCODE_TEXT_FRAME;
+}
+
 static void
-conn_mod_write_short_frame(conn_t * conn, void *data, int len)
+conn_mod_write_short_frame(conn_t * conn, void *data, int len, int compressed)
 {
 	ws_frame_hdr_t hdr = WEBSOCKET_FRAME_HDR_INIT;
 
-	ws_frame_set_opcode(&hdr, WEBSOCKET_OPCODE_TEXT_FRAME);
+	ws_frame_set_opcode(&hdr, ws_data_opcode(conn));
 	ws_frame_set_fin(&hdr, 1);
+	ws_frame_set_rsv1(&hdr, compressed);
 	hdr.payload_length_mask = len & 0x7f;
 
 	conn_mod_write(conn, &hdr, sizeof(hdr));
@@ -345,12 +425,13 @@ conn_mod_write_short_frame(conn_t * conn, void *data, int len)
 }
 
 static void
-conn_mod_write_long_frame(conn_t * conn, void *data, int len)
+conn_mod_write_long_frame(conn_t * conn, void *data, int len, int compressed)
 {
 	ws_frame_ext_t hdr = WEBSOCKET_FRAME_EXT_INIT;
 
-	ws_frame_set_opcode(&hdr.header, WEBSOCKET_OPCODE_TEXT_FRAME);
+	ws_frame_set_opcode(&hdr.header, ws_data_opcode(conn));
 	ws_frame_set_fin(&hdr.header, 1);
+	ws_frame_set_rsv1(&hdr.header, compressed);
 	hdr.header.payload_length_mask = 126;
 	hdr.payload_length_extended = htons(len);
 
@@ -358,19 +439,42 @@ conn_mod_write_long_frame(conn_t * conn, void *data, int len)
 	conn_mod_write(conn, data, len);
 }
 
+#ifdef HAVE_LIBZ
+static int ws_deflate(conn_t *conn, void *data, int len, uint8_t *out, size_t outlen);
+#endif
+
 static void
 conn_mod_write_frame(conn_t *conn, void *data, int len)
 {
+	int compressed = 0;
+
 	if(IsDead(conn))	/* no point in queueing to a dead man */
 		return;
 
+#ifdef HAVE_LIBZ
+	uint8_t zbuf[READBUF_SIZE + 64];
+
+	/* anything too big for zbuf may go uncompressed, which is allowed */
+	if (conn->zout != NULL && len <= READBUF_SIZE)
+	{
+		int zlen = ws_deflate(conn, data, len, zbuf, sizeof(zbuf));
+
+		if (zlen >= 0)
+		{
+			data = zbuf;
+			len = zlen;
+			compressed = 1;
+		}
+	}
+#endif
+
 	if (len < WEBSOCKET_MAX_UNEXTENDED_PAYLOAD_DATA_LENGTH)
 	{
-		conn_mod_write_short_frame(conn, data, len);
+		conn_mod_write_short_frame(conn, data, len, compressed);
 		return;
 	}
 
-	conn_mod_write_long_frame(conn, data, len);
+	conn_mod_write_long_frame(conn, data, len, compressed);
 }
 
 static void
@@ -434,6 +538,10 @@ close_conn(conn_t * conn, int wait_plain, const char *fmt, ...)
 	rb_close(conn->mod_fd);
 	SetDead(conn);
 
+#ifdef HAVE_LIBZ
+	ws_deflate_free(conn);
+#endif
+
 	rb_dlinkDelete(&conn->node, connid_hash(conn->id));
 
 	if(!wait_plain || fmt == NULL)
@@ -487,209 +595,856 @@ cleanup_bad_message(mod_ctl_t * ctl, mod_ctl_buf_t * ctlb)
 		rb_close(ctlb->F[i]);
 }
 
-static void
-ws_frame_unmask(char *msg, int length, uint8_t maskval[WEBSOCKET_MASK_LENGTH])
+/*
+ * ring_plain_fd
+ *
+ * A connection handed over with only its remote end has its plaintext
+ * end on the ring, under the connection id: open that into the message
+ * in place of a passed descriptor.  If there is no ring to open it on,
+ * the connection is dropped and false returned.
+ */
+static bool
+ring_plain_fd(mod_ctl_t * ctl, mod_ctl_buf_t * ctlb)
 {
-	int i;
+	static const char *reason = "no ring channel for the plaintext side";
+	uint8_t buf[256];
 
-	for (i = 0; i < length; i++)
-		msg[i] = msg[i] ^ maskval[i % 4];
+	if(ctlb->nfds == 2)
+		return true;
+
+	if(ctl->ring != NULL)
+		ctlb->F[1] = rb_ring_open(ctl->ring, buf_to_uint32(&ctlb->buf[1]), "ircd ring channel");
+	if(ctlb->F[1] != NULL)
+	{
+		ctlb->nfds = 2;
+		return true;
+	}
+
+	cleanup_bad_message(ctl, ctlb);
+	buf[0] = 'D';
+	memcpy(&buf[1], &ctlb->buf[1], 4);
+	rb_strlcpy((char *) &buf[5], reason, sizeof(buf) - 5);
+	mod_cmd_write_queue(ctl, buf, strlen(reason) + 1 + 5);
+	return false;
 }
 
 static void
-conn_mod_process_frame(conn_t *conn, ws_frame_hdr_t *hdr, int masked)
+wsock_process_ring(mod_ctl_t * ctl, mod_ctl_buf_t * ctlb)
 {
-	char msg[WEBSOCKET_MAX_UNEXTENDED_PAYLOAD_DATA_LENGTH];
-	uint8_t maskval[WEBSOCKET_MASK_LENGTH];
-	int dolen;
+	char reply[2] = { 'R', '0' };
+
+	if(ctl->ring != NULL)
+		cleanup_bad_message(ctl, ctlb);
+	else if((ctl->ring = rb_ring_attach(ctlb->F)) != NULL)
+		reply[1] = '1';
 
-	/* if we're masked, we get to collect the masking key for this frame */
-	if (masked)
+	mod_cmd_write_queue(ctl, reply, sizeof(reply));
+}
+
+/*
+ * utf8_validate
+ *
+ * Check the next piece of a UTF-8 string, which may end or start in the
+ * middle of a character; st carries that over.  Overlong forms,
+ * surrogates and anything past U+10FFFF are refused, as RFC 3629 says.
+ */
+static bool
+utf8_validate(struct utf8_state *st, const uint8_t *p, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
 	{
-		dolen = rb_rawbuf_get(conn->modbuf_in, maskval, sizeof(maskval));
-		if (!dolen)
+		uint8_t c = p[i];
+
+		if (st->need > 0)
 		{
-			close_conn(conn, WAIT_PLAIN, "websocket error: fault unpacking unmask key");
-			return;
+			if (c < st->lo || c > st->hi)
+				return false;
+			st->need--;
+			st->lo = 0x80;
+			st->hi = 0xBF;
+			continue;
+		}
+
+		if (c < 0x80)
+			continue;
+
+		st->lo = 0x80;
+		st->hi = 0xBF;
+
+		if (c >= 0xC2 && c <= 0xDF)
+			st->need = 1;
+		else if (c >= 0xE0 && c <= 0xEF)
+		{
+			st->need = 2;
+			if (c == 0xE0)
+				st->lo = 0xA0;
+			else if (c == 0xED)
+				st->hi = 0x9F;
+		}
+		else if (c >= 0xF0 && c <= 0xF4)
+		{
+			st->need = 3;
+			if (c == 0xF0)
+				st->lo = 0x90;
+			else if (c == 0xF4)
+				st->hi = 0x8F;
 		}
+		else
+			return false;
 	}
 
-	dolen = rb_rawbuf_get(conn->modbuf_in, msg, hdr->payload_length_mask);
-	if (!dolen)
+	return true;
+}
+
+/*
+ * utf8_sanitize
+ *
+ * Copy a line to out, which has room for three times its length,
+ * replacing whatever isn't valid UTF-8 with U+FFFD a byte at a time.
+ */
+static size_t
+utf8_sanitize(const uint8_t *in, size_t len, uint8_t *out)
+{
+	size_t i = 0, o = 0;
+
+	while (i < len)
 	{
-		close_conn(conn, WAIT_PLAIN, "websocket error: fault unpacking message");
-		return;
+		struct utf8_state st = { 0, 0, 0 };
+		size_t n = 1;
+
+		if (utf8_validate(&st, &in[i], 1))
+		{
+			while (st.need > 0 && i + n < len && utf8_validate(&st, &in[i + n], 1))
+				n++;
+		}
+		else
+			st.need = 1;
+
+		if (st.need > 0)
+		{
+			out[o++] = 0xEF;
+			out[o++] = 0xBF;
+			out[o++] = 0xBD;
+			i++;
+			continue;
+		}
+
+		memcpy(&out[o], &in[i], n);
+		o += n;
+		i += n;
+	}
+
+	return o;
+}
+
+/*
+ * conn_mod_deliver
+ *
+ * Hand payload of the message being received to the plain side.
+ */
+static bool
+conn_mod_deliver(conn_t *conn, const uint8_t *data, size_t len)
+{
+	if (len == 0)
+		return true;
+
+	if (conn->msg_utf8 && !utf8_validate(&conn->utf8, data, len))
+	{
+		close_conn(conn, WAIT_PLAIN, "websocket error: invalid UTF-8");
+		return false;
 	}
 
-	if (masked)
-		ws_frame_unmask(msg, dolen, maskval);
+	conn->msg_last = data[len - 1];
+	rb_linebuf_parse(&conn->plainbuf_out, (char *) data, len, 1);
+	return true;
+}
+
+#ifdef HAVE_LIBZ
+/* permessage-deflate (RFC 7692) settings, from the ircd's 'O' command */
+static bool deflate_enabled;
+static bool deflate_takeover = true;
+static size_t deflate_memory_cap = 64 * 1024 * 1024;
+
+#define DEFLATE_LEVEL		6
+#define DEFLATE_MEMLEVEL	7
+#define DEFLATE_WINDOW_BITS	13	/* plenty for IRC lines, and a quarter of the memory */
+#define INFLATE_WINDOW_BITS	12	/* asked of clients that let us choose */
+#define INFLATE_MAX_MESSAGE	(64 * 1024)	/* largest message we will inflate */
 
-	rb_linebuf_parse(&conn->plainbuf_out, msg, dolen, 1);
-	rb_linebuf_parse(&conn->plainbuf_out, "\r\n", 2, 1);
+/* totals for this wsockd, reported to the ircd every DEFLATE_STATS_INTERVAL */
+#define DEFLATE_STATS_INTERVAL	30
+
+static struct
+{
+	size_t memory;			/* zlib memory of live connections, estimated */
+	uint64_t negotiated;		/* connections that got compression */
+	uint64_t refused;		/* offers turned down to stay under the cap */
+	uint64_t deflate_in, deflate_out;
+	uint64_t inflate_in, inflate_out;
+	uint64_t ns;			/* time spent in zlib */
+} deflate_stats;
+
+/* what zlib will allocate for a pair of streams, per zconf.h */
+static size_t
+ws_deflate_memory(int deflate_bits, int inflate_bits)
+{
+	size_t deflate_mem = (1 << (deflate_bits + 2)) + (1 << (DEFLATE_MEMLEVEL + 9));
+	size_t inflate_mem = (1 << inflate_bits) + 7 * 1024;
+
+	return deflate_mem + inflate_mem + 2 * sizeof(z_stream);
 }
 
 static void
-conn_mod_process_large(conn_t *conn, ws_frame_hdr_t *hdr, int masked)
+ws_deflate_free(conn_t *conn)
 {
-	char msg[READBUF_SIZE];
-	uint16_t msglen;
-	uint8_t maskval[WEBSOCKET_MASK_LENGTH];
-	int dolen;
-
-	memset(msg, 0, sizeof msg);
+	if (conn->zout != NULL)
+	{
+		deflateEnd(conn->zout);
+		rb_free(conn->zout);
+		conn->zout = NULL;
+	}
 
-	dolen = rb_rawbuf_get(conn->modbuf_in, &msglen, sizeof(msglen));
-	if (!dolen)
+	if (conn->zin != NULL)
 	{
-		close_conn(conn, WAIT_PLAIN, "websocket error: fault unpacking message size");
-		return;
+		inflateEnd(conn->zin);
+		rb_free(conn->zin);
+		conn->zin = NULL;
 	}
 
-	msglen = ntohs(msglen);
+	deflate_stats.memory -= conn->zmemory;
+	conn->zmemory = 0;
+}
+
+/*
+ * ws_deflate_negotiate
+ *
+ * Look at the client's Sec-WebSocket-Extensions header and, if it offers
+ * permessage-deflate with parameters we can meet and there is memory
+ * for it under the cap, set up the streams and write the response
+ * parameters into resp.  Returns false to go without compression.
+ */
+static bool
+ws_deflate_negotiate(conn_t *conn, const char *offers, char *resp, size_t resplen)
+{
+	char buf[512];
+	char *offer, *offer_next;
+
+	if (!deflate_enabled || conn->zout != NULL)
+		return false;
+
+	rb_strlcpy(buf, offers, sizeof(buf));
 
-	if (masked)
+	for (offer = rb_strtok_r(buf, ",", &offer_next); offer != NULL; offer = rb_strtok_r(NULL, ",", &offer_next))
 	{
-		dolen = rb_rawbuf_get(conn->modbuf_in, maskval, sizeof(maskval));
-		if (!dolen)
+		char *param, *param_next;
+		int window_bits = DEFLATE_WINDOW_BITS, client_bits = 15, server_bits = 0;
+		bool server_takeover = deflate_takeover, client_takeover = deflate_takeover;
+		bool ok = true;
+		size_t memory;
+
+		param = rb_strtok_r(offer, ";", &param_next);
+		if (param == NULL)
+			continue;
+		while (*param == ' ' || *param == '\t')
+			param++;
+		if (rb_strncasecmp(param, "permessage-deflate", 18) || (param[18] != '\0' && param[18] != ' ' && param[18] != '\t'))
+			continue;
+
+		while (ok && (param = rb_strtok_r(NULL, ";", &param_next)) != NULL)
 		{
-			close_conn(conn, WAIT_PLAIN, "websocket error: fault unpacking unmask key");
-			return;
+			char *value;
+
+			while (*param == ' ' || *param == '\t')
+				param++;
+			if ((value = strchr(param, '=')) != NULL)
+			{
+				*value++ = '\0';
+				if (*value == '"')
+					value++;
+			}
+
+			if (!rb_strncasecmp(param, "server_no_context_takeover", 26))
+				server_takeover = false;
+			else if (!rb_strncasecmp(param, "client_no_context_takeover", 26))
+				client_takeover = false;
+			else if (!rb_strncasecmp(param, "server_max_window_bits", 22))
+			{
+				/* zlib can't do an 8 bit window for raw deflate */
+				server_bits = value != NULL ? atoi(value) : 0;
+				if (server_bits < 9 || server_bits > 15)
+					ok = false;
+				else if (server_bits < window_bits)
+					window_bits = server_bits;
+			}
+			else if (!rb_strncasecmp(param, "client_max_window_bits", 22))
+			{
+				/* with no value, it only says we may pick one */
+				int bits = value != NULL ? atoi(value) : INFLATE_WINDOW_BITS;
+
+				if (value != NULL && (bits < 8 || bits > 15))
+					ok = false;
+				client_bits = bits < INFLATE_WINDOW_BITS ? bits : INFLATE_WINDOW_BITS;
+			}
+			else
+				ok = false;
+		}
+
+		if (!ok)
+			continue;
+
+		memory = ws_deflate_memory(window_bits, client_bits);
+		if (deflate_stats.memory + memory > deflate_memory_cap)
+		{
+			deflate_stats.refused++;
+			return false;
 		}
+
+		conn->zout = rb_malloc(sizeof(z_stream));
+		if (deflateInit2(conn->zout, DEFLATE_LEVEL, Z_DEFLATED, -window_bits, DEFLATE_MEMLEVEL, Z_DEFAULT_STRATEGY) != Z_OK)
+		{
+			rb_free(conn->zout);
+			conn->zout = NULL;
+			return false;
+		}
+
+		conn->zin = rb_malloc(sizeof(z_stream));
+		/* an 8 bit window is too small for zlib, but a bigger one reads it fine */
+		if (inflateInit2(conn->zin, client_bits == 8 ? -9 : -client_bits) != Z_OK)
+		{
+			rb_free(conn->zin);
+			conn->zin = NULL;
+			ws_deflate_free(conn);
+			return false;
+		}
+
+		conn->zmemory = memory;
+		deflate_stats.memory += memory;
+		conn->server_takeover = server_takeover;
+		conn->client_takeover = client_takeover;
+		deflate_stats.negotiated++;
+
+		snprintf(resp, resplen, "permessage-deflate%s%s",
+			 server_takeover ? "" : "; server_no_context_takeover",
+			 client_takeover ? "" : "; client_no_context_takeover");
+		if (server_bits != 0)
+			rb_snprintf_append(resp, resplen, "; server_max_window_bits=%d", window_bits);
+		if (client_bits != 15)
+			rb_snprintf_append(resp, resplen, "; client_max_window_bits=%d", client_bits);
+		return true;
 	}
 
-	dolen = rb_rawbuf_get(conn->modbuf_in, msg, msglen);
-	if (!dolen)
+	return false;
+}
+
+/*
+ * ws_deflate
+ *
+ * Compress one outgoing message.  Returns its length with the trailing
+ * 00 00 ff ff of the sync flush taken off, as RFC 7692 wants, or -1 if
+ * it couldn't be done, in which case we stop compressing what we send as
+ * the client can't follow our context any more.  Its own messages may
+ * still be compressed, so the inflate side is left alone; the memory
+ * estimate for the pair stays until the connection closes.
+ */
+static int
+ws_deflate(conn_t *conn, void *data, int len, uint8_t *out, size_t outlen)
+{
+	z_stream *z = conn->zout;
+	uint64_t start = rb_monotonic_ns();
+	int ret;
+
+	z->next_in = data;
+	z->avail_in = len;
+	z->next_out = out;
+	z->avail_out = outlen;
+
+	ret = deflate(z, Z_SYNC_FLUSH);
+	deflate_stats.ns += rb_monotonic_ns() - start;
+
+	if (ret != Z_OK || z->avail_in != 0 || z->avail_out == 0 || outlen - z->avail_out < 4)
 	{
-		close_conn(conn, WAIT_PLAIN, "websocket error: fault unpacking message");
-		return;
+		deflateEnd(z);
+		rb_free(z);
+		conn->zout = NULL;
+		return -1;
 	}
 
-	if (masked)
-		ws_frame_unmask(msg, dolen, maskval);
+	len = outlen - z->avail_out - 4;
 
-	rb_linebuf_parse(&conn->plainbuf_out, msg, dolen, 1);
-	rb_linebuf_parse(&conn->plainbuf_out, "\r\n", 2, 1);
+	if (!conn->server_takeover)
+		deflateReset(z);
+
+	deflate_stats.deflate_in += z->next_in - (Bytef *) data;
+	deflate_stats.deflate_out += len;
+	return len;
+}
+
+/*
+ * ws_inflate
+ *
+ * Inflate part of a compressed message into the plain side linebuf.
+ */
+static bool
+ws_inflate(conn_t *conn, const uint8_t *data, size_t len)
+{
+	uint8_t out[READBUF_SIZE];
+	z_stream *z = conn->zin;
+	uint64_t start = rb_monotonic_ns();
+	int ret;
+
+	z->next_in = (Bytef *) data;
+	z->avail_in = len;
+	deflate_stats.inflate_in += len;
+
+	do
+	{
+		size_t outlen;
+
+		z->next_out = out;
+		z->avail_out = sizeof(out);
+
+		ret = inflate(z, Z_SYNC_FLUSH);
+		if (ret != Z_OK && ret != Z_BUF_ERROR && ret != Z_STREAM_END)
+		{
+			deflate_stats.ns += rb_monotonic_ns() - start;
+			close_conn(conn, WAIT_PLAIN, "websocket error: bad compressed data");
+			return false;
+		}
+
+		outlen = sizeof(out) - z->avail_out;
+		conn->msg_inflated += outlen;
+		deflate_stats.inflate_out += outlen;
+
+		if (conn->msg_inflated > INFLATE_MAX_MESSAGE)
+		{
+			deflate_stats.ns += rb_monotonic_ns() - start;
+			close_conn(conn, WAIT_PLAIN, "websocket error: compressed message too large");
+			return false;
+		}
+
+		if (!conn_mod_deliver(conn, out, outlen))
+			return false;
+
+		/* the client ended its deflate stream, a new one follows */
+		if (ret == Z_STREAM_END)
+			inflateReset(z);
+	}
+	while (z->avail_out == 0 || (ret == Z_STREAM_END && z->avail_in > 0));
+
+	deflate_stats.ns += rb_monotonic_ns() - start;
+	return true;
+}
+
+static bool
+ws_inflate_finish(conn_t *conn)
+{
+	static const uint8_t tail[] = { 0x00, 0x00, 0xff, 0xff };
+
+	if (!ws_inflate(conn, tail, sizeof(tail)))
+		return false;
+
+	if (!conn->client_takeover)
+		inflateReset(conn->zin);
+
+	return true;
+}
+
+static void
+send_deflate_stats(void *unused)
+{
+	char buf[256];
+	int len;
+
+	if (!deflate_enabled && deflate_stats.negotiated == 0)
+		return;
+
+	len = snprintf(buf, sizeof(buf), "S %" PRIu64 " %" PRIu64 " %zu %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64,
+		       deflate_stats.negotiated, deflate_stats.refused, deflate_stats.memory,
+		       deflate_stats.deflate_in, deflate_stats.deflate_out,
+		       deflate_stats.inflate_in, deflate_stats.inflate_out,
+		       deflate_stats.ns);
+	mod_cmd_write_queue(mod_ctl, buf, len + 1);
 }
 
 static void
-conn_mod_process_huge(conn_t *conn, ws_frame_hdr_t *hdr, int masked)
+set_deflate_options(mod_ctl_t * ctl, mod_ctl_buf_t * ctlb)
 {
-	/* XXX implement me */
+	if (ctlb->buflen < 7)
+		return;
+
+	deflate_enabled = ctlb->buf[1];
+	deflate_takeover = ctlb->buf[2];
+	deflate_memory_cap = buf_to_uint32(&ctlb->buf[3]);
 }
+#endif
 
+/*
+ * ws_frame_unmask
+ *
+ * Unmask length bytes of payload which start offset bytes into the frame.
+ * The mask is applied eight bytes at a time, which the compiler is free
+ * to widen further; only the tail is done bytewise.
+ */
 static void
-conn_mod_process_ping(conn_t *conn, ws_frame_hdr_t *hdr, int masked)
+ws_frame_unmask(uint8_t *msg, size_t length, const uint8_t maskval[WEBSOCKET_MASK_LENGTH], uint64_t offset)
 {
-	char msg[WEBSOCKET_MAX_UNEXTENDED_PAYLOAD_DATA_LENGTH];
-	uint8_t maskval[WEBSOCKET_MASK_LENGTH];
-	int dolen;
+	uint8_t mask[8];
+	uint64_t mask64;
+	size_t i;
 
-	if (masked)
+	for (i = 0; i < sizeof(mask); i++)
+		mask[i] = maskval[(offset + i) % WEBSOCKET_MASK_LENGTH];
+	memcpy(&mask64, mask, sizeof(mask64));
+
+	for (i = 0; i + sizeof(mask64) <= length; i += sizeof(mask64))
 	{
-		dolen = rb_rawbuf_get(conn->modbuf_in, maskval, sizeof(maskval));
-		if (!dolen)
-		{
-			close_conn(conn, WAIT_PLAIN, "websocket error: fault unpacking unmask key");
-			return;
-		}
+		uint64_t word;
+
+		memcpy(&word, msg + i, sizeof(word));
+		word ^= mask64;
+		memcpy(msg + i, &word, sizeof(word));
 	}
 
-	dolen = rb_rawbuf_get(conn->modbuf_in, msg, hdr->payload_length_mask);
-	if (!dolen)
+	for (; i < length; i++)
+		msg[i] ^= mask[i % sizeof(mask)];
+}
+
+/* how long the header in frame_hdr will be, as far as it is known yet */
+static size_t
+ws_frame_hdr_length(const conn_t *conn)
+{
+	size_t len = sizeof(ws_frame_hdr_t);
+
+	if (conn->frame_hdrlen < len)
+		return len;
+
+	switch (conn->frame_hdr[1] & 0x7f)
 	{
-		close_conn(conn, WAIT_PLAIN, "websocket error: fault unpacking message");
-		return;
+	case 126:
+		len += 2;
+		break;
+	case 127:
+		len += 8;
+		break;
 	}
 
-	if (masked)
-		ws_frame_unmask(msg, dolen, maskval);
+	if (conn->frame_hdr[1] & 0x80)
+		len += WEBSOCKET_MASK_LENGTH;
 
-	ws_frame_hdr_t out_hdr = WEBSOCKET_FRAME_HDR_INIT;
+	return len;
+}
 
-	ws_frame_set_opcode(&out_hdr, WEBSOCKET_OPCODE_PONG_FRAME);
-	ws_frame_set_fin(&out_hdr, 1);
-	out_hdr.payload_length_mask = (dolen) & 0x7f;
+/*
+ * conn_mod_read_frame_hdr
+ *
+ * Collect the header of the next frame, which may arrive in pieces.
+ * Returns true once the whole header is in and has been checked.
+ */
+static bool
+conn_mod_read_frame_hdr(conn_t *conn)
+{
+	const uint8_t *p = conn->frame_hdr;
+	size_t need;
+
+	while ((need = ws_frame_hdr_length(conn)) > conn->frame_hdrlen)
+	{
+		int dolen = rb_rawbuf_get(conn->modbuf_in, conn->frame_hdr + conn->frame_hdrlen,
+					  need - conn->frame_hdrlen);
+		if (dolen <= 0)
+			return false;
+
+		conn->frame_hdrlen += dolen;
+	}
 
-	conn_mod_write(conn, &out_hdr, sizeof(out_hdr));
-	conn_mod_write(conn, msg, dolen);
+	conn->frame_opcode = p[0] & 0xF;
+	conn->frame_fin = (p[0] >> 7) & 0x1;
+	conn->frame_masked = (p[1] >> 7) & 0x1;
+	conn->frame_pos = 0;
+	p += sizeof(ws_frame_hdr_t);
+
+	switch (conn->frame_hdr[1] & 0x7f)
+	{
+	case 126:
+		conn->frame_len = (uint64_t) p[0] << 8 | p[1];
+		p += 2;
+		break;
+	case 127:
+		conn->frame_len = 0;
+		for (int i = 0; i < 8; i++)
+			conn->frame_len = conn->frame_len << 8 | p[i];
+		p += 8;
+
+		/* the most significant bit must be 0 */
+		if (conn->frame_len >> 63)
+		{
+			close_conn(conn, WAIT_PLAIN, "websocket error: bad frame length");
+			return false;
+		}
+		break;
+	default:
+		conn->frame_len = conn->frame_hdr[1] & 0x7f;
+		break;
+	}
+
+	if (conn->frame_masked)
+		memcpy(conn->frame_mask, p, WEBSOCKET_MASK_LENGTH);
+
+	/* RSV1 marks the first frame of a compressed message, if we agreed to that */
+	if (conn->frame_hdr[0] & WEBSOCKET_RSV_MASK)
+	{
+		bool ok = false;
+
+#ifdef HAVE_LIBZ
+		ok = (conn->frame_hdr[0] & WEBSOCKET_RSV_MASK) == WEBSOCKET_RSV1 && conn->zin != NULL &&
+			(conn->frame_opcode == WEBSOCKET_OPCODE_TEXT_FRAME || conn->frame_opcode == WEBSOCKET_OPCODE_BINARY_FRAME);
+#endif
+		if (!ok)
+		{
+			close_conn(conn, WAIT_PLAIN, "websocket error: unexpected reserved bits");
+			return false;
+		}
+	}
+
+	switch (conn->frame_opcode)
+	{
+	case WEBSOCKET_OPCODE_CLOSE_FRAME:
+	case WEBSOCKET_OPCODE_PING_FRAME:
+	case WEBSOCKET_OPCODE_PONG_FRAME:
+		if (!conn->frame_fin || conn->frame_len > sizeof(conn->ctl_buf))
+		{
+			close_conn(conn, WAIT_PLAIN, "websocket error: bad control frame");
+			return false;
+		}
+		break;
+	case WEBSOCKET_OPCODE_CONTINUATION_FRAME:
+		if (!conn->in_message)
+		{
+			close_conn(conn, WAIT_PLAIN, "websocket error: unexpected continuation frame");
+			return false;
+		}
+		break;
+	case WEBSOCKET_OPCODE_TEXT_FRAME:
+	case WEBSOCKET_OPCODE_BINARY_FRAME:
+		if (conn->in_message)
+		{
+			close_conn(conn, WAIT_PLAIN, "websocket error: expected continuation frame");
+			return false;
+		}
+		conn->in_message = true;
+		conn->msg_last = '\n';
+		conn->msg_utf8 = conn->subprotocol == WS_SUBPROTOCOL_TEXT &&
+			conn->frame_opcode == WEBSOCKET_OPCODE_TEXT_FRAME;
+		memset(&conn->utf8, 0, sizeof(conn->utf8));
+#ifdef HAVE_LIBZ
+		conn->msg_compressed = (conn->frame_hdr[0] & WEBSOCKET_RSV1) != 0;
+		conn->msg_inflated = 0;
+#endif
+		break;
+	default:
+		close_conn(conn, WAIT_PLAIN, "websocket error: unknown opcode %d", conn->frame_opcode);
+		return false;
+	}
+
+	return true;
 }
 
+/*
+ * conn_mod_process_data
+ *
+ * Pass on as much of the payload of a data frame as has arrived.  It is
+ * unmasked in place and goes straight into the plain side linebuf, which
+ * splits it into lines, so one message may carry several IRC lines and
+ * one line may be spread over several frames.  The end of a message ends
+ * the line in it, if it didn't already.
+ */
 static void
-conn_mod_process_pong(conn_t *conn, ws_frame_hdr_t *hdr, int masked)
+conn_mod_process_data(conn_t *conn)
 {
-	char msg[WEBSOCKET_MAX_UNEXTENDED_PAYLOAD_DATA_LENGTH];
-	int dolen = rb_rawbuf_get(conn->modbuf_in, msg, hdr->payload_length_mask);
-	if (!dolen)
+	uint8_t buf[READBUF_SIZE];
+
+	while (conn->frame_pos < conn->frame_len)
 	{
-		close_conn(conn, WAIT_PLAIN, "websocket error: fault unpacking message");
-		return;
+		uint64_t left = conn->frame_len - conn->frame_pos;
+		int dolen = rb_rawbuf_get(conn->modbuf_in, buf, left < sizeof(buf) ? left : sizeof(buf));
+
+		if (dolen <= 0)
+			return;
+
+		if (conn->frame_masked)
+			ws_frame_unmask(buf, dolen, conn->frame_mask, conn->frame_pos);
+
+		conn->frame_pos += dolen;
+
+#ifdef HAVE_LIBZ
+		if (conn->msg_compressed)
+		{
+			if (!ws_inflate(conn, buf, dolen))
+				return;
+			continue;
+		}
+#endif
+
+		if (!conn_mod_deliver(conn, buf, dolen))
+			return;
+	}
+
+	if (conn->frame_fin)
+	{
+#ifdef HAVE_LIBZ
+		if (conn->msg_compressed && !ws_inflate_finish(conn))
+			return;
+#endif
+		if (conn->msg_utf8 && conn->utf8.need > 0)
+		{
+			close_conn(conn, WAIT_PLAIN, "websocket error: invalid UTF-8");
+			return;
+		}
+		if (conn->msg_last != '\n' && conn->msg_last != '\r')
+			rb_linebuf_parse(&conn->plainbuf_out, "\r\n", 2, 1);
+		conn->in_message = false;
 	}
 }
 
+/*
+ * conn_mod_process_control
+ *
+ * Collect the payload of a control frame, and act on it once it is all in.
+ */
 static void
-conn_mod_process(conn_t *conn)
+conn_mod_process_control(conn_t *conn)
 {
-	ws_frame_hdr_t hdr;
-
-	while (1)
+	while (conn->frame_pos < conn->frame_len)
 	{
-		int masked, opcode;
+		int dolen = rb_rawbuf_get(conn->modbuf_in, conn->ctl_buf + conn->frame_pos,
+					  conn->frame_len - conn->frame_pos);
+		if (dolen <= 0)
+			return;
 
-		int dolen = rb_rawbuf_get(conn->modbuf_in, &hdr, sizeof(hdr));
-		if (dolen != sizeof(hdr))
-			break;
+		conn->frame_pos += dolen;
+	}
+
+	if (conn->frame_masked)
+		ws_frame_unmask(conn->ctl_buf, conn->frame_len, conn->frame_mask, 0);
 
-		masked = (hdr.payload_length_mask >> 7) == 1;
-		hdr.payload_length_mask &= 0x7f;
+	switch (conn->frame_opcode)
+	{
+	case WEBSOCKET_OPCODE_CLOSE_FRAME:
+		close_conn(conn, WAIT_PLAIN, "websocket error: received close frame");
+		break;
+	case WEBSOCKET_OPCODE_PING_FRAME:
+	{
+		ws_frame_hdr_t out_hdr = WEBSOCKET_FRAME_HDR_INIT;
 
-		opcode = (hdr.opcode_rsv_fin & 0xF);
+		ws_frame_set_opcode(&out_hdr, WEBSOCKET_OPCODE_PONG_FRAME);
+		ws_frame_set_fin(&out_hdr, 1);
+		out_hdr.payload_length_mask = conn->frame_len & 0x7f;
 
-		switch (opcode)
+		conn_mod_write(conn, &out_hdr, sizeof(out_hdr));
+		conn_mod_write(conn, conn->ctl_buf, conn->frame_len);
+		break;
+	}
+	case WEBSOCKET_OPCODE_PONG_FRAME:
+		break;
+	}
+}
+
+static void
+conn_mod_process(conn_t *conn)
+{
+	while (!IsDead(conn))
+	{
+		if (!conn->frame_active)
 		{
-		case WEBSOCKET_OPCODE_CLOSE_FRAME:
-			close_conn(conn, WAIT_PLAIN, "websocket error: received close frame");
-			break;
-		case WEBSOCKET_OPCODE_PING_FRAME:
-			conn_mod_process_ping(conn, &hdr, masked);
-			break;
-		case WEBSOCKET_OPCODE_PONG_FRAME:
-			conn_mod_process_pong(conn, &hdr, masked);
-			break;
-		default:
-			switch (hdr.payload_length_mask)
-			{
-			case 126:
-				conn_mod_process_large(conn, &hdr, masked);
-				break;
-			case 127:
-				conn_mod_process_huge(conn, &hdr, masked);
-				break;
-			default:
-				conn_mod_process_frame(conn, &hdr, masked);
+			if (!conn_mod_read_frame_hdr(conn))
 				break;
-			}
+			conn->frame_active = true;
 		}
+
+		if (conn->frame_opcode & 0x8)
+			conn_mod_process_control(conn);
+		else
+			conn_mod_process_data(conn);
+
+		if (conn->frame_pos < conn->frame_len)
+			break;
+
+		/* frame done, on to the next */
+		conn->frame_active = false;
+		conn->frame_hdrlen = 0;
 	}
 
 	conn_plain_write_sendq(conn->plain_fd, conn);
 }
 
+/* copy the value of a request header, up to the end of its line */
+static bool
+ws_header_value(const char *req, const char *name, char *buf, size_t buflen)
+{
+	const char *p = rb_strcasestr(req, name);
+	char *end;
+
+	if (p == NULL)
+		return false;
+
+	p += strlen(name);
+	while (*p == ' ' || *p == '\t')
+		p++;
+
+	rb_strlcpy(buf, p, buflen);
+	if ((end = strpbrk(buf, "\r\n")) != NULL)
+		*end = '\0';
+
+	return true;
+}
+
+/* pick from the subprotocols the client offers, binary first */
+static uint8_t
+ws_choose_subprotocol(char *offers)
+{
+	char *proto, *next;
+	uint8_t chosen = WS_SUBPROTOCOL_NONE;
+
+	for (proto = rb_strtok_r(offers, ", \t", &next); proto != NULL; proto = rb_strtok_r(NULL, ", \t", &next))
+	{
+		if (!rb_strcasecmp(proto, "binary.ircv3.net"))
+			return WS_SUBPROTOCOL_BINARY;
+		if (!rb_strcasecmp(proto, "text.ircv3.net"))
+			chosen = WS_SUBPROTOCOL_TEXT;
+	}
+
+	return chosen;
+}
+
 static void
 conn_mod_handshake_process(conn_t *conn)
 {
 	char inbuf[READBUF_SIZE];
+	char value[512];
+	char extensions[128] = "";
 
 	memset(inbuf, 0, sizeof inbuf);
 
 	while (1)
 	{
-		char *p = NULL;
+		char *p = NULL, *key;
 
 		int dolen = rb_rawbuf_get(conn->modbuf_in, inbuf, sizeof inbuf);
 		if (!dolen)
 			break;
 
-		if ((p = rb_strcasestr(inbuf, "Sec-WebSocket-Key:")) != NULL)
+		key = rb_strcasestr(inbuf, "Sec-WebSocket-Key:");
+
+		if (key != NULL && ws_header_value(inbuf, "Sec-WebSocket-Protocol:", value, sizeof(value)))
+			conn->subprotocol = ws_choose_subprotocol(value);
+
+#ifdef HAVE_LIBZ
+		/* only alongside the key, as that is when we answer; and before
+		 * it is cut off in place below */
+		if (key != NULL && ws_header_value(inbuf, "Sec-WebSocket-Extensions:", value, sizeof(value)))
+			ws_deflate_negotiate(conn, value, extensions, sizeof(extensions));
+#endif
+
+		if ((p = key) != NULL)
 		{
 			char *start, *end;
 
@@ -730,6 +1485,19 @@ conn_mod_handshake_process(conn_t *conn)
 
 		conn_mod_write(conn, WEBSOCKET_ANSWER_STRING_1, strlen(WEBSOCKET_ANSWER_STRING_1));
 		conn_mod_write(conn, resp, strlen(resp));
+		if (conn->subprotocol != WS_SUBPROTOCOL_NONE)
+		{
+			const char *proto = conn->subprotocol == WS_SUBPROTOCOL_BINARY ?
+				"binary.ircv3.net" : "text.ircv3.net";
+
+			conn_mod_write(conn, WEBSOCKET_PROTOCOL_STRING, strlen(WEBSOCKET_PROTOCOL_STRING));
+			conn_mod_write(conn, (void *) proto, strlen(proto));
+		}
+		if (*extensions != '\0')
+		{
+			conn_mod_write(conn, WEBSOCKET_EXTENSIONS_STRING, strlen(WEBSOCKET_EXTENSIONS_STRING));
+			conn_mod_write(conn, extensions, strlen(extensions));
+		}
 		conn_mod_write(conn, WEBSOCKET_ANSWER_STRING_2, strlen(WEBSOCKET_ANSWER_STRING_2));
 
 		rb_free(resp);
@@ -823,6 +1591,20 @@ conn_plain_process_recvq(conn_t *conn)
 		if (!dolen)
 			break;
 
+		/* text.ircv3.net promises the client UTF-8, whatever the ircd has */
+		if (conn->subprotocol == WS_SUBPROTOCOL_TEXT)
+		{
+			struct utf8_state st = { 0, 0, 0 };
+
+			if (!utf8_validate(&st, (uint8_t *) inbuf, dolen) || st.need > 0)
+			{
+				uint8_t clean[sizeof(inbuf) * 3];
+
+				conn_mod_write_frame(conn, clean, utf8_sanitize((uint8_t *) inbuf, dolen, clean));
+				continue;
+			}
+		}
+
 		conn_mod_write_frame(conn, inbuf, dolen);
 	}
 
@@ -876,6 +1658,15 @@ conn_plain_read_cb(rb_fde_t *fd, void *data)
 			return;
 		if(plain_check_cork(conn))
 			return;
+
+		/* bail if short read, the ircd's end has nothing more for now */
+		if((size_t) length < sizeof(inbuf))
+		{
+			rb_setselect(conn->plain_fd, RB_SELECT_READ, conn_plain_read_cb, conn);
+			if (IsKeyed(conn))
+				conn_plain_process_recvq(conn);
+			return;
+		}
 	}
 }
 
@@ -944,14 +1735,31 @@ mod_process_cmd_recv(mod_ctl_t * ctl)
 		{
 		case 'A':
 			{
-				if (ctl_buf->nfds != 2 || ctl_buf->buflen != 5)
+				if ((ctl_buf->nfds != 2 && ctl_buf->nfds != 1) || ctl_buf->buflen != 5)
 				{
 					cleanup_bad_message(ctl, ctl_buf);
 					break;
 				}
+				if(!ring_plain_fd(ctl, ctl_buf))
+					break;
 				wsock_process(ctl, ctl_buf);
 				break;
 			}
+		case 'R':
+			{
+				if (ctl_buf->nfds != RB_RING_FDS)
+				{
+					cleanup_bad_message(ctl, ctl_buf);
+					break;
+				}
+				wsock_process_ring(ctl, ctl_buf);
+				break;
+			}
+#ifdef HAVE_LIBZ
+		case 'O':
+			set_deflate_options(ctl, ctl_buf);
+			break;
+#endif
 		default:
 			break;
 			/* Log unknown commands */
@@ -1071,6 +1879,9 @@ main(int argc, char **argv)
 	rb_set_nb(mod_ctl->F);
 	rb_set_nb(mod_ctl->F_pipe);
 	rb_event_addish("clean_dead_conns", clean_dead_conns, NULL, 10);
+#ifdef HAVE_LIBZ
+	rb_event_addish("send_deflate_stats", send_deflate_stats, NULL, DEFLATE_STATS_INTERVAL);
+#endif
 	read_pipe_ctl(mod_ctl->F_pipe, NULL);
 	mod_read_ctl(mod_ctl->F, mod_ctl);
 